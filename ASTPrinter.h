@@ -0,0 +1,138 @@
+#ifndef ASTPRINTER_H
+#define ASTPRINTER_H
+
+#include "Parser.h"
+#include <ostream>
+#include <string>
+
+// Writes an indented, one-node-per-line dump of the AST (used by --dump-ast)
+class ASTPrinter {
+private:
+    std::ostream& out;
+
+    void line(int depth, const std::string& text, ASTNode* node) {
+        out << std::string(depth * 2, ' ') << text << "  [line " << node->lineNumber << "]\n";
+    }
+
+    void print(ASTNode* node, int depth) {
+        switch (node->type) {
+            case N_NUMBER:
+                line(depth, "Number " + std::to_string(static_cast<NumberNode*>(node)->value), node);
+                break;
+            case N_VARIABLE:
+                line(depth, "Variable " + static_cast<VariableNode*>(node)->name, node);
+                break;
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                line(depth, std::string("BinOp ") + opKindToString(binOp->op), node);
+                print(binOp->left, depth + 1);
+                print(binOp->right, depth + 1);
+                break;
+            }
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                line(depth, std::string("UnaryOp ") + opKindToString(unaryOp->op), node);
+                print(unaryOp->operand, depth + 1);
+                break;
+            }
+            case N_ASSIGN: {
+                AssignNode* assign = static_cast<AssignNode*>(node);
+                line(depth, "Assign " + assign->name, node);
+                print(assign->value, depth + 1);
+                break;
+            }
+            case N_PRINT:
+                line(depth, "Print", node);
+                print(static_cast<PrintNode*>(node)->expression, depth + 1);
+                break;
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                line(depth, "If", node);
+                print(ifNode->condition, depth + 1);
+                print(ifNode->trueBlock, depth + 1);
+                if (ifNode->falseBlock) {
+                    out << std::string((depth + 1) * 2, ' ') << "Else\n";
+                    print(ifNode->falseBlock, depth + 1);
+                }
+                break;
+            }
+            case N_WHILE: {
+                WhileNode* whileNode = static_cast<WhileNode*>(node);
+                line(depth, "While", node);
+                print(whileNode->condition, depth + 1);
+                print(whileNode->block, depth + 1);
+                break;
+            }
+            case N_BLOCK:
+                line(depth, "Block", node);
+                for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                    print(stmt, depth + 1);
+                break;
+            case N_INDEX:
+                line(depth, "Index", node);
+                print(static_cast<IndexNode*>(node)->array, depth + 1);
+                print(static_cast<IndexNode*>(node)->index, depth + 1);
+                break;
+            case N_INDEX_ASSIGN: {
+                IndexAssignNode* store = static_cast<IndexAssignNode*>(node);
+                line(depth, "IndexAssign " + store->target->name, node);
+                print(store->index, depth + 1);
+                print(store->value, depth + 1);
+                break;
+            }
+            case N_CALL:
+                line(depth, std::string("Call ") + builtinName(static_cast<CallNode*>(node)->function), node);
+                print(static_cast<CallNode*>(node)->argument, depth + 1);
+                break;
+            case N_ARRAY_LITERAL:
+                line(depth, "Array", node);
+                for (ASTNode* element : static_cast<ArrayLiteralNode*>(node)->elements)
+                    print(element, depth + 1);
+                break;
+            default:
+                line(depth, "Unknown", node);
+                break;
+        }
+    }
+
+public:
+    ASTPrinter(std::ostream& out) : out(out) {}
+
+    // Renders an expression in source form, with every binary operation parenthesized
+    static std::string expression(ASTNode* node) {
+        switch (node->type) {
+            case N_NUMBER:
+                return std::to_string(static_cast<NumberNode*>(node)->value);
+            case N_VARIABLE:
+                return static_cast<VariableNode*>(node)->name;
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                return "(" + expression(binOp->left) + " " + opKindToString(binOp->op) + " " + expression(binOp->right) + ")";
+            }
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                return opKindToString(unaryOp->op) + expression(unaryOp->operand);
+            }
+            case N_INDEX:
+                return expression(static_cast<IndexNode*>(node)->array) + "[" + expression(static_cast<IndexNode*>(node)->index) + "]";
+            case N_CALL: {
+                CallNode* call = static_cast<CallNode*>(node);
+                return std::string(builtinName(call->function)) + "(" + expression(call->argument) + ")";
+            }
+            case N_ARRAY_LITERAL: {
+                std::string text = "[";
+                for (ASTNode* element : static_cast<ArrayLiteralNode*>(node)->elements)
+                    text += (text.size() > 1 ? ", " : "") + expression(element);
+                return text + "]";
+            }
+            default:
+                return "?";
+        }
+    }
+
+    void print(ASTNode* root) {
+        print(root, 0);
+    }
+};
+
+#endif // ASTPRINTER_H
@@ -0,0 +1,386 @@
+#ifndef ARRAY_KERNELS_H
+#define ARRAY_KERNELS_H
+
+#include "Lexer.h"
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ARRAY_KERNELS_X86 1
+#endif
+
+// Whole-array operations on contiguous int arrays (see Interpreter.h): elementwise
+// arithmetic and comparisons, and the sum / min / max reductions. Each comes as a
+// scalar loop, an SSE2 loop (4 ints at a time) and an AVX2 loop (8 at a time); the
+// widest set the CPU supports is chosen once at startup, and other targets use the
+// scalar loops. All three give the same results: arithmetic wraps around like the
+// engines' scalar arithmetic, and comparisons produce 0 or 1.
+// Division and modulo have no vector instruction and stay scalar at every level.
+
+namespace arraykernels {
+
+// Which operands of an elementwise operation are arrays. A scalar operand is a single
+// int that takes part in every element's operation.
+enum Shape {
+    ARRAY_ARRAY,
+    ARRAY_SCALAR,
+    SCALAR_ARRAY
+};
+
+// out[i] = left[i] op right[i] for i < count, where a scalar operand points at one int.
+// out may be one of the array operands. Returns false when a divisor is zero, in which
+// case out holds nothing useful.
+typedef bool (*BinaryKernel)(const int* left, const int* right, int* out, size_t count);
+
+// Sum (wrapping around), minimum or maximum of values[0, count); min and max need count > 0
+typedef int (*Reduction)(const int* values, size_t count);
+
+inline int wrapAdd32(int a, int b) {
+    return static_cast<int>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+}
+
+#ifdef ARRAY_KERNELS_X86
+#define ARRAY_KERNELS_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Operators: the scalar form and, on x86, the 4- and 8-lane forms
+
+struct Add {
+    static int scalar(int a, int b) { return wrapAdd32(a, b); }
+#ifdef ARRAY_KERNELS_X86
+    static __m128i sse2(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+    ARRAY_KERNELS_AVX2 static __m256i avx2(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+#endif
+};
+
+struct Sub {
+    static int scalar(int a, int b) { return static_cast<int>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)); }
+#ifdef ARRAY_KERNELS_X86
+    static __m128i sse2(__m128i a, __m128i b) { return _mm_sub_epi32(a, b); }
+    ARRAY_KERNELS_AVX2 static __m256i avx2(__m256i a, __m256i b) { return _mm256_sub_epi32(a, b); }
+#endif
+};
+
+struct Mul {
+    static int scalar(int a, int b) { return static_cast<int>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b)); }
+#ifdef ARRAY_KERNELS_X86
+    // SSE2 has no 32-bit multiply; the low halves of two 32x32->64 products are the same
+    static __m128i sse2(__m128i a, __m128i b) {
+        __m128i even = _mm_mul_epu32(a, b);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+    ARRAY_KERNELS_AVX2 static __m256i avx2(__m256i a, __m256i b) { return _mm256_mullo_epi32(a, b); }
+#endif
+};
+
+// Comparisons: a lane mask, turned into 0 / 1 by and-ing with 1 (or and-not for the
+// negated forms)
+#ifdef ARRAY_KERNELS_X86
+inline __m128i ones4() { return _mm_set1_epi32(1); }
+ARRAY_KERNELS_AVX2 inline __m256i ones8() { return _mm256_set1_epi32(1); }
+#endif
+
+struct Eq {
+    static int scalar(int a, int b) { return a == b; }
+#ifdef ARRAY_KERNELS_X86
+    static __m128i sse2(__m128i a, __m128i b) { return _mm_and_si128(_mm_cmpeq_epi32(a, b), ones4()); }
+    ARRAY_KERNELS_AVX2 static __m256i avx2(__m256i a, __m256i b) { return _mm256_and_si256(_mm256_cmpeq_epi32(a, b), ones8()); }
+#endif
+};
+
+struct Ne {
+    static int scalar(int a, int b) { return a != b; }
+#ifdef ARRAY_KERNELS_X86
+    static __m128i sse2(__m128i a, __m128i b) { return _mm_andnot_si128(_mm_cmpeq_epi32(a, b), ones4()); }
+    ARRAY_KERNELS_AVX2 static __m256i avx2(__m256i a, __m256i b) { return _mm256_andnot_si256(_mm256_cmpeq_epi32(a, b), ones8()); }
+#endif
+};
+
+struct Lt {
+    static int scalar(int a, int b) { return a < b; }
+#ifdef ARRAY_KERNELS_X86
+    static __m128i sse2(__m128i a, __m128i b) { return _mm_and_si128(_mm_cmpgt_epi32(b, a), ones4()); }
+    ARRAY_KERNELS_AVX2 static __m256i avx2(__m256i a, __m256i b) { return _mm256_and_si256(_mm256_cmpgt_epi32(b, a), ones8()); }
+#endif
+};
+
+struct Le {
+    static int scalar(int a, int b) { return a <= b; }
+#ifdef ARRAY_KERNELS_X86
+    static __m128i sse2(__m128i a, __m128i b) { return _mm_andnot_si128(_mm_cmpgt_epi32(a, b), ones4()); }
+    ARRAY_KERNELS_AVX2 static __m256i avx2(__m256i a, __m256i b) { return _mm256_andnot_si256(_mm256_cmpgt_epi32(a, b), ones8()); }
+#endif
+};
+
+struct Gt {
+    static int scalar(int a, int b) { return a > b; }
+#ifdef ARRAY_KERNELS_X86
+    static __m128i sse2(__m128i a, __m128i b) { return _mm_and_si128(_mm_cmpgt_epi32(a, b), ones4()); }
+    ARRAY_KERNELS_AVX2 static __m256i avx2(__m256i a, __m256i b) { return _mm256_and_si256(_mm256_cmpgt_epi32(a, b), ones8()); }
+#endif
+};
+
+struct Ge {
+    static int scalar(int a, int b) { return a >= b; }
+#ifdef ARRAY_KERNELS_X86
+    static __m128i sse2(__m128i a, __m128i b) { return _mm_andnot_si128(_mm_cmpgt_epi32(b, a), ones4()); }
+    ARRAY_KERNELS_AVX2 static __m256i avx2(__m256i a, __m256i b) { return _mm256_andnot_si256(_mm256_cmpgt_epi32(b, a), ones8()); }
+#endif
+};
+
+// Elementwise loops. The scalar side of a broadcast is read before any store, so out
+// may alias an array operand.
+
+template <class Op, Shape S>
+bool mapScalar(const int* left, const int* right, int* out, size_t count) {
+    int leftValue = S == SCALAR_ARRAY ? *left : 0;
+    int rightValue = S == ARRAY_SCALAR ? *right : 0;
+    for (size_t i = 0; i < count; i++)
+        out[i] = Op::scalar(S == SCALAR_ARRAY ? leftValue : left[i], S == ARRAY_SCALAR ? rightValue : right[i]);
+    return true;
+}
+
+template <bool Modulo, Shape S>
+bool divideScalar(const int* left, const int* right, int* out, size_t count) {
+    int leftValue = S == SCALAR_ARRAY ? *left : 0;
+    int rightValue = S == ARRAY_SCALAR ? *right : 0;
+    for (size_t i = 0; i < count; i++) {
+        int a = S == SCALAR_ARRAY ? leftValue : left[i];
+        int b = S == ARRAY_SCALAR ? rightValue : right[i];
+        if (b == 0)
+            return false;
+        out[i] = Modulo ? a % b : a / b;
+    }
+    return true;
+}
+
+#ifdef ARRAY_KERNELS_X86
+
+template <class Op, Shape S>
+bool mapSse2(const int* left, const int* right, int* out, size_t count) {
+    __m128i leftValue = _mm_set1_epi32(S == SCALAR_ARRAY ? *left : 0);
+    __m128i rightValue = _mm_set1_epi32(S == ARRAY_SCALAR ? *right : 0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i a = S == SCALAR_ARRAY ? leftValue : _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+        __m128i b = S == ARRAY_SCALAR ? rightValue : _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), Op::sse2(a, b));
+    }
+    return mapScalar<Op, S>(S == SCALAR_ARRAY ? left : left + i, S == ARRAY_SCALAR ? right : right + i, out + i, count - i);
+}
+
+template <class Op, Shape S>
+ARRAY_KERNELS_AVX2 bool mapAvx2(const int* left, const int* right, int* out, size_t count) {
+    __m256i leftValue = _mm256_set1_epi32(S == SCALAR_ARRAY ? *left : 0);
+    __m256i rightValue = _mm256_set1_epi32(S == ARRAY_SCALAR ? *right : 0);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i a = S == SCALAR_ARRAY ? leftValue : _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+        __m256i b = S == ARRAY_SCALAR ? rightValue : _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), Op::avx2(a, b));
+    }
+    return mapScalar<Op, S>(S == SCALAR_ARRAY ? left : left + i, S == ARRAY_SCALAR ? right : right + i, out + i, count - i);
+}
+
+#endif // ARRAY_KERNELS_X86
+
+// Reductions
+
+inline int sumScalar(const int* values, size_t count) {
+    uint32_t total = 0;
+    for (size_t i = 0; i < count; i++)
+        total += static_cast<uint32_t>(values[i]);
+    return static_cast<int>(total);
+}
+
+inline int minScalar(const int* values, size_t count) {
+    int result = values[0];
+    for (size_t i = 1; i < count; i++)
+        result = values[i] < result ? values[i] : result;
+    return result;
+}
+
+inline int maxScalar(const int* values, size_t count) {
+    int result = values[0];
+    for (size_t i = 1; i < count; i++)
+        result = values[i] > result ? values[i] : result;
+    return result;
+}
+
+#ifdef ARRAY_KERNELS_X86
+
+// SSE2 has no 32-bit min / max; select with a comparison mask instead
+inline __m128i min4(__m128i a, __m128i b) {
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+}
+
+inline __m128i max4(__m128i a, __m128i b) {
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+}
+
+inline int sumSse2(const int* values, size_t count) {
+    __m128i total = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        total = _mm_add_epi32(total, _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)));
+    int lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), total);
+    return wrapAdd32(sumScalar(lanes, 4), sumScalar(values + i, count - i));
+}
+
+template <bool Maximum>
+int extremeSse2(const int* values, size_t count) {
+    if (count < 4)
+        return Maximum ? maxScalar(values, count) : minScalar(values, count);
+    __m128i best = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4) {
+        __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        best = Maximum ? max4(best, next) : min4(best, next);
+    }
+    // The last 4 values again cover the tail; min and max don't mind duplicates
+    __m128i last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + count - 4));
+    best = Maximum ? max4(best, last) : min4(best, last);
+    int lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), best);
+    return Maximum ? maxScalar(lanes, 4) : minScalar(lanes, 4);
+}
+
+ARRAY_KERNELS_AVX2 inline int sumAvx2(const int* values, size_t count) {
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        total = _mm256_add_epi32(total, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i)));
+    int lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return wrapAdd32(sumScalar(lanes, 8), sumScalar(values + i, count - i));
+}
+
+template <bool Maximum>
+ARRAY_KERNELS_AVX2 int extremeAvx2(const int* values, size_t count) {
+    if (count < 8)
+        return extremeSse2<Maximum>(values, count);
+    __m256i best = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values));
+    size_t i = 8;
+    for (; i + 8 <= count; i += 8) {
+        __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        best = Maximum ? _mm256_max_epi32(best, next) : _mm256_min_epi32(best, next);
+    }
+    __m256i last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + count - 8));
+    best = Maximum ? _mm256_max_epi32(best, last) : _mm256_min_epi32(best, last);
+    int lanes[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), best);
+    return Maximum ? maxScalar(lanes, 8) : minScalar(lanes, 8);
+}
+
+#endif // ARRAY_KERNELS_X86
+
+enum KernelLevel {
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2
+};
+
+inline const char* kernelLevelName(KernelLevel level) {
+    switch (level) {
+        case KERNEL_SSE2: return "sse2";
+        case KERNEL_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+// The widest kernel set this CPU supports
+inline KernelLevel detectKernelLevel() {
+#ifdef ARRAY_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return KERNEL_SSE2;
+#endif
+    return KERNEL_SCALAR;
+}
+
+struct Kernels {
+    BinaryKernel binary[O_GE + 1][3]; // by OpKind and Shape; nullptr for non-binary operators
+    Reduction sum;
+    Reduction min;
+    Reduction max;
+    KernelLevel level;
+
+    explicit Kernels(KernelLevel requested) {
+#ifdef ARRAY_KERNELS_X86
+        KernelLevel supported = detectKernelLevel();
+        level = requested > supported ? supported : requested;
+#else
+        (void)requested;
+        level = KERNEL_SCALAR;
+#endif
+        for (int op = 0; op <= O_GE; op++)
+            binary[op][ARRAY_ARRAY] = binary[op][ARRAY_SCALAR] = binary[op][SCALAR_ARRAY] = nullptr;
+        use<Add>(O_ADD);
+        use<Sub>(O_SUB);
+        use<Mul>(O_MUL);
+        use<Eq>(O_EQ);
+        use<Ne>(O_NE);
+        use<Lt>(O_LT);
+        use<Le>(O_LE);
+        use<Gt>(O_GT);
+        use<Ge>(O_GE);
+        binary[O_DIV][ARRAY_ARRAY] = &divideScalar<false, ARRAY_ARRAY>;
+        binary[O_DIV][ARRAY_SCALAR] = &divideScalar<false, ARRAY_SCALAR>;
+        binary[O_DIV][SCALAR_ARRAY] = &divideScalar<false, SCALAR_ARRAY>;
+        binary[O_MOD][ARRAY_ARRAY] = &divideScalar<true, ARRAY_ARRAY>;
+        binary[O_MOD][ARRAY_SCALAR] = &divideScalar<true, ARRAY_SCALAR>;
+        binary[O_MOD][SCALAR_ARRAY] = &divideScalar<true, SCALAR_ARRAY>;
+
+        sum = &sumScalar;
+        min = &minScalar;
+        max = &maxScalar;
+#ifdef ARRAY_KERNELS_X86
+        if (level == KERNEL_AVX2) {
+            sum = &sumAvx2;
+            min = &extremeAvx2<false>;
+            max = &extremeAvx2<true>;
+        } else if (level == KERNEL_SSE2) {
+            sum = &sumSse2;
+            min = &extremeSse2<false>;
+            max = &extremeSse2<true>;
+        }
+#endif
+    }
+
+private:
+    template <class Op>
+    void use(OpKind op) {
+        binary[op][ARRAY_ARRAY] = &mapScalar<Op, ARRAY_ARRAY>;
+        binary[op][ARRAY_SCALAR] = &mapScalar<Op, ARRAY_SCALAR>;
+        binary[op][SCALAR_ARRAY] = &mapScalar<Op, SCALAR_ARRAY>;
+#ifdef ARRAY_KERNELS_X86
+        if (level == KERNEL_AVX2) {
+            binary[op][ARRAY_ARRAY] = &mapAvx2<Op, ARRAY_ARRAY>;
+            binary[op][ARRAY_SCALAR] = &mapAvx2<Op, ARRAY_SCALAR>;
+            binary[op][SCALAR_ARRAY] = &mapAvx2<Op, SCALAR_ARRAY>;
+        } else if (level == KERNEL_SSE2) {
+            binary[op][ARRAY_ARRAY] = &mapSse2<Op, ARRAY_ARRAY>;
+            binary[op][ARRAY_SCALAR] = &mapSse2<Op, ARRAY_SCALAR>;
+            binary[op][SCALAR_ARRAY] = &mapSse2<Op, SCALAR_ARRAY>;
+        }
+#endif
+    }
+};
+
+// Chosen once, on first use
+inline const Kernels& defaultKernels() {
+    static const Kernels kernels(KERNEL_AVX2);
+    return kernels;
+}
+
+} // namespace arraykernels
+
+#endif // ARRAY_KERNELS_H
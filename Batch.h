@@ -0,0 +1,137 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "Pipeline.h"
+#include "ThreadPool.h"
+#include "SourceFile.h"
+#include "OutputSink.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <ostream>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+// Runs many scripts concurrently on a ThreadPool. Each script is lexed, parsed and run
+// on one worker with its output captured in memory; results are then written in input
+// order, so the combined output does not depend on scheduling:
+//
+//   stdout  ==> path (exit N) <==      followed by everything the script printed
+//   stderr  path: Error: message       for scripts that failed
+//
+// Scripts share nothing but the read-only options, which is what makes this safe.
+class BatchRunner {
+public:
+    struct Result {
+        std::string path;
+        std::string output;
+        std::string error;
+        int status;
+        bool done;
+        Result() : status(0), done(false) {}
+    };
+
+private:
+    PipelineOptions options;
+    std::vector<Result> results;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    BatchRunner(const BatchRunner&);
+    BatchRunner& operator=(const BatchRunner&);
+
+    void runScript(size_t index) {
+        Result& result = results[index];
+        std::string output;
+        std::string error;
+        int status = 0;
+        try {
+            SourceFile source;
+            if (!source.open(result.path.c_str())) {
+                error = "Could not open file: " + result.path;
+                status = 1;
+            } else {
+                OutputSink out(&output);
+                try {
+                    runPipeline(source.data(), source.size(), options, out);
+                } catch (const std::exception& e) {
+                    error = std::string("Error: ") + e.what();
+                    status = 1;
+                }
+            }
+        } catch (...) {
+            error = "Error: unknown failure";
+            status = 1;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        result.output.swap(output);
+        result.error.swap(error);
+        result.status = status;
+        result.done = true;
+        finished.notify_all();
+    }
+
+public:
+    // Scripts already run in parallel, so each one is lexed on a single thread
+    explicit BatchRunner(const PipelineOptions& options) : options(options) {
+        this->options.lexThreads = 1;
+    }
+
+    // Reads one path per line; blank lines and lines starting with '#' are skipped
+    static bool readManifest(const char* path, std::vector<std::string>& paths) {
+        std::ifstream file(path);
+        if (!file)
+            return false;
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#')
+                continue;
+            size_t end = line.find_last_not_of(" \t\r");
+            paths.push_back(line.substr(start, end - start + 1));
+        }
+        return true;
+    }
+
+    // Runs every script with up to jobs threads (0: one per core), writing each result as
+    // soon as it and all scripts before it are done. Returns the number of failed scripts.
+    size_t run(const std::vector<std::string>& paths, size_t jobs, OutputSink& out, std::ostream& err) {
+        results.assign(paths.size(), Result());
+        for (size_t i = 0; i < paths.size(); i++)
+            results[i].path = paths[i];
+        if (jobs == 0)
+            jobs = ThreadPool::defaultThreadCount();
+        if (jobs > paths.size())
+            jobs = paths.size() > 0 ? paths.size() : 1;
+
+        size_t failures = 0;
+        ThreadPool pool(jobs);
+        for (size_t i = 0; i < paths.size(); i++)
+            pool.submit([this, i] { runScript(i); });
+
+        for (size_t i = 0; i < results.size(); i++) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                finished.wait(lock, [this, i] { return results[i].done; });
+            }
+            Result& result = results[i];
+            out.write("==> " + result.path + " (exit " + std::to_string(result.status) + ") <==\n");
+            out.write(result.output);
+            if (!result.error.empty()) {
+                // Keep the error after the script's output when both streams go to a terminal
+                out.flush();
+                err << result.path << ": " << result.error << std::endl;
+            }
+            if (result.status != 0)
+                failures++;
+            // Captured output is no longer needed once written
+            std::string().swap(result.output);
+        }
+        pool.wait();
+        return failures;
+    }
+};
+
+#endif // BATCH_H
@@ -0,0 +1,400 @@
+#ifndef CLOSURECOMPILER_H
+#define CLOSURECOMPILER_H
+
+#include "Parser.h"
+#include "Resolver.h"
+#include "OutputSink.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <stdexcept>
+
+// Closure engine: every ASTNode is compiled once into a Closure, a small record holding
+// a function pointer specialized for exactly that node (operator, operand kinds, slot)
+// plus pre-linked pointers to its children. Running the program is a chain of direct
+// calls; there is no type switch, no operator dispatch and no name lookup at runtime.
+// A compiled ClosureProgram does not reference the AST, which can be freed after compile().
+
+struct Closure;
+
+// Mutable state of one run
+struct ClosureFrame {
+    int* slots;
+    char* defined;
+    OutputSink* out;
+    const std::vector<std::string>* names;
+};
+
+typedef int (*ClosureFn)(const Closure* self, ClosureFrame& frame);
+
+struct Closure {
+    ClosureFn fn;
+    const Closure* a;           // children (operands, condition, branches, loop body)
+    const Closure* b;
+    const Closure* c;
+    const Closure* const* list; // block statements
+    int x;                      // constant value, slot, or statement count
+    int y;                      // nameId for variables, first scoped slot for blocks
+    int z;                      // scoped slot count for blocks
+    int lineNumber;
+};
+
+// How an operand is fetched: inlined constant, inlined checked slot read, inlined
+// slot read proved defined by DefiniteAssignment, or a call
+enum OperandKind {
+    K_CONST,
+    K_VAR,
+    K_SLOT,
+    K_CALL
+};
+
+namespace closures {
+
+inline void undefinedVariable(const Closure* self, ClosureFrame& frame) {
+    throw std::runtime_error("Undefined variable '" + (*frame.names)[self->y] + "' at line " + std::to_string(self->lineNumber));
+}
+
+template<int K>
+inline int operand(const Closure* child, ClosureFrame& frame) {
+    if (K == K_CONST)
+        return child->x;
+    if (K == K_VAR) {
+        if (!frame.defined[child->x])
+            undefinedVariable(child, frame);
+        return frame.slots[child->x];
+    }
+    if (K == K_SLOT)
+        return frame.slots[child->x];
+    return child->fn(child, frame);
+}
+
+inline int number(const Closure* self, ClosureFrame&) {
+    return self->x;
+}
+
+inline int variable(const Closure* self, ClosureFrame& frame) {
+    return operand<K_VAR>(self, frame);
+}
+
+inline int definedVariable(const Closure* self, ClosureFrame& frame) {
+    return operand<K_SLOT>(self, frame);
+}
+
+template<OpKind OP>
+inline int apply(int left, int right, const Closure* self) {
+    switch (OP) {
+        case O_ADD: return left + right;
+        case O_SUB: return left - right;
+        case O_MUL: return left * right;
+        case O_DIV:
+            if (right == 0)
+                throw std::runtime_error("Division by zero at line " + std::to_string(self->lineNumber));
+            return left / right;
+        case O_MOD:
+            if (right == 0)
+                throw std::runtime_error("Modulo by zero at line " + std::to_string(self->lineNumber));
+            return left % right;
+        case O_EQ: return left == right;
+        case O_NE: return left != right;
+        case O_LT: return left < right;
+        case O_LE: return left <= right;
+        case O_GT: return left > right;
+        case O_GE: return left >= right;
+        default: return 0;
+    }
+}
+
+template<OpKind OP, int L, int R>
+int binaryOp(const Closure* self, ClosureFrame& frame) {
+    int left = operand<L>(self->a, frame);
+    int right = operand<R>(self->b, frame);
+    return apply<OP>(left, right, self);
+}
+
+template<int K>
+int negate(const Closure* self, ClosureFrame& frame) {
+    return -operand<K>(self->a, frame);
+}
+
+template<int K>
+int logicalNot(const Closure* self, ClosureFrame& frame) {
+    return !operand<K>(self->a, frame);
+}
+
+template<int K>
+int assign(const Closure* self, ClosureFrame& frame) {
+    int value = operand<K>(self->a, frame);
+    frame.slots[self->x] = value;
+    frame.defined[self->x] = 1;
+    return value;
+}
+
+template<int K>
+int print(const Closure* self, ClosureFrame& frame) {
+    int value = operand<K>(self->a, frame);
+    frame.out->printInt(value);
+    return value;
+}
+
+inline int ifThen(const Closure* self, ClosureFrame& frame) {
+    if (self->a->fn(self->a, frame))
+        self->b->fn(self->b, frame);
+    return 0;
+}
+
+inline int ifThenElse(const Closure* self, ClosureFrame& frame) {
+    if (self->a->fn(self->a, frame))
+        self->b->fn(self->b, frame);
+    else
+        self->c->fn(self->c, frame);
+    return 0;
+}
+
+inline int whileLoop(const Closure* self, ClosureFrame& frame) {
+    const Closure* condition = self->a;
+    const Closure* body = self->b;
+    while (condition->fn(condition, frame))
+        body->fn(body, frame);
+    return 0;
+}
+
+// A loop whose body is an unscoped block runs the statements itself
+inline int whileBlock(const Closure* self, ClosureFrame& frame) {
+    const Closure* condition = self->a;
+    const Closure* const* begin = self->b->list;
+    const Closure* const* end = begin + self->b->x;
+    while (condition->fn(condition, frame))
+        for (const Closure* const* stmt = begin; stmt != end; ++stmt)
+            (*stmt)->fn(*stmt, frame);
+    return 0;
+}
+
+inline int block(const Closure* self, ClosureFrame& frame) {
+    const Closure* const* stmt = self->list;
+    for (int i = 0; i < self->x; i++)
+        stmt[i]->fn(stmt[i], frame);
+    return 0;
+}
+
+// A block that declares variables (block scoping) clears them on exit
+inline int scopedBlock(const Closure* self, ClosureFrame& frame) {
+    block(self, frame);
+    for (int slot = self->y; slot < self->y + self->z; slot++)
+        frame.defined[slot] = 0;
+    return 0;
+}
+
+} // namespace closures
+
+// The compiled program: closures, identifier names and frame size
+class ClosureProgram {
+private:
+    std::deque<Closure> closures;                    // stable addresses
+    std::deque<std::vector<const Closure*> > lists;  // block statement arrays
+    std::vector<std::string> names;
+    int frameSize;
+    const Closure* entry;
+
+    ClosureProgram(const ClosureProgram&);
+    ClosureProgram& operator=(const ClosureProgram&);
+
+    friend class ClosureCompiler;
+
+public:
+    ClosureProgram() : frameSize(0), entry(nullptr) {}
+
+    void run(OutputSink& out) const {
+        std::vector<int> slots(frameSize, 0);
+        std::vector<char> defined(frameSize, 0);
+        run(slots.data(), defined.data(), out);
+    }
+
+    // Runs on caller-owned variable storage of frameSlots() entries. The program itself
+    // is not modified, so one program can run on many frames at once.
+    void run(int* slots, char* defined, OutputSink& out) const {
+        ClosureFrame frame = {slots, defined, &out, &names};
+        entry->fn(entry, frame);
+    }
+
+    int frameSlots() const {
+        return frameSize;
+    }
+
+    size_t closureCount() const {
+        return closures.size();
+    }
+};
+
+// Compiles a resolved AST (after Resolver::resolve) into a ClosureProgram
+class ClosureCompiler {
+private:
+    ClosureProgram* program;
+
+    Closure* make(ClosureFn fn, int lineNumber) {
+        Closure closure = {fn, nullptr, nullptr, nullptr, nullptr, 0, 0, 0, lineNumber};
+        program->closures.push_back(closure);
+        return &program->closures.back();
+    }
+
+    static int kindOf(ASTNode* node) {
+        if (node->type == N_NUMBER)
+            return K_CONST;
+        if (node->type == N_VARIABLE)
+            return static_cast<VariableNode*>(node)->checked ? K_VAR : K_SLOT;
+        return K_CALL;
+    }
+
+    // Picks the instantiation of a one-operand template for the operand's kind
+    template<template<int> class F>
+    static ClosureFn pick(int kind) {
+        switch (kind) {
+            case K_CONST: return &F<K_CONST>::fn;
+            case K_VAR: return &F<K_VAR>::fn;
+            case K_SLOT: return &F<K_SLOT>::fn;
+            default: return &F<K_CALL>::fn;
+        }
+    }
+
+    template<int K> struct Negate { static int fn(const Closure* s, ClosureFrame& f) { return closures::negate<K>(s, f); } };
+    template<int K> struct Not { static int fn(const Closure* s, ClosureFrame& f) { return closures::logicalNot<K>(s, f); } };
+    template<int K> struct Assign { static int fn(const Closure* s, ClosureFrame& f) { return closures::assign<K>(s, f); } };
+    template<int K> struct Print { static int fn(const Closure* s, ClosureFrame& f) { return closures::print<K>(s, f); } };
+
+    template<OpKind OP, int L>
+    static ClosureFn binaryFor(int right) {
+        switch (right) {
+            case K_CONST: return &closures::binaryOp<OP, L, K_CONST>;
+            case K_VAR: return &closures::binaryOp<OP, L, K_VAR>;
+            case K_SLOT: return &closures::binaryOp<OP, L, K_SLOT>;
+            default: return &closures::binaryOp<OP, L, K_CALL>;
+        }
+    }
+
+    template<OpKind OP>
+    static ClosureFn binaryFor(int left, int right) {
+        switch (left) {
+            case K_CONST: return binaryFor<OP, K_CONST>(right);
+            case K_VAR: return binaryFor<OP, K_VAR>(right);
+            case K_SLOT: return binaryFor<OP, K_SLOT>(right);
+            default: return binaryFor<OP, K_CALL>(right);
+        }
+    }
+
+    static ClosureFn binaryFn(BinOpNode* node) {
+        int left = kindOf(node->left);
+        int right = kindOf(node->right);
+        switch (node->op) {
+            case O_ADD: return binaryFor<O_ADD>(left, right);
+            case O_SUB: return binaryFor<O_SUB>(left, right);
+            case O_MUL: return binaryFor<O_MUL>(left, right);
+            case O_DIV: return binaryFor<O_DIV>(left, right);
+            case O_MOD: return binaryFor<O_MOD>(left, right);
+            case O_EQ: return binaryFor<O_EQ>(left, right);
+            case O_NE: return binaryFor<O_NE>(left, right);
+            case O_LT: return binaryFor<O_LT>(left, right);
+            case O_LE: return binaryFor<O_LE>(left, right);
+            case O_GT: return binaryFor<O_GT>(left, right);
+            case O_GE: return binaryFor<O_GE>(left, right);
+            default:
+                throw std::runtime_error(std::string("Unknown operator '") + opKindToString(node->op) + "' at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+    const Closure* compile(ASTNode* node) {
+        switch (node->type) {
+            case N_NUMBER: {
+                Closure* closure = make(&closures::number, node->lineNumber);
+                closure->x = static_cast<NumberNode*>(node)->value;
+                return closure;
+            }
+            case N_VARIABLE: {
+                VariableNode* var = static_cast<VariableNode*>(node);
+                Closure* closure = make(var->checked ? &closures::variable : &closures::definedVariable, node->lineNumber);
+                closure->x = var->slot;
+                closure->y = var->nameId;
+                return closure;
+            }
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                Closure* closure = make(binaryFn(binOp), node->lineNumber);
+                closure->a = compile(binOp->left);
+                closure->b = compile(binOp->right);
+                return closure;
+            }
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                Closure* closure;
+                switch (unaryOp->op) {
+                    case O_ADD: return compile(unaryOp->operand); // +e is e
+                    case O_SUB: closure = make(pick<Negate>(kindOf(unaryOp->operand)), node->lineNumber); break;
+                    case O_NOT: closure = make(pick<Not>(kindOf(unaryOp->operand)), node->lineNumber); break;
+                    default:
+                        throw std::runtime_error(std::string("Unknown operator '") + opKindToString(unaryOp->op) + "' at line " + std::to_string(node->lineNumber));
+                }
+                closure->a = compile(unaryOp->operand);
+                return closure;
+            }
+            case N_ASSIGN: {
+                AssignNode* assign = static_cast<AssignNode*>(node);
+                Closure* closure = make(pick<Assign>(kindOf(assign->value)), node->lineNumber);
+                closure->a = compile(assign->value);
+                closure->x = assign->slot;
+                return closure;
+            }
+            case N_PRINT: {
+                PrintNode* printNode = static_cast<PrintNode*>(node);
+                Closure* closure = make(pick<Print>(kindOf(printNode->expression)), node->lineNumber);
+                closure->a = compile(printNode->expression);
+                return closure;
+            }
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                Closure* closure = make(ifNode->falseBlock ? &closures::ifThenElse : &closures::ifThen, node->lineNumber);
+                closure->a = compile(ifNode->condition);
+                closure->b = compile(ifNode->trueBlock);
+                if (ifNode->falseBlock)
+                    closure->c = compile(ifNode->falseBlock);
+                return closure;
+            }
+            case N_WHILE: {
+                WhileNode* whileNode = static_cast<WhileNode*>(node);
+                bool plainBlock = whileNode->block->type == N_BLOCK && static_cast<BlockNode*>(whileNode->block)->slotCount == 0;
+                Closure* closure = make(plainBlock ? &closures::whileBlock : &closures::whileLoop, node->lineNumber);
+                closure->a = compile(whileNode->condition);
+                closure->b = compile(whileNode->block);
+                return closure;
+            }
+            case N_BLOCK: {
+                BlockNode* blockNode = static_cast<BlockNode*>(node);
+                Closure* closure = make(blockNode->slotCount > 0 ? &closures::scopedBlock : &closures::block, node->lineNumber);
+                program->lists.push_back(std::vector<const Closure*>());
+                std::vector<const Closure*>& statements = program->lists.back();
+                statements.reserve(blockNode->statements.size());
+                for (ASTNode* stmt : blockNode->statements)
+                    statements.push_back(compile(stmt));
+                closure->list = statements.data();
+                closure->x = static_cast<int>(statements.size());
+                closure->y = blockNode->firstSlot;
+                closure->z = blockNode->slotCount;
+                return closure;
+            }
+            default:
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+public:
+    ClosureCompiler() : program(nullptr) {}
+
+    void compile(ASTNode* root, const SymbolTable& symbols, ClosureProgram& out) {
+        program = &out;
+        out.closures.clear();
+        out.lists.clear();
+        out.names = symbols.names;
+        out.frameSize = symbols.frameSize;
+        out.entry = compile(root);
+        program = nullptr;
+    }
+};
+
+#endif // CLOSURECOMPILER_H
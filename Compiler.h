@@ -0,0 +1,218 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include "Parser.h"
+#include "Resolver.h"
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+
+// Bytecode instruction set for the stack-based VM (see VM.h)
+enum OpCode : uint8_t {
+    OP_CONST,         // push operand
+    OP_LOAD,          // push variables[operand], failing if it is undefined
+    OP_LOAD_FAST,     // push variables[operand], known to be defined
+    OP_STORE,         // pop into variables[operand]
+    OP_CLEAR,         // undefine the slots of scopes[operand] (block exit)
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_NEG,           // replace top with -top
+    OP_NOT,           // replace top with !top
+    OP_PRINT,         // pop and print
+    OP_JUMP,          // pc = operand
+    OP_JUMP_IF_FALSE, // pop, if zero pc = operand
+    OP_HALT
+};
+
+// One instruction: opcode plus a single 32-bit operand (constant, variable slot or jump target)
+struct Instruction {
+    OpCode op;
+    int32_t operand;
+};
+
+// Where an instruction came from; only read when reporting errors
+struct DebugInfo {
+    int lineNumber;
+    int nameId; // identifier of OP_LOAD / OP_LOAD_FAST / OP_STORE, -1 otherwise
+};
+
+// Slots declared by a block, reclaimed by OP_CLEAR
+struct SlotRange {
+    int first;
+    int count;
+};
+
+// A compiled program: linear code with parallel debug info, identifier names and frame layout
+struct Chunk {
+    std::vector<Instruction> code;
+    std::vector<DebugInfo> debug;
+    std::vector<std::string> names;
+    std::vector<SlotRange> scopes;
+    int frameSize;
+    int maxStackDepth;
+
+    Chunk() : frameSize(0), maxStackDepth(0) {}
+};
+
+// Compiler lowers a resolved AST (see Resolver.h) into a Chunk.
+// Variables use the resolver's frame slots, if/while become conditional and unconditional jumps.
+class Compiler {
+private:
+    Chunk chunk;
+    int depth; // operand stack depth at the current instruction
+
+    int emit(OpCode op, int32_t operand, int lineNumber, int nameId = -1) {
+        chunk.code.push_back(Instruction{op, operand});
+        chunk.debug.push_back(DebugInfo{lineNumber, nameId});
+        switch (op) {
+            case OP_CONST:
+            case OP_LOAD:
+            case OP_LOAD_FAST:
+                depth++;
+                break;
+            case OP_NEG:
+            case OP_NOT:
+            case OP_CLEAR:
+            case OP_JUMP:
+            case OP_HALT:
+                break;
+            default: // stores, binary operators, print and conditional jumps pop one operand
+                depth--;
+                break;
+        }
+        if (depth > chunk.maxStackDepth)
+            chunk.maxStackDepth = depth;
+        return static_cast<int>(chunk.code.size()) - 1;
+    }
+
+    // Points the jump at index 'at' to the next instruction to be emitted
+    void patchJump(int at) {
+        chunk.code[at].operand = static_cast<int32_t>(chunk.code.size());
+    }
+
+    OpCode binaryOpCode(OpKind op, int lineNumber) {
+        switch (op) {
+            case O_ADD: return OP_ADD;
+            case O_SUB: return OP_SUB;
+            case O_MUL: return OP_MUL;
+            case O_DIV: return OP_DIV;
+            case O_MOD: return OP_MOD;
+            case O_EQ: return OP_EQ;
+            case O_NE: return OP_NE;
+            case O_LT: return OP_LT;
+            case O_LE: return OP_LE;
+            case O_GT: return OP_GT;
+            case O_GE: return OP_GE;
+            default:
+                throw std::runtime_error(std::string("Unknown operator '") + opKindToString(op) + "' at line " + std::to_string(lineNumber));
+        }
+    }
+
+    void compileExpression(ASTNode* node) {
+        switch (node->type) {
+            case N_NUMBER:
+                emit(OP_CONST, static_cast<NumberNode*>(node)->value, node->lineNumber);
+                break;
+            case N_VARIABLE: {
+                VariableNode* var = static_cast<VariableNode*>(node);
+                emit(var->checked ? OP_LOAD : OP_LOAD_FAST, var->slot, node->lineNumber, var->nameId);
+                break;
+            }
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                compileExpression(binOp->left);
+                compileExpression(binOp->right);
+                emit(binaryOpCode(binOp->op, node->lineNumber), 0, node->lineNumber);
+                break;
+            }
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                compileExpression(unaryOp->operand);
+                if (unaryOp->op == O_SUB)
+                    emit(OP_NEG, 0, node->lineNumber);
+                else if (unaryOp->op == O_NOT)
+                    emit(OP_NOT, 0, node->lineNumber);
+                else if (unaryOp->op != O_ADD)
+                    throw std::runtime_error(std::string("Unknown operator '") + opKindToString(unaryOp->op) + "' at line " + std::to_string(node->lineNumber));
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+    void compileStatement(ASTNode* node) {
+        switch (node->type) {
+            case N_ASSIGN: {
+                AssignNode* assign = static_cast<AssignNode*>(node);
+                compileExpression(assign->value);
+                emit(OP_STORE, assign->slot, node->lineNumber, assign->nameId);
+                break;
+            }
+            case N_PRINT:
+                compileExpression(static_cast<PrintNode*>(node)->expression);
+                emit(OP_PRINT, 0, node->lineNumber);
+                break;
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                compileExpression(ifNode->condition);
+                int elseJump = emit(OP_JUMP_IF_FALSE, 0, node->lineNumber);
+                compileStatement(ifNode->trueBlock);
+                if (ifNode->falseBlock) {
+                    int endJump = emit(OP_JUMP, 0, node->lineNumber);
+                    patchJump(elseJump);
+                    compileStatement(ifNode->falseBlock);
+                    patchJump(endJump);
+                } else {
+                    patchJump(elseJump);
+                }
+                break;
+            }
+            case N_WHILE: {
+                WhileNode* whileNode = static_cast<WhileNode*>(node);
+                int loopStart = static_cast<int>(chunk.code.size());
+                compileExpression(whileNode->condition);
+                int exitJump = emit(OP_JUMP_IF_FALSE, 0, node->lineNumber);
+                compileStatement(whileNode->block);
+                emit(OP_JUMP, loopStart, node->lineNumber);
+                patchJump(exitJump);
+                break;
+            }
+            case N_BLOCK: {
+                BlockNode* block = static_cast<BlockNode*>(node);
+                for (ASTNode* stmt : block->statements)
+                    compileStatement(stmt);
+                if (block->slotCount > 0) {
+                    chunk.scopes.push_back(SlotRange{block->firstSlot, block->slotCount});
+                    emit(OP_CLEAR, static_cast<int32_t>(chunk.scopes.size()) - 1, node->lineNumber);
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+public:
+    Compiler() : depth(0) {}
+
+    Chunk compile(ASTNode* root, const SymbolTable& symbols) {
+        chunk.names = symbols.names;
+        chunk.frameSize = symbols.frameSize;
+        compileStatement(root);
+        emit(OP_HALT, 0, root->lineNumber);
+        return chunk;
+    }
+};
+
+#endif // COMPILER_H
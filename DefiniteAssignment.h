@@ -0,0 +1,183 @@
+#ifndef DEFINITE_ASSIGNMENT_H
+#define DEFINITE_ASSIGNMENT_H
+
+#include "Parser.h"
+#include "Resolver.h"
+#include <vector>
+#include <ostream>
+#include <cstddef>
+
+// Definite-assignment analysis over a resolved AST. It proves which variable reads are
+// always preceded by an assignment to the same slot on every path through the program,
+// and clears VariableNode::checked on those reads, so the engines can skip the
+// "Undefined variable" test there. Reads it cannot prove keep the test, and with a
+// warning stream they are reported before the program runs.
+//
+// The analysis walks the tree once, tracking the set of slots assigned on every path
+// so far:
+//   - an assignment adds its slot after its value is analyzed;
+//   - an if keeps the slots assigned by both branches (by the true branch alone when
+//     there is no else);
+//   - a while loop adds nothing, since its body may not run. Its condition and body
+//     are analyzed with the set at loop entry, which is a subset of the set at the start
+//     of every later iteration, so whatever holds on the first holds on all of them;
+//   - a block with block scoping removes its own slots on exit, as the engines do.
+//
+// Conditions are not evaluated, so `if (1) { x = 1; }` does not assign x here; the
+// optimizer folds such branches away first when it runs.
+class DefiniteAssignment {
+private:
+    std::ostream* warnings;
+    const SymbolTable* symbols;
+    std::vector<char> assigned; // per slot: assigned on every path to this point
+    std::vector<int> trail;     // slots in the order they were added, for rollback
+    size_t provedReads;
+    size_t checkedReads;
+
+    DefiniteAssignment(const DefiniteAssignment&);
+    DefiniteAssignment& operator=(const DefiniteAssignment&);
+
+    void assign(int slot) {
+        if (!assigned[slot]) {
+            assigned[slot] = 1;
+            trail.push_back(slot);
+        }
+    }
+
+    // Forgets every slot added since the trail had 'mark' entries
+    void rollback(size_t mark) {
+        while (trail.size() > mark) {
+            assigned[trail.back()] = 0;
+            trail.pop_back();
+        }
+    }
+
+    void visitVariable(VariableNode* node) {
+        if (assigned[node->slot]) {
+            node->checked = false;
+            provedReads++;
+            return;
+        }
+        node->checked = true;
+        checkedReads++;
+        if (warnings) {
+            *warnings << "Warning: variable '" << symbols->names[node->nameId] << "' may be used before it is assigned at line "
+                      << node->lineNumber << std::endl;
+        }
+    }
+
+    void visit(ASTNode* node) {
+        switch (node->type) {
+            case N_NUMBER:
+                break;
+            case N_VARIABLE:
+                visitVariable(static_cast<VariableNode*>(node));
+                break;
+            case N_BIN_OP:
+                visit(static_cast<BinOpNode*>(node)->left);
+                visit(static_cast<BinOpNode*>(node)->right);
+                break;
+            case N_UNARY_OP:
+                visit(static_cast<UnaryOpNode*>(node)->operand);
+                break;
+            case N_ASSIGN: {
+                AssignNode* assignNode = static_cast<AssignNode*>(node);
+                visit(assignNode->value);
+                assign(assignNode->slot);
+                break;
+            }
+            case N_PRINT:
+                visit(static_cast<PrintNode*>(node)->expression);
+                break;
+            case N_IF:
+                visitIf(static_cast<IfNode*>(node));
+                break;
+            case N_WHILE: {
+                WhileNode* whileNode = static_cast<WhileNode*>(node);
+                visit(whileNode->condition);
+                size_t mark = trail.size();
+                visit(whileNode->block);
+                rollback(mark);
+                break;
+            }
+            case N_BLOCK: {
+                BlockNode* block = static_cast<BlockNode*>(node);
+                for (ASTNode* stmt : block->statements)
+                    visit(stmt);
+                // Slots declared in this block go out of scope (only non-empty with block scoping)
+                for (int slot = block->firstSlot; slot < block->firstSlot + block->slotCount; slot++)
+                    assigned[slot] = 0;
+                break;
+            }
+            case N_INDEX:
+                visit(static_cast<IndexNode*>(node)->array);
+                visit(static_cast<IndexNode*>(node)->index);
+                break;
+            case N_INDEX_ASSIGN: {
+                // Storing an element reads the array variable and assigns nothing
+                IndexAssignNode* store = static_cast<IndexAssignNode*>(node);
+                visit(store->target);
+                visit(store->index);
+                visit(store->value);
+                break;
+            }
+            case N_CALL:
+                visit(static_cast<CallNode*>(node)->argument);
+                break;
+            case N_ARRAY_LITERAL:
+                for (ASTNode* element : static_cast<ArrayLiteralNode*>(node)->elements)
+                    visit(element);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void visitIf(IfNode* node) {
+        visit(node->condition);
+        size_t mark = trail.size();
+        visit(node->trueBlock);
+        if (!node->falseBlock) {
+            rollback(mark);
+            return;
+        }
+        std::vector<int> trueSlots;
+        for (size_t i = mark; i < trail.size(); i++)
+            if (assigned[trail[i]])
+                trueSlots.push_back(trail[i]);
+        rollback(mark);
+        visit(node->falseBlock);
+        // Slots the true branch added are unassigned at 'mark', so any that are set now
+        // were assigned by the false branch too
+        std::vector<int> both;
+        for (int slot : trueSlots)
+            if (assigned[slot])
+                both.push_back(slot);
+        rollback(mark);
+        for (int slot : both)
+            assign(slot);
+    }
+
+public:
+    // Possibly-undefined reads are reported on 'warnings' when it is not nullptr
+    explicit DefiniteAssignment(std::ostream* warnings = nullptr)
+        : warnings(warnings), symbols(nullptr), provedReads(0), checkedReads(0) {}
+
+    void analyze(ASTNode* root, const SymbolTable& symbolTable) {
+        symbols = &symbolTable;
+        assigned.assign(static_cast<size_t>(symbolTable.frameSize), 0);
+        trail.clear();
+        visit(root);
+    }
+
+    // Reads proved to follow an assignment, and reads that keep the runtime check
+    size_t proved() const {
+        return provedReads;
+    }
+
+    size_t checked() const {
+        return checkedReads;
+    }
+};
+
+#endif // DEFINITE_ASSIGNMENT_H
@@ -0,0 +1,279 @@
+#ifndef EXECUTION_BUDGET_H
+#define EXECUTION_BUDGET_H
+
+#include "Parser.h"
+#include "OutputSink.h"
+#include "Stack.h"
+#include <string>
+#include <stdexcept>
+#include <chrono>
+#include <cstdint>
+
+// Limits on what one run of an untrusted script may consume (tree engine).
+//
+// Loop iterations are the only unbounded work in the language, so the budget is
+// charged there: every iteration decrements ExecutionBudget::countdown, and only when
+// it reaches zero does refill() account the interval, read the clock and compare the
+// counters with the limits. The interval is BUDGET_CHECK_INTERVAL iterations, cut
+// short so that the iteration limit is hit exactly. Compiled loops (JIT.h) decrement
+// the same counter in place; closed-form loops (ScalarEvolution.h) are charged their
+// whole trip count at once and only taken when it fits the budget.
+//
+// One iteration can also run whole-array operations of any length, so array work is
+// charged by element: every BUDGET_CHECK_ELEMENTS elements processed read the clock,
+// like a refill. Array sizes are checked before the storage is allocated.
+//
+// Every print, interpreted or compiled, works out its length first and is refused
+// without writing anything if it would take the output over the limit, so a script
+// never gets more than --max-output bytes out. The variable count is checked once
+// before the run. Exceeding a limit raises BudgetExceeded.
+
+// Iterations between two full checks of the budget
+const int64_t BUDGET_CHECK_INTERVAL = 4096;
+
+// Array elements processed between two clock checks, about as long as an interval of
+// interpreted iterations
+const int64_t BUDGET_CHECK_ELEMENTS = 1 << 18;
+
+// Zero means no limit
+struct ExecutionLimits {
+    uint64_t maxIterations;   // loop iterations, over all loops
+    uint64_t maxMilliseconds; // wall-clock time of the run
+    uint64_t maxOutputBytes;
+    int maxVariables;         // frame slots
+    uint64_t maxArrayElements; // held by array variables, plus the array being built
+
+    ExecutionLimits() : maxIterations(0), maxMilliseconds(0), maxOutputBytes(0), maxVariables(0), maxArrayElements(0) {}
+
+    bool any() const {
+        return maxIterations || maxMilliseconds || maxOutputBytes || maxVariables || maxArrayElements;
+    }
+};
+
+// Thrown when a run exceeds one of its limits
+class BudgetExceeded : public std::runtime_error {
+public:
+    explicit BudgetExceeded(const std::string& message) : std::runtime_error(message) {}
+};
+
+class ExecutionBudget {
+public:
+    // Iterations left before the next refill(). It is the first member: compiled code
+    // decrements it through the budget pointer.
+    int64_t countdown;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    ExecutionLimits limits;
+    const OutputSink& out;
+    int variables;
+    uint64_t charged;  // iterations accounted before the current interval
+    int64_t interval;  // length of the current interval
+    int64_t elementCountdown; // array elements left before the next clock check
+    Clock::time_point started;
+    uint64_t elapsed;  // milliseconds, as of the last check
+    const char* exceeded; // what ran out, once something has
+    uint64_t limit;       // and its limit
+    int line;
+
+    ExecutionBudget(const ExecutionBudget&);
+    ExecutionBudget& operator=(const ExecutionBudget&);
+
+    void startInterval() {
+        interval = BUDGET_CHECK_INTERVAL;
+        // Reaching zero starts iteration maxIterations + 1, which is refused
+        if (limits.maxIterations && limits.maxIterations - charged + 1 < static_cast<uint64_t>(interval))
+            interval = static_cast<int64_t>(limits.maxIterations - charged + 1);
+        countdown = interval;
+    }
+
+    uint64_t measure() {
+        elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - started).count());
+        return elapsed;
+    }
+
+    bool exceed(const char* what, uint64_t whatLimit, int atLine) {
+        exceeded = what;
+        limit = whatLimit;
+        line = atLine;
+        return false;
+    }
+
+    // The first node, in source order, that uses a slot at or above 'slot'; nullptr if
+    // none. Walks with an explicit stack, so trees of any depth are searched.
+    static ASTNode* firstSlotUse(ASTNode* root, int slot) {
+        Stack<ASTNode*> nodes;
+        nodes.push(root);
+        while (!nodes.isEmpty()) {
+            ASTNode* node = nodes.pop();
+            if (!node)
+                continue;
+            switch (node->type) {
+                case N_VARIABLE:
+                    if (static_cast<VariableNode*>(node)->slot >= slot)
+                        return node;
+                    break;
+                case N_BIN_OP:
+                    nodes.push(static_cast<BinOpNode*>(node)->right);
+                    nodes.push(static_cast<BinOpNode*>(node)->left);
+                    break;
+                case N_UNARY_OP:
+                    nodes.push(static_cast<UnaryOpNode*>(node)->operand);
+                    break;
+                case N_ASSIGN:
+                    if (static_cast<AssignNode*>(node)->slot >= slot)
+                        return node;
+                    nodes.push(static_cast<AssignNode*>(node)->value);
+                    break;
+                case N_PRINT:
+                    nodes.push(static_cast<PrintNode*>(node)->expression);
+                    break;
+                case N_IF:
+                    nodes.push(static_cast<IfNode*>(node)->falseBlock);
+                    nodes.push(static_cast<IfNode*>(node)->trueBlock);
+                    nodes.push(static_cast<IfNode*>(node)->condition);
+                    break;
+                case N_WHILE:
+                    nodes.push(static_cast<WhileNode*>(node)->block);
+                    nodes.push(static_cast<WhileNode*>(node)->condition);
+                    break;
+                case N_BLOCK: {
+                    std::vector<ASTNode*>& statements = static_cast<BlockNode*>(node)->statements;
+                    for (size_t i = statements.size(); i > 0; i--)
+                        nodes.push(statements[i - 1]);
+                    break;
+                }
+                case N_INDEX:
+                    nodes.push(static_cast<IndexNode*>(node)->index);
+                    nodes.push(static_cast<IndexNode*>(node)->array);
+                    break;
+                case N_INDEX_ASSIGN:
+                    nodes.push(static_cast<IndexAssignNode*>(node)->value);
+                    nodes.push(static_cast<IndexAssignNode*>(node)->index);
+                    nodes.push(static_cast<IndexAssignNode*>(node)->target);
+                    break;
+                case N_CALL:
+                    nodes.push(static_cast<CallNode*>(node)->argument);
+                    break;
+                case N_ARRAY_LITERAL: {
+                    std::vector<ASTNode*>& elements = static_cast<ArrayLiteralNode*>(node)->elements;
+                    for (size_t i = elements.size(); i > 0; i--)
+                        nodes.push(elements[i - 1]);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    // The clock starts now. 'variables' is the frame size the run allocates.
+    ExecutionBudget(const ExecutionLimits& limits, const OutputSink& out, int variables)
+        : countdown(0), limits(limits), out(out), variables(variables), charged(0), interval(0),
+          elementCountdown(BUDGET_CHECK_ELEMENTS), started(Clock::now()), elapsed(0), exceeded(nullptr), limit(0), line(0) {
+        startInterval();
+    }
+
+    // Refuses a program that needs more variables than allowed, naming the first use
+    // of one too many
+    static void checkVariables(ASTNode* root, int frameSize, const ExecutionLimits& limits) {
+        if (!limits.maxVariables || frameSize <= limits.maxVariables)
+            return;
+        ASTNode* node = firstSlotUse(root, limits.maxVariables);
+        throw BudgetExceeded("Execution limit exceeded: more than " + std::to_string(limits.maxVariables) +
+                             " variables at line " + std::to_string(node ? node->lineNumber : root->lineNumber) +
+                             " (program uses " + std::to_string(frameSize) + ")");
+    }
+
+    // Loop iterations started so far, including the current one
+    uint64_t iterations() const {
+        return charged + static_cast<uint64_t>(interval - countdown);
+    }
+
+    // Iterations that may still start; UINT64_MAX without an iteration limit
+    uint64_t remainingIterations() const {
+        if (!limits.maxIterations)
+            return UINT64_MAX;
+        uint64_t used = iterations();
+        return used >= limits.maxIterations ? 0 : limits.maxIterations - used;
+    }
+
+    // Called when countdown reaches zero, as iteration iterations() of a loop at 'atLine'
+    // is about to start. False, with the reason recorded for error(), if it must not;
+    // never throws, so compiled code can call it.
+    bool refill(int atLine) {
+        charged += static_cast<uint64_t>(interval);
+        countdown = 0;
+        interval = 0;
+        if (limits.maxIterations && charged > limits.maxIterations) {
+            charged--; // that iteration never ran
+            return exceed("loop iterations", limits.maxIterations, atLine);
+        }
+        if (limits.maxMilliseconds && measure() > limits.maxMilliseconds) {
+            charged--;
+            return exceed("milliseconds", limits.maxMilliseconds, atLine);
+        }
+        startInterval();
+        return true;
+    }
+
+    // Accounts iterations run all at once by a closed form; count is at most
+    // remainingIterations()
+    void charge(uint64_t count) {
+        charged = iterations() + count;
+        startInterval();
+    }
+
+    // Accounts array work of 'count' elements at 'atLine' (an elementwise operation,
+    // copy, reduction or print) and throws when the time limit has passed
+    void chargeElements(uint64_t count, int atLine) {
+        if (count < static_cast<uint64_t>(elementCountdown)) {
+            elementCountdown -= static_cast<int64_t>(count);
+            return;
+        }
+        elementCountdown = BUDGET_CHECK_ELEMENTS;
+        if (limits.maxMilliseconds && measure() > limits.maxMilliseconds) {
+            exceed("milliseconds", limits.maxMilliseconds, atLine);
+            throw error();
+        }
+    }
+
+    // Throws when building an array of 'size' elements at 'atLine', while array
+    // variables hold 'held', would go over the element limit; called before allocating
+    void checkArraySize(uint64_t held, uint64_t size, int atLine) {
+        if (limits.maxArrayElements && held + size > limits.maxArrayElements) {
+            exceed("array elements", limits.maxArrayElements, atLine);
+            throw error();
+        }
+    }
+
+    // Called before a print of 'bytes' bytes at 'atLine'. False, with the reason
+    // recorded for error(), if it would take the output over the limit; the print must
+    // then not be written. Never throws, so compiled code can call it.
+    bool outputFits(uint64_t bytes, int atLine) {
+        if (limits.maxOutputBytes && out.bytesWritten() + bytes > limits.maxOutputBytes)
+            return exceed("output bytes", limits.maxOutputBytes, atLine);
+        return true;
+    }
+
+    // Throws when a print of 'bytes' bytes at 'node' would take the output over the
+    // limit; called before writing it
+    void checkOutput(uint64_t bytes, ASTNode* node) {
+        if (!outputFits(bytes, node->lineNumber))
+            throw error();
+    }
+
+    // The error for the limit refill() reported, with the counters at that point
+    BudgetExceeded error() {
+        measure();
+        return BudgetExceeded("Execution limit exceeded: more than " + std::to_string(limit) + " " + exceeded + " at line " +
+                              std::to_string(line) + " (" + std::to_string(iterations()) + " iterations, " +
+                              std::to_string(elapsed) + " ms, " + std::to_string(out.bytesWritten()) + " output bytes, " +
+                              std::to_string(variables) + " variables)");
+    }
+};
+
+#endif // EXECUTION_BUDGET_H
@@ -0,0 +1,482 @@
+#ifndef FAST_LEXER_H
+#define FAST_LEXER_H
+
+#include "Lexer.h"
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FAST_LEXER_X86 1
+#endif
+
+// Drop-in replacement for Lexer that produces the same tokens, line numbers and errors
+// (Lexer stays as the reference; suite_bench --verify-lexer compares the two).
+//
+// Every byte is classified with one 256-entry table lookup instead of the isspace /
+// isalpha / isalnum calls, and the token loop walks a plain pointer: there is no
+// per-character bounds check or newline test. Whitespace, identifier and digit runs
+// are scanned 16 (SSE2) or 32 (AVX2) bytes at a time, and the newlines inside a
+// whitespace run are counted from the same comparison. The vector width is chosen once
+// at startup from the CPU; other targets use the table-driven scalar loops.
+// Keywords are found with a perfect hash on the first character and the length, so an
+// identifier costs at most one memcmp.
+
+namespace fastlex {
+
+enum CharClass : uint8_t {
+    C_SPACE = 1,  // isspace: ' ', '\t', '\n', '\v', '\f', '\r'
+    C_ALPHA = 2,  // may start an identifier
+    C_DIGIT = 4,
+    C_IDENT = 8   // may continue an identifier: letters, digits and '_'
+};
+
+struct CharTable {
+    uint8_t classes[256];
+
+    CharTable() {
+        std::memset(classes, 0, sizeof(classes));
+        const char* spaces = " \t\n\v\f\r";
+        for (const char* c = spaces; *c; c++)
+            classes[static_cast<unsigned char>(*c)] = C_SPACE;
+        for (int c = 'a'; c <= 'z'; c++) {
+            classes[c] = C_ALPHA | C_IDENT;
+            classes[c - 'a' + 'A'] = C_ALPHA | C_IDENT;
+        }
+        for (int c = '0'; c <= '9'; c++)
+            classes[c] = C_DIGIT | C_IDENT;
+        classes[static_cast<unsigned char>('_')] = C_IDENT;
+    }
+};
+
+inline const uint8_t* charClasses() {
+    static const CharTable table;
+    return table.classes;
+}
+
+// Run scanners: each returns the first byte in [p, end) outside its class, or end.
+// skipSpace also adds the number of newlines it skipped to 'lines'.
+typedef const char* (*SpaceScanner)(const char* p, const char* end, int& lines);
+typedef const char* (*RunScanner)(const char* p, const char* end);
+
+inline const char* skipSpaceScalar(const char* p, const char* end, int& lines) {
+    const uint8_t* classes = charClasses();
+    while (p < end && (classes[static_cast<unsigned char>(*p)] & C_SPACE)) {
+        lines += *p == '\n';
+        p++;
+    }
+    return p;
+}
+
+inline const char* scanIdentScalar(const char* p, const char* end) {
+    const uint8_t* classes = charClasses();
+    while (p < end && (classes[static_cast<unsigned char>(*p)] & C_IDENT))
+        p++;
+    return p;
+}
+
+inline const char* scanDigitsScalar(const char* p, const char* end) {
+    while (p < end && static_cast<unsigned char>(*p - '0') <= 9)
+        p++;
+    return p;
+}
+
+#ifdef FAST_LEXER_X86
+
+// Byte-wise "x <= limit" on unsigned bytes
+inline __m128i atMost16(__m128i x, uint8_t limit) {
+    __m128i bound = _mm_set1_epi8(static_cast<char>(limit));
+    return _mm_cmpeq_epi8(_mm_min_epu8(x, bound), x);
+}
+
+inline __m128i spaceMask16(__m128i c) {
+    __m128i controls = atMost16(_mm_sub_epi8(c, _mm_set1_epi8('\t')), '\r' - '\t');
+    return _mm_or_si128(controls, _mm_cmpeq_epi8(c, _mm_set1_epi8(' ')));
+}
+
+inline __m128i digitMask16(__m128i c) {
+    return atMost16(_mm_sub_epi8(c, _mm_set1_epi8('0')), 9);
+}
+
+inline __m128i identMask16(__m128i c) {
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i letter = atMost16(_mm_sub_epi8(lower, _mm_set1_epi8('a')), 'z' - 'a');
+    __m128i underscore = _mm_cmpeq_epi8(c, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letter, underscore), digitMask16(c));
+}
+
+inline const char* skipSpaceSse2(const char* p, const char* end, int& lines) {
+    while (end - p >= 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned int outside = ~static_cast<unsigned int>(_mm_movemask_epi8(spaceMask16(c))) & 0xFFFFu;
+        unsigned int newlines = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n'))));
+        if (outside) {
+            int stop = __builtin_ctz(outside);
+            lines += __builtin_popcount(newlines & ((1u << stop) - 1));
+            return p + stop;
+        }
+        lines += __builtin_popcount(newlines);
+        p += 16;
+    }
+    return skipSpaceScalar(p, end, lines);
+}
+
+inline const char* scanIdentSse2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned int outside = ~static_cast<unsigned int>(_mm_movemask_epi8(identMask16(c))) & 0xFFFFu;
+        if (outside)
+            return p + __builtin_ctz(outside);
+        p += 16;
+    }
+    return scanIdentScalar(p, end);
+}
+
+inline const char* scanDigitsSse2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned int outside = ~static_cast<unsigned int>(_mm_movemask_epi8(digitMask16(c))) & 0xFFFFu;
+        if (outside)
+            return p + __builtin_ctz(outside);
+        p += 16;
+    }
+    return scanDigitsScalar(p, end);
+}
+
+#define FAST_LEXER_AVX2 __attribute__((target("avx2,popcnt")))
+
+FAST_LEXER_AVX2 inline __m256i atMost32(__m256i x, uint8_t limit) {
+    __m256i bound = _mm256_set1_epi8(static_cast<char>(limit));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(x, bound), x);
+}
+
+FAST_LEXER_AVX2 inline __m256i digitMask32(__m256i c) {
+    return atMost32(_mm256_sub_epi8(c, _mm256_set1_epi8('0')), 9);
+}
+
+FAST_LEXER_AVX2 inline const char* skipSpaceAvx2(const char* p, const char* end, int& lines) {
+    while (end - p >= 32) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i controls = atMost32(_mm256_sub_epi8(c, _mm256_set1_epi8('\t')), '\r' - '\t');
+        __m256i space = _mm256_or_si256(controls, _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')));
+        uint32_t outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(space));
+        uint32_t newlines = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'))));
+        if (outside) {
+            int stop = __builtin_ctz(outside);
+            lines += __builtin_popcount(newlines & ((1u << stop) - 1));
+            return p + stop;
+        }
+        lines += __builtin_popcount(newlines);
+        p += 32;
+    }
+    return skipSpaceSse2(p, end, lines);
+}
+
+FAST_LEXER_AVX2 inline const char* scanIdentAvx2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+        __m256i letter = atMost32(_mm256_sub_epi8(lower, _mm256_set1_epi8('a')), 'z' - 'a');
+        __m256i underscore = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_'));
+        __m256i ident = _mm256_or_si256(_mm256_or_si256(letter, underscore), digitMask32(c));
+        uint32_t outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(ident));
+        if (outside)
+            return p + __builtin_ctz(outside);
+        p += 32;
+    }
+    return scanIdentSse2(p, end);
+}
+
+FAST_LEXER_AVX2 inline const char* scanDigitsAvx2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t outside = ~static_cast<uint32_t>(_mm256_movemask_epi8(digitMask32(c)));
+        if (outside)
+            return p + __builtin_ctz(outside);
+        p += 32;
+    }
+    return scanDigitsSse2(p, end);
+}
+
+#endif // FAST_LEXER_X86
+
+enum ScanLevel {
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+};
+
+inline const char* scanLevelName(ScanLevel level) {
+    switch (level) {
+        case SCAN_SSE2: return "sse2";
+        case SCAN_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+// The widest scanner set this CPU supports
+inline ScanLevel detectScanLevel() {
+#ifdef FAST_LEXER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return SCAN_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SCAN_SSE2;
+#endif
+    return SCAN_SCALAR;
+}
+
+struct Scanners {
+    SpaceScanner skipSpace;
+    RunScanner scanIdent;
+    RunScanner scanDigits;
+    ScanLevel level;
+
+    explicit Scanners(ScanLevel requested) {
+        level = SCAN_SCALAR;
+        skipSpace = &skipSpaceScalar;
+        scanIdent = &scanIdentScalar;
+        scanDigits = &scanDigitsScalar;
+#ifdef FAST_LEXER_X86
+        ScanLevel supported = detectScanLevel();
+        if (requested > supported)
+            requested = supported;
+        if (requested == SCAN_AVX2) {
+            skipSpace = &skipSpaceAvx2;
+            scanIdent = &scanIdentAvx2;
+            scanDigits = &scanDigitsAvx2;
+            level = SCAN_AVX2;
+        } else if (requested == SCAN_SSE2) {
+            skipSpace = &skipSpaceSse2;
+            scanIdent = &scanIdentSse2;
+            scanDigits = &scanDigitsSse2;
+            level = SCAN_SSE2;
+        }
+#else
+        (void)requested;
+#endif
+    }
+};
+
+// Chosen once, on first use
+inline const Scanners& defaultScanners() {
+    static const Scanners scanners(SCAN_AVX2);
+    return scanners;
+}
+
+// Perfect hash of the keywords: (first character + length) & 7 is distinct for
+// if (3), else (1), while (4) and print (5)
+inline TokenType keywordType(const char* text, uint32_t length) {
+    struct Keyword {
+        const char* text;
+        uint32_t length;
+        TokenType type;
+    };
+    static const Keyword keywords[8] = {
+        {"", 0, T_IDENTIFIER},
+        {"else", 4, T_ELSE},
+        {"", 0, T_IDENTIFIER},
+        {"if", 2, T_IF},
+        {"while", 5, T_WHILE},
+        {"print", 5, T_PRINT},
+        {"", 0, T_IDENTIFIER},
+        {"", 0, T_IDENTIFIER},
+    };
+    const Keyword& keyword = keywords[(static_cast<unsigned char>(text[0]) + length) & 7];
+    if (keyword.length == length && std::memcmp(text, keyword.text, length) == 0)
+        return keyword.type;
+    return T_IDENTIFIER;
+}
+
+} // namespace fastlex
+
+class FastLexer {
+private:
+    const char* input;
+    size_t length;
+    int firstLine;
+    const fastlex::Scanners& scanners;
+
+    static const int SHORT_RUN = 8;
+
+    FastLexer(const FastLexer&);
+    FastLexer& operator=(const FastLexer&);
+
+    static Token makeToken(TokenType type, const char* start, const char* end, int line, OpKind op = O_NONE) {
+        Token token;
+        token.text = start;
+        token.length = static_cast<uint32_t>(end - start);
+        token.lineNumber = line;
+        token.number = 0;
+        token.type = type;
+        token.op = op;
+        token.overflow = false;
+        return token;
+    }
+
+    // Scans up to SHORT_RUN bytes of a run with the table, then hands over to scan
+    static const char* scanShort(const char* p, const char* end, uint8_t cls, fastlex::RunScanner scan) {
+        const uint8_t* classes = fastlex::charClasses();
+        const char* limit = end - p > SHORT_RUN ? p + SHORT_RUN : end;
+        while (p < limit && (classes[static_cast<unsigned char>(*p)] & cls))
+            p++;
+        return p == limit && p < end ? scan(p, end) : p;
+    }
+
+    // Same arithmetic as Lexer::number, including where an overflowing literal restarts
+    static void numberValue(Token& token) {
+        const char* p = token.text;
+        if (token.length <= 9) {
+            int value = 0;
+            for (uint32_t i = 0; i < token.length; i++)
+                value = value * 10 + (p[i] - '0');
+            token.number = value;
+            return;
+        }
+        long long value = 0;
+        for (uint32_t i = 0; i < token.length; i++) {
+            value = value * 10 + (p[i] - '0');
+            if (value > INT_MAX) {
+                token.overflow = true;
+                value = 0;
+            }
+        }
+        token.number = static_cast<int>(value);
+    }
+
+public:
+    FastLexer(const char* input, size_t length, int firstLine = 1)
+        : input(input), length(length), firstLine(firstLine), scanners(fastlex::defaultScanners()) {}
+
+    // The string is referenced, not copied: it must outlive the lexer and its tokens
+    explicit FastLexer(const std::string& input)
+        : input(input.data()), length(input.size()), firstLine(1), scanners(fastlex::defaultScanners()) {}
+
+    // Pins the scanners to one vector width (capped at what the CPU supports)
+    FastLexer(const char* input, size_t length, const fastlex::Scanners& scanners)
+        : input(input), length(length), firstLine(1), scanners(scanners) {}
+
+    // Where and why lexRange stopped
+    enum StopReason {
+        STOP_END,
+        STOP_NUL,    // a NUL byte, which ends the input like it does for Lexer
+        STOP_UNKNOWN // a character no token starts with
+    };
+
+    struct Stop {
+        const char* at; // end of the range, the NUL byte or the unknown character
+        int line;       // line number at that point
+        StopReason reason;
+    };
+
+    static Token endToken(const char* at, int line) {
+        return makeToken(T_EOF, at, at, line);
+    }
+
+    static std::string unknownCharacterMessage(const Stop& stop) {
+        return "Unknown character '" + std::string(1, *stop.at) + "' at line " + std::to_string(stop.line);
+    }
+
+    // Passes the tokens of [begin, end) to tokens.enqueue(), numbering lines from 'line',
+    // and reports where it stopped instead of throwing or adding T_EOF. This is the
+    // whole lexer; ParallelLexer runs it on several ranges at once, with sinks that
+    // count tokens or write them straight into place.
+    template <typename Sink>
+    Stop lexRange(Sink& tokens, const char* begin, const char* end, int line) const {
+        const uint8_t* classes = fastlex::charClasses();
+        const char* p = begin;
+        while (p < end) {
+            uint8_t cls = classes[static_cast<unsigned char>(*p)];
+            // Most runs are a few bytes long: handle those inline and leave the long
+            // ones (indentation, long names and literals) to the vector scanners
+            if (cls & fastlex::C_SPACE) {
+                line += *p == '\n';
+                p++;
+                if (p < end && (classes[static_cast<unsigned char>(*p)] & fastlex::C_SPACE))
+                    p = scanners.skipSpace(p, end, line);
+                continue;
+            }
+            if (cls & fastlex::C_ALPHA) {
+                const char* start = p;
+                p = scanShort(p + 1, end, fastlex::C_IDENT, scanners.scanIdent);
+                Token token = makeToken(T_IDENTIFIER, start, p, line);
+                if (token.length <= 5)
+                    token.type = fastlex::keywordType(start, token.length);
+                tokens.enqueue(token);
+                continue;
+            }
+            if (cls & fastlex::C_DIGIT) {
+                const char* start = p;
+                p = scanShort(p + 1, end, fastlex::C_DIGIT, scanners.scanDigits);
+                Token token = makeToken(T_NUMBER, start, p, line);
+                numberValue(token);
+                tokens.enqueue(token);
+                continue;
+            }
+            char next = p + 1 < end ? p[1] : '\0';
+            TokenType type = T_OPERATOR;
+            OpKind op = O_NONE;
+            size_t width = 1;
+            switch (*p) {
+                case '+': op = O_ADD; break;
+                case '-': op = O_SUB; break;
+                case '*': op = O_MUL; break;
+                case '/': op = O_DIV; break;
+                case '%': op = O_MOD; break;
+                case '=':
+                    if (next == '=') {
+                        op = O_EQ;
+                        width = 2;
+                    } else {
+                        type = T_ASSIGN;
+                    }
+                    break;
+                case '!':
+                    op = next == '=' ? O_NE : O_NOT;
+                    width = next == '=' ? 2 : 1;
+                    break;
+                case '<':
+                    op = next == '=' ? O_LE : O_LT;
+                    width = next == '=' ? 2 : 1;
+                    break;
+                case '>':
+                    op = next == '=' ? O_GE : O_GT;
+                    width = next == '=' ? 2 : 1;
+                    break;
+                case ';': type = T_SEMICOLON; break;
+                case '(': type = T_LPAREN; break;
+                case ')': type = T_RPAREN; break;
+                case '{': type = T_LBRACE; break;
+                case '}': type = T_RBRACE; break;
+                case '[': type = T_LBRACKET; break;
+                case ']': type = T_RBRACKET; break;
+                case ',': type = T_COMMA; break;
+                default: {
+                    Stop stop = {p, line, *p == '\0' ? STOP_NUL : STOP_UNKNOWN};
+                    return stop;
+                }
+            }
+            tokens.enqueue(makeToken(type, p, p + width, line, op));
+            p += width;
+        }
+        Stop stop = {p, line, STOP_END};
+        return stop;
+    }
+
+    Queue<Token> generateTokens() {
+        Queue<Token> tokens;
+        // Source code has a token every few bytes; capacity that is never filled is
+        // never touched, so over-reserving costs address space, not memory
+        tokens.reserve(length / 2 + 1);
+        Stop stop = lexRange(tokens, input, input + length, firstLine);
+        if (stop.reason == STOP_UNKNOWN)
+            throw std::runtime_error(unknownCharacterMessage(stop));
+        tokens.enqueue(endToken(stop.at, stop.line));
+        return tokens;
+    }
+};
+
+#endif // FAST_LEXER_H
@@ -0,0 +1,323 @@
+#ifndef FLATAST_H
+#define FLATAST_H
+
+#include "Parser.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <stdexcept>
+
+// Flat AST: an alternative to the pointer-linked ASTNode tree.
+// All nodes live contiguously in one vector and refer to their children by 32-bit
+// index. Identifier names and block child lists are kept in side tables, so the whole
+// tree is a handful of allocations and tearing it down is O(1) in the number of nodes.
+
+typedef uint32_t NodeIndex;
+const NodeIndex NO_NODE = 0xFFFFFFFFu;
+
+// Operand meaning per node type:
+//   N_NUMBER    a = value
+//   N_VARIABLE  a = nameId
+//   N_BIN_OP    a = left, b = right, op
+//   N_UNARY_OP  a = operand, op
+//   N_ASSIGN    a = nameId, b = value
+//   N_PRINT     a = expression
+//   N_IF        a = condition, b = true branch, c = false branch or NO_NODE
+//   N_WHILE     a = condition, b = body
+//   N_BLOCK     a = offset into FlatAST::lists, b = statement count
+//   N_INDEX     a = array, b = index
+//   N_INDEX_ASSIGN  a = target variable, b = index, c = value
+//   N_CALL      a = argument, op = Builtin
+//   N_ARRAY_LITERAL a = offset into FlatAST::lists, b = element count
+struct FlatNode {
+    uint8_t type;  // NodeType
+    uint8_t op;    // OpKind, or Builtin for N_CALL
+    int32_t lineNumber;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+// Read-only view of a flat tree's arrays. A FlatAST provides one over its vectors; a
+// cached program (ProgramCache.h) provides one straight over its memory-mapped image.
+struct FlatView {
+    const FlatNode* nodes;
+    const NodeIndex* lists;
+    const char* nameChars;
+    const uint32_t* nameOffsets;
+    uint32_t nameCount;
+    NodeIndex root;
+
+    std::string name(uint32_t nameId) const {
+        return std::string(nameChars + nameOffsets[nameId], nameOffsets[nameId + 1] - nameOffsets[nameId]);
+    }
+};
+
+class FlatAST {
+public:
+    std::vector<FlatNode> nodes;
+    std::vector<NodeIndex> lists;       // block children and array elements, each run is contiguous
+    std::string nameChars;              // identifier characters, back to back
+    std::vector<uint32_t> nameOffsets;  // nameId -> [nameOffsets[id], nameOffsets[id + 1])
+    NodeIndex root;
+
+    FlatAST() : root(NO_NODE) {
+        nameOffsets.push_back(0);
+    }
+
+    size_t nameCount() const {
+        return nameOffsets.size() - 1;
+    }
+
+    std::string name(uint32_t nameId) const {
+        return nameChars.substr(nameOffsets[nameId], nameOffsets[nameId + 1] - nameOffsets[nameId]);
+    }
+
+    FlatView view() const {
+        FlatView view = {nodes.data(), lists.data(), nameChars.data(), nameOffsets.data(),
+                         static_cast<uint32_t>(nameCount()), root};
+        return view;
+    }
+
+    // Bytes held by the tree (capacity, not just size), excluding the intern map used while building
+    size_t memoryBytes() const {
+        return nodes.capacity() * sizeof(FlatNode) + lists.capacity() * sizeof(NodeIndex) +
+               nameChars.capacity() + nameOffsets.capacity() * sizeof(uint32_t) + sizeof(FlatAST);
+    }
+};
+
+// FlatBuilder lets BasicParser (Parser.h) build straight into a FlatAST
+class FlatBuilder {
+private:
+    FlatAST* ast;
+    std::unordered_map<std::string, uint32_t>* nameIds;
+    std::vector<NodeIndex>* pending; // statements of the blocks still being parsed
+
+    NodeIndex add(NodeType type, OpKind op, int lineNumber, uint32_t a, uint32_t b = NO_NODE, uint32_t c = NO_NODE) {
+        FlatNode node = {static_cast<uint8_t>(type), static_cast<uint8_t>(op), lineNumber, a, b, c};
+        ast->nodes.push_back(node);
+        return static_cast<NodeIndex>(ast->nodes.size() - 1);
+    }
+
+    uint32_t intern(const std::string& name) {
+        std::unordered_map<std::string, uint32_t>::iterator it = nameIds->find(name);
+        if (it != nameIds->end())
+            return it->second;
+        uint32_t id = static_cast<uint32_t>(ast->nameCount());
+        (*nameIds)[name] = id;
+        ast->nameChars += name;
+        ast->nameOffsets.push_back(static_cast<uint32_t>(ast->nameChars.size()));
+        return id;
+    }
+
+public:
+    typedef NodeIndex Node;
+    struct Block {
+        size_t mark; // size of the pending stack when the block opened
+        int lineNumber;
+    };
+
+    FlatBuilder(FlatAST* ast, std::unordered_map<std::string, uint32_t>* nameIds, std::vector<NodeIndex>* pending)
+        : ast(ast), nameIds(nameIds), pending(pending) {}
+
+    Node none() { return NO_NODE; }
+    Node number(int value, int lineNumber) { return add(N_NUMBER, O_NONE, lineNumber, static_cast<uint32_t>(value)); }
+    Node variable(const std::string& name, int lineNumber) { return add(N_VARIABLE, O_NONE, lineNumber, intern(name)); }
+    Node binaryOp(Node left, OpKind op, Node right, int lineNumber) { return add(N_BIN_OP, op, lineNumber, left, right); }
+    Node unaryOp(OpKind op, Node operand, int lineNumber) { return add(N_UNARY_OP, op, lineNumber, operand); }
+    Node assign(const std::string& name, Node value, int lineNumber) { return add(N_ASSIGN, O_NONE, lineNumber, intern(name), value); }
+    Node print(Node expr, int lineNumber) { return add(N_PRINT, O_NONE, lineNumber, expr); }
+    Node ifStatement(Node cond, Node tBlock, Node fBlock, int lineNumber) { return add(N_IF, O_NONE, lineNumber, cond, tBlock, fBlock); }
+    Node whileStatement(Node cond, Node blk, int lineNumber) { return add(N_WHILE, O_NONE, lineNumber, cond, blk); }
+    Node index(Node array, Node index, int lineNumber) { return add(N_INDEX, O_NONE, lineNumber, array, index); }
+    Node indexAssign(Node target, Node index, Node value, int lineNumber) {
+        return add(N_INDEX_ASSIGN, O_NONE, lineNumber, target, index, value);
+    }
+    Node call(Builtin function, Node argument, int lineNumber) {
+        return add(N_CALL, static_cast<OpKind>(function), lineNumber, argument);
+    }
+
+    Node arrayLiteral(const std::vector<Node>& elements, int lineNumber) {
+        uint32_t offset = static_cast<uint32_t>(ast->lists.size());
+        ast->lists.insert(ast->lists.end(), elements.begin(), elements.end());
+        return add(N_ARRAY_LITERAL, O_NONE, lineNumber, offset, static_cast<uint32_t>(elements.size()));
+    }
+
+    Block beginBlock(int lineNumber) {
+        Block block = {pending->size(), lineNumber};
+        return block;
+    }
+
+    void addStatement(Block&, Node stmt) {
+        pending->push_back(stmt);
+    }
+
+    Node endBlock(Block& block) {
+        uint32_t offset = static_cast<uint32_t>(ast->lists.size());
+        uint32_t count = static_cast<uint32_t>(pending->size() - block.mark);
+        ast->lists.insert(ast->lists.end(), pending->begin() + block.mark, pending->end());
+        pending->resize(block.mark);
+        return add(N_BLOCK, O_NONE, block.lineNumber, offset, count);
+    }
+};
+
+// Parses a token queue directly into a FlatAST, consuming the tokens. FlatInterpreter
+// recurses, so trees deeper than depthLimit are rejected.
+inline void parseFlat(Queue<Token>&& tokens, FlatAST& ast, int depthLimit = RECURSIVE_DEPTH_LIMIT) {
+    std::unordered_map<std::string, uint32_t> nameIds;
+    std::vector<NodeIndex> pending;
+    BasicParser<FlatBuilder> parser(std::move(tokens), FlatBuilder(&ast, &nameIds, &pending));
+    parser.setDepthLimit(depthLimit);
+    ast.root = parser.parse();
+}
+
+// Replays a pointer-linked tree into any builder, e.g. FlatBuilder to flatten an optimized tree
+template <typename Builder>
+typename Builder::Node replayTree(ASTNode* node, Builder& builder) {
+    if (!node)
+        return builder.none();
+    switch (node->type) {
+        case N_NUMBER:
+            return builder.number(static_cast<NumberNode*>(node)->value, node->lineNumber);
+        case N_VARIABLE:
+            return builder.variable(static_cast<VariableNode*>(node)->name, node->lineNumber);
+        case N_BIN_OP: {
+            BinOpNode* binOp = static_cast<BinOpNode*>(node);
+            typename Builder::Node left = replayTree(binOp->left, builder);
+            typename Builder::Node right = replayTree(binOp->right, builder);
+            return builder.binaryOp(left, binOp->op, right, node->lineNumber);
+        }
+        case N_UNARY_OP: {
+            UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+            return builder.unaryOp(unaryOp->op, replayTree(unaryOp->operand, builder), node->lineNumber);
+        }
+        case N_ASSIGN: {
+            AssignNode* assign = static_cast<AssignNode*>(node);
+            return builder.assign(assign->name, replayTree(assign->value, builder), node->lineNumber);
+        }
+        case N_PRINT:
+            return builder.print(replayTree(static_cast<PrintNode*>(node)->expression, builder), node->lineNumber);
+        case N_IF: {
+            IfNode* ifNode = static_cast<IfNode*>(node);
+            typename Builder::Node condition = replayTree(ifNode->condition, builder);
+            typename Builder::Node trueBlock = replayTree(ifNode->trueBlock, builder);
+            typename Builder::Node falseBlock = replayTree(ifNode->falseBlock, builder);
+            return builder.ifStatement(condition, trueBlock, falseBlock, node->lineNumber);
+        }
+        case N_WHILE: {
+            WhileNode* whileNode = static_cast<WhileNode*>(node);
+            typename Builder::Node condition = replayTree(whileNode->condition, builder);
+            return builder.whileStatement(condition, replayTree(whileNode->block, builder), node->lineNumber);
+        }
+        case N_BLOCK: {
+            BlockNode* blockNode = static_cast<BlockNode*>(node);
+            typename Builder::Block block = builder.beginBlock(node->lineNumber);
+            for (ASTNode* stmt : blockNode->statements)
+                builder.addStatement(block, replayTree(stmt, builder));
+            return builder.endBlock(block);
+        }
+        case N_INDEX: {
+            IndexNode* indexNode = static_cast<IndexNode*>(node);
+            typename Builder::Node array = replayTree(indexNode->array, builder);
+            return builder.index(array, replayTree(indexNode->index, builder), node->lineNumber);
+        }
+        case N_INDEX_ASSIGN: {
+            IndexAssignNode* store = static_cast<IndexAssignNode*>(node);
+            typename Builder::Node target = replayTree(store->target, builder);
+            typename Builder::Node index = replayTree(store->index, builder);
+            typename Builder::Node value = replayTree(store->value, builder);
+            return builder.indexAssign(target, index, value, node->lineNumber);
+        }
+        case N_CALL: {
+            CallNode* call = static_cast<CallNode*>(node);
+            return builder.call(call->function, replayTree(call->argument, builder), node->lineNumber);
+        }
+        case N_ARRAY_LITERAL: {
+            std::vector<typename Builder::Node> elements;
+            for (ASTNode* element : static_cast<ArrayLiteralNode*>(node)->elements)
+                elements.push_back(replayTree(element, builder));
+            return builder.arrayLiteral(elements, node->lineNumber);
+        }
+        default:
+            throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+    }
+}
+
+// Replays a flat tree into any builder, e.g. TreeBuilder to get a pointer-linked tree back
+template <typename Builder>
+typename Builder::Node replayFlat(const FlatView& ast, NodeIndex index, Builder& builder) {
+    if (index == NO_NODE)
+        return builder.none();
+    const FlatNode& node = ast.nodes[index];
+    OpKind op = static_cast<OpKind>(node.op);
+    switch (node.type) {
+        case N_NUMBER:
+            return builder.number(static_cast<int>(node.a), node.lineNumber);
+        case N_VARIABLE:
+            return builder.variable(ast.name(node.a), node.lineNumber);
+        case N_BIN_OP: {
+            typename Builder::Node left = replayFlat(ast, node.a, builder);
+            typename Builder::Node right = replayFlat(ast, node.b, builder);
+            return builder.binaryOp(left, op, right, node.lineNumber);
+        }
+        case N_UNARY_OP:
+            return builder.unaryOp(op, replayFlat(ast, node.a, builder), node.lineNumber);
+        case N_ASSIGN:
+            return builder.assign(ast.name(node.a), replayFlat(ast, node.b, builder), node.lineNumber);
+        case N_PRINT:
+            return builder.print(replayFlat(ast, node.a, builder), node.lineNumber);
+        case N_IF: {
+            typename Builder::Node condition = replayFlat(ast, node.a, builder);
+            typename Builder::Node trueBlock = replayFlat(ast, node.b, builder);
+            typename Builder::Node falseBlock = replayFlat(ast, node.c, builder);
+            return builder.ifStatement(condition, trueBlock, falseBlock, node.lineNumber);
+        }
+        case N_WHILE: {
+            typename Builder::Node condition = replayFlat(ast, node.a, builder);
+            return builder.whileStatement(condition, replayFlat(ast, node.b, builder), node.lineNumber);
+        }
+        case N_BLOCK: {
+            typename Builder::Block block = builder.beginBlock(node.lineNumber);
+            for (uint32_t i = 0; i < node.b; i++)
+                builder.addStatement(block, replayFlat(ast, ast.lists[node.a + i], builder));
+            return builder.endBlock(block);
+        }
+        case N_INDEX: {
+            typename Builder::Node array = replayFlat(ast, node.a, builder);
+            return builder.index(array, replayFlat(ast, node.b, builder), node.lineNumber);
+        }
+        case N_INDEX_ASSIGN: {
+            typename Builder::Node target = replayFlat(ast, node.a, builder);
+            typename Builder::Node index = replayFlat(ast, node.b, builder);
+            typename Builder::Node value = replayFlat(ast, node.c, builder);
+            return builder.indexAssign(target, index, value, node.lineNumber);
+        }
+        case N_CALL:
+            return builder.call(static_cast<Builtin>(node.op), replayFlat(ast, node.a, builder), node.lineNumber);
+        case N_ARRAY_LITERAL: {
+            std::vector<typename Builder::Node> elements;
+            for (uint32_t i = 0; i < node.b; i++)
+                elements.push_back(replayFlat(ast, ast.lists[node.a + i], builder));
+            return builder.arrayLiteral(elements, node.lineNumber);
+        }
+        default:
+            throw std::runtime_error("Unknown node type at line " + std::to_string(node.lineNumber));
+    }
+}
+
+// Flattens a pointer-linked tree into an empty FlatAST
+inline void flattenTree(ASTNode* root, FlatAST& ast) {
+    std::unordered_map<std::string, uint32_t> nameIds;
+    std::vector<NodeIndex> pending;
+    FlatBuilder builder(&ast, &nameIds, &pending);
+    ast.root = replayTree(root, builder);
+}
+
+// Builds a pointer-linked tree from a flat one; the caller owns the result
+inline ASTNode* unflattenTree(const FlatView& ast) {
+    TreeBuilder builder;
+    return replayFlat(ast, ast.root, builder);
+}
+
+#endif // FLATAST_H
@@ -0,0 +1,119 @@
+#ifndef FLATINTERPRETER_H
+#define FLATINTERPRETER_H
+
+#include "FlatAST.h"
+#include "OutputSink.h"
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+// Tree-walking interpreter over a FlatAST, or any FlatView such as a cached image. Mirrors Interpreter node for node; variables
+// are indexed directly by the interned nameId.
+class FlatInterpreter {
+private:
+    FlatView ast;
+    OutputSink& out;
+    const FlatNode* nodes;
+    std::vector<int> variables;
+    std::vector<char> defined;
+
+    std::string lineSuffix(const FlatNode& node) const {
+        return " at line " + std::to_string(node.lineNumber);
+    }
+
+    int visit(NodeIndex index) {
+        const FlatNode& node = nodes[index];
+        switch (node.type) {
+            case N_NUMBER:
+                return static_cast<int>(node.a);
+            case N_VARIABLE:
+                if (!defined[node.a])
+                    throw std::runtime_error("Undefined variable '" + ast.name(node.a) + "'" + lineSuffix(node));
+                return variables[node.a];
+            case N_BIN_OP:
+                return visitBinOp(node);
+            case N_UNARY_OP: {
+                int operand = visit(node.a);
+                switch (node.op) {
+                    case O_ADD: return operand;
+                    case O_SUB: return -operand;
+                    case O_NOT: return !operand;
+                    default:
+                        throw std::runtime_error(std::string("Unknown operator '") + opKindToString(static_cast<OpKind>(node.op)) + "'" + lineSuffix(node));
+                }
+            }
+            case N_ASSIGN: {
+                int value = visit(node.b);
+                variables[node.a] = value;
+                defined[node.a] = 1;
+                return value;
+            }
+            case N_PRINT: {
+                int value = visit(node.a);
+                out.printInt(value);
+                return value;
+            }
+            case N_IF:
+                if (visit(node.a))
+                    visit(node.b);
+                else if (node.c != NO_NODE)
+                    visit(node.c);
+                return 0;
+            case N_WHILE:
+                while (visit(node.a))
+                    visit(node.b);
+                return 0;
+            case N_BLOCK: {
+                const NodeIndex* stmt = ast.lists + node.a;
+                for (uint32_t i = 0; i < node.b; i++)
+                    visit(stmt[i]);
+                return 0;
+            }
+            case N_INDEX:
+            case N_INDEX_ASSIGN:
+            case N_CALL:
+            case N_ARRAY_LITERAL:
+                throw std::runtime_error("Arrays are only supported by the tree engine" + lineSuffix(node));
+            default:
+                throw std::runtime_error("Unknown node type" + lineSuffix(node));
+        }
+    }
+
+    int visitBinOp(const FlatNode& node) {
+        int left = visit(node.a);
+        int right = visit(node.b);
+        switch (node.op) {
+            case O_ADD: return left + right;
+            case O_SUB: return left - right;
+            case O_MUL: return left * right;
+            case O_DIV:
+                if (right == 0)
+                    throw std::runtime_error("Division by zero" + lineSuffix(node));
+                return left / right;
+            case O_MOD:
+                if (right == 0)
+                    throw std::runtime_error("Modulo by zero" + lineSuffix(node));
+                return left % right;
+            case O_EQ: return left == right;
+            case O_NE: return left != right;
+            case O_LT: return left < right;
+            case O_LE: return left <= right;
+            case O_GT: return left > right;
+            case O_GE: return left >= right;
+            default:
+                throw std::runtime_error(std::string("Unknown operator '") + opKindToString(static_cast<OpKind>(node.op)) + "'" + lineSuffix(node));
+        }
+    }
+
+public:
+    FlatInterpreter(const FlatView& ast, OutputSink& out)
+        : ast(ast), out(out), nodes(ast.nodes), variables(ast.nameCount, 0), defined(ast.nameCount, 0) {}
+
+    FlatInterpreter(const FlatAST& ast, OutputSink& out) : FlatInterpreter(ast.view(), out) {}
+
+    void interpret() {
+        visit(ast.root);
+    }
+};
+
+#endif // FLATINTERPRETER_H
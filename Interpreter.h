@@ -2,16 +2,52 @@
 #define INTERPRETER_H
 
 #include "Parser.h"
-#include <unordered_map>
+#include "Resolver.h"
+#include "OutputSink.h"
+#include "JIT.h"
+#include "ScalarEvolution.h"
+#include "ExecutionBudget.h"
+#include "Profiler.h"
+#include "ArrayKernels.h"
+#include <vector>
 #include <string>
-#include <iostream>
 #include <stdexcept>
-using namespace std;
 
-class Interpreter {
+// The contiguous storage of one array value
+typedef std::vector<int> IntArray;
+
+// Iterations after which a while loop is compiled to native code (see JIT.h)
+const int JIT_THRESHOLD = 1000;
+
+// Tree-walking interpreter. Profile receives statement and loop events (see Profiler.h);
+// the default NoProfiler compiles them away.
+template<class Profile>
+class BasicInterpreter {
 private:
+    // Tier-up state of one while loop
+    struct LoopTier {
+        int iterations; //iterations interpreted so far, -1 once the loop cannot be compiled
+        JitLoop* code;
+        bool analyzed;  //closedForm has been looked for
+        ClosedFormLoop* closedForm;
+        LoopTier() : iterations(0), code(nullptr), analyzed(false), closedForm(nullptr) {}
+    };
+
     ASTNode* root;
-    unordered_map<string, int> variables; //it will store variables as keys and their values as values
+    OutputSink& out;
+    std::vector<int> variables; //values indexed by the frame slots assigned by Resolver
+    std::vector<char> defined;  //defined[slot] is set once the slot has been assigned
+    std::vector<IntArray> arrays; //values of array variables, by slot like 'variables'
+    uint64_t heldElements;        //total length of 'arrays', for the array element limit
+    const arraykernels::Kernels* kernels;
+    bool jit;
+    bool closedForms;
+    std::vector<LoopTier> loops; //indexed by WhileNode::loopIndex
+    Profile* profile;
+    ExecutionBudget* budget;     //nullptr when the run has no limits
+
+    BasicInterpreter(const BasicInterpreter&);
+    BasicInterpreter& operator=(const BasicInterpreter&);
 
     int visit(ASTNode* node) {
         switch (node->type) {
@@ -21,6 +57,8 @@ private:
                 return visitVariableNode(static_cast<VariableNode*>(node));
             case N_BIN_OP:
                 return visitBinOpNode(static_cast<BinOpNode*>(node));
+            case N_UNARY_OP:
+                return visitUnaryOpNode(static_cast<UnaryOpNode*>(node));
             case N_ASSIGN:
                 return visitAssignNode(static_cast<AssignNode*>(node));
             case N_PRINT:
@@ -31,58 +69,260 @@ private:
                 return visitWhileNode(static_cast<WhileNode*>(node));
             case N_BLOCK:
                 return visitBlockNode(static_cast<BlockNode*>(node));
+            case N_INDEX:
+                return visitIndexNode(static_cast<IndexNode*>(node));
+            case N_INDEX_ASSIGN:
+                return visitIndexAssignNode(static_cast<IndexAssignNode*>(node));
+            case N_CALL:
+                return visitCallNode(static_cast<CallNode*>(node));
             default:
-                throw runtime_error("Unknown node type at line " + to_string(node->lineNumber));
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
         }
     }
 
     int visitVariableNode(VariableNode* node) {
-        const string& varName = node->name;
-        if (variables.find(varName) == variables.end())
-            throw runtime_error("Undefined variable '" + varName + "' at line " + to_string(node->lineNumber));
-        return variables[varName];
+        if (node->checked && !defined[node->slot])
+            throw std::runtime_error("Undefined variable '" + node->name + "' at line " + std::to_string(node->lineNumber));
+        return variables[node->slot];
+    }
+
+    // Arrays
+
+    IntArray& arrayVariable(VariableNode* node) {
+        if (node->checked && !defined[node->slot])
+            throw std::runtime_error("Undefined variable '" + node->name + "' at line " + std::to_string(node->lineNumber));
+        return arrays[node->slot];
+    }
+
+    // An array operand: a variable is used in place, anything else is evaluated into scratch
+    const IntArray& arrayOperand(ASTNode* node, IntArray& scratch) {
+        if (node->type == N_VARIABLE)
+            return arrayVariable(static_cast<VariableNode*>(node));
+        evaluateArray(node, scratch);
+        return scratch;
+    }
+
+    // Charges array work of 'count' elements at 'node' to the budget; 'allocates' when
+    // an array of that length is about to be built
+    void arrayWork(size_t count, ASTNode* node, bool allocates) {
+        if (!budget)
+            return;
+        if (allocates)
+            budget->checkArraySize(heldElements, count, node->lineNumber);
+        budget->chargeElements(count, node->lineNumber);
+    }
+
+    size_t elementIndex(const IntArray& array, int index, ASTNode* node) {
+        if (index < 0 || static_cast<size_t>(index) >= array.size())
+            throw std::runtime_error("Index " + std::to_string(index) + " is out of bounds for an array of length " +
+                                     std::to_string(array.size()) + " at line " + std::to_string(node->lineNumber));
+        return static_cast<size_t>(index);
+    }
+
+    // Evaluates an array-valued expression (ASTNode::isArray) into result, which must
+    // not be the storage of a variable the expression reads
+    void evaluateArray(ASTNode* node, IntArray& result) {
+        switch (node->type) {
+            case N_VARIABLE: {
+                const IntArray& source = arrayVariable(static_cast<VariableNode*>(node));
+                arrayWork(source.size(), node, true);
+                result = source;
+                break;
+            }
+            case N_ARRAY_LITERAL: {
+                std::vector<ASTNode*>& elements = static_cast<ArrayLiteralNode*>(node)->elements;
+                arrayWork(elements.size(), node, true);
+                result.resize(elements.size());
+                for (size_t i = 0; i < elements.size(); i++)
+                    result[i] = visit(elements[i]);
+                break;
+            }
+            case N_CALL: {
+                CallNode* call = static_cast<CallNode*>(node);
+                if (call->function != B_ARRAY)
+                    throw std::runtime_error(std::string(builtinName(call->function)) + "() does not return an array at line " + std::to_string(node->lineNumber));
+                int size = visit(call->argument);
+                if (size < 0)
+                    throw std::runtime_error("Array size " + std::to_string(size) + " is negative at line " + std::to_string(node->lineNumber));
+                arrayWork(static_cast<size_t>(size), node, true);
+                result.assign(static_cast<size_t>(size), 0);
+                break;
+            }
+            case N_BIN_OP:
+                evaluateArrayBinOp(static_cast<BinOpNode*>(node), result);
+                break;
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                if (unaryOp->op == O_ADD) {
+                    evaluateArray(unaryOp->operand, result);
+                    break;
+                }
+                // -a is 0 - a and !a is a == 0, elementwise
+                IntArray scratch;
+                const IntArray& operand = arrayOperand(unaryOp->operand, scratch);
+                int zero = 0;
+                arrayWork(operand.size(), node, true);
+                result.resize(operand.size());
+                if (unaryOp->op == O_SUB)
+                    kernels->binary[O_SUB][arraykernels::SCALAR_ARRAY](&zero, operand.data(), result.data(), operand.size());
+                else if (unaryOp->op == O_NOT)
+                    kernels->binary[O_EQ][arraykernels::ARRAY_SCALAR](operand.data(), &zero, result.data(), operand.size());
+                else
+                    throw std::runtime_error(std::string("Unknown operator '") + opKindToString(unaryOp->op) + "' at line " + std::to_string(node->lineNumber));
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+    // Elementwise operation with at least one array operand; a scalar operand is combined
+    // with every element
+    void evaluateArrayBinOp(BinOpNode* node, IntArray& result) {
+        IntArray leftScratch;
+        IntArray rightScratch;
+        int leftValue = 0;
+        int rightValue = 0;
+        const IntArray* left = nullptr;
+        const IntArray* right = nullptr;
+        if (node->left->isArray)
+            left = &arrayOperand(node->left, leftScratch);
+        else
+            leftValue = visit(node->left);
+        if (node->right->isArray)
+            right = &arrayOperand(node->right, rightScratch);
+        else
+            rightValue = visit(node->right);
+
+        arraykernels::Shape shape = arraykernels::ARRAY_ARRAY;
+        if (!right)
+            shape = arraykernels::ARRAY_SCALAR;
+        else if (!left)
+            shape = arraykernels::SCALAR_ARRAY;
+        else if (left->size() != right->size())
+            throw std::runtime_error("Array lengths " + std::to_string(left->size()) + " and " + std::to_string(right->size()) +
+                                     " differ at line " + std::to_string(node->lineNumber));
+        size_t count = left ? left->size() : right->size();
+        arraykernels::BinaryKernel kernel = node->op <= O_GE ? kernels->binary[node->op][shape] : nullptr;
+        if (!kernel)
+            throw std::runtime_error(std::string("Unknown operator '") + opKindToString(node->op) + "' at line " + std::to_string(node->lineNumber));
+        arrayWork(count, node, true);
+        result.resize(count);
+        if (!kernel(left ? left->data() : &leftValue, right ? right->data() : &rightValue, result.data(), count))
+            throw std::runtime_error(std::string(node->op == O_DIV ? "Division" : "Modulo") + " by zero at line " + std::to_string(node->lineNumber));
+    }
+
+    int visitIndexNode(IndexNode* node) {
+        IntArray scratch;
+        const IntArray& array = arrayOperand(node->array, scratch);
+        int index = visit(node->index);
+        return array[elementIndex(array, index, node)];
+    }
+
+    int visitCallNode(CallNode* node) {
+        if (node->function == B_ARRAY)
+            throw std::runtime_error("array() does not return an int at line " + std::to_string(node->lineNumber));
+        IntArray scratch;
+        const IntArray& array = arrayOperand(node->argument, scratch);
+        if (node->function != B_LEN)
+            arrayWork(array.size(), node, false);
+        switch (node->function) {
+            case B_LEN:
+                return static_cast<int>(array.size());
+            case B_SUM:
+                return kernels->sum(array.data(), array.size());
+            case B_MIN:
+            case B_MAX:
+                if (array.empty())
+                    throw std::runtime_error(std::string(builtinName(node->function)) + "() of an empty array at line " + std::to_string(node->lineNumber));
+                return node->function == B_MIN ? kernels->min(array.data(), array.size()) : kernels->max(array.data(), array.size());
+            default:
+                throw std::runtime_error("Unknown function at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+    int visitIndexAssignNode(IndexAssignNode* node) {
+        typename Profile::Scope scope(profile, node);
+        IntArray& array = arrayVariable(node->target);
+        int index = visit(node->index);
+        int value = visit(node->value);
+        array[elementIndex(array, index, node)] = value;
+        return value;
     }
 
     int visitBinOpNode(BinOpNode* node) {
         int left = visit(node->left);
         int right = visit(node->right);
-        const string& op = node->op;
-        if (op == "+") return left + right;
-        if (op == "-") return left - right;
-        if (op == "*") return left * right;
-        if (op == "/") {
-            if (right == 0)
-                throw runtime_error("Division by zero at line " + to_string(node->lineNumber));
-            return left / right;
+        switch (node->op) {
+            case O_ADD: return left + right;
+            case O_SUB: return left - right;
+            case O_MUL: return left * right;
+            case O_DIV:
+                if (right == 0)
+                    throw std::runtime_error("Division by zero at line " + std::to_string(node->lineNumber));
+                return left / right;
+            case O_MOD:
+                if (right == 0)
+                    throw std::runtime_error("Modulo by zero at line " + std::to_string(node->lineNumber));
+                return left % right;
+            case O_EQ: return left == right;
+            case O_NE: return left != right;
+            case O_LT: return left < right;
+            case O_LE: return left <= right;
+            case O_GT: return left > right;
+            case O_GE: return left >= right;
+            default:
+                throw std::runtime_error(std::string("Unknown operator '") + opKindToString(node->op) + "' at line " + std::to_string(node->lineNumber));
         }
-        if (op == "%") {
-            if (right == 0)
-                throw runtime_error("Modulo by zero at line " + to_string(node->lineNumber));
-            return left % right;
+    }
+
+    int visitUnaryOpNode(UnaryOpNode* node) {
+        int operand = visit(node->operand);
+        switch (node->op) {
+            case O_ADD: return operand;
+            case O_SUB: return -operand;
+            case O_NOT: return !operand;
+            default:
+                throw std::runtime_error(std::string("Unknown operator '") + opKindToString(node->op) + "' at line " + std::to_string(node->lineNumber));
         }
-        if (op == "==") return left == right;
-        if (op == "!=") return left != right;
-        if (op == "<") return left < right;
-        if (op == "<=") return left <= right;
-        if (op == ">") return left > right;
-        if (op == ">=") return left >= right;
-        if (op == "!") return !right;
-        throw runtime_error("Unknown operator '" + op + "' at line " + to_string(node->lineNumber));
     }
 
     int visitAssignNode(AssignNode* node) {
+        typename Profile::Scope scope(profile, node);
+        if (node->isArray) {
+            IntArray value;
+            evaluateArray(node->value, value);
+            heldElements = heldElements - arrays[node->slot].size() + value.size();
+            arrays[node->slot].swap(value);
+            defined[node->slot] = 1;
+            return 0;
+        }
         int value = visit(node->value);
-        variables[node->name] = value;
+        variables[node->slot] = value;
+        defined[node->slot] = 1;
         return value;
     }
 
     int visitPrintNode(PrintNode* node) {
+        typename Profile::Scope scope(profile, node);
+        if (node->isArray) {
+            IntArray scratch;
+            const IntArray& array = arrayOperand(node->expression, scratch);
+            arrayWork(array.size(), node, false);
+            if (budget)
+                budget->checkOutput(OutputSink::arrayLength(array.data(), array.size()), node);
+            out.printArray(array.data(), array.size());
+            return 0;
+        }
         int value = visit(node->expression);
-        cout << value << endl;
+        if (budget)
+            budget->checkOutput(OutputSink::intLength(value), node);
+        out.printInt(value);
         return value;
     }
 
     int visitIfNode(IfNode* node) {
+        typename Profile::Scope scope(profile, node);
         int condition = visit(node->condition);
         if (condition) {
             visit(node->trueBlock);
@@ -93,26 +333,117 @@ private:
     }
 
     int visitWhileNode(WhileNode* node) {
+        typename Profile::Scope scope(profile, node);
+        if (closedForms && runClosedForm(node))
+            return 0;
+        if (!jit) {
+            while (visit(node->condition)) {
+                profile->loopIteration(node);
+                startIteration(node);
+                visit(node->block);
+            }
+            return 0;
+        }
+        LoopTier& tier = loops[node->loopIndex];
+        if (tier.code && runCompiled(tier.code))
+            return 0;
         while (visit(node->condition)) {
+            profile->loopIteration(node);
+            startIteration(node);
             visit(node->block);
+            // Hot loop: compile it and continue natively from the next iteration
+            if (tier.iterations >= 0 && !tier.code && ++tier.iterations >= JIT_THRESHOLD) {
+                LoopCompiler compiler;
+                tier.code = compiler.compile(node, defined, budget != nullptr);
+                if (!tier.code)
+                    tier.iterations = -1;
+                else if (runCompiled(tier.code))
+                    return 0;
+            }
         }
         return 0;
     }
 
+    // Counts an iteration that is about to start against the budget
+    void startIteration(WhileNode* node) {
+        if (budget && --budget->countdown == 0 && !budget->refill(node->lineNumber))
+            throw budget->error();
+    }
+
+    // Runs the whole loop as its closed form (see ScalarEvolution.h); false if it has none,
+    // it does not apply to the current values or its iterations do not fit the budget
+    bool runClosedForm(WhileNode* node) {
+        LoopTier& tier = loops[node->loopIndex];
+        if (!tier.analyzed) {
+            tier.analyzed = true;
+            tier.closedForm = ScalarEvolution().analyze(node);
+        }
+        if (!tier.closedForm)
+            return false;
+        int64_t count = tier.closedForm->run(variables.data(), defined.data(),
+                                             budget ? budget->remainingIterations() : UINT64_MAX);
+        if (count < 0)
+            return false;
+        if (budget)
+            budget->charge(static_cast<uint64_t>(count));
+        return true;
+    }
+
+    // Runs a compiled loop to completion; false if its entry guards sent it back to
+    // the interpreter. A deopt re-evaluates the failing node here, which raises the
+    // error exactly as interpretation would.
+    bool runCompiled(JitLoop* code) {
+        int result = code->run(variables.data(), defined.data(), &out, budget);
+        if (result == JIT_GUARD_FAILED)
+            return false;
+        if (result == JIT_OUT_OF_BUDGET)
+            throw budget->error();
+        if (result >= JIT_DEOPT) {
+            ASTNode* failed = code->deoptNode(result);
+            visit(failed);
+            throw std::runtime_error("JIT deoptimization did not reproduce an error at line " + std::to_string(failed->lineNumber));
+        }
+        return true;
+    }
+
     int visitBlockNode(BlockNode* node) {
-        // Implement variable scoping if needed
         for (ASTNode* stmt : node->statements) {
             visit(stmt);
         }
+        // Variables declared in this block go out of scope (only non-empty with block scoping)
+        for (int slot = node->firstSlot; slot < node->firstSlot + node->slotCount; slot++)
+            defined[slot] = 0;
         return 0;
     }
 
 public:
-    Interpreter(ASTNode* root) : root(root) {}
+    // With 'jit' set, loops that run JIT_THRESHOLD iterations are compiled to native
+    // code where the platform supports it (x86-64 Linux)
+    // A profile, when given, has to outlive the interpreter; profiling needs jit and
+    // closedForms off
+    // With 'closedForms' set, counting loops that have a closed form skip straight to
+    // their final values
+    // A budget, when given, is charged for every loop iteration, print and element of
+    // array work; exceeding it throws BudgetExceeded
+    BasicInterpreter(ASTNode* root, const SymbolTable& symbols, OutputSink& out, bool jit = true, Profile* profile = nullptr,
+                     bool closedForms = true, ExecutionBudget* budget = nullptr)
+        : root(root), out(out), variables(symbols.frameSize, 0), defined(symbols.frameSize, 0),
+          arrays(symbols.frameSize), heldElements(0), kernels(&arraykernels::defaultKernels()), jit(jit), closedForms(closedForms),
+          loops(symbols.loopCount), profile(profile), budget(budget) {}
+
+    ~BasicInterpreter() {
+        for (LoopTier& tier : loops) {
+            delete tier.code;
+            delete tier.closedForm;
+        }
+    }
 
     void interpret() {
         visit(root);
     }
 };
 
+typedef BasicInterpreter<NoProfiler> Interpreter;
+typedef BasicInterpreter<Profiler> ProfilingInterpreter;
+
 #endif // INTERPRETER_H
@@ -0,0 +1,515 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "Parser.h"
+#include "OutputSink.h"
+#include "ExecutionBudget.h"
+#include <vector>
+#include <utility>
+#include <initializer_list>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define JIT_AVAILABLE 1
+#endif
+
+// Tier-up JIT for hot while loops (x86-64 Linux only, no dependencies).
+//
+// LoopCompiler turns a WhileNode (condition, body and everything nested in it) into a
+// native function that works directly on the interpreter's frame: r12 points at the
+// int slot array, r13 at the defined-flags array and rbx at the OutputSink. Because
+// all state lives in those arrays the function can be entered at any iteration
+// boundary, so the interpreter switches to it in the middle of a running loop.
+//
+// The generated code never raises errors itself. When a read finds an undefined slot
+// or a divisor is zero it returns the id of the failing node ("deopt"); the
+// interpreter then re-evaluates that node, which raises exactly the error, message
+// and line number the interpreter would have produced.
+//
+// Under an ExecutionBudget (r14) the budget's countdown lives in r15 while the code
+// runs. Every iteration decrements it and calls back into the budget when it runs out,
+// and every print calls back to check the output limit before printing; if the budget
+// refuses, the code returns and the interpreter raises the budget error.
+
+// Results of JitLoop::run()
+const int JIT_DONE = 0;         // the loop ran to completion
+const int JIT_GUARD_FAILED = 1; // an entry guard failed before anything ran; interpret instead
+const int JIT_OUT_OF_BUDGET = 2; // the execution budget refused another iteration
+const int JIT_DEOPT = 3;        // JIT_DEOPT + i: node i of the deopt table failed
+
+typedef int (*JitEntry)(int* slots, char* defined, OutputSink* out, ExecutionBudget* budget);
+
+// Called from generated code for print statements
+inline void jitPrint(OutputSink* out, int value) {
+    out->printInt(value);
+}
+
+// Called from generated code for print statements under a budget; prints and returns
+// nonzero, or returns zero without printing if the output limit would be exceeded
+inline int jitPrintChecked(ExecutionBudget* budget, OutputSink* out, int value, PrintNode* print) {
+    if (!budget->outputFits(OutputSink::intLength(value), print->lineNumber))
+        return 0;
+    out->printInt(value);
+    return 1;
+}
+
+// Called from generated code when the budget's countdown runs out at the start of an
+// iteration of loop; nonzero to go on
+inline int jitRefill(ExecutionBudget* budget, WhileNode* loop) {
+    return budget->refill(loop->lineNumber) ? 1 : 0;
+}
+
+// A compiled loop in its own executable mapping
+class JitLoop {
+private:
+    void* memory;
+    size_t size;
+    std::vector<ASTNode*> deoptNodes;
+
+    JitLoop(const JitLoop&);
+    JitLoop& operator=(const JitLoop&);
+
+public:
+    JitLoop(void* memory, size_t size, std::vector<ASTNode*>& nodes) : memory(memory), size(size) {
+        deoptNodes.swap(nodes);
+    }
+
+    ~JitLoop() {
+#ifdef JIT_AVAILABLE
+        munmap(memory, size);
+#endif
+    }
+
+    // budget is nullptr for code compiled without one
+    int run(int* slots, char* defined, OutputSink* out, ExecutionBudget* budget) const {
+        return reinterpret_cast<JitEntry>(memory)(slots, defined, out, budget);
+    }
+
+    // The node whose evaluation failed, for a result >= JIT_DEOPT
+    ASTNode* deoptNode(int result) const {
+        return deoptNodes[static_cast<size_t>(result - JIT_DEOPT)];
+    }
+
+    size_t codeSize() const {
+        return size;
+    }
+};
+
+class LoopCompiler {
+private:
+    // x86 condition codes
+    enum Condition { CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+    std::vector<uint8_t> code;
+    std::vector<char> known;                     // slots known to be defined throughout the loop
+    std::vector<ASTNode*> deoptNodes;
+    std::vector<std::pair<size_t, size_t> > deoptJumps; // (rel32 position, deopt index)
+    bool budgeted;                               // count iterations against the budget in r14
+    std::vector<size_t> budgetJumps;             // rel32 positions jumping to the out-of-budget exit
+
+    // Emission helpers
+
+    void byte(uint8_t value) {
+        code.push_back(value);
+    }
+
+    void bytes(std::initializer_list<uint8_t> values) {
+        code.insert(code.end(), values.begin(), values.end());
+    }
+
+    void imm32(int32_t value) {
+        uint8_t raw[4];
+        std::memcpy(raw, &value, 4);
+        code.insert(code.end(), raw, raw + 4);
+    }
+
+    void imm64(uint64_t value) {
+        uint8_t raw[8];
+        std::memcpy(raw, &value, 8);
+        code.insert(code.end(), raw, raw + 8);
+    }
+
+    // Emits a jump with a rel32 to be patched; returns the position of the rel32
+    size_t jump() {
+        byte(0xE9);
+        imm32(0);
+        return code.size() - 4;
+    }
+
+    size_t jumpIf(Condition cc) {
+        bytes({0x0F, static_cast<uint8_t>(0x80 | cc)});
+        imm32(0);
+        return code.size() - 4;
+    }
+
+    void patch(size_t at, size_t target) {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&code[at], &rel, 4);
+    }
+
+    void jumpBack(size_t target) {
+        patch(jump(), target);
+    }
+
+    void deoptIf(Condition cc, ASTNode* node) {
+        deoptJumps.push_back(std::make_pair(jumpIf(cc), deoptNodes.size()));
+        deoptNodes.push_back(node);
+    }
+
+    static Condition invert(Condition cc) {
+        return static_cast<Condition>(cc ^ 1);
+    }
+
+    static bool comparison(OpKind op, Condition& cc) {
+        switch (op) {
+            case O_EQ: cc = CC_E; return true;
+            case O_NE: cc = CC_NE; return true;
+            case O_LT: cc = CC_L; return true;
+            case O_LE: cc = CC_LE; return true;
+            case O_GT: cc = CC_G; return true;
+            case O_GE: cc = CC_GE; return true;
+            default: return false;
+        }
+    }
+
+    // [r12 + slot * 4] and [r13 + slot], always with a 32-bit displacement
+    void slotOperand(uint8_t reg, int slot) {
+        bytes({static_cast<uint8_t>(0x84 | (reg << 3)), 0x24});
+        imm32(slot * 4);
+    }
+
+    void flagOperand(uint8_t reg, int slot) {
+        byte(static_cast<uint8_t>(0x85 | (reg << 3)));
+        imm32(slot);
+    }
+
+    void checkDefined(VariableNode* node) {
+        if (known[node->slot])
+            return;
+        bytes({0x41, 0x80}); // cmp byte [r13 + slot], 0
+        flagOperand(7, node->slot);
+        byte(0x00);
+        deoptIf(CC_E, node);
+    }
+
+    void setFlag(int slot, uint8_t value) {
+        bytes({0x41, 0xC6}); // mov byte [r13 + slot], value
+        flagOperand(0, slot);
+        byte(value);
+    }
+
+    // Expressions: the result ends up in eax
+
+    void loadVariable(VariableNode* node, uint8_t reg) {
+        checkDefined(node);
+        bytes({0x41, 0x8B}); // mov reg, [r12 + slot * 4]
+        slotOperand(reg, node->slot);
+    }
+
+    // Loads the right operand into ecx, keeping eax
+    void loadRight(ASTNode* node) {
+        if (node->type == N_NUMBER) {
+            byte(0xB9); // mov ecx, imm32
+            imm32(static_cast<NumberNode*>(node)->value);
+        } else if (node->type == N_VARIABLE) {
+            loadVariable(static_cast<VariableNode*>(node), 1);
+        } else {
+            byte(0x50);              // push rax
+            expression(node);
+            bytes({0x89, 0xC1});     // mov ecx, eax
+            byte(0x58);              // pop rax
+        }
+    }
+
+    void binaryOp(BinOpNode* node) {
+        expression(node->left);
+        loadRight(node->right);
+        Condition cc = CC_E;
+        switch (node->op) {
+            case O_ADD: bytes({0x01, 0xC8}); break;        // add eax, ecx
+            case O_SUB: bytes({0x29, 0xC8}); break;        // sub eax, ecx
+            case O_MUL: bytes({0x0F, 0xAF, 0xC1}); break;  // imul eax, ecx
+            case O_DIV:
+            case O_MOD:
+                bytes({0x85, 0xC9});                       // test ecx, ecx
+                deoptIf(CC_E, node);
+                bytes({0x99, 0xF7, 0xF9});                 // cdq; idiv ecx
+                if (node->op == O_MOD)
+                    bytes({0x89, 0xD0});                   // mov eax, edx
+                break;
+            default:
+                comparison(node->op, cc);
+                bytes({0x39, 0xC8});                       // cmp eax, ecx
+                bytes({0x0F, static_cast<uint8_t>(0x90 | cc), 0xC0, 0x0F, 0xB6, 0xC0}); // setcc al; movzx eax, al
+                break;
+        }
+    }
+
+    void expression(ASTNode* node) {
+        switch (node->type) {
+            case N_NUMBER:
+                byte(0xB8); // mov eax, imm32
+                imm32(static_cast<NumberNode*>(node)->value);
+                break;
+            case N_VARIABLE:
+                loadVariable(static_cast<VariableNode*>(node), 0);
+                break;
+            case N_BIN_OP:
+                binaryOp(static_cast<BinOpNode*>(node));
+                break;
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                expression(unaryOp->operand);
+                if (unaryOp->op == O_SUB)
+                    bytes({0xF7, 0xD8}); // neg eax
+                else if (unaryOp->op == O_NOT)
+                    bytes({0x85, 0xC0, 0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0}); // test eax, eax; sete al; movzx eax, al
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Emits a jump taken when the condition is false; returns the rel32 to patch
+    size_t branchIfFalse(ASTNode* node) {
+        Condition cc;
+        if (node->type == N_BIN_OP && comparison(static_cast<BinOpNode*>(node)->op, cc)) {
+            BinOpNode* binOp = static_cast<BinOpNode*>(node);
+            expression(binOp->left);
+            loadRight(binOp->right);
+            bytes({0x39, 0xC8}); // cmp eax, ecx
+            return jumpIf(invert(cc));
+        }
+        expression(node);
+        bytes({0x85, 0xC0}); // test eax, eax
+        return jumpIf(CC_E);
+    }
+
+    // Statements
+
+    void statement(ASTNode* node) {
+        switch (node->type) {
+            case N_ASSIGN: {
+                AssignNode* assign = static_cast<AssignNode*>(node);
+                expression(assign->value);
+                bytes({0x41, 0x89}); // mov [r12 + slot * 4], eax
+                slotOperand(0, assign->slot);
+                if (!known[assign->slot])
+                    setFlag(assign->slot, 1);
+                break;
+            }
+            case N_PRINT:
+                expression(static_cast<PrintNode*>(node)->expression);
+                if (budgeted) {
+                    bytes({0x4C, 0x89, 0xF7, 0x48, 0x89, 0xDE}); // mov rdi, r14; mov rsi, rbx
+                    bytes({0x89, 0xC2, 0x48, 0xB9});             // mov edx, eax; mov rcx, node
+                    imm64(reinterpret_cast<uint64_t>(node));
+                    bytes({0x48, 0xB8});                         // mov rax, jitPrintChecked
+                    imm64(reinterpret_cast<uint64_t>(&jitPrintChecked));
+                    bytes({0xFF, 0xD0, 0x85, 0xC0});             // call rax; test eax, eax
+                    budgetJumps.push_back(jumpIf(CC_E));
+                    break;
+                }
+                bytes({0x48, 0x89, 0xDF, 0x89, 0xC6}); // mov rdi, rbx; mov esi, eax
+                bytes({0x48, 0xB8});                   // mov rax, jitPrint
+                imm64(reinterpret_cast<uint64_t>(&jitPrint));
+                bytes({0xFF, 0xD0});                   // call rax
+                break;
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                size_t toElse = branchIfFalse(ifNode->condition);
+                statement(ifNode->trueBlock);
+                if (ifNode->falseBlock) {
+                    size_t toEnd = jump();
+                    patch(toElse, code.size());
+                    statement(ifNode->falseBlock);
+                    patch(toEnd, code.size());
+                } else {
+                    patch(toElse, code.size());
+                }
+                break;
+            }
+            case N_WHILE:
+                loop(static_cast<WhileNode*>(node));
+                break;
+            case N_BLOCK: {
+                BlockNode* block = static_cast<BlockNode*>(node);
+                for (ASTNode* stmt : block->statements)
+                    statement(stmt);
+                for (int slot = block->firstSlot; slot < block->firstSlot + block->slotCount; slot++)
+                    setFlag(slot, 0);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void loop(WhileNode* node) {
+        size_t top = code.size();
+        size_t toExit = branchIfFalse(node->condition);
+        if (budgeted) {
+            bytes({0x49, 0xFF, 0xCF});             // dec r15
+            size_t toBody = jumpIf(CC_NE);
+            bytes({0x4D, 0x89, 0x3E});             // mov [r14], r15 (budget->countdown)
+            bytes({0x4C, 0x89, 0xF7, 0x48, 0xBE}); // mov rdi, r14; mov rsi, node
+            imm64(reinterpret_cast<uint64_t>(node));
+            bytes({0x48, 0xB8});                   // mov rax, jitRefill
+            imm64(reinterpret_cast<uint64_t>(&jitRefill));
+            bytes({0xFF, 0xD0});                   // call rax
+            bytes({0x4D, 0x8B, 0x3E, 0x85, 0xC0}); // mov r15, [r14]; test eax, eax
+            budgetJumps.push_back(jumpIf(CC_E));
+            patch(toBody, code.size());
+        }
+        statement(node->block);
+        jumpBack(top);
+        patch(toExit, code.size());
+    }
+
+    // Slots read in the loop, and slots cleared by blocks inside it. Sets 'arrays' when
+    // the loop uses arrays, which stay in the interpreter.
+    static void scan(ASTNode* node, std::vector<char>& read, std::vector<char>& scoped, bool& arrays) {
+        if (node->isArray)
+            arrays = true;
+        switch (node->type) {
+            case N_VARIABLE:
+                read[static_cast<VariableNode*>(node)->slot] = 1;
+                break;
+            case N_BIN_OP:
+                scan(static_cast<BinOpNode*>(node)->left, read, scoped, arrays);
+                scan(static_cast<BinOpNode*>(node)->right, read, scoped, arrays);
+                break;
+            case N_UNARY_OP:
+                scan(static_cast<UnaryOpNode*>(node)->operand, read, scoped, arrays);
+                break;
+            case N_ASSIGN:
+                scan(static_cast<AssignNode*>(node)->value, read, scoped, arrays);
+                break;
+            case N_PRINT:
+                scan(static_cast<PrintNode*>(node)->expression, read, scoped, arrays);
+                break;
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                scan(ifNode->condition, read, scoped, arrays);
+                scan(ifNode->trueBlock, read, scoped, arrays);
+                if (ifNode->falseBlock)
+                    scan(ifNode->falseBlock, read, scoped, arrays);
+                break;
+            }
+            case N_WHILE:
+                scan(static_cast<WhileNode*>(node)->condition, read, scoped, arrays);
+                scan(static_cast<WhileNode*>(node)->block, read, scoped, arrays);
+                break;
+            case N_BLOCK: {
+                BlockNode* block = static_cast<BlockNode*>(node);
+                for (ASTNode* stmt : block->statements)
+                    scan(stmt, read, scoped, arrays);
+                for (int slot = block->firstSlot; slot < block->firstSlot + block->slotCount; slot++)
+                    scoped[slot] = 1;
+                break;
+            }
+            case N_INDEX:
+            case N_INDEX_ASSIGN:
+            case N_CALL:
+            case N_ARRAY_LITERAL:
+                arrays = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+public:
+    // Compiles a loop given the current defined flags. Slots that are defined now, read
+    // by the loop and not scoped inside it stay defined while it runs; they are checked
+    // once per entry instead of on every read. Returns nullptr if JIT is unavailable
+    // or the loop uses arrays. With 'budget' set the code counts iterations against the
+    // budget it is run with.
+    JitLoop* compile(WhileNode* node, const std::vector<char>& defined, bool budget = false) {
+#ifdef JIT_AVAILABLE
+        code.clear();
+        deoptNodes.clear();
+        deoptJumps.clear();
+        budgeted = budget;
+        budgetJumps.clear();
+        std::vector<char> read(defined.size(), 0);
+        std::vector<char> scoped(defined.size(), 0);
+        bool arrays = false;
+        scan(node, read, scoped, arrays);
+        if (arrays)
+            return nullptr;
+        known.assign(defined.size(), 0);
+
+        // push rbp; mov rbp, rsp; push rbx; push r12; push r13; push r14; push r15; sub rsp, 8
+        bytes({0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x48, 0x83, 0xEC, 0x08});
+        // mov r12, rdi; mov r13, rsi; mov rbx, rdx; mov r14, rcx
+        bytes({0x49, 0x89, 0xFC, 0x49, 0x89, 0xF5, 0x48, 0x89, 0xD3, 0x49, 0x89, 0xCE});
+        if (budgeted)
+            bytes({0x4D, 0x8B, 0x3E}); // mov r15, [r14]
+
+        // Entry guards
+        std::vector<size_t> guardJumps;
+        for (size_t slot = 0; slot < defined.size(); slot++) {
+            if (read[slot] && !scoped[slot] && defined[slot]) {
+                bytes({0x41, 0x80});
+                flagOperand(7, static_cast<int>(slot));
+                byte(0x00);
+                guardJumps.push_back(jumpIf(CC_E));
+                known[slot] = 1;
+            }
+        }
+
+        loop(node);
+        bytes({0x31, 0xC0}); // xor eax, eax (JIT_DONE)
+        size_t epilogue = code.size();
+        if (budgeted)
+            bytes({0x4D, 0x89, 0x3E}); // mov [r14], r15
+        // lea rsp, [rbp - 40]; pop r15; pop r14; pop r13; pop r12; pop rbx; pop rbp; ret
+        bytes({0x48, 0x8D, 0x65, 0xD8, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D, 0xC3});
+
+        for (size_t at : guardJumps)
+            patch(at, code.size());
+        byte(0xB8); // mov eax, JIT_GUARD_FAILED
+        imm32(JIT_GUARD_FAILED);
+        jumpBack(epilogue);
+
+        if (!budgetJumps.empty()) {
+            for (size_t at : budgetJumps)
+                patch(at, code.size());
+            byte(0xB8); // mov eax, JIT_OUT_OF_BUDGET
+            imm32(JIT_OUT_OF_BUDGET);
+            jumpBack(epilogue);
+        }
+
+        for (size_t i = 0; i < deoptJumps.size(); i++) {
+            patch(deoptJumps[i].first, code.size());
+            byte(0xB8); // mov eax, JIT_DEOPT + index
+            imm32(static_cast<int32_t>(JIT_DEOPT + deoptJumps[i].second));
+            jumpBack(epilogue);
+        }
+
+        // Write the code, then make it executable but no longer writable
+        size_t size = (code.size() + 4095) & ~static_cast<size_t>(4095);
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            return nullptr;
+        std::memcpy(memory, code.data(), code.size());
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, size);
+            return nullptr;
+        }
+        return new JitLoop(memory, size, deoptNodes);
+#else
+        (void)node;
+        (void)defined;
+        (void)budget;
+        return nullptr;
+#endif
+    }
+};
+
+#endif // JIT_H
@@ -2,12 +2,15 @@
 #define LEXER_H
 
 #include <string>
+#include <cstring>
+#include <cstdint>
+#include <climits>
 #include <cctype> // has the functions like isalnum() and isspace()
 #include <stdexcept> //errro handle krne me
 #include "Queue.h" //my self built queue
 
 // Token types
-enum TokenType {
+enum TokenType : uint8_t {
     T_IDENTIFIER, //all variables
     T_NUMBER, //constants
     T_OPERATOR,
@@ -17,6 +20,9 @@ enum TokenType {
     T_RPAREN,//)
     T_LBRACE,//{
     T_RBRACE,//}
+    T_LBRACKET,//[
+    T_RBRACKET,//]
+    T_COMMA,
     T_IF,
     T_ELSE,
     T_WHILE,
@@ -25,11 +31,59 @@ enum TokenType {
     T_UNKNOWN
 };
 
-// Token structure
+// Operator kinds carried by T_OPERATOR tokens and stored in BinOpNode / UnaryOpNode
+enum OpKind : uint8_t {
+    O_NONE, // not an operator token
+    O_ADD,  // +
+    O_SUB,  // -
+    O_MUL,  // *
+    O_DIV,  // /
+    O_MOD,  // %
+    O_EQ,   // ==
+    O_NE,   // !=
+    O_LT,   // <
+    O_LE,   // <=
+    O_GT,   // >
+    O_GE,   // >=
+    O_NOT   // !
+};
+
+inline const char* opKindToString(OpKind op) {
+    switch (op) {
+        case O_ADD: return "+";
+        case O_SUB: return "-";
+        case O_MUL: return "*";
+        case O_DIV: return "/";
+        case O_MOD: return "%";
+        case O_EQ: return "==";
+        case O_NE: return "!=";
+        case O_LT: return "<";
+        case O_LE: return "<=";
+        case O_GT: return ">";
+        case O_GE: return ">=";
+        case O_NOT: return "!";
+        default: return "?";
+    }
+}
+
+// Token structure: a small POD record pointing back into the source buffer, so lexing
+// allocates nothing per token. The source must outlive the tokens.
 struct Token {
-    TokenType type;
-    std::string value;
+    const char* text;  // first character of the lexeme
+    uint32_t length;   // lexeme length in bytes
     int lineNumber;
+    int number;        // value of a T_NUMBER token
+    TokenType type;
+    OpKind op;         // O_NONE unless type is T_OPERATOR
+    bool overflow;     // T_NUMBER does not fit in an int
+
+    std::string value() const {
+        return std::string(text, length);
+    }
+
+    bool is(const char* keyword, uint32_t keywordLength) const {
+        return length == keywordLength && std::memcmp(text, keyword, keywordLength) == 0;
+    }
 };
 
 class Lexer {
@@ -46,7 +100,8 @@ private:
 // constructor
 // generateTokens(): returns the whole queue of structure tokens
 
-    std::string input; // for complete source code (for program1.txt: "x = 10;\ny = x + 5;\nprint(y);")
+    const char* input; // complete source code, not copied (for program1.txt: "x = 10;\ny = x + 5;\nprint(y);")
+    size_t length;
     size_t pos; // for traversal- curret position
     char currentChar;
     int lineNumber;
@@ -55,7 +110,7 @@ private:
         if (currentChar == '\n')
             lineNumber++;
         pos++;
-        if (pos < input.length())
+        if (pos < length)
             currentChar = input[pos];
         else
             currentChar = '\0';
@@ -66,39 +121,73 @@ private:
             advance();
     }
 
+    // Token for the lexeme [start, pos)
+    Token makeToken(TokenType type, size_t start, OpKind op = O_NONE) const {
+        Token token;
+        token.text = input + start;
+        token.length = static_cast<uint32_t>(pos - start);
+        token.lineNumber = lineNumber;
+        token.number = 0;
+        token.type = type;
+        token.op = op;
+        token.overflow = false;
+        return token;
+    }
+
+    // Consumes 'width' characters as one token
+    void emit(Queue<Token>& tokens, TokenType type, size_t width, OpKind op = O_NONE) {
+        size_t start = pos;
+        int line = lineNumber;
+        for (size_t i = 0; i < width; i++)
+            advance();
+        Token token = makeToken(type, start, op);
+        token.lineNumber = line;
+        tokens.enqueue(token);
+    }
+
     Token identifier() {
-        std::string result;
-        while (currentChar != '\0' && (isalnum(currentChar) || currentChar == '_')) {
-            result += currentChar;
+        size_t start = pos;
+        while (currentChar != '\0' && (isalnum(currentChar) || currentChar == '_'))
             advance();
-        }
-        if (result == "if")
-            return Token{T_IF, result, lineNumber};
-        else if (result == "else")
-            return Token{T_ELSE, result, lineNumber};
-        else if (result == "while")
-            return Token{T_WHILE, result, lineNumber};
-        else if (result == "print")
-            return Token{T_PRINT, result, lineNumber};
-        else
-            return Token{T_IDENTIFIER, result, lineNumber};
+        Token token = makeToken(T_IDENTIFIER, start);
+        if (token.is("if", 2))
+            token.type = T_IF;
+        else if (token.is("else", 4))
+            token.type = T_ELSE;
+        else if (token.is("while", 5))
+            token.type = T_WHILE;
+        else if (token.is("print", 5))
+            token.type = T_PRINT;
+        return token;
     }
 
     Token number() {
-        std::string result;
+        size_t start = pos;
+        long long value = 0;
+        bool overflow = false;
         while (currentChar != '\0' && isdigit(currentChar)) {
-            result += currentChar;
+            value = value * 10 + (currentChar - '0');
+            if (value > INT_MAX) {
+                overflow = true;
+                value = 0;
+            }
             advance();
         }
-        return Token{T_NUMBER, result, lineNumber};
+        Token token = makeToken(T_NUMBER, start);
+        token.number = static_cast<int>(value);
+        token.overflow = overflow;
+        return token;
     }
 
 public:
-    Lexer(const std::string& input) : input(input), pos(0), lineNumber(1) {
-        if (!input.empty())
-            currentChar = input[pos];
-        else
-            currentChar = '\0';
+    // firstLine numbers the lines of a fragment that starts in the middle of a file
+    Lexer(const char* input, size_t length, int firstLine = 1) : input(input), length(length), pos(0), lineNumber(firstLine) {
+        currentChar = length > 0 ? input[0] : '\0';
+    }
+
+    // The string is referenced, not copied: it must outlive the lexer and its tokens
+    Lexer(const std::string& input) : input(input.data()), length(input.size()), pos(0), lineNumber(1) {
+        currentChar = length > 0 ? input[0] : '\0';
     }
 
     Queue<Token> generateTokens() {
@@ -116,91 +205,52 @@ public:
                 tokens.enqueue(number());
                 continue;
             }
-            if (currentChar == '+') {
-                tokens.enqueue(Token{T_OPERATOR, "+", lineNumber});
-                advance();
-                continue;
-            }
-            if (currentChar == '-') {
-                tokens.enqueue(Token{T_OPERATOR, "-", lineNumber});
-                advance();
-                continue;
-            }
-            if (currentChar == '*') {
-                tokens.enqueue(Token{T_OPERATOR, "*", lineNumber});
-                advance();
-                continue;
-            }
-            if (currentChar == '/') {
-                tokens.enqueue(Token{T_OPERATOR, "/", lineNumber});
-                advance();
-                continue;
-            }
-            if (currentChar == '%') {
-                tokens.enqueue(Token{T_OPERATOR, "%", lineNumber});
-                advance();
-                continue;
-            }
-            if (currentChar == '=') {
-                advance();
-                if (currentChar == '=') {
-                    tokens.enqueue(Token{T_OPERATOR, "==", lineNumber});
-                    advance();
-                } else {
-                    tokens.enqueue(Token{T_ASSIGN, "=", lineNumber});
-                }
-                continue;
-            }
-            if (currentChar == '!') {
-                advance();
-                if (currentChar == '=') {
-                    tokens.enqueue(Token{T_OPERATOR, "!=", lineNumber});
-                    advance();
-                } else {
-                    tokens.enqueue(Token{T_OPERATOR, "!", lineNumber});
-                }
-                continue;
-            }
-            if (currentChar == '<' || currentChar == '>') {
-                char prevChar = currentChar;
-                advance();
-                if (currentChar == '=') {
-                    tokens.enqueue(Token{T_OPERATOR, std::string(1, prevChar) + "=", lineNumber});
-                    advance();
-                } else {
-                    tokens.enqueue(Token{T_OPERATOR, std::string(1, prevChar), lineNumber});
-                }
-                continue;
-            }
-            if (currentChar == ';') {
-                tokens.enqueue(Token{T_SEMICOLON, ";", lineNumber});
-                advance();
-                continue;
-            }
-            if (currentChar == '(') {
-                tokens.enqueue(Token{T_LPAREN, "(", lineNumber});
-                advance();
-                continue;
-            }
-            if (currentChar == ')') {
-                tokens.enqueue(Token{T_RPAREN, ")", lineNumber});
-                advance();
-                continue;
-            }
-            if (currentChar == '{') {
-                tokens.enqueue(Token{T_LBRACE, "{", lineNumber});
-                advance();
-                continue;
-            }
-            if (currentChar == '}') {
-                tokens.enqueue(Token{T_RBRACE, "}", lineNumber});
-                advance();
-                continue;
+            char next = pos + 1 < length ? input[pos + 1] : '\0';
+            switch (currentChar) {
+                case '+': emit(tokens, T_OPERATOR, 1, O_ADD); continue;
+                case '-': emit(tokens, T_OPERATOR, 1, O_SUB); continue;
+                case '*': emit(tokens, T_OPERATOR, 1, O_MUL); continue;
+                case '/': emit(tokens, T_OPERATOR, 1, O_DIV); continue;
+                case '%': emit(tokens, T_OPERATOR, 1, O_MOD); continue;
+                case '=':
+                    if (next == '=')
+                        emit(tokens, T_OPERATOR, 2, O_EQ);
+                    else
+                        emit(tokens, T_ASSIGN, 1);
+                    continue;
+                case '!':
+                    if (next == '=')
+                        emit(tokens, T_OPERATOR, 2, O_NE);
+                    else
+                        emit(tokens, T_OPERATOR, 1, O_NOT);
+                    continue;
+                case '<':
+                    if (next == '=')
+                        emit(tokens, T_OPERATOR, 2, O_LE);
+                    else
+                        emit(tokens, T_OPERATOR, 1, O_LT);
+                    continue;
+                case '>':
+                    if (next == '=')
+                        emit(tokens, T_OPERATOR, 2, O_GE);
+                    else
+                        emit(tokens, T_OPERATOR, 1, O_GT);
+                    continue;
+                case ';': emit(tokens, T_SEMICOLON, 1); continue;
+                case '(': emit(tokens, T_LPAREN, 1); continue;
+                case ')': emit(tokens, T_RPAREN, 1); continue;
+                case '{': emit(tokens, T_LBRACE, 1); continue;
+                case '}': emit(tokens, T_RBRACE, 1); continue;
+                case '[': emit(tokens, T_LBRACKET, 1); continue;
+                case ']': emit(tokens, T_RBRACKET, 1); continue;
+                case ',': emit(tokens, T_COMMA, 1); continue;
+                default:
+                    break;
             }
             // Unknown character
             throw std::runtime_error("Unknown character '" + std::string(1, currentChar) + "' at line " + std::to_string(lineNumber));
         }
-        tokens.enqueue(Token{T_EOF, "", lineNumber});
+        tokens.enqueue(makeToken(T_EOF, pos));
         return tokens;
     }
 };
@@ -5,6 +5,9 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <utility>
+#include <cstddef>
+#include <iterator>
 
 // Node structure for the linked list
 template <typename T>
@@ -13,94 +16,168 @@ public:
     T data;
     ListNode* next;
 
-    ListNode(T value) : data(value), next(nullptr) {}
+    ListNode(const T& value) : data(value), next(nullptr) {}
+    ListNode(T&& value) : data(std::move(value)), next(nullptr) {}
 };
 
-// Linked List class
+// Linked List class. Keeps a tail pointer so append and access to the last element are
+// O(1); iterate with begin()/end() instead of get(i) to walk the list in O(n) total.
 template <typename T>
 class LinkedList {
 private:
     ListNode<T>* head;
+    ListNode<T>* tail;
     int size;
 
-public:
-    LinkedList() : head(nullptr), size(0) {}
-
-    // Function to add a node at the end
-    void append(T value) {
-        ListNode<T>* newNode = new ListNode<T>(value);
-        if (!head) {
-            head = newNode;
-        } else {
-            ListNode<T>* temp = head;
-            while (temp->next)
-                temp = temp->next;
-            temp->next = newNode;
-        }
-        size++;
+    ListNode<T>* nodeAt(int index) const {
+        if (index == size - 1)
+            return tail;
+        ListNode<T>* temp = head;
+        for (int i = 0; i < index; i++)
+            temp = temp->next;
+        return temp;
     }
 
-    // Function to insert a node at a specific index
-    void insert(int index, T value) {
-        if (index < 0 || index > size)
+    void linkAt(int index, ListNode<T>* newNode) {
+        if (index < 0 || index > size) {
+            delete newNode;
             throw std::out_of_range("Index out of range");
-        ListNode<T>* newNode = new ListNode<T>(value);
+        }
         if (index == 0) {
             newNode->next = head;
             head = newNode;
+            if (!tail)
+                tail = newNode;
+        } else if (index == size) {
+            tail->next = newNode;
+            tail = newNode;
         } else {
-            ListNode<T>* temp = head;
-            for (int i = 0; i < index - 1; i++)
-                temp = temp->next;
-            newNode->next = temp->next;
-            temp->next = newNode;
+            ListNode<T>* prev = nodeAt(index - 1);
+            newNode->next = prev->next;
+            prev->next = newNode;
         }
         size++;
     }
 
+public:
+    class iterator {
+    private:
+        ListNode<T>* node;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T* pointer;
+        typedef T& reference;
+
+        explicit iterator(ListNode<T>* node = nullptr) : node(node) {}
+        T& operator*() const { return node->data; }
+        T* operator->() const { return &node->data; }
+        iterator& operator++() { node = node->next; return *this; }
+        iterator operator++(int) { iterator old = *this; node = node->next; return old; }
+        bool operator==(const iterator& other) const { return node == other.node; }
+        bool operator!=(const iterator& other) const { return node != other.node; }
+    };
+
+    class const_iterator {
+    private:
+        const ListNode<T>* node;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        explicit const_iterator(const ListNode<T>* node = nullptr) : node(node) {}
+        const T& operator*() const { return node->data; }
+        const T* operator->() const { return &node->data; }
+        const_iterator& operator++() { node = node->next; return *this; }
+        const_iterator operator++(int) { const_iterator old = *this; node = node->next; return old; }
+        bool operator==(const const_iterator& other) const { return node == other.node; }
+        bool operator!=(const const_iterator& other) const { return node != other.node; }
+    };
+
+    LinkedList() : head(nullptr), tail(nullptr), size(0) {}
+
+    LinkedList(const LinkedList& other) : head(nullptr), tail(nullptr), size(0) {
+        for (const ListNode<T>* node = other.head; node; node = node->next)
+            append(node->data);
+    }
+
+    LinkedList(LinkedList&& other) : head(other.head), tail(other.tail), size(other.size) {
+        other.head = other.tail = nullptr;
+        other.size = 0;
+    }
+
+    LinkedList& operator=(LinkedList other) {
+        std::swap(head, other.head);
+        std::swap(tail, other.tail);
+        std::swap(size, other.size);
+        return *this;
+    }
+
+    // Function to add a node at the end
+    void append(const T& value) {
+        linkAt(size, new ListNode<T>(value));
+    }
+
+    void append(T&& value) {
+        linkAt(size, new ListNode<T>(std::move(value)));
+    }
+
+    // Function to insert a node at a specific index
+    void insert(int index, const T& value) {
+        linkAt(index, new ListNode<T>(value));
+    }
+
     // Function to remove a node at a specific index
     void remove(int index) {
         if (index < 0 || index >= size)
             throw std::out_of_range("Index out of range");
-        ListNode<T>* temp = head;
+        ListNode<T>* nodeToDelete;
         if (index == 0) {
+            nodeToDelete = head;
             head = head->next;
-            delete temp;
+            if (!head)
+                tail = nullptr;
         } else {
-            for (int i = 0; i < index - 1; i++)
-                temp = temp->next;
-            ListNode<T>* nodeToDelete = temp->next;
-            temp->next = nodeToDelete->next;
-            delete nodeToDelete;
+            ListNode<T>* prev = nodeAt(index - 1);
+            nodeToDelete = prev->next;
+            prev->next = nodeToDelete->next;
+            if (nodeToDelete == tail)
+                tail = prev;
         }
+        delete nodeToDelete;
         size--;
     }
 
     // Function to get the value at a specific index
-    T get(int index) {
+    T get(int index) const {
         if (index < 0 || index >= size)
             throw std::out_of_range("Index out of range");
-        ListNode<T>* temp = head;
-        for (int i = 0; i < index; i++)
-            temp = temp->next;
-        return temp->data;
+        return nodeAt(index)->data;
     }
 
     // Function to set the value at a specific index
-    void set(int index, T value) {
+    void set(int index, const T& value) {
         if (index < 0 || index >= size)
             throw std::out_of_range("Index out of range");
-        ListNode<T>* temp = head;
-        for (int i = 0; i < index; i++)
-            temp = temp->next;
-        temp->data = value;
+        nodeAt(index)->data = value;
     }
 
     // Function to get the size of the list
-    int getSize() {
+    int getSize() const {
         return size;
     }
 
+    iterator begin() { return iterator(head); }
+    iterator end() { return iterator(); }
+    const_iterator begin() const { return const_iterator(head); }
+    const_iterator end() const { return const_iterator(); }
+
     // Destructor to free memory
     ~LinkedList() {
         ListNode<T>* temp = head;
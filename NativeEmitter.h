@@ -0,0 +1,961 @@
+#ifndef NATIVE_EMITTER_H
+#define NATIVE_EMITTER_H
+
+#include "Pipeline.h"
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+// Ahead-of-time compilation. --emit=asm turns a program into a standalone x86-64 Linux
+// assembly file (GNU as, Intel syntax, raw system calls, no libc); --emit=c turns it
+// into a C file. buildNative() runs the local assembler and linker or C compiler on
+// the result to produce an executable.
+//
+// The program goes through the front end of the tree engine (parsing, optimization,
+// type checking, resolution and definite assignment), and the generated code follows
+// Interpreter step for step: 32-bit wrapping arithmetic, operands evaluated left to
+// right, reads of possibly unassigned variables checked, divisors checked for zero,
+// and block-scoped variables forgotten at the end of their block. Output is buffered
+// and printed as "%d\n". An error flushes the output so far, prints "Error: <message>"
+// on stderr (e.g. "Error: Division by zero at line 3") and exits with status 1, like
+// mini_compiler itself. Arrays are not supported.
+
+enum EmitTarget {
+    EMIT_ASM,
+    EMIT_C
+};
+
+// Slots that have a checked read somewhere, so their defined flag has to be kept
+inline void findCheckedSlots(ASTNode* node, std::vector<char>& checked) {
+    if (!node)
+        return;
+    switch (node->type) {
+        case N_VARIABLE: {
+            VariableNode* var = static_cast<VariableNode*>(node);
+            if (var->checked)
+                checked[var->slot] = 1;
+            break;
+        }
+        case N_BIN_OP:
+            findCheckedSlots(static_cast<BinOpNode*>(node)->left, checked);
+            findCheckedSlots(static_cast<BinOpNode*>(node)->right, checked);
+            break;
+        case N_UNARY_OP:
+            findCheckedSlots(static_cast<UnaryOpNode*>(node)->operand, checked);
+            break;
+        case N_ASSIGN:
+            findCheckedSlots(static_cast<AssignNode*>(node)->value, checked);
+            break;
+        case N_PRINT:
+            findCheckedSlots(static_cast<PrintNode*>(node)->expression, checked);
+            break;
+        case N_IF:
+            findCheckedSlots(static_cast<IfNode*>(node)->condition, checked);
+            findCheckedSlots(static_cast<IfNode*>(node)->trueBlock, checked);
+            findCheckedSlots(static_cast<IfNode*>(node)->falseBlock, checked);
+            break;
+        case N_WHILE:
+            findCheckedSlots(static_cast<WhileNode*>(node)->condition, checked);
+            findCheckedSlots(static_cast<WhileNode*>(node)->block, checked);
+            break;
+        case N_BLOCK:
+            for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                findCheckedSlots(stmt, checked);
+            break;
+        default:
+            break;
+    }
+}
+
+inline std::string undefinedMessage(VariableNode* var) {
+    return "Undefined variable '" + var->name + "' at line ";
+}
+
+inline bool isComparison(OpKind op) {
+    return op == O_EQ || op == O_NE || op == O_LT || op == O_LE || op == O_GT || op == O_GE;
+}
+
+// Generates a GNU as file. Up to six of the most used variables (uses weighted by loop
+// nesting) live in callee-saved registers for the whole run; the others live in .bss.
+// Expressions are evaluated into a stack of scratch registers that spills to the
+// machine stack when it runs out. Failing checks jump to out-of-line stubs that pass
+// the message and line to mc_fail.
+class AsmEmitter {
+private:
+    static const int SCRATCH_COUNT = 7;
+    static const int VARIABLE_REGISTER_COUNT = 6;
+
+    const SymbolTable& symbols;
+    std::vector<char> checked;       // per slot: has a checked read
+    std::vector<int> variableRegister; // per slot: index into VARIABLE_REGISTERS, or -1
+    std::ostringstream code;
+    std::ostringstream stubs;        // error paths, after the main code
+    std::ostringstream strings;      // .rodata
+    std::unordered_map<std::string, int> messageIds;
+    int labelCount;
+
+    AsmEmitter(const AsmEmitter&);
+    AsmEmitter& operator=(const AsmEmitter&);
+
+    static const char* scratch(int k) {
+        static const char* const names[SCRATCH_COUNT] = {"edi", "esi", "ecx", "r8d", "r9d", "r10d", "r11d"};
+        return names[k];
+    }
+
+    static const char* scratch64(int k) {
+        static const char* const names[SCRATCH_COUNT] = {"rdi", "rsi", "rcx", "r8", "r9", "r10", "r11"};
+        return names[k];
+    }
+
+    static const char* scratch8(const std::string& reg) {
+        static const char* const names32[SCRATCH_COUNT] = {"edi", "esi", "ecx", "r8d", "r9d", "r10d", "r11d"};
+        static const char* const names8[SCRATCH_COUNT] = {"dil", "sil", "cl", "r8b", "r9b", "r10b", "r11b"};
+        for (int k = 0; k < SCRATCH_COUNT; k++) {
+            if (reg == names32[k])
+                return names8[k];
+        }
+        return "al";
+    }
+
+    static const char* variableRegisterName(int index) {
+        static const char* const names[VARIABLE_REGISTER_COUNT] = {"ebx", "ebp", "r12d", "r13d", "r14d", "r15d"};
+        return names[index];
+    }
+
+    static const char* conditionCode(OpKind op, bool negate) {
+        switch (op) {
+            case O_EQ: return negate ? "ne" : "e";
+            case O_NE: return negate ? "e" : "ne";
+            case O_LT: return negate ? "ge" : "l";
+            case O_LE: return negate ? "g" : "le";
+            case O_GT: return negate ? "le" : "g";
+            default:   return negate ? "l" : "ge";
+        }
+    }
+
+    void line(const std::string& instruction) {
+        code << "    " << instruction << "\n";
+    }
+
+    std::string newLabel() {
+        return ".L" + std::to_string(labelCount++);
+    }
+
+    void countUses(ASTNode* node, double weight, std::vector<double>& uses) {
+        if (!node)
+            return;
+        switch (node->type) {
+            case N_VARIABLE:
+                uses[static_cast<VariableNode*>(node)->slot] += weight;
+                break;
+            case N_BIN_OP:
+                countUses(static_cast<BinOpNode*>(node)->left, weight, uses);
+                countUses(static_cast<BinOpNode*>(node)->right, weight, uses);
+                break;
+            case N_UNARY_OP:
+                countUses(static_cast<UnaryOpNode*>(node)->operand, weight, uses);
+                break;
+            case N_ASSIGN:
+                uses[static_cast<AssignNode*>(node)->slot] += weight;
+                countUses(static_cast<AssignNode*>(node)->value, weight, uses);
+                break;
+            case N_PRINT:
+                countUses(static_cast<PrintNode*>(node)->expression, weight, uses);
+                break;
+            case N_IF:
+                countUses(static_cast<IfNode*>(node)->condition, weight, uses);
+                countUses(static_cast<IfNode*>(node)->trueBlock, weight, uses);
+                countUses(static_cast<IfNode*>(node)->falseBlock, weight, uses);
+                break;
+            case N_WHILE: {
+                // A loop body is assumed to run eight times as often as its surroundings
+                double inner = std::min(weight * 8, 1e30);
+                countUses(static_cast<WhileNode*>(node)->condition, inner, uses);
+                countUses(static_cast<WhileNode*>(node)->block, inner, uses);
+                break;
+            }
+            case N_BLOCK:
+                for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                    countUses(stmt, weight, uses);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void allocateRegisters(ASTNode* root) {
+        std::vector<double> uses(symbols.frameSize, 0.0);
+        countUses(root, 1.0, uses);
+        std::vector<int> slots;
+        for (int slot = 0; slot < symbols.frameSize; slot++) {
+            if (uses[slot] > 0)
+                slots.push_back(slot);
+        }
+        std::stable_sort(slots.begin(), slots.end(), [&uses](int a, int b) { return uses[a] > uses[b]; });
+        for (size_t i = 0; i < slots.size() && i < static_cast<size_t>(VARIABLE_REGISTER_COUNT); i++)
+            variableRegister[slots[i]] = static_cast<int>(i);
+    }
+
+    bool inRegister(int slot) const {
+        return variableRegister[slot] >= 0;
+    }
+
+    std::string location(int slot) const {
+        if (inRegister(slot))
+            return variableRegisterName(variableRegister[slot]);
+        return "dword ptr [rip + mc_vars + " + std::to_string(slot * 4) + "]";
+    }
+
+    std::string definedFlag(int slot) const {
+        return "byte ptr [rip + mc_defined + " + std::to_string(slot) + "]";
+    }
+
+    // An operand that needs no code: a number, or a variable read without a check
+    std::string leaf(ASTNode* node) const {
+        if (node->type == N_NUMBER)
+            return std::to_string(static_cast<NumberNode*>(node)->value);
+        if (node->type == N_VARIABLE && !static_cast<VariableNode*>(node)->checked)
+            return location(static_cast<VariableNode*>(node)->slot);
+        return "";
+    }
+
+    static bool isMemory(const std::string& operand) {
+        return operand.find('[') != std::string::npos;
+    }
+
+    // After a test or cmp against zero: jumps to an error stub reporting message + line
+    // when the value was zero
+    void failIfZero(const std::string& message, int lineNumber) {
+        std::string stub = newLabel();
+        line("je " + stub);
+        int id;
+        std::unordered_map<std::string, int>::iterator it = messageIds.find(message);
+        if (it != messageIds.end()) {
+            id = it->second;
+        } else {
+            id = static_cast<int>(messageIds.size());
+            messageIds[message] = id;
+            strings << "mc_message" << id << ":\n    .ascii \"" << message << "\"\n";
+        }
+        stubs << stub << ":\n"
+              << "    mov edi, " << lineNumber << "\n"
+              << "    lea rsi, [rip + mc_message" << id << "]\n"
+              << "    mov edx, " << message.size() << "\n"
+              << "    jmp mc_fail\n";
+    }
+
+    void checkRead(VariableNode* var) {
+        if (!var->checked)
+            return;
+        line("cmp " + definedFlag(var->slot) + ", 0");
+        failIfZero(undefinedMessage(var), var->lineNumber);
+    }
+
+    // Applies op to a (a register) and b, leaving the result in dest (a scratch register)
+    void operation(BinOpNode* node, const std::string& a, const std::string& b, const std::string& dest) {
+        switch (node->op) {
+            case O_ADD:
+            case O_SUB:
+                line(std::string(node->op == O_ADD ? "add " : "sub ") + a + ", " + b);
+                break;
+            case O_MUL:
+                if (!b.empty() && (isdigit(static_cast<unsigned char>(b[0])) || b[0] == '-'))
+                    line("imul " + a + ", " + a + ", " + b);
+                else
+                    line("imul " + a + ", " + b);
+                break;
+            case O_DIV:
+            case O_MOD:
+                if (!(node->right->type == N_NUMBER && static_cast<NumberNode*>(node->right)->value != 0)) {
+                    line("test " + b + ", " + b);
+                    failIfZero(node->op == O_DIV ? "Division by zero at line " : "Modulo by zero at line ",
+                               node->lineNumber);
+                }
+                if (a != "eax")
+                    line("mov eax, " + a);
+                line("cdq");
+                line("idiv " + b);
+                line("mov " + dest + ", " + (node->op == O_DIV ? "eax" : "edx"));
+                return;
+            default:
+                line("cmp " + a + ", " + b);
+                line(std::string("set") + conditionCode(node->op, false) + " " + scratch8(dest));
+                line("movzx " + dest + ", " + scratch8(dest));
+                return;
+        }
+        if (a != dest)
+            line("mov " + dest + ", " + a);
+    }
+
+    // Evaluates an expression into scratch register k
+    void expression(ASTNode* node, int k) {
+        const char* dest = scratch(k);
+        switch (node->type) {
+            case N_NUMBER:
+                line(std::string("mov ") + dest + ", " + std::to_string(static_cast<NumberNode*>(node)->value));
+                break;
+            case N_VARIABLE: {
+                VariableNode* var = static_cast<VariableNode*>(node);
+                checkRead(var);
+                line(std::string("mov ") + dest + ", " + location(var->slot));
+                break;
+            }
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                expression(unaryOp->operand, k);
+                if (unaryOp->op == O_SUB) {
+                    line(std::string("neg ") + dest);
+                } else if (unaryOp->op == O_NOT) {
+                    line(std::string("test ") + dest + ", " + dest);
+                    line(std::string("sete ") + scratch8(dest));
+                    line(std::string("movzx ") + dest + ", " + scratch8(dest));
+                }
+                break;
+            }
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                expression(binOp->left, k);
+                bool division = binOp->op == O_DIV || binOp->op == O_MOD;
+                std::string right = division ? "" : leaf(binOp->right);
+                if (!right.empty()) {
+                    operation(binOp, dest, right, dest);
+                } else if (k + 1 < SCRATCH_COUNT) {
+                    expression(binOp->right, k + 1);
+                    operation(binOp, dest, scratch(k + 1), dest);
+                } else {
+                    // Out of scratch registers: park the left operand on the stack
+                    line(std::string("push ") + scratch64(k));
+                    expression(binOp->right, k);
+                    line("pop rax");
+                    operation(binOp, "eax", dest, dest);
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+    // Jumps to target when the condition is (jumpIf) true or false
+    void branch(ASTNode* condition, const std::string& target, bool jumpIf) {
+        if (condition->type == N_UNARY_OP && static_cast<UnaryOpNode*>(condition)->op == O_NOT) {
+            branch(static_cast<UnaryOpNode*>(condition)->operand, target, !jumpIf);
+            return;
+        }
+        if (condition->type == N_BIN_OP && isComparison(static_cast<BinOpNode*>(condition)->op)) {
+            BinOpNode* compare = static_cast<BinOpNode*>(condition);
+            // cmp takes a register or memory on the left, not an immediate
+            std::string left = compare->left->type == N_VARIABLE ? leaf(compare->left) : "";
+            if (left.empty()) {
+                expression(compare->left, 0);
+                left = scratch(0);
+            }
+            std::string right = leaf(compare->right);
+            if (right.empty() || (isMemory(left) && isMemory(right))) {
+                expression(compare->right, 1);
+                right = scratch(1);
+            }
+            line("cmp " + left + ", " + right);
+            line(std::string("j") + conditionCode(compare->op, !jumpIf) + " " + target);
+            return;
+        }
+        expression(condition, 0);
+        line(std::string("test ") + scratch(0) + ", " + scratch(0));
+        line(std::string(jumpIf ? "jne " : "je ") + target);
+    }
+
+    void assignment(AssignNode* assign) {
+        std::string target = location(assign->slot);
+        ASTNode* value = assign->value;
+        std::string direct = leaf(value);
+        if (!direct.empty() && !(isMemory(target) && isMemory(direct))) {
+            line("mov " + target + ", " + direct);
+        } else if (!updateInPlace(assign)) {
+            expression(value, 0);
+            line("mov " + target + ", " + scratch(0));
+        }
+        if (checked[assign->slot])
+            line("mov " + definedFlag(assign->slot) + ", 1");
+    }
+
+    // x = x + e, x = x - e and (x in a register) x = x * e with e a leaf update x directly
+    bool updateInPlace(AssignNode* assign) {
+        if (assign->value->type != N_BIN_OP)
+            return false;
+        BinOpNode* binOp = static_cast<BinOpNode*>(assign->value);
+        if (binOp->left->type != N_VARIABLE)
+            return false;
+        VariableNode* self = static_cast<VariableNode*>(binOp->left);
+        if (self->checked || self->slot != assign->slot)
+            return false;
+        std::string target = location(assign->slot);
+        std::string right = leaf(binOp->right);
+        if (right.empty() || (isMemory(target) && isMemory(right)))
+            return false;
+        if (binOp->op == O_ADD || binOp->op == O_SUB) {
+            line(std::string(binOp->op == O_ADD ? "add " : "sub ") + target + ", " + right);
+            return true;
+        }
+        if (binOp->op == O_MUL && inRegister(assign->slot)) {
+            operation(binOp, target, right, target);
+            return true;
+        }
+        return false;
+    }
+
+    void statement(ASTNode* node) {
+        switch (node->type) {
+            case N_ASSIGN:
+                assignment(static_cast<AssignNode*>(node));
+                break;
+            case N_PRINT:
+                expression(static_cast<PrintNode*>(node)->expression, 0); // edi
+                line("call mc_print");
+                break;
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                std::string otherwise = newLabel();
+                branch(ifNode->condition, otherwise, false);
+                statement(ifNode->trueBlock);
+                if (ifNode->falseBlock) {
+                    std::string end = newLabel();
+                    line("jmp " + end);
+                    code << otherwise << ":\n";
+                    statement(ifNode->falseBlock);
+                    code << end << ":\n";
+                } else {
+                    code << otherwise << ":\n";
+                }
+                break;
+            }
+            case N_WHILE: {
+                // Rotated: the condition is tested at the bottom, and once on entry
+                WhileNode* whileNode = static_cast<WhileNode*>(node);
+                std::string body = newLabel();
+                std::string test = newLabel();
+                line("jmp " + test);
+                line(".p2align 4");
+                code << body << ":\n";
+                statement(whileNode->block);
+                code << test << ":\n";
+                branch(whileNode->condition, body, true);
+                break;
+            }
+            case N_BLOCK: {
+                BlockNode* block = static_cast<BlockNode*>(node);
+                for (ASTNode* stmt : block->statements)
+                    statement(stmt);
+                // Variables declared in this block go out of scope (only non-empty with block scoping)
+                for (int slot = block->firstSlot; slot < block->firstSlot + block->slotCount; slot++) {
+                    if (checked[slot])
+                        line("mov " + definedFlag(slot) + ", 0");
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+    // mc_print (edi: value), mc_flush and mc_fail (edi: line, rsi/edx: message). They
+    // clobber only rax, rcx, rdx, rsi, rdi and r8-r11, never a variable register.
+    static const char* runtime() {
+        return
+            "# Appends the signed value in r8 in decimal at r9, advancing r9\n"
+            "mc_append_int:\n"
+            "    mov rax, r8\n"
+            "    test rax, rax\n"
+            "    jns 1f\n"
+            "    mov byte ptr [r9], 45\n"
+            "    inc r9\n"
+            "    neg rax\n"
+            "1:  lea r11, [rsp - 8]\n"
+            "    mov rcx, r11\n"
+            "    mov r10d, 10\n"
+            "2:  xor edx, edx\n"
+            "    div r10\n"
+            "    add dl, 48\n"
+            "    dec rcx\n"
+            "    mov byte ptr [rcx], dl\n"
+            "    test rax, rax\n"
+            "    jnz 2b\n"
+            "3:  mov dl, byte ptr [rcx]\n"
+            "    mov byte ptr [r9], dl\n"
+            "    inc rcx\n"
+            "    inc r9\n"
+            "    cmp rcx, r11\n"
+            "    jne 3b\n"
+            "    ret\n"
+            "\n"
+            "mc_print:\n"
+            "    movsxd r8, edi\n"
+            "    cmp qword ptr [rip + mc_used], 65536 - 12\n"
+            "    jbe 1f\n"
+            "    call mc_flush\n"
+            "1:  lea r9, [rip + mc_out]\n"
+            "    add r9, qword ptr [rip + mc_used]\n"
+            "    call mc_append_int\n"
+            "    mov byte ptr [r9], 10\n"
+            "    inc r9\n"
+            "    lea rax, [rip + mc_out]\n"
+            "    sub r9, rax\n"
+            "    mov qword ptr [rip + mc_used], r9\n"
+            "    ret\n"
+            "\n"
+            "mc_flush:\n"
+            "    lea rsi, [rip + mc_out]\n"
+            "    mov rdx, qword ptr [rip + mc_used]\n"
+            "1:  test rdx, rdx\n"
+            "    jz 2f\n"
+            "    mov edi, 1\n"
+            "    mov eax, 1\n"
+            "    syscall\n"
+            "    cmp rax, -4\n"
+            "    je 1b\n"
+            "    test rax, rax\n"
+            "    jle 2f\n"
+            "    add rsi, rax\n"
+            "    sub rdx, rax\n"
+            "    jmp 1b\n"
+            "2:  mov qword ptr [rip + mc_used], 0\n"
+            "    ret\n"
+            "\n"
+            "# Flushes the output, prints \"Error: <message><line>\" on stderr and exits with status 1\n"
+            "mc_fail:\n"
+            "    mov ebx, edi\n"
+            "    mov r12, rsi\n"
+            "    mov r13, rdx\n"
+            "    call mc_flush\n"
+            "    mov edi, 2\n"
+            "    lea rsi, [rip + mc_error]\n"
+            "    mov edx, 7\n"
+            "    mov eax, 1\n"
+            "    syscall\n"
+            "    mov edi, 2\n"
+            "    mov rsi, r12\n"
+            "    mov rdx, r13\n"
+            "    mov eax, 1\n"
+            "    syscall\n"
+            "    movsxd r8, ebx\n"
+            "    lea r9, [rip + mc_out]\n"
+            "    call mc_append_int\n"
+            "    mov byte ptr [r9], 10\n"
+            "    inc r9\n"
+            "    lea rsi, [rip + mc_out]\n"
+            "    mov rdx, r9\n"
+            "    sub rdx, rsi\n"
+            "    mov edi, 2\n"
+            "    mov eax, 1\n"
+            "    syscall\n"
+            "    mov edi, 1\n"
+            "    mov eax, 231\n"
+            "    syscall\n";
+    }
+
+public:
+    explicit AsmEmitter(const SymbolTable& symbols)
+        : symbols(symbols), checked(symbols.frameSize, 0), variableRegister(symbols.frameSize, -1), labelCount(0) {}
+
+    std::string emit(ASTNode* root) {
+        findCheckedSlots(root, checked);
+        allocateRegisters(root);
+        for (int slot = 0; slot < symbols.frameSize; slot++) {
+            if (inRegister(slot))
+                line(std::string("xor ") + location(slot) + ", " + location(slot));
+        }
+        statement(root);
+        line("call mc_flush");
+        line("xor edi, edi");
+        line("mov eax, 231");
+        line("syscall");
+
+        std::ostringstream file;
+        file << "# Generated by mini_compiler --emit=asm\n"
+             << "    .intel_syntax noprefix\n"
+             << "    .text\n"
+             << "    .globl _start\n"
+             << "_start:\n";
+        for (int slot = 0; slot < symbols.frameSize; slot++) {
+            if (inRegister(slot))
+                file << "    # " << location(slot) << ": slot " << slot << "\n";
+        }
+        file << code.str() << "\n" << stubs.str() << "\n" << runtime() << "\n"
+             << "    .section .rodata\n"
+             << "mc_error:\n    .ascii \"Error: \"\n"
+             << strings.str() << "\n"
+             << "    .bss\n"
+             << "    .p2align 4\n"
+             << "mc_vars:\n    .zero " << std::max(symbols.frameSize, 1) * 4 << "\n"
+             << "mc_defined:\n    .zero " << std::max(symbols.frameSize, 1) << "\n"
+             << "    .p2align 3\n"
+             << "mc_used:\n    .zero 8\n"
+             << "mc_out:\n    .zero 65536\n"
+             << "    .section .note.GNU-stack,\"\",@progbits\n";
+        return file.str();
+    }
+};
+
+// Generates a C99 file. Variables are locals of main(), which the C compiler keeps in
+// registers. Anything that can fail is emitted as a statement in evaluation order, so
+// expressions are free of side effects and C's unspecified operand order does not
+// matter; arithmetic goes through unsigned to wrap instead of overflowing.
+class CEmitter {
+private:
+    // An expression free of side effects, and how deeply nested its text is
+    struct Expr {
+        std::string text;
+        int depth;
+    };
+
+    // Nesting at which an expression is bound to a temporary, well within what
+    // C compilers accept
+    static const int MAX_EXPR_DEPTH = 32;
+
+    const SymbolTable& symbols;
+    std::vector<char> checked;
+    std::ostringstream code;
+    int indent;
+    int temporaries;
+
+    CEmitter(const CEmitter&);
+    CEmitter& operator=(const CEmitter&);
+
+    void line(const std::string& text) {
+        code << std::string(static_cast<size_t>(indent) * 4, ' ') << text << "\n";
+    }
+
+    static std::string variable(int slot) {
+        return "v" + std::to_string(slot);
+    }
+
+    static std::string flag(int slot) {
+        return "d" + std::to_string(slot);
+    }
+
+    static std::string quoted(const std::string& text) {
+        return "\"" + text + "\"";
+    }
+
+    Expr bind(const Expr& value) {
+        std::string name = "t" + std::to_string(temporaries++);
+        line("int " + name + " = " + value.text + ";");
+        Expr result = {name, 0};
+        return result;
+    }
+
+    Expr expression(ASTNode* node) {
+        Expr result = {"", 0};
+        switch (node->type) {
+            case N_NUMBER: {
+                int value = static_cast<NumberNode*>(node)->value;
+                result.text = value == -2147483647 - 1 ? "(-2147483647 - 1)" :
+                              value < 0 ? "(" + std::to_string(value) + ")" : std::to_string(value);
+                return result;
+            }
+            case N_VARIABLE: {
+                VariableNode* var = static_cast<VariableNode*>(node);
+                if (var->checked) {
+                    line("if (!" + flag(var->slot) + ") mc_fail(" + quoted(undefinedMessage(var)) + ", " +
+                         std::to_string(var->lineNumber) + ");");
+                }
+                result.text = variable(var->slot);
+                return result;
+            }
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                Expr operand = expression(unaryOp->operand);
+                result.depth = operand.depth + 1;
+                if (unaryOp->op == O_SUB)
+                    result.text = "mc_neg(" + operand.text + ")";
+                else if (unaryOp->op == O_NOT)
+                    result.text = "(!" + operand.text + ")";
+                else
+                    result = operand;
+                break;
+            }
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                Expr left = expression(binOp->left);
+                Expr right = expression(binOp->right);
+                result.depth = std::max(left.depth, right.depth) + 1;
+                switch (binOp->op) {
+                    case O_ADD:
+                    case O_SUB:
+                    case O_MUL:
+                        result.text = std::string(binOp->op == O_ADD ? "mc_add(" : binOp->op == O_SUB ? "mc_sub(" : "mc_mul(") +
+                                      left.text + ", " + right.text + ")";
+                        break;
+                    case O_DIV:
+                    case O_MOD: {
+                        std::string failure = "mc_fail(" +
+                            quoted(binOp->op == O_DIV ? "Division by zero at line " : "Modulo by zero at line ") + ", " +
+                            std::to_string(binOp->lineNumber) + ");";
+                        if (binOp->right->type == N_NUMBER) {
+                            if (static_cast<NumberNode*>(binOp->right)->value == 0) {
+                                // Always fails; the value is never used
+                                line(failure);
+                                result.text = "0";
+                                break;
+                            }
+                        } else {
+                            if (binOp->right->type != N_VARIABLE)
+                                right = bind(right);
+                            line("if (" + right.text + " == 0) " + failure);
+                        }
+                        result.text = "(" + left.text + " " + opKindToString(binOp->op) + " " + right.text + ")";
+                        break;
+                    }
+                    default:
+                        result.text = "(" + left.text + " " + opKindToString(binOp->op) + " " + right.text + ")";
+                        break;
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+        }
+        return result.depth > MAX_EXPR_DEPTH ? bind(result) : result;
+    }
+
+    void statement(ASTNode* node) {
+        switch (node->type) {
+            case N_ASSIGN: {
+                AssignNode* assign = static_cast<AssignNode*>(node);
+                Expr value = expression(assign->value);
+                line(variable(assign->slot) + " = " + value.text + ";");
+                if (checked[assign->slot])
+                    line(flag(assign->slot) + " = 1;");
+                break;
+            }
+            case N_PRINT:
+                line("mc_print(" + expression(static_cast<PrintNode*>(node)->expression).text + ");");
+                break;
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                line("if (" + expression(ifNode->condition).text + ") {");
+                indent++;
+                statement(ifNode->trueBlock);
+                indent--;
+                if (ifNode->falseBlock) {
+                    line("} else {");
+                    indent++;
+                    statement(ifNode->falseBlock);
+                    indent--;
+                }
+                line("}");
+                break;
+            }
+            case N_WHILE: {
+                WhileNode* whileNode = static_cast<WhileNode*>(node);
+                line("for (;;) {");
+                indent++;
+                line("if (!" + expression(whileNode->condition).text + ") break;");
+                statement(whileNode->block);
+                indent--;
+                line("}");
+                break;
+            }
+            case N_BLOCK: {
+                BlockNode* block = static_cast<BlockNode*>(node);
+                line("{");
+                indent++;
+                for (ASTNode* stmt : block->statements)
+                    statement(stmt);
+                // Variables declared in this block go out of scope (only non-empty with block scoping)
+                for (int slot = block->firstSlot; slot < block->firstSlot + block->slotCount; slot++) {
+                    if (checked[slot])
+                        line(flag(slot) + " = 0;");
+                }
+                indent--;
+                line("}");
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+    static const char* runtime() {
+        return
+            "#include <errno.h>\n"
+            "#include <stdlib.h>\n"
+            "#include <string.h>\n"
+            "#include <unistd.h>\n"
+            "\n"
+            "static char mc_out[65536];\n"
+            "static size_t mc_used;\n"
+            "\n"
+            "/* Wrapping 32-bit arithmetic, as in the interpreter */\n"
+            "static inline int mc_add(int a, int b) { return (int)((unsigned)a + (unsigned)b); }\n"
+            "static inline int mc_sub(int a, int b) { return (int)((unsigned)a - (unsigned)b); }\n"
+            "static inline int mc_mul(int a, int b) { return (int)((unsigned)a * (unsigned)b); }\n"
+            "static inline int mc_neg(int a) { return (int)(0u - (unsigned)a); }\n"
+            "\n"
+            "static void mc_flush(void) {\n"
+            "    size_t done = 0;\n"
+            "    while (done < mc_used) {\n"
+            "        ssize_t written = write(1, mc_out + done, mc_used - done);\n"
+            "        if (written < 0 && errno == EINTR)\n"
+            "            continue;\n"
+            "        if (written <= 0)\n"
+            "            break;\n"
+            "        done += (size_t)written;\n"
+            "    }\n"
+            "    mc_used = 0;\n"
+            "}\n"
+            "\n"
+            "static size_t mc_format(char* at, int value) {\n"
+            "    char digits[12];\n"
+            "    size_t length = 0, count = 0;\n"
+            "    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;\n"
+            "    if (value < 0)\n"
+            "        at[length++] = '-';\n"
+            "    do {\n"
+            "        digits[count++] = (char)('0' + magnitude % 10);\n"
+            "        magnitude /= 10;\n"
+            "    } while (magnitude);\n"
+            "    while (count)\n"
+            "        at[length++] = digits[--count];\n"
+            "    return length;\n"
+            "}\n"
+            "\n"
+            "static void mc_print(int value) {\n"
+            "    if (sizeof(mc_out) - mc_used < 12)\n"
+            "        mc_flush();\n"
+            "    mc_used += mc_format(mc_out + mc_used, value);\n"
+            "    mc_out[mc_used++] = '\\n';\n"
+            "}\n"
+            "\n"
+            "/* Flushes the output, prints \"Error: <message><line>\" on stderr and exits with status 1 */\n"
+            "static void mc_fail(const char* message, int line) __attribute__((noreturn, cold));\n"
+            "static void mc_fail(const char* message, int line) {\n"
+            "    char number[16];\n"
+            "    size_t length;\n"
+            "    mc_flush();\n"
+            "    length = mc_format(number, line);\n"
+            "    number[length++] = '\\n';\n"
+            "    if (write(2, \"Error: \", 7) < 0 || write(2, message, strlen(message)) < 0 || write(2, number, length) < 0)\n"
+            "        exit(1);\n"
+            "    exit(1);\n"
+            "}\n";
+    }
+
+public:
+    explicit CEmitter(const SymbolTable& symbols)
+        : symbols(symbols), checked(symbols.frameSize, 0), indent(1), temporaries(0) {}
+
+    std::string emit(ASTNode* root) {
+        findCheckedSlots(root, checked);
+        for (int slot = 0; slot < symbols.frameSize; slot++) {
+            line("int " + variable(slot) + " = 0; /* " +
+                 (slot < static_cast<int>(symbols.names.size()) ? symbols.names[slot] : std::string("?")) + " */");
+            if (checked[slot])
+                line("unsigned char " + flag(slot) + " = 0;");
+        }
+        statement(root);
+        line("mc_flush();");
+        line("return 0;");
+
+        std::ostringstream file;
+        file << "/* Generated by mini_compiler --emit=c */\n"
+             << runtime() << "\n"
+             << "int main(void) {\n"
+             << code.str()
+             << "}\n";
+        return file.str();
+    }
+};
+
+// Runs the tree engine's front end on the program in data[0, size) and returns it as
+// assembly or C source. Errors are thrown as std::runtime_error.
+inline std::string emitNative(const char* data, size_t size, const PipelineOptions& options, EmitTarget target) {
+    ParallelLexer lexer(data, size, options.lexThreads);
+    Queue<Token> tokens = lexer.generateTokens();
+
+    // The emitters recurse
+    Parser parser(std::move(tokens));
+    parser.setDepthLimit(options.maxDepth > 0 && options.maxDepth < RECURSIVE_DEPTH_LIMIT ? options.maxDepth
+                                                                                          : RECURSIVE_DEPTH_LIMIT);
+    ASTHolder root(parser.parse());
+    if (options.optimize) {
+        Optimizer optimizer(options.blockScope, options.optReport);
+        root.reset(optimizer.optimize(root.get()));
+    }
+
+    TypeChecker types;
+    types.check(root.get());
+    if (types.usesArrays())
+        throw std::runtime_error("Arrays are not supported by --emit at line " + std::to_string(types.arrayLine()));
+    Resolver resolver(options.blockScope);
+    SymbolTable symbols = resolver.resolve(root.get());
+    DefiniteAssignment(options.warnUndefined).analyze(root.get(), symbols);
+
+    if (target == EMIT_ASM)
+        return AsmEmitter(symbols).emit(root.get());
+    return CEmitter(symbols).emit(root.get());
+}
+
+// Runs a build tool and waits for it; its exit status, or -1 if it could not be started
+inline int runBuildTool(const std::vector<std::string>& command) {
+    std::vector<char*> argv;
+    for (const std::string& arg : command)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+        return -1;
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Writes source next to output and builds the executable output from it: with $AS
+// (default as) and $LD (default ld) for assembly, with $CC (default cc) -O2 for C.
+// The intermediate files are removed once the build succeeds.
+inline void buildNative(const std::string& source, EmitTarget target, const std::string& output) {
+    std::string sourcePath = output + (target == EMIT_ASM ? ".s" : ".c");
+    std::string objectPath = output + ".o";
+    {
+        std::ofstream file(sourcePath.c_str(), std::ios::binary);
+        file << source;
+        if (!file)
+            throw std::runtime_error("Could not write " + sourcePath);
+    }
+
+    const char* as = std::getenv("AS");
+    const char* ld = std::getenv("LD");
+    const char* cc = std::getenv("CC");
+    std::vector<std::vector<std::string> > steps;
+    if (target == EMIT_ASM) {
+        steps.push_back({as && *as ? as : "as", "-o", objectPath, sourcePath});
+        steps.push_back({ld && *ld ? ld : "ld", "-o", output, objectPath});
+    } else {
+        steps.push_back({cc && *cc ? cc : "cc", "-O2", "-o", output, sourcePath});
+    }
+    for (const std::vector<std::string>& step : steps) {
+        int status = runBuildTool(step);
+        if (status != 0) {
+            throw std::runtime_error("'" + step[0] + "' " + (status < 0 ? "could not be run" : "failed with status " + std::to_string(status)) +
+                                     " building " + output + " (source kept in " + sourcePath + ")");
+        }
+    }
+    std::remove(sourcePath.c_str());
+    if (target == EMIT_ASM)
+        std::remove(objectPath.c_str());
+}
+
+#endif // NATIVE_EMITTER_H
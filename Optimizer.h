@@ -0,0 +1,760 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "Parser.h"
+#include "ASTPrinter.h"
+#include "TypeChecker.h"
+#include <vector>
+#include <string>
+#include <ostream>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+// 32-bit two's complement arithmetic, as the engines compute it at runtime
+inline int wrapAdd(int a, int b) { return static_cast<int>(static_cast<unsigned int>(a) + static_cast<unsigned int>(b)); }
+inline int wrapSub(int a, int b) { return static_cast<int>(static_cast<unsigned int>(a) - static_cast<unsigned int>(b)); }
+inline int wrapMul(int a, int b) { return static_cast<int>(static_cast<unsigned int>(a) * static_cast<unsigned int>(b)); }
+inline int wrapNeg(int a) { return static_cast<int>(0u - static_cast<unsigned int>(a)); }
+
+// Evaluates a binary operator on constants. Returns false when the operation has to stay
+// in the tree because it fails at runtime (division or modulo by zero, INT_MIN / -1).
+inline bool foldBinary(OpKind op, int left, int right, int& result) {
+    switch (op) {
+        case O_ADD: result = wrapAdd(left, right); return true;
+        case O_SUB: result = wrapSub(left, right); return true;
+        case O_MUL: result = wrapMul(left, right); return true;
+        case O_DIV:
+        case O_MOD:
+            if (right == 0 || (left == INT_MIN && right == -1))
+                return false;
+            result = op == O_DIV ? left / right : left % right;
+            return true;
+        case O_EQ: result = left == right; return true;
+        case O_NE: result = left != right; return true;
+        case O_LT: result = left < right; return true;
+        case O_LE: result = left <= right; return true;
+        case O_GT: result = left > right; return true;
+        case O_GE: result = left >= right; return true;
+        default: return false;
+    }
+}
+
+// Optimizer runs between Parser::parse() and execution and rewrites the AST in place:
+// - folds constant subexpressions (never an operation that would fail at runtime, so
+//   division or modulo by a constant zero still raises its error at the same line)
+// - applies identities: x+0, 0+x, x-0, x*1, 1*x, x/1, +x, -(-x) become x, and x*0, 0*x
+//   become 0 when x can neither fail nor read a possibly undefined variable
+// - simplifies !!e to e where only the truth value is used (if / while conditions)
+// - removes if branches whose condition is constant and while loops that never run
+// - moves loop-invariant expressions out of while loops and strength-reduces induction
+//   variable products (see optimizeLoop)
+// Array-valued expressions are never hoisted or replaced by 0, since an array operation
+// can fail on arrays of different lengths; storing an element counts as assigning the
+// array. It must run before Resolver, which assigns slots to the final tree.
+class Optimizer {
+private:
+    // What a while loop assigns, and the statements to run before it
+    struct LoopInfo {
+        std::unordered_map<std::string, int> assigns; // name -> assignments anywhere in the loop
+        std::vector<AssignNode*> temps;               // invariant temporaries, in prelude order
+        std::string report;
+    };
+
+    bool blockScoping;
+    std::unordered_set<std::string> assigned; // names definitely assigned at the current point
+    int rewrites;
+    std::ostream* report;          // per-loop report (--verbose-opt), or nullptr
+    std::vector<ASTNode*> prelude; // statements the last optimized loop wants placed before it
+    int nextTemp;
+    int nextInduction;
+    bool inBlock;                  // is the statement being optimized directly inside a block?
+
+    static bool isNumber(ASTNode* node, int value) {
+        return node->type == N_NUMBER && static_cast<NumberNode*>(node)->value == value;
+    }
+
+    ASTNode* replaceWithNumber(ASTNode* node, int value) {
+        NumberNode* number = new NumberNode(value, node->lineNumber);
+        delete node;
+        rewrites++;
+        return number;
+    }
+
+    // Can evaluating this expression neither fail nor read an undefined variable?
+    bool isSafe(ASTNode* node) const {
+        if (node->isArray)
+            return false;
+        switch (node->type) {
+            case N_NUMBER:
+                return true;
+            case N_VARIABLE:
+                return assigned.count(static_cast<VariableNode*>(node)->name) > 0;
+            case N_UNARY_OP:
+                return isSafe(static_cast<UnaryOpNode*>(node)->operand);
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                if (binOp->op == O_DIV || binOp->op == O_MOD) {
+                    // Only a constant divisor other than 0 and -1 can never fail
+                    if (binOp->right->type != N_NUMBER || isNumber(binOp->right, 0) || isNumber(binOp->right, -1))
+                        return false;
+                }
+                return isSafe(binOp->left) && isSafe(binOp->right);
+            }
+            default:
+                return false;
+        }
+    }
+
+    // Replaces 'node' by its child 'keep', freeing everything else
+    ASTNode* collapseTo(BinOpNode* node, ASTNode* keep) {
+        if (keep == node->left)
+            node->left = nullptr;
+        else
+            node->right = nullptr;
+        delete node;
+        rewrites++;
+        return keep;
+    }
+
+    ASTNode* optimizeBinOp(BinOpNode* node) {
+        node->left = optimizeExpression(node->left, false);
+        node->right = optimizeExpression(node->right, false);
+        ASTNode* left = node->left;
+        ASTNode* right = node->right;
+        int result;
+        if (left->type == N_NUMBER && right->type == N_NUMBER &&
+            foldBinary(node->op, static_cast<NumberNode*>(left)->value, static_cast<NumberNode*>(right)->value, result))
+            return replaceWithNumber(node, result);
+        switch (node->op) {
+            case O_ADD:
+                if (isNumber(right, 0)) return collapseTo(node, left);
+                if (isNumber(left, 0)) return collapseTo(node, right);
+                break;
+            case O_SUB:
+                if (isNumber(right, 0)) return collapseTo(node, left);
+                break;
+            case O_MUL:
+                if (isNumber(right, 1)) return collapseTo(node, left);
+                if (isNumber(left, 1)) return collapseTo(node, right);
+                if ((isNumber(right, 0) && isSafe(left)) || (isNumber(left, 0) && isSafe(right)))
+                    return replaceWithNumber(node, 0);
+                break;
+            case O_DIV:
+                if (isNumber(right, 1)) return collapseTo(node, left);
+                break;
+            default:
+                break;
+        }
+        return node;
+    }
+
+    ASTNode* optimizeUnaryOp(UnaryOpNode* node, bool condition) {
+        // Only the truth value of the operand of ! matters
+        node->operand = optimizeExpression(node->operand, node->op == O_NOT);
+        ASTNode* operand = node->operand;
+        if (operand->type == N_NUMBER) {
+            int value = static_cast<NumberNode*>(operand)->value;
+            if (node->op == O_SUB)
+                return replaceWithNumber(node, wrapNeg(value));
+            if (node->op == O_NOT)
+                return replaceWithNumber(node, !value);
+        }
+        bool unwrapSelf = node->op == O_ADD;
+        bool unwrapPair = operand->type == N_UNARY_OP && static_cast<UnaryOpNode*>(operand)->op == node->op &&
+                          (node->op == O_SUB || (node->op == O_NOT && condition));
+        if (unwrapSelf || unwrapPair) {
+            // +e is e; -(-e) is e; !!e has the truth value of e
+            ASTNode* keep = unwrapSelf ? operand : static_cast<UnaryOpNode*>(operand)->operand;
+            if (unwrapSelf)
+                node->operand = nullptr;
+            else
+                static_cast<UnaryOpNode*>(operand)->operand = nullptr;
+            delete node;
+            rewrites++;
+            return keep;
+        }
+        return node;
+    }
+
+    // 'condition' is true where only the truth value of the result matters
+    ASTNode* optimizeExpression(ASTNode* node, bool condition) {
+        switch (node->type) {
+            case N_BIN_OP:
+                return optimizeBinOp(static_cast<BinOpNode*>(node));
+            case N_UNARY_OP:
+                return optimizeUnaryOp(static_cast<UnaryOpNode*>(node), condition);
+            case N_INDEX: {
+                IndexNode* index = static_cast<IndexNode*>(node);
+                index->array = optimizeExpression(index->array, false);
+                index->index = optimizeExpression(index->index, false);
+                return node;
+            }
+            case N_CALL: {
+                CallNode* call = static_cast<CallNode*>(node);
+                call->argument = optimizeExpression(call->argument, false);
+                return node;
+            }
+            case N_ARRAY_LITERAL:
+                for (ASTNode*& element : static_cast<ArrayLiteralNode*>(node)->elements)
+                    element = optimizeExpression(element, false);
+                return node;
+            default:
+                return node;
+        }
+    }
+
+    static bool isConstant(ASTNode* node, int& value) {
+        if (node->type != N_NUMBER)
+            return false;
+        value = static_cast<NumberNode*>(node)->value;
+        return true;
+    }
+
+    // Returns the optimized statement, or nullptr when it was removed
+    ASTNode* optimizeStatement(ASTNode* node) {
+        switch (node->type) {
+            case N_ASSIGN: {
+                AssignNode* assign = static_cast<AssignNode*>(node);
+                assign->value = optimizeExpression(assign->value, false);
+                assigned.insert(assign->name);
+                return node;
+            }
+            case N_PRINT: {
+                PrintNode* print = static_cast<PrintNode*>(node);
+                print->expression = optimizeExpression(print->expression, false);
+                return node;
+            }
+            case N_INDEX_ASSIGN: {
+                IndexAssignNode* store = static_cast<IndexAssignNode*>(node);
+                store->index = optimizeExpression(store->index, false);
+                store->value = optimizeExpression(store->value, false);
+                return node;
+            }
+            case N_IF:
+                return optimizeIf(static_cast<IfNode*>(node));
+            case N_WHILE:
+                return optimizeWhile(static_cast<WhileNode*>(node));
+            case N_BLOCK:
+                return optimizeBlock(static_cast<BlockNode*>(node));
+            default:
+                return node;
+        }
+    }
+
+    ASTNode* optimizeIf(IfNode* node) {
+        node->condition = optimizeExpression(node->condition, true);
+        int value;
+        if (isConstant(node->condition, value)) {
+            // Keep only the branch that runs
+            ASTNode* taken = value ? node->trueBlock : node->falseBlock;
+            if (value)
+                node->trueBlock = nullptr;
+            else
+                node->falseBlock = nullptr;
+            delete node;
+            rewrites++;
+            return taken ? optimizeNested(taken) : nullptr;
+        }
+        std::unordered_set<std::string> before = assigned;
+        ASTNode* trueBlock = optimizeNested(node->trueBlock);
+        node->trueBlock = trueBlock ? trueBlock : new BlockNode(node->lineNumber);
+        std::unordered_set<std::string> afterTrue;
+        afterTrue.swap(assigned);
+        assigned = before;
+        if (node->falseBlock) {
+            node->falseBlock = optimizeNested(node->falseBlock);
+            if (!node->falseBlock)
+                rewrites++;
+        }
+        // Definitely assigned after the if: assigned on both paths
+        std::unordered_set<std::string> merged;
+        for (const std::string& name : afterTrue)
+            if (assigned.count(name))
+                merged.insert(name);
+        assigned.swap(merged);
+        return node;
+    }
+
+    ASTNode* optimizeWhile(WhileNode* node) {
+        node->condition = optimizeExpression(node->condition, true);
+        int value;
+        if (isConstant(node->condition, value) && value == 0) {
+            delete node;
+            rewrites++;
+            return nullptr;
+        }
+        // The body may run zero times: nothing it assigns is definite afterwards
+        std::unordered_set<std::string> before = assigned;
+        ASTNode* body = optimizeNested(node->block);
+        node->block = body ? body : new BlockNode(node->lineNumber);
+        assigned.swap(before);
+        optimizeLoop(node);
+        return node;
+    }
+
+    // Optimizes a statement that is not directly inside a block (an if branch or a loop
+    // body). A loop there that needs a prelude gets wrapped in a block of its own.
+    ASTNode* optimizeNested(ASTNode* node) {
+        bool outer = inBlock;
+        inBlock = false;
+        ASTNode* optimized = optimizeStatement(node);
+        inBlock = outer;
+        if (prelude.empty())
+            return optimized;
+        BlockNode* wrapper = new BlockNode(optimized->lineNumber);
+        wrapper->statements.swap(prelude);
+        wrapper->statements.push_back(optimized);
+        return wrapper;
+    }
+
+    ASTNode* optimizeBlock(BlockNode* node) {
+        std::unordered_set<std::string> before;
+        if (blockScoping)
+            before = assigned;
+        std::vector<ASTNode*> kept;
+        kept.reserve(node->statements.size());
+        for (ASTNode* stmt : node->statements) {
+            inBlock = true;
+            ASTNode* optimized = optimizeStatement(stmt);
+            kept.insert(kept.end(), prelude.begin(), prelude.end());
+            prelude.clear();
+            // Empty nested blocks declare nothing and do nothing
+            if (optimized && optimized->type == N_BLOCK && static_cast<BlockNode*>(optimized)->statements.empty()) {
+                delete optimized;
+                optimized = nullptr;
+                rewrites++;
+            }
+            if (optimized)
+                kept.push_back(optimized);
+        }
+        node->statements.swap(kept);
+        if (blockScoping) {
+            // Names first assigned in the block go out of scope with it
+            assigned.swap(before);
+        }
+        return node;
+    }
+
+    // Loop optimizations
+
+    static int assignCount(const LoopInfo& loop, const std::string& name) {
+        std::unordered_map<std::string, int>::const_iterator it = loop.assigns.find(name);
+        return it == loop.assigns.end() ? 0 : it->second;
+    }
+
+    static bool isTemporary(const std::string& name) {
+        return !name.empty() && name[0] == '$'; // the lexer never produces '$'
+    }
+
+    static void collectAssignments(ASTNode* node, std::unordered_map<std::string, int>& counts) {
+        switch (node->type) {
+            case N_ASSIGN:
+                counts[static_cast<AssignNode*>(node)->name]++;
+                break;
+            case N_INDEX_ASSIGN:
+                counts[static_cast<IndexAssignNode*>(node)->target->name]++;
+                break;
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                collectAssignments(ifNode->trueBlock, counts);
+                if (ifNode->falseBlock)
+                    collectAssignments(ifNode->falseBlock, counts);
+                break;
+            }
+            case N_WHILE:
+                collectAssignments(static_cast<WhileNode*>(node)->block, counts);
+                break;
+            case N_BLOCK:
+                for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                    collectAssignments(stmt, counts);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Does the expression read none of the variables the loop assigns?
+    static bool isInvariant(ASTNode* node, const LoopInfo& loop) {
+        switch (node->type) {
+            case N_NUMBER:
+                return true;
+            case N_VARIABLE:
+                return loop.assigns.count(static_cast<VariableNode*>(node)->name) == 0;
+            case N_UNARY_OP:
+                return isInvariant(static_cast<UnaryOpNode*>(node)->operand, loop);
+            case N_BIN_OP:
+                return isInvariant(static_cast<BinOpNode*>(node)->left, loop) &&
+                       isInvariant(static_cast<BinOpNode*>(node)->right, loop);
+            default:
+                return false;
+        }
+    }
+
+    static bool sameExpression(ASTNode* a, ASTNode* b) {
+        if (a->type != b->type)
+            return false;
+        switch (a->type) {
+            case N_NUMBER:
+                return static_cast<NumberNode*>(a)->value == static_cast<NumberNode*>(b)->value;
+            case N_VARIABLE:
+                return static_cast<VariableNode*>(a)->name == static_cast<VariableNode*>(b)->name;
+            case N_UNARY_OP:
+                return static_cast<UnaryOpNode*>(a)->op == static_cast<UnaryOpNode*>(b)->op &&
+                       sameExpression(static_cast<UnaryOpNode*>(a)->operand, static_cast<UnaryOpNode*>(b)->operand);
+            case N_BIN_OP: {
+                BinOpNode* left = static_cast<BinOpNode*>(a);
+                BinOpNode* right = static_cast<BinOpNode*>(b);
+                return left->op == right->op && sameExpression(left->left, right->left) &&
+                       sameExpression(left->right, right->right);
+            }
+            default:
+                return false;
+        }
+    }
+
+    // Calls f on every expression slot of a statement, including nested statements
+    template<typename F>
+    static void forEachExpression(ASTNode* node, F& f) {
+        switch (node->type) {
+            case N_ASSIGN:
+                f(static_cast<AssignNode*>(node)->value);
+                break;
+            case N_PRINT:
+                f(static_cast<PrintNode*>(node)->expression);
+                break;
+            case N_INDEX_ASSIGN:
+                f(static_cast<IndexAssignNode*>(node)->index);
+                f(static_cast<IndexAssignNode*>(node)->value);
+                break;
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                f(ifNode->condition);
+                forEachExpression(ifNode->trueBlock, f);
+                if (ifNode->falseBlock)
+                    forEachExpression(ifNode->falseBlock, f);
+                break;
+            }
+            case N_WHILE: {
+                WhileNode* whileNode = static_cast<WhileNode*>(node);
+                f(whileNode->condition);
+                forEachExpression(whileNode->block, f);
+                break;
+            }
+            case N_BLOCK:
+                for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                    forEachExpression(stmt, f);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void note(LoopInfo& loop, const std::string& text) {
+        if (report)
+            loop.report += (loop.report.empty() ? "" : "; ") + text;
+    }
+
+    // Temporaries that inner loops placed in this loop's body and that do not depend on
+    // anything this loop assigns can move further out
+    void moveInvariantTemps(ASTNode* node, LoopInfo& loop) {
+        switch (node->type) {
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                moveInvariantTemps(ifNode->trueBlock, loop);
+                if (ifNode->falseBlock)
+                    moveInvariantTemps(ifNode->falseBlock, loop);
+                break;
+            }
+            case N_WHILE:
+                moveInvariantTemps(static_cast<WhileNode*>(node)->block, loop);
+                break;
+            case N_BLOCK: {
+                std::vector<ASTNode*>& statements = static_cast<BlockNode*>(node)->statements;
+                size_t kept = 0;
+                for (size_t i = 0; i < statements.size(); i++) {
+                    ASTNode* stmt = statements[i];
+                    if (stmt->type == N_ASSIGN) {
+                        AssignNode* assign = static_cast<AssignNode*>(stmt);
+                        if (isTemporary(assign->name) && assignCount(loop, assign->name) == 1 &&
+                            isInvariant(assign->value, loop) && isSafe(assign->value)) {
+                            loop.assigns.erase(assign->name);
+                            loop.temps.push_back(assign);
+                            assigned.insert(assign->name);
+                            note(loop, "moved out " + assign->name + " = " + ASTPrinter::expression(assign->value));
+                            rewrites++;
+                            continue;
+                        }
+                    } else {
+                        moveInvariantTemps(stmt, loop);
+                    }
+                    statements[kept++] = stmt;
+                }
+                statements.resize(kept);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Replaces every occurrence of variable * factor (either order) by the variable 'temp'
+    struct ProductReplacer {
+        const std::string* variable;
+        int factor;
+        const std::string* temp;
+        int count;
+
+        bool matches(ASTNode* node) const {
+            if (node->type != N_BIN_OP || static_cast<BinOpNode*>(node)->op != O_MUL)
+                return false;
+            BinOpNode* binOp = static_cast<BinOpNode*>(node);
+            return (isVariable(binOp->left, *variable) && isNumber(binOp->right, factor)) ||
+                   (isNumber(binOp->left, factor) && isVariable(binOp->right, *variable));
+        }
+
+        void operator()(ASTNode*& node) {
+            if (matches(node)) {
+                int lineNumber = node->lineNumber;
+                delete node;
+                node = new VariableNode(*temp, lineNumber);
+                count++;
+            } else if (node->type == N_BIN_OP) {
+                (*this)(static_cast<BinOpNode*>(node)->left);
+                (*this)(static_cast<BinOpNode*>(node)->right);
+            } else if (node->type == N_UNARY_OP) {
+                (*this)(static_cast<UnaryOpNode*>(node)->operand);
+            }
+        }
+    };
+
+    // Collects the constant factors k of every variable * k and how often each is
+    // evaluated per iteration; a use inside a nested loop counts as several
+    struct FactorCollector {
+        const std::string* variable;
+        std::vector<int> factors;
+        std::vector<int> uses;
+        int weight;
+
+        void operator()(ASTNode*& node) {
+            if (node->type == N_BIN_OP) {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                if (binOp->op == O_MUL) {
+                    int factor;
+                    if ((isVariable(binOp->left, *variable) && isConstant(binOp->right, factor)) ||
+                        (isConstant(binOp->left, factor) && isVariable(binOp->right, *variable))) {
+                        size_t index = std::find(factors.begin(), factors.end(), factor) - factors.begin();
+                        if (index == factors.size()) {
+                            factors.push_back(factor);
+                            uses.push_back(0);
+                        }
+                        uses[index] += weight;
+                        return;
+                    }
+                }
+                (*this)(binOp->left);
+                (*this)(binOp->right);
+            } else if (node->type == N_UNARY_OP) {
+                (*this)(static_cast<UnaryOpNode*>(node)->operand);
+            }
+        }
+
+        void statement(ASTNode* node) {
+            switch (node->type) {
+                case N_ASSIGN:
+                    (*this)(static_cast<AssignNode*>(node)->value);
+                    break;
+                case N_PRINT:
+                    (*this)(static_cast<PrintNode*>(node)->expression);
+                    break;
+                case N_INDEX_ASSIGN:
+                    (*this)(static_cast<IndexAssignNode*>(node)->index);
+                    (*this)(static_cast<IndexAssignNode*>(node)->value);
+                    break;
+                case N_IF: {
+                    IfNode* ifNode = static_cast<IfNode*>(node);
+                    (*this)(ifNode->condition);
+                    statement(ifNode->trueBlock);
+                    if (ifNode->falseBlock)
+                        statement(ifNode->falseBlock);
+                    break;
+                }
+                case N_WHILE: {
+                    WhileNode* whileNode = static_cast<WhileNode*>(node);
+                    int outer = weight;
+                    weight = 2;
+                    (*this)(whileNode->condition);
+                    statement(whileNode->block);
+                    weight = outer;
+                    break;
+                }
+                case N_BLOCK:
+                    for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                        statement(stmt);
+                    break;
+                default:
+                    break;
+            }
+        }
+    };
+
+    static bool isVariable(ASTNode* node, const std::string& name) {
+        return node->type == N_VARIABLE && static_cast<VariableNode*>(node)->name == name;
+    }
+
+    // Is 'stmt' an update 'i = i + c', 'i = c + i' or 'i = i - c'? Sets i and the step.
+    static bool isInductionUpdate(ASTNode* stmt, std::string& variable, int& step) {
+        if (stmt->type != N_ASSIGN || stmt->isArray)
+            return false;
+        AssignNode* assign = static_cast<AssignNode*>(stmt);
+        if (assign->value->type != N_BIN_OP)
+            return false;
+        BinOpNode* binOp = static_cast<BinOpNode*>(assign->value);
+        int constant;
+        if (binOp->op == O_ADD && isVariable(binOp->left, assign->name) && isConstant(binOp->right, constant))
+            step = constant;
+        else if (binOp->op == O_ADD && isConstant(binOp->left, constant) && isVariable(binOp->right, assign->name))
+            step = constant;
+        else if (binOp->op == O_SUB && isVariable(binOp->left, assign->name) && isConstant(binOp->right, constant))
+            step = wrapNeg(constant);
+        else
+            return false;
+        variable = assign->name;
+        return true;
+    }
+
+    // Strength reduction: for an induction variable i that is definitely assigned before
+    // the loop and updated exactly once per iteration by 'i = i + c' at the top level of the
+    // body, every i * k becomes a temporary initialized to i * k before the loop and
+    // advanced by c * k right after the update. Wraparound keeps this exact. The extra
+    // update only pays off when i * k is evaluated more than once per iteration.
+    void strengthReduce(WhileNode* node, LoopInfo& loop) {
+        if (node->block->type != N_BLOCK)
+            return;
+        std::vector<ASTNode*>& statements = static_cast<BlockNode*>(node->block)->statements;
+        for (size_t i = 0; i < statements.size(); i++) {
+            std::string variable;
+            int step;
+            if (!isInductionUpdate(statements[i], variable, step) || assignCount(loop, variable) != 1 ||
+                !assigned.count(variable))
+                continue;
+            FactorCollector collector = {&variable, std::vector<int>(), std::vector<int>(), 1};
+            collector(node->condition);
+            collector.statement(node->block);
+            for (size_t f = 0; f < collector.factors.size(); f++) {
+                if (collector.uses[f] < 2)
+                    continue;
+                int factor = collector.factors[f];
+                std::string temp = "$s" + std::to_string(nextInduction++);
+                ProductReplacer replacer = {&variable, factor, &temp, 0};
+                replacer(node->condition);
+                forEachExpression(node->block, replacer);
+                int lineNumber = statements[i]->lineNumber;
+                AssignNode* init = new AssignNode(temp, new BinOpNode(new VariableNode(variable, node->lineNumber), O_MUL,
+                                                                      new NumberNode(factor, node->lineNumber), node->lineNumber),
+                                                  node->lineNumber);
+                AssignNode* advance = new AssignNode(temp, new BinOpNode(new VariableNode(temp, lineNumber), O_ADD,
+                                                                         new NumberNode(wrapMul(step, factor), lineNumber), lineNumber),
+                                                     lineNumber);
+                statements.insert(statements.begin() + i + 1, advance);
+                loop.temps.push_back(init);
+                loop.assigns[temp] = 2;
+                assigned.insert(temp);
+                rewrites += replacer.count;
+                note(loop, "strength-reduced " + variable + " * " + std::to_string(factor) + " into " + temp +
+                               " (advanced by " + std::to_string(wrapMul(step, factor)) + ", " +
+                               std::to_string(replacer.count) + " use" + (replacer.count == 1 ? "" : "s") + ")");
+            }
+        }
+    }
+
+    // Replaces maximal invariant subexpressions by temporaries computed before the loop.
+    // Only expressions that cannot fail and read only variables definitely assigned before
+    // the loop are moved, so a loop that never runs or an error inside the loop (division
+    // by zero, undefined variable) behaves exactly as before.
+    struct Hoister {
+        Optimizer* optimizer;
+        LoopInfo* loop;
+
+        void operator()(ASTNode*& node) {
+            if (node->type == N_INDEX) {
+                (*this)(static_cast<IndexNode*>(node)->index);
+                return;
+            }
+            if (node->type != N_BIN_OP && node->type != N_UNARY_OP)
+                return;
+            if (isInvariant(node, *loop) && optimizer->isSafe(node)) {
+                node = optimizer->hoist(node, *loop);
+            } else if (node->type == N_BIN_OP) {
+                (*this)(static_cast<BinOpNode*>(node)->left);
+                (*this)(static_cast<BinOpNode*>(node)->right);
+            } else {
+                (*this)(static_cast<UnaryOpNode*>(node)->operand);
+            }
+        }
+    };
+
+    ASTNode* hoist(ASTNode* expr, LoopInfo& loop) {
+        int lineNumber = expr->lineNumber;
+        rewrites++;
+        // Identical invariant expressions share one temporary
+        for (AssignNode* temp : loop.temps) {
+            if (sameExpression(temp->value, expr)) {
+                delete expr;
+                return new VariableNode(temp->name, lineNumber);
+            }
+        }
+        std::string name = "$t" + std::to_string(nextTemp++);
+        note(loop, "hoisted " + ASTPrinter::expression(expr) + " into " + name);
+        loop.temps.push_back(new AssignNode(name, expr, lineNumber));
+        assigned.insert(name);
+        return new VariableNode(name, lineNumber);
+    }
+
+    // Runs after the loop's body has been optimized, with 'assigned' holding the names
+    // definitely assigned before the loop. New statements go to 'prelude'.
+    void optimizeLoop(WhileNode* node) {
+        if (blockScoping && !inBlock) {
+            // Under block scoping a wrapper block would change where the body's names are
+            // declared, so loops that are not directly inside a block are left alone
+            if (report)
+                *report << "Loop at line " << node->lineNumber << ": not optimized (not directly inside a block)" << std::endl;
+            return;
+        }
+        LoopInfo loop;
+        collectAssignments(node->block, loop.assigns);
+        moveInvariantTemps(node->block, loop);
+        strengthReduce(node, loop);
+        Hoister hoister = {this, &loop};
+        hoister(node->condition);
+        forEachExpression(node->block, hoister);
+        prelude.insert(prelude.end(), loop.temps.begin(), loop.temps.end());
+        if (report) {
+            *report << "Loop at line " << node->lineNumber << ": "
+                    << (loop.report.empty() ? "nothing to hoist" : loop.report) << std::endl;
+        }
+    }
+
+public:
+    Optimizer(bool blockScoping = false, std::ostream* report = nullptr)
+        : blockScoping(blockScoping), rewrites(0), report(report), nextTemp(0), nextInduction(0), inBlock(true) {}
+
+    // Optimizes the program in place; the root block is always kept
+    ASTNode* optimize(ASTNode* root) {
+        TypeChecker().check(root);
+        if (root->type == N_BLOCK) {
+            optimizeBlock(static_cast<BlockNode*>(root));
+            return root;
+        }
+        ASTNode* result = optimizeStatement(root);
+        return result ? result : new BlockNode(root->lineNumber);
+    }
+
+    int rewriteCount() const {
+        return rewrites;
+    }
+};
+
+#endif // OPTIMIZER_H
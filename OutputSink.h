@@ -0,0 +1,212 @@
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define OUTPUTSINK_POSIX 1
+#endif
+
+// Destination for everything a program prints. Output is collected in a large
+// user-space buffer and written with one syscall per flush instead of one per print.
+//
+// - FULLY_BUFFERED flushes when the buffer fills up, on flush() and on destruction.
+// - LINE_BUFFERED additionally flushes after every line, for interactive use.
+//
+// The sink writes to a file descriptor, appends to a caller-owned string, or hands
+// each flushed chunk to a caller-supplied function.
+// Callers that report errors on another stream must flush() first to keep ordering.
+class OutputSink {
+public:
+    enum Mode {
+        FULLY_BUFFERED,
+        LINE_BUFFERED
+    };
+
+    static const size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    // Receives flushed output; context is passed through unchanged
+    typedef void (*WriteFunction)(void* context, const char* data, size_t length);
+
+private:
+    int fd;              // -1 when writing to memory or a function
+    std::string* memory; // in-memory target, or nullptr
+    WriteFunction function;
+    void* context;
+    Mode mode;
+    std::vector<char> buffer;
+    size_t used;
+    unsigned long long flushed; // bytes handed to the target so far
+
+    OutputSink(const OutputSink&);
+    OutputSink& operator=(const OutputSink&);
+
+    void writeOut(const char* data, size_t length) {
+        flushed += length;
+        if (memory) {
+            memory->append(data, length);
+            return;
+        }
+        if (function) {
+            function(context, data, length);
+            return;
+        }
+#ifdef OUTPUTSINK_POSIX
+        while (length > 0) {
+            ssize_t written = ::write(fd, data, length);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return; // nowhere left to report it (closed pipe, full disk)
+            }
+            data += written;
+            length -= static_cast<size_t>(written);
+        }
+#else
+        std::fwrite(data, 1, length, fd == 2 ? stderr : stdout);
+        std::fflush(fd == 2 ? stderr : stdout);
+#endif
+    }
+
+    // Characters in the decimal form of value, sign included
+    static size_t decimalLength(int value) {
+        unsigned int magnitude = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+        size_t length = value < 0 ? 2 : 1;
+        while (magnitude >= 10) {
+            magnitude /= 10;
+            length++;
+        }
+        return length;
+    }
+
+    // Writes the decimal form of value at the end of the buffer; needs at most 11 bytes
+    void appendInt(int value) {
+        static const char digitPairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        char digits[12];
+        char* end = digits + sizeof(digits);
+        char* p = end;
+        unsigned int magnitude = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+        while (magnitude >= 100) {
+            unsigned int pair = (magnitude % 100) * 2;
+            magnitude /= 100;
+            *--p = digitPairs[pair + 1];
+            *--p = digitPairs[pair];
+        }
+        if (magnitude >= 10) {
+            *--p = digitPairs[magnitude * 2 + 1];
+            *--p = digitPairs[magnitude * 2];
+        } else {
+            *--p = static_cast<char>('0' + magnitude);
+        }
+        if (value < 0)
+            *--p = '-';
+        std::memcpy(buffer.data() + used, p, static_cast<size_t>(end - p));
+        used += static_cast<size_t>(end - p);
+    }
+
+public:
+    // Writes to a file descriptor (e.g. 1 for stdout). The descriptor is not closed.
+    explicit OutputSink(int fd, Mode mode = FULLY_BUFFERED, size_t capacity = DEFAULT_CAPACITY)
+        : fd(fd), memory(nullptr), function(nullptr), context(nullptr), mode(mode),
+          buffer(capacity < 64 ? 64 : capacity), used(0), flushed(0) {}
+
+    // Appends to a string owned by the caller
+    explicit OutputSink(std::string* memory, size_t capacity = DEFAULT_CAPACITY)
+        : fd(-1), memory(memory), function(nullptr), context(nullptr), mode(FULLY_BUFFERED),
+          buffer(capacity < 64 ? 64 : capacity), used(0), flushed(0) {}
+
+    // Calls function(context, data, length) with each flushed chunk
+    OutputSink(WriteFunction function, void* context, Mode mode = FULLY_BUFFERED, size_t capacity = DEFAULT_CAPACITY)
+        : fd(-1), memory(nullptr), function(function), context(context), mode(mode),
+          buffer(capacity < 64 ? 64 : capacity), used(0), flushed(0) {}
+
+    ~OutputSink() {
+        flush();
+    }
+
+    // Bytes printInt(value) writes
+    static size_t intLength(int value) {
+        return decimalLength(value) + 1;
+    }
+
+    // Bytes printArray(values, count) writes
+    static size_t arrayLength(const int* values, size_t count) {
+        size_t length = 3 + (count > 0 ? 2 * (count - 1) : 0); // brackets, newline, separators
+        for (size_t i = 0; i < count; i++)
+            length += decimalLength(values[i]);
+        return length;
+    }
+
+    // Prints an integer followed by a newline, like `cout << value << endl`
+    void printInt(int value) {
+        if (buffer.size() - used < 12)
+            flush();
+        appendInt(value);
+        buffer[used++] = '\n';
+        if (mode == LINE_BUFFERED)
+            flush();
+    }
+
+    // Prints an array as [1, 2, 3] followed by a newline
+    void printArray(const int* values, size_t count) {
+        if (buffer.size() - used < 2)
+            flush();
+        buffer[used++] = '[';
+        for (size_t i = 0; i < count; i++) {
+            if (buffer.size() - used < 14)
+                flush();
+            if (i > 0) {
+                buffer[used++] = ',';
+                buffer[used++] = ' ';
+            }
+            appendInt(values[i]);
+        }
+        if (buffer.size() - used < 2)
+            flush();
+        buffer[used++] = ']';
+        buffer[used++] = '\n';
+        if (mode == LINE_BUFFERED)
+            flush();
+    }
+
+    void write(const char* data, size_t length) {
+        if (length > buffer.size() - used) {
+            flush();
+            if (length >= buffer.size()) {
+                writeOut(data, length);
+                return;
+            }
+        }
+        std::memcpy(buffer.data() + used, data, length);
+        used += length;
+        if (mode == LINE_BUFFERED && std::memchr(data, '\n', length))
+            flush();
+    }
+
+    void write(const std::string& text) {
+        write(text.data(), text.size());
+    }
+
+    // Everything printed so far, flushed or not
+    unsigned long long bytesWritten() const {
+        return flushed + used;
+    }
+
+    void flush() {
+        if (used > 0) {
+            writeOut(buffer.data(), used);
+            used = 0;
+        }
+    }
+};
+
+#endif // OUTPUTSINK_H
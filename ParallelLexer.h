@@ -0,0 +1,148 @@
+#ifndef PARALLEL_LEXER_H
+#define PARALLEL_LEXER_H
+
+#include "FastLexer.h"
+#include "ThreadPool.h"
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+
+// Lexes a large source on several threads with the same result as FastLexer (and so
+// Lexer): the same tokens, line numbers, and the same first error.
+//
+// No token spans a newline, so the input is cut into chunks just after newlines, and
+// the chunks are lexed in two parallel passes:
+//
+//   1. count the tokens and newlines of every chunk, remembering where it stopped;
+//   2. lex every chunk again, writing its tokens straight into their final place in
+//      the result, with lines numbered from the chunk's first line.
+//
+// Between the passes, prefix sums over the counts give every chunk its first line and
+// the index of its first token. Chunks are walked in order to find the first one that
+// stopped early: an unknown character there is the error the serial lexer would have
+// reported first, and a NUL byte ends the input there, dropping everything after it.
+// Counting again is cheaper than lexing into per-chunk queues and copying them, since
+// the token array is written once and never read back.
+//
+// Inputs smaller than two chunks, or a single thread, are lexed serially.
+class ParallelLexer {
+public:
+    static const size_t DEFAULT_MIN_CHUNK = 1 << 20;
+
+private:
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        size_t tokens;
+        FastLexer::Stop stop;
+        int firstLine;   // from the prefix sum
+        size_t offset;   // index of its first token in the result
+    };
+
+    // Token sinks for FastLexer::lexRange
+    struct TokenCounter {
+        size_t count;
+        void enqueue(const Token&) {
+            count++;
+        }
+    };
+
+    struct TokenWriter {
+        Token* out;
+        void enqueue(const Token& token) {
+            *out++ = token;
+        }
+    };
+
+    const char* input;
+    size_t length;
+    size_t threads;
+    size_t minChunk;
+
+    ParallelLexer(const ParallelLexer&);
+    ParallelLexer& operator=(const ParallelLexer&);
+
+    // Splits the input into about 'count' chunks, each ending just after a newline
+    void split(size_t count, std::vector<Chunk>& chunks) const {
+        const char* end = input + length;
+        const char* begin = input;
+        for (size_t k = 1; k <= count && begin < end; k++) {
+            const char* cut = end;
+            if (k < count) {
+                const char* target = input + length / count * k;
+                if (target < begin)
+                    target = begin;
+                const void* newline = std::memchr(target, '\n', static_cast<size_t>(end - target));
+                cut = newline ? static_cast<const char*>(newline) + 1 : end;
+            }
+            Chunk chunk = {begin, cut, 0, {cut, 0, FastLexer::STOP_END}, 0, 0};
+            chunks.push_back(chunk);
+            begin = cut;
+        }
+    }
+
+public:
+    // threads: 0 means one per core; minChunk: smallest chunk worth its own task
+    ParallelLexer(const char* input, size_t length, size_t threads = 0, size_t minChunk = DEFAULT_MIN_CHUNK)
+        : input(input), length(length), threads(threads ? threads : ThreadPool::defaultThreadCount()),
+          minChunk(minChunk ? minChunk : 1) {}
+
+    Queue<Token> generateTokens() {
+        // A few chunks per thread, so work stealing evens out uneven chunks
+        size_t count = threads * 4;
+        if (count > length / minChunk)
+            count = length / minChunk;
+        if (threads <= 1 || count <= 1)
+            return FastLexer(input, length).generateTokens();
+
+        std::vector<Chunk> chunks;
+        split(count, chunks);
+        ThreadPool pool(threads < chunks.size() ? threads : chunks.size());
+        for (size_t k = 0; k < chunks.size(); k++) {
+            Chunk* chunk = &chunks[k];
+            pool.submit([chunk] {
+                FastLexer lexer(chunk->begin, static_cast<size_t>(chunk->end - chunk->begin), 0);
+                TokenCounter counter = {0};
+                chunk->stop = lexer.lexRange(counter, chunk->begin, chunk->end, 0);
+                chunk->tokens = counter.count;
+            });
+        }
+        pool.wait();
+
+        // Prefix sums up to the first chunk that stopped before its end
+        int line = 1;
+        size_t total = 0;
+        size_t used = 0;
+        while (used < chunks.size()) {
+            Chunk& chunk = chunks[used++];
+            chunk.firstLine = line;
+            chunk.offset = total;
+            chunk.stop.line += line;
+            line = chunk.stop.line;
+            total += chunk.tokens;
+            if (chunk.stop.reason != FastLexer::STOP_END)
+                break;
+        }
+        const FastLexer::Stop& last = chunks[used - 1].stop;
+        if (last.reason == FastLexer::STOP_UNKNOWN)
+            throw std::runtime_error(FastLexer::unknownCharacterMessage(last));
+
+        Queue<Token> tokens;
+        Token* out = tokens.extend(total + 1);
+        for (size_t k = 0; k < used; k++) {
+            Chunk* chunk = &chunks[k];
+            pool.submit([chunk, out] {
+                FastLexer lexer(chunk->begin, static_cast<size_t>(chunk->end - chunk->begin), chunk->firstLine);
+                TokenWriter writer = {out + chunk->offset};
+                lexer.lexRange(writer, chunk->begin, chunk->stop.at, chunk->firstLine);
+            });
+        }
+        pool.wait();
+        out[total] = FastLexer::endToken(last.at, last.line);
+        return tokens;
+    }
+};
+
+#endif // PARALLEL_LEXER_H
@@ -2,32 +2,107 @@
 #define PARSER_H
 
 #include "Lexer.h"
+#include "Stack.h"
 #include <vector>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <algorithm>
 
 // AST Node Types
-enum NodeType {
+enum NodeType : uint8_t {
     N_NUMBER,
     N_VARIABLE,
     N_BIN_OP,
+    N_UNARY_OP,
     N_ASSIGN,
     N_PRINT,
     N_IF,
     N_WHILE,
-    N_BLOCK
+    N_BLOCK,
+    N_INDEX,         // a[i]
+    N_INDEX_ASSIGN,  // a[i] = e;
+    N_CALL,          // len(a), sum(a), ...
+    N_ARRAY_LITERAL  // [e, ...]
 };
 
+// Built-in functions, called as name(argument)
+enum Builtin : uint8_t {
+    B_ARRAY, // array(n): n zeros
+    B_LEN,
+    B_SUM,
+    B_MIN,
+    B_MAX
+};
+
+inline const char* builtinName(Builtin function) {
+    switch (function) {
+        case B_ARRAY: return "array";
+        case B_LEN: return "len";
+        case B_SUM: return "sum";
+        case B_MIN: return "min";
+        case B_MAX: return "max";
+        default: return "?";
+    }
+}
+
+// Returns false when name is not a built-in function
+inline bool findBuiltin(const std::string& name, Builtin& function) {
+    static const Builtin all[] = {B_ARRAY, B_LEN, B_SUM, B_MIN, B_MAX};
+    for (Builtin candidate : all) {
+        if (name == builtinName(candidate)) {
+            function = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
 // Base AST Node
 class ASTNode {
 public:
     NodeType type;
+    bool isArray; // evaluates to an array (for assignments and prints: their value does); set by TypeChecker
     int lineNumber;
 
-    ASTNode(NodeType type, int lineNumber) : type(type), lineNumber(lineNumber) {}
+    ASTNode(NodeType type, int lineNumber) : type(type), isArray(false), lineNumber(lineNumber) {}
     virtual ~ASTNode() {}
+
+protected:
+    // Deletes a child subtree. Destructors recurse as usual up to RELEASE_RECURSION
+    // levels; deeper subtrees are deferred to an explicit stack owned by the first
+    // deferral on this thread, so trees of any depth can be freed.
+    static void release(ASTNode* child);
 };
 
+const int RELEASE_RECURSION = 1000;
+
+inline void ASTNode::release(ASTNode* child) {
+    static thread_local int depth = 0;
+    static thread_local Stack<ASTNode*>* pending = nullptr;
+    if (!child)
+        return;
+    if (depth < RELEASE_RECURSION) {
+        depth++;
+        delete child;
+        depth--;
+        return;
+    }
+    if (pending) {
+        pending->push(child);
+        return;
+    }
+    Stack<ASTNode*> stack;
+    stack.push(child);
+    pending = &stack;
+    int saved = depth;
+    depth = 0;
+    while (!stack.isEmpty())
+        delete stack.pop();
+    depth = saved;
+    pending = nullptr;
+}
+
 // Number Node
 class NumberNode : public ASTNode {
 public:
@@ -39,21 +114,38 @@ public:
 class VariableNode : public ASTNode {
 public:
     std::string name;
-    VariableNode(const std::string& name, int lineNumber) : ASTNode(N_VARIABLE, lineNumber), name(name) {}
+    int nameId; // interned identifier, filled in by Resolver
+    int slot;   // frame slot, filled in by Resolver
+    bool checked; // the read may find the slot unassigned; cleared by DefiniteAssignment
+    VariableNode(const std::string& name, int lineNumber)
+        : ASTNode(N_VARIABLE, lineNumber), name(name), nameId(-1), slot(-1), checked(true) {}
 };
 
 // Binary Operation Node
 class BinOpNode : public ASTNode {
 public:
     ASTNode* left;
-    std::string op;
+    OpKind op;
     ASTNode* right;
 
-    BinOpNode(ASTNode* left, const std::string& op, ASTNode* right, int lineNumber)
+    BinOpNode(ASTNode* left, OpKind op, ASTNode* right, int lineNumber)
         : ASTNode(N_BIN_OP, lineNumber), left(left), op(op), right(right) {}
     ~BinOpNode() {
-        delete left;
-        delete right;
+        release(left);
+        release(right);
+    }
+};
+
+// Unary Operation Node (+e, -e, !e)
+class UnaryOpNode : public ASTNode {
+public:
+    OpKind op;
+    ASTNode* operand;
+
+    UnaryOpNode(OpKind op, ASTNode* operand, int lineNumber)
+        : ASTNode(N_UNARY_OP, lineNumber), op(op), operand(operand) {}
+    ~UnaryOpNode() {
+        release(operand);
     }
 };
 
@@ -62,11 +154,13 @@ class AssignNode : public ASTNode {
 public:
     std::string name;
     ASTNode* value;
+    int nameId; // interned identifier, filled in by Resolver
+    int slot;   // frame slot, filled in by Resolver
 
     AssignNode(const std::string& name, ASTNode* value, int lineNumber)
-        : ASTNode(N_ASSIGN, lineNumber), name(name), value(value) {}
+        : ASTNode(N_ASSIGN, lineNumber), name(name), value(value), nameId(-1), slot(-1) {}
     ~AssignNode() {
-        delete value;
+        release(value);
     }
 };
 
@@ -76,7 +170,7 @@ public:
     ASTNode* expression;
     PrintNode(ASTNode* expr, int lineNumber) : ASTNode(N_PRINT, lineNumber), expression(expr) {}
     ~PrintNode() {
-        delete expression;
+        release(expression);
     }
 };
 
@@ -90,10 +184,9 @@ public:
     IfNode(ASTNode* cond, ASTNode* tBlock, ASTNode* fBlock, int lineNumber)
         : ASTNode(N_IF, lineNumber), condition(cond), trueBlock(tBlock), falseBlock(fBlock) {}
     ~IfNode() {
-        delete condition;
-        delete trueBlock;
-        if (falseBlock)
-            delete falseBlock;
+        release(condition);
+        release(trueBlock);
+        release(falseBlock);
     }
 };
 
@@ -102,12 +195,13 @@ class WhileNode : public ASTNode {
 public:
     ASTNode* condition;
     ASTNode* block;
+    int loopIndex; // dense loop number, filled in by Resolver
 
     WhileNode(ASTNode* cond, ASTNode* blk, int lineNumber)
-        : ASTNode(N_WHILE, lineNumber), condition(cond), block(blk) {}
+        : ASTNode(N_WHILE, lineNumber), condition(cond), block(blk), loopIndex(-1) {}
     ~WhileNode() {
-        delete condition;
-        delete block;
+        release(condition);
+        release(block);
     }
 };
 
@@ -115,17 +209,116 @@ public:
 class BlockNode : public ASTNode {
 public:
     std::vector<ASTNode*> statements;
+    int firstSlot; // slots declared by this block (block scoping only), reclaimed on exit
+    int slotCount;
 
-    BlockNode(int lineNumber) : ASTNode(N_BLOCK, lineNumber) {}
+    BlockNode(int lineNumber) : ASTNode(N_BLOCK, lineNumber), firstSlot(0), slotCount(0) {}
     ~BlockNode() {
         for (ASTNode* stmt : statements)
-            delete stmt;
+            release(stmt);
+    }
+};
+
+// Array element read: array[index]
+class IndexNode : public ASTNode {
+public:
+    ASTNode* array;
+    ASTNode* index;
+
+    IndexNode(ASTNode* array, ASTNode* index, int lineNumber)
+        : ASTNode(N_INDEX, lineNumber), array(array), index(index) {}
+    ~IndexNode() {
+        release(array);
+        release(index);
+    }
+};
+
+// Array element assignment: target[index] = value. The target is read, not assigned,
+// so it is an ordinary VariableNode.
+class IndexAssignNode : public ASTNode {
+public:
+    VariableNode* target;
+    ASTNode* index;
+    ASTNode* value;
+
+    IndexAssignNode(VariableNode* target, ASTNode* index, ASTNode* value, int lineNumber)
+        : ASTNode(N_INDEX_ASSIGN, lineNumber), target(target), index(index), value(value) {}
+    ~IndexAssignNode() {
+        release(target);
+        release(index);
+        release(value);
     }
 };
 
-class Parser {
+// Built-in function call
+class CallNode : public ASTNode {
+public:
+    Builtin function;
+    ASTNode* argument;
+
+    CallNode(Builtin function, ASTNode* argument, int lineNumber)
+        : ASTNode(N_CALL, lineNumber), function(function), argument(argument) {}
+    ~CallNode() {
+        release(argument);
+    }
+};
+
+// Array literal: [e1, e2, ...]
+class ArrayLiteralNode : public ASTNode {
+public:
+    std::vector<ASTNode*> elements;
+
+    ArrayLiteralNode(int lineNumber) : ASTNode(N_ARRAY_LITERAL, lineNumber) {}
+    ~ArrayLiteralNode() {
+        for (ASTNode* element : elements)
+            release(element);
+    }
+};
+
+// TreeBuilder creates the pointer-linked AST above. The grammar in BasicParser only
+// talks to a builder, so the same parser can also fill other representations
+// (see FlatAST.h).
+struct TreeBuilder {
+    typedef ASTNode* Node;
+    typedef BlockNode* Block;
+
+    Node none() { return nullptr; }
+    Node number(int value, int lineNumber) { return new NumberNode(value, lineNumber); }
+    Node variable(const std::string& name, int lineNumber) { return new VariableNode(name, lineNumber); }
+    Node binaryOp(Node left, OpKind op, Node right, int lineNumber) { return new BinOpNode(left, op, right, lineNumber); }
+    Node unaryOp(OpKind op, Node operand, int lineNumber) { return new UnaryOpNode(op, operand, lineNumber); }
+    Node assign(const std::string& name, Node value, int lineNumber) { return new AssignNode(name, value, lineNumber); }
+    Node print(Node expr, int lineNumber) { return new PrintNode(expr, lineNumber); }
+    Node ifStatement(Node cond, Node tBlock, Node fBlock, int lineNumber) { return new IfNode(cond, tBlock, fBlock, lineNumber); }
+    Node whileStatement(Node cond, Node blk, int lineNumber) { return new WhileNode(cond, blk, lineNumber); }
+    Node index(Node array, Node index, int lineNumber) { return new IndexNode(array, index, lineNumber); }
+    Node indexAssign(Node target, Node index, Node value, int lineNumber) {
+        return new IndexAssignNode(static_cast<VariableNode*>(target), index, value, lineNumber);
+    }
+    Node call(Builtin function, Node argument, int lineNumber) { return new CallNode(function, argument, lineNumber); }
+    Node arrayLiteral(const std::vector<Node>& elements, int lineNumber) {
+        ArrayLiteralNode* node = new ArrayLiteralNode(lineNumber);
+        node->elements = elements;
+        return node;
+    }
+    Block beginBlock(int lineNumber) { return new BlockNode(lineNumber); }
+    void addStatement(Block& block, Node stmt) { block->statements.push_back(stmt); }
+    Node endBlock(Block& block) { return block; }
+};
+
+// The deepest tree the recursive passes and engines (optimizer, type inference, JIT,
+// vm, closure and flat engines, AST printing, ...) are given. The parser and the
+// resolver handle any depth; the pipeline runs deeper trees on StackInterpreter.
+const int RECURSIVE_DEPTH_LIMIT = 2000;
+
+template <typename Builder>
+class BasicParser {
 private:
+    typedef typename Builder::Node Node;
+    typedef typename Builder::Block Block;
+
     Queue<Token> tokens;
+    Builder builder;
     Token currentToken;
     Token prevToken;
 
@@ -153,6 +346,9 @@ private:
             case T_RPAREN: return ")";
             case T_LBRACE: return "{";
             case T_RBRACE: return "}";
+            case T_LBRACKET: return "[";
+            case T_RBRACKET: return "]";
+            case T_COMMA: return ",";
             case T_PRINT: return "print";
             case T_IF: return "if";
             case T_ELSE: return "else";
@@ -161,178 +357,420 @@ private:
         }
     }
 
-    // Parsing functions
-    ASTNode* program() {
-        BlockNode* root = new BlockNode(currentToken.lineNumber);
-        while (currentToken.type != T_EOF) {
-            root->statements.push_back(statement());
+    // Parsing functions. Nested statements, parentheses and operators are kept on the
+    // heap-allocated stacks below instead of the C++ call stack, so nesting is limited
+    // only by memory and by the optional depth limit.
+
+    // A parsed expression or statement and the depth of its tree (a leaf has depth 1)
+    struct Operand {
+        Node node;
+        int depth;
+    };
+
+    // What the expression being parsed is inside of
+    enum PendingKind : uint8_t {
+        P_ROOT,   // nothing: the whole expression
+        P_PAREN,  // ( ... )
+        P_CALL,   // name( ... )
+        P_INDEX,  // operand[ ... ]
+        P_ARRAY,  // [ ..., ... ]
+        P_UNARY,  // prefix operator waiting for its operand
+        P_BINARY  // infix operator waiting for its right operand
+    };
+
+    struct Pending {
+        PendingKind kind;
+        OpKind op;          // P_UNARY, P_BINARY
+        Builtin function;   // P_CALL
+        int precedence;     // P_BINARY
+        int lineNumber;
+        size_t elements;    // P_ARRAY: elements parsed so far
+    };
+
+    // Compound statements waiting for a nested statement
+    enum FrameKind : uint8_t {
+        F_BLOCK,
+        F_IF,    // waiting for the true branch
+        F_ELSE,  // waiting for the false branch
+        F_WHILE
+    };
+
+    struct Frame {
+        FrameKind kind;
+        int lineNumber;
+        int depth;      // deepest part so far
+        Node condition;
+        Node trueBlock;
+        Block block;
+    };
+
+    Stack<Operand> operands;
+    Stack<Pending> pending;
+    Stack<Frame> frames;
+    int depthLimit;  // 0 for none
+    int deepest;     // deepest tree built so far
+
+    // The depth of a node over children at most childDepth deep, checked against the limit
+    // before the node is built
+    int nested(int childDepth, int lineNumber) {
+        int depth = childDepth + 1;
+        if (depth > deepest) {
+            if (depthLimit > 0 && depth > depthLimit)
+                throw std::runtime_error("Nesting depth limit of " + std::to_string(depthLimit) + " exceeded at line " +
+                                         std::to_string(lineNumber));
+            deepest = depth;
         }
-        return root;
+        return depth;
     }
 
-    ASTNode* statement() {
-        if (currentToken.type == T_IDENTIFIER) {
-            // Variable assignment
-            return assignmentStatement();
-        } else if (currentToken.type == T_PRINT) {
-            // Print statement
-            return printStatement();
-        } else if (currentToken.type == T_IF) {
-            // If statement
-            return ifStatement();
-        } else if (currentToken.type == T_WHILE) {
-            // While loop
-            return whileStatement();
-        } else if (currentToken.type == T_LBRACE) {
-            // Block
-            return block();
-        } else {
-            throw std::runtime_error("Unexpected token '" + currentToken.value + "' at line " + std::to_string(currentToken.lineNumber));
+    static int precedence(OpKind op) {
+        switch (op) {
+            case O_EQ: case O_NE: return 1;
+            case O_LT: case O_LE: case O_GT: case O_GE: return 2;
+            case O_ADD: case O_SUB: return 3;
+            case O_MUL: case O_DIV: case O_MOD: return 4;
+            default: return 0;
         }
     }
 
-    ASTNode* assignmentStatement() {
-        std::string varName = currentToken.value;
-        int lineNumber = currentToken.lineNumber;
-        advance();
-        expect(T_ASSIGN);
-        ASTNode* expr = expression();
-        expect(T_SEMICOLON);
-        return new AssignNode(varName, expr, lineNumber);
+    void pushPending(PendingKind kind, int lineNumber, OpKind op = O_NONE, Builtin function = B_ARRAY) {
+        Pending entry = {kind, op, function, precedence(op), lineNumber, 0};
+        pending.push(entry);
     }
 
-    ASTNode* printStatement() {
-        int lineNumber = currentToken.lineNumber;
-        expect(T_PRINT);
-        expect(T_LPAREN);
-        ASTNode* expr = expression();
-        expect(T_RPAREN);
-        expect(T_SEMICOLON);
-        return new PrintNode(expr, lineNumber);
+    void pushOperand(Node node, int depth) {
+        Operand operand = {node, depth};
+        operands.push(operand);
     }
 
-    ASTNode* ifStatement() {
-        int lineNumber = currentToken.lineNumber;
-        expect(T_IF);
-        expect(T_LPAREN);
-        ASTNode* condition = expression();
-        expect(T_RPAREN);
-        ASTNode* trueBlock = statement();
-        ASTNode* falseBlock = nullptr;
-        if (currentToken.type == T_ELSE) {
-            advance();
-            falseBlock = statement();
+    // Applies the operator on top of 'pending' to the operands it is waiting for
+    void reduce() {
+        Pending op = pending.pop();
+        Operand right = operands.pop();
+        if (op.kind == P_UNARY) {
+            int depth = nested(right.depth, op.lineNumber);
+            pushOperand(builder.unaryOp(op.op, right.node, op.lineNumber), depth);
+            return;
         }
-        return new IfNode(condition, trueBlock, falseBlock, lineNumber);
+        Operand left = operands.pop();
+        int depth = nested(std::max(left.depth, right.depth), op.lineNumber);
+        pushOperand(builder.binaryOp(left.node, op.op, right.node, op.lineNumber), depth);
     }
 
-    ASTNode* whileStatement() {
+    Node program() {
         int lineNumber = currentToken.lineNumber;
-        expect(T_WHILE);
-        expect(T_LPAREN);
-        ASTNode* condition = expression();
-        expect(T_RPAREN);
-        ASTNode* loopBlock = statement();
-        return new WhileNode(condition, loopBlock, lineNumber);
-    }
-
-    ASTNode* block() {
-        int lineNumber = currentToken.lineNumber;
-        expect(T_LBRACE);
-        BlockNode* blockNode = new BlockNode(lineNumber);
-        while (currentToken.type != T_RBRACE && currentToken.type != T_EOF) {
-            blockNode->statements.push_back(statement());
+        Block root = builder.beginBlock(lineNumber);
+        int depth = 0;
+        while (currentToken.type != T_EOF) {
+            Operand stmt = statement();
+            builder.addStatement(root, stmt.node);
+            depth = std::max(depth, stmt.depth);
         }
-        expect(T_RBRACE);
-        return blockNode;
+        nested(depth, lineNumber);
+        return builder.endBlock(root);
     }
 
-    ASTNode* expression() {
-        ASTNode* node = equality();
-        return node;
+    // One statement with everything nested in it
+    Operand statement() {
+        size_t base = frames.getSize();
+        for (;;) {
+            Operand done;
+            if (!beginStatement(done))
+                continue;
+            // Hand the finished statement to the compound statements waiting for it
+            for (;;) {
+                if (frames.getSize() == base)
+                    return done;
+                if (!finishNested(done))
+                    break;
+            }
+        }
     }
 
-    ASTNode* equality() {
-        ASTNode* node = comparison();
-        while (currentToken.type == T_OPERATOR && (currentToken.value == "==" || currentToken.value == "!=")) {
-            std::string op = currentToken.value;
-            int lineNumber = currentToken.lineNumber;
+    // Parses a simple statement into done, or opens the frame of a compound one and
+    // returns false
+    bool beginStatement(Operand& done) {
+        int lineNumber = currentToken.lineNumber;
+        if (currentToken.type == T_IDENTIFIER) {
+            // Variable assignment
+            done = assignmentStatement();
+            return true;
+        } else if (currentToken.type == T_PRINT) {
+            // Print statement
+            expect(T_PRINT);
+            expect(T_LPAREN);
+            Operand expr = expression();
+            expect(T_RPAREN);
+            expect(T_SEMICOLON);
+            int depth = nested(expr.depth, lineNumber);
+            done.node = builder.print(expr.node, lineNumber);
+            done.depth = depth;
+            return true;
+        } else if (currentToken.type == T_IF || currentToken.type == T_WHILE) {
+            // If statement or while loop: the condition, then the nested statement
+            FrameKind kind = currentToken.type == T_IF ? F_IF : F_WHILE;
             advance();
-            node = new BinOpNode(node, op, comparison(), lineNumber);
+            expect(T_LPAREN);
+            Operand condition = expression();
+            expect(T_RPAREN);
+            Frame frame = {kind, lineNumber, condition.depth, condition.node, builder.none(), Block()};
+            frames.push(frame);
+            return false;
+        } else if (currentToken.type == T_LBRACE) {
+            // Block
+            expect(T_LBRACE);
+            Frame frame = {F_BLOCK, lineNumber, 0, builder.none(), builder.none(), builder.beginBlock(lineNumber)};
+            frames.push(frame);
+            if (currentToken.type != T_RBRACE && currentToken.type != T_EOF)
+                return false;
+            done = closeBlock();
+            return true;
+        } else {
+            throw std::runtime_error("Unexpected token '" + currentToken.value() + "' at line " + std::to_string(currentToken.lineNumber));
         }
-        return node;
     }
 
-    ASTNode* comparison() {
-        ASTNode* node = term();
-        while (currentToken.type == T_OPERATOR && (currentToken.value == "<" || currentToken.value == "<=" ||
-                                                   currentToken.value == ">" || currentToken.value == ">=")) {
-            std::string op = currentToken.value;
-            int lineNumber = currentToken.lineNumber;
-            advance();
-            node = new BinOpNode(node, op, term(), lineNumber);
+    // Gives a finished statement to the frame on top. Returns true with the frame's own
+    // statement in done once it is complete, false if it needs another statement.
+    bool finishNested(Operand& done) {
+        Frame& frame = frames.top();
+        frame.depth = std::max(frame.depth, done.depth);
+        switch (frame.kind) {
+            case F_BLOCK:
+                builder.addStatement(frame.block, done.node);
+                if (currentToken.type != T_RBRACE && currentToken.type != T_EOF)
+                    return false;
+                done = closeBlock();
+                return true;
+            case F_IF:
+                frame.trueBlock = done.node;
+                if (currentToken.type == T_ELSE) {
+                    advance();
+                    frame.kind = F_ELSE;
+                    return false;
+                }
+                done.node = builder.none();
+                break;
+            default:
+                break;
         }
-        return node;
+        Frame finished = frames.pop();
+        int depth = nested(finished.depth, finished.lineNumber);
+        if (finished.kind == F_WHILE)
+            done.node = builder.whileStatement(finished.condition, done.node, finished.lineNumber);
+        else
+            done.node = builder.ifStatement(finished.condition, finished.trueBlock, done.node, finished.lineNumber);
+        done.depth = depth;
+        return true;
     }
 
-    ASTNode* term() {
-        ASTNode* node = factor();
-        while (currentToken.type == T_OPERATOR && (currentToken.value == "+" || currentToken.value == "-")) {
-            std::string op = currentToken.value;
-            int lineNumber = currentToken.lineNumber;
-            advance();
-            node = new BinOpNode(node, op, factor(), lineNumber);
-        }
-        return node;
+    Operand closeBlock() {
+        Frame frame = frames.pop();
+        expect(T_RBRACE);
+        Operand block;
+        block.depth = nested(frame.depth, frame.lineNumber);
+        block.node = builder.endBlock(frame.block);
+        return block;
     }
 
-    ASTNode* factor() {
-        ASTNode* node = unary();
-        while (currentToken.type == T_OPERATOR && (currentToken.value == "*" || currentToken.value == "/" || currentToken.value == "%")) {
-            std::string op = currentToken.value;
-            int lineNumber = currentToken.lineNumber;
+    Operand assignmentStatement() {
+        std::string varName = currentToken.value();
+        int lineNumber = currentToken.lineNumber;
+        advance();
+        Operand result;
+        if (currentToken.type == T_LBRACKET) {
+            // Array element assignment
+            Node target = builder.variable(varName, lineNumber);
             advance();
-            node = new BinOpNode(node, op, unary(), lineNumber);
+            Operand index = expression();
+            expect(T_RBRACKET);
+            expect(T_ASSIGN);
+            Operand value = expression();
+            expect(T_SEMICOLON);
+            result.depth = nested(std::max(1, std::max(index.depth, value.depth)), lineNumber);
+            result.node = builder.indexAssign(target, index.node, value.node, lineNumber);
+            return result;
         }
-        return node;
+        expect(T_ASSIGN);
+        Operand expr = expression();
+        expect(T_SEMICOLON);
+        result.depth = nested(expr.depth, lineNumber);
+        result.node = builder.assign(varName, expr.node, lineNumber);
+        return result;
     }
 
-    ASTNode* unary() {
-        if (currentToken.type == T_OPERATOR && (currentToken.value == "+" || currentToken.value == "-" || currentToken.value == "!")) {
-            std::string op = currentToken.value;
-            int lineNumber = currentToken.lineNumber;
-            advance();
-            return new BinOpNode(new NumberNode(0, lineNumber), op, unary(), lineNumber);
+    // Operator precedence parsing: operands and the operators and brackets still
+    // waiting for them are kept on two stacks
+    Operand expression() {
+        pushPending(P_ROOT, currentToken.lineNumber);
+        for (;;) {
+            // Prefix operators, then a primary, then whatever follows an operand
+            while (currentToken.op == O_ADD || currentToken.op == O_SUB || currentToken.op == O_NOT) {
+                pushPending(P_UNARY, currentToken.lineNumber, currentToken.op);
+                advance();
+            }
+            if (primary() && afterOperand())
+                return operands.pop();
         }
-        return primary();
     }
 
-    ASTNode* primary() {
+    // Parses a primary onto 'operands'; false if it opened a bracket instead
+    bool primary() {
         Token token = currentToken;
         if (token.type == T_NUMBER) {
             advance();
-            return new NumberNode(std::stoi(token.value), token.lineNumber);
+            // Out-of-range literals go through stoi so they fail exactly as before
+            int value = token.overflow ? std::stoi(token.value()) : token.number;
+            pushOperand(builder.number(value, token.lineNumber), nested(0, token.lineNumber));
+            return true;
         } else if (token.type == T_IDENTIFIER) {
             advance();
-            return new VariableNode(token.value, token.lineNumber);
+            if (currentToken.type == T_LPAREN) {
+                // name(argument); the names are ordinary identifiers everywhere else
+                Builtin function;
+                if (!findBuiltin(token.value(), function))
+                    throw std::runtime_error("Unknown function '" + token.value() + "' at line " + std::to_string(token.lineNumber));
+                expect(T_LPAREN);
+                pushPending(P_CALL, token.lineNumber, O_NONE, function);
+                return false;
+            }
+            pushOperand(builder.variable(token.value(), token.lineNumber), nested(0, token.lineNumber));
+            return true;
         } else if (token.type == T_LPAREN) {
             advance();
-            ASTNode* node = expression();
-            expect(T_RPAREN);
-            return node;
+            pushPending(P_PAREN, token.lineNumber);
+            return false;
+        } else if (token.type == T_LBRACKET) {
+            expect(T_LBRACKET);
+            if (currentToken.type != T_RBRACKET) {
+                pushPending(P_ARRAY, token.lineNumber);
+                return false;
+            }
+            expect(T_RBRACKET);
+            pushOperand(builder.arrayLiteral(std::vector<Node>(), token.lineNumber), nested(0, token.lineNumber));
+            return true;
         } else {
-            throw std::runtime_error("Unexpected token '" + token.value + "' at line " + std::to_string(token.lineNumber));
+            throw std::runtime_error("Unexpected token '" + token.value() + "' at line " + std::to_string(token.lineNumber));
+        }
+    }
+
+    // After an operand: applies [index] suffixes, then the operators and brackets that
+    // are complete. True once the whole expression is, false if another operand follows.
+    bool afterOperand() {
+        for (;;) {
+            if (currentToken.type == T_LBRACKET) {
+                pushPending(P_INDEX, currentToken.lineNumber);
+                advance();
+                return false;
+            }
+            while (pending.top().kind == P_UNARY)
+                reduce();
+            int level = precedence(currentToken.op);
+            if (level > 0) {
+                // Left associative: equal precedence binds to the left
+                while (pending.top().kind == P_BINARY && pending.top().precedence >= level)
+                    reduce();
+                pushPending(P_BINARY, currentToken.lineNumber, currentToken.op);
+                advance();
+                return false;
+            }
+            while (pending.top().kind == P_BINARY)
+                reduce();
+
+            Pending closed = pending.pop();
+            switch (closed.kind) {
+                case P_ROOT:
+                    return true;
+                case P_PAREN:
+                    expect(T_RPAREN);
+                    break;
+                case P_CALL: {
+                    expect(T_RPAREN);
+                    Operand argument = operands.pop();
+                    int depth = nested(argument.depth, closed.lineNumber);
+                    pushOperand(builder.call(closed.function, argument.node, closed.lineNumber), depth);
+                    break;
+                }
+                case P_INDEX: {
+                    expect(T_RBRACKET);
+                    Operand index = operands.pop();
+                    Operand array = operands.pop();
+                    int depth = nested(std::max(array.depth, index.depth), closed.lineNumber);
+                    pushOperand(builder.index(array.node, index.node, closed.lineNumber), depth);
+                    break;
+                }
+                case P_ARRAY: {
+                    closed.elements++;
+                    if (currentToken.type == T_COMMA) {
+                        advance();
+                        pending.push(closed);
+                        return false;
+                    }
+                    expect(T_RBRACKET);
+                    std::vector<Node> elements(closed.elements);
+                    int childDepth = 0;
+                    for (size_t i = closed.elements; i > 0; i--) {
+                        Operand element = operands.pop();
+                        elements[i - 1] = element.node;
+                        childDepth = std::max(childDepth, element.depth);
+                    }
+                    int depth = nested(childDepth, closed.lineNumber);
+                    pushOperand(builder.arrayLiteral(elements, closed.lineNumber), depth);
+                    break;
+                }
+                default:
+                    break;
+            }
         }
     }
 
 public:
-    Parser(Queue<Token>& tokens) : tokens(tokens) {
+    BasicParser(Queue<Token>& tokens, Builder builder = Builder())
+        : tokens(tokens), builder(builder), currentToken(), prevToken(), depthLimit(0), deepest(0) {
+        advance();
+    }
+
+    // Takes over the token queue instead of copying it
+    BasicParser(Queue<Token>&& tokens, Builder builder = Builder())
+        : tokens(std::move(tokens)), builder(builder), currentToken(), prevToken(), depthLimit(0), deepest(0) {
         advance();
     }
 
-    ASTNode* parse() {
+    // Rejects trees deeper than limit with an error at the line of the first node that
+    // would be; 0 (the default) means no limit
+    void setDepthLimit(int limit) {
+        depthLimit = limit;
+    }
+
+    // Depth of the deepest tree built so far; a leaf has depth 1
+    int depth() const {
+        return deepest;
+    }
+
+    Node parse() {
         return program();
     }
+
+    // Statement-at-a-time parsing of a token stream, for callers that need each
+    // statement's extent (see Watch.h). current() is the next statement's first token
+    // and, after nextStatement(), previous() is its last.
+    bool atEnd() const {
+        return currentToken.type == T_EOF;
+    }
+
+    Node nextStatement() {
+        return statement().node;
+    }
+
+    const Token& current() const {
+        return currentToken;
+    }
+
+    const Token& previous() const {
+        return prevToken;
+    }
 };
 
+typedef BasicParser<TreeBuilder> Parser;
+
 #endif // PARSER_H
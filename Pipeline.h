@@ -0,0 +1,228 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "ParallelLexer.h"
+#include "Parser.h"
+#include "TypeChecker.h"
+#include "Resolver.h"
+#include "DefiniteAssignment.h"
+#include "Interpreter.h"
+#include "StackInterpreter.h"
+#include "Compiler.h"
+#include "VM.h"
+#include "ClosureCompiler.h"
+#include "Optimizer.h"
+#include "ASTPrinter.h"
+#include "Profiler.h"
+#include "ExecutionBudget.h"
+#include "FlatAST.h"
+#include "FlatInterpreter.h"
+#include "ProgramCache.h"
+#include "OutputSink.h"
+#include <ostream>
+#include <string>
+#include <utility>
+#include <cstddef>
+
+// How one program is run: which engine executes it and where diagnostics go.
+// Diagnostic streams are nullptr when the corresponding flag is off.
+struct PipelineOptions {
+    std::string engine;       // tree, vm, closure or flat
+    bool blockScope;
+    bool optimize;
+    bool jit;
+    bool closedForms;         // tree engine: counting loops skip to their final values
+    std::ostream* dumpAst;    // AST before and after optimization
+    std::ostream* optReport;  // loop optimizer decisions
+    std::ostream* astStats;   // flat engine node and memory counts
+    std::ostream* warnUndefined; // reads that may find their variable unassigned
+    Profiler* profiler;       // tree engine only; disables the JIT
+    ProgramCache* cache;      // parsed programs from earlier runs, or nullptr
+    size_t lexThreads;        // threads lexing a large source; 0 means one per core
+    ExecutionLimits limits;   // tree engine: iteration, time, output and variable limits
+    int maxDepth;             // deepest tree the parser accepts; 0 means no limit
+
+    PipelineOptions()
+        : engine("tree"), blockScope(false), optimize(true), jit(true), closedForms(true),
+          dumpAst(nullptr), optReport(nullptr), astStats(nullptr), warnUndefined(nullptr), profiler(nullptr), cache(nullptr), lexThreads(0),
+          maxDepth(0) {}
+};
+
+// Owns the tree between the pipeline stages so it is freed when a stage throws
+class ASTHolder {
+private:
+    ASTNode* node;
+
+    ASTHolder(const ASTHolder&);
+    ASTHolder& operator=(const ASTHolder&);
+
+public:
+    explicit ASTHolder(ASTNode* node) : node(node) {}
+
+    ~ASTHolder() {
+        delete node;
+    }
+
+    ASTNode* get() const {
+        return node;
+    }
+
+    // For passes that rewrite the tree in place and free whatever they replace
+    void reset(ASTNode* replacement) {
+        node = replacement;
+    }
+};
+
+// The parser's depth limit. Trees deeper than RECURSIVE_DEPTH_LIMIT only run on the
+// tree engine, without the diagnostics that walk them recursively; elsewhere they are
+// rejected while parsing.
+inline int depthLimit(const PipelineOptions& options) {
+    bool recursive = options.engine != "tree" || options.dumpAst || options.warnUndefined || options.profiler;
+    if (recursive && (options.maxDepth == 0 || options.maxDepth > RECURSIVE_DEPTH_LIMIT))
+        return RECURSIVE_DEPTH_LIMIT;
+    return options.maxDepth;
+}
+
+// Resolves a parsed (and possibly optimized) tree and runs it on the selected engine.
+// A deep tree (deeper than RECURSIVE_DEPTH_LIMIT) only goes through the passes that
+// walk it iteratively and runs on StackInterpreter.
+inline void runTree(ASTNode* root, const PipelineOptions& options, OutputSink& out, bool deep = false) {
+    // Array types; only the tree engine runs arrays
+    TypeChecker types;
+    types.check(root, deep);
+    if (types.usesArrays() && options.engine != "tree")
+        throw std::runtime_error("Arrays are only supported by the tree engine at line " + std::to_string(types.arrayLine()));
+
+    // Name resolution: intern identifiers and assign frame slots
+    Resolver resolver(options.blockScope);
+    SymbolTable symbols = resolver.resolve(root);
+
+    // Reads that always follow an assignment skip the undefined-variable check
+    if (!deep)
+        DefiniteAssignment(options.warnUndefined).analyze(root, symbols);
+    ExecutionBudget::checkVariables(root, symbols.frameSize, options.limits);
+
+    if (deep) {
+        // Tree-walking on explicit stacks; every read keeps its check
+        ExecutionBudget budget(options.limits, out, symbols.frameSize);
+        StackInterpreter interpreter(root, symbols, out, options.limits.any() ? &budget : nullptr);
+        interpreter.interpret();
+    } else if (options.engine == "vm") {
+        // Compile to bytecode and run it on the stack VM
+        Compiler compiler;
+        Chunk chunk = compiler.compile(root, symbols);
+        VM vm(chunk, out);
+        vm.run();
+    } else if (options.engine == "closure") {
+        // Compile every node into a pre-linked, specialized callable and run those
+        ClosureProgram program;
+        ClosureCompiler().compile(root, symbols, program);
+        program.run(out);
+    } else if (options.profiler) {
+        // Tree-walking with per-statement timing; the JIT is off so every statement is observed
+        ExecutionBudget budget(options.limits, out, symbols.frameSize);
+        ProfilingInterpreter interpreter(root, symbols, out, false, options.profiler, false,
+                                         options.limits.any() ? &budget : nullptr);
+        options.profiler->start();
+        interpreter.interpret();
+    } else {
+        // Interpretation (reference tree-walking engine; hot loops tier up to native code)
+        ExecutionBudget budget(options.limits, out, symbols.frameSize);
+        Interpreter interpreter(root, symbols, out, options.jit, nullptr, options.closedForms,
+                                options.limits.any() ? &budget : nullptr);
+        interpreter.interpret();
+    }
+}
+
+// The flat engine keeps every check; only the warnings need the analysis, which runs
+// on a pointer tree rebuilt from the flat one
+inline void warnUndefinedReads(const FlatView& flat, std::ostream& warnings) {
+    ASTHolder root(unflattenTree(flat));
+    Resolver resolver;
+    SymbolTable symbols = resolver.resolve(root.get());
+    DefiniteAssignment(&warnings).analyze(root.get(), symbols);
+}
+
+// Lexes, parses, optimizes, resolves and runs the program in data[0, size), printing
+// to out. Errors are thrown as std::runtime_error. Everything the run needs lives on
+// this call's stack, so separate calls can run concurrently on different threads.
+inline void runPipeline(const char* data, size_t size, const PipelineOptions& options, OutputSink& out) {
+    bool flat = options.engine == "flat";
+
+    // A cached tree stands in for lexing, parsing and optimization. Diagnostics that
+    // report on those stages bypass the cache, and so does --max-depth, which the
+    // parser enforces.
+    ProgramCache* cache = options.dumpAst || options.optReport || options.astStats || options.maxDepth ? nullptr : options.cache;
+    CacheKey key = CacheKey();
+    if (cache) {
+        uint32_t flags = 0;
+        if (!flat && options.optimize)
+            flags = CACHE_OPTIMIZED | (options.blockScope ? CACHE_BLOCK_SCOPE : 0);
+        key = cache->key(data, size, flags);
+        CachedProgram cached;
+        if (cache->load(key, cached)) {
+            if (flat) {
+                // Walk the mapped image in place
+                if (options.warnUndefined)
+                    warnUndefinedReads(cached.view(), *options.warnUndefined);
+                FlatInterpreter interpreter(cached.view(), out);
+                interpreter.interpret();
+                return;
+            }
+            ASTHolder root(unflattenTree(cached.view()));
+            runTree(root.get(), options, out);
+            return;
+        }
+    }
+
+    // Lexical Analysis
+    ParallelLexer lexer(data, size, options.lexThreads);
+    Queue<Token> tokens = lexer.generateTokens();
+
+    if (flat) {
+        // Parse straight into the arena-allocated AST and walk it
+        FlatAST ast;
+        parseFlat(std::move(tokens), ast, depthLimit(options));
+        if (options.astStats) {
+            *options.astStats << "AST: " << ast.nodes.size() << " nodes, " << ast.memoryBytes() << " bytes, "
+                              << (ast.nodes.empty() ? 0.0 : static_cast<double>(ast.memoryBytes()) / ast.nodes.size())
+                              << " bytes/node" << std::endl;
+        }
+        if (cache)
+            cache->store(key, ast);
+        if (options.warnUndefined)
+            warnUndefinedReads(ast.view(), *options.warnUndefined);
+        FlatInterpreter interpreter(ast, out);
+        interpreter.interpret();
+        return;
+    }
+
+    // Parsing
+    Parser parser(std::move(tokens));
+    parser.setDepthLimit(depthLimit(options));
+    ASTHolder root(parser.parse());
+    bool deep = parser.depth() > RECURSIVE_DEPTH_LIMIT;
+
+    // Constant folding, simplification and loop optimizations
+    if (options.dumpAst) {
+        *options.dumpAst << "AST before optimization:" << std::endl;
+        ASTPrinter(*options.dumpAst).print(root.get());
+    }
+    if (options.optimize && !deep) {
+        Optimizer optimizer(options.blockScope, options.optReport);
+        root.reset(optimizer.optimize(root.get()));
+        if (options.dumpAst) {
+            *options.dumpAst << "AST after optimization (" << optimizer.rewriteCount() << " rewrites):" << std::endl;
+            ASTPrinter(*options.dumpAst).print(root.get());
+        }
+    }
+
+    if (cache && !deep) {
+        FlatAST image;
+        flattenTree(root.get(), image);
+        cache->store(key, image);
+    }
+    runTree(root.get(), options, out, deep);
+}
+
+#endif // PIPELINE_H
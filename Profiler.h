@@ -0,0 +1,219 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "Parser.h"
+#include <vector>
+#include <string>
+#include <ostream>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Profiling hooks for BasicInterpreter (Interpreter.h). The interpreter calls them
+// around every statement and once per while-loop iteration. NoProfiler's hooks are
+// empty inline functions, so the regular Interpreter compiles to the same code as
+// before profiling existed.
+struct NoProfiler {
+    struct Scope {
+        Scope(NoProfiler*, ASTNode*) {}
+    };
+
+    void loopIteration(WhileNode*) {}
+};
+
+// Records, per source line, how many statements ran, their inclusive and self time and
+// the entries and iterations of while loops. Time is attributed along the statement
+// nesting, which also yields a collapsed-stack profile ("line 3;line 5 1200") for
+// flamegraph tools.
+class Profiler {
+public:
+    struct LineStats {
+        uint64_t count;          // statements executed
+        uint64_t inclusiveNs;    // time in statements on this line, nested work included
+        uint64_t selfNs;         // time not spent in nested statements
+        uint64_t loopEntries;
+        uint64_t loopIterations;
+        int active;              // statements on this line currently running
+        LineStats() : count(0), inclusiveNs(0), selfNs(0), loopEntries(0), loopIterations(0), active(0) {}
+    };
+
+    // Opens a statement frame for its lifetime, so a statement that throws is closed too
+    struct Scope {
+        Profiler* profiler;
+        Scope(Profiler* profiler, ASTNode* node) : profiler(profiler) {
+            profiler->enter(node);
+        }
+        ~Scope() {
+            profiler->exit();
+        }
+    };
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // Call tree of statement lines; index 0 is the program itself
+    struct StackNode {
+        int line;
+        int parent;
+        uint64_t selfNs;
+    };
+
+    struct Frame {
+        int node;
+        int line;
+        Clock::time_point start;
+        uint64_t childNs;
+    };
+
+    std::vector<LineStats> lines; // indexed by line number
+    std::vector<StackNode> stackNodes;
+    std::unordered_map<uint64_t, int> children; // (parent << 32 | line) -> stack node
+    std::vector<Frame> frames;
+    Clock::time_point started;
+    bool running;
+    uint64_t totalNs;
+    uint64_t statements;
+
+    LineStats& statsFor(int line) {
+        if (line < 0)
+            line = 0;
+        if (static_cast<size_t>(line) >= lines.size())
+            lines.resize(line + 1);
+        return lines[line];
+    }
+
+    int stackNodeFor(int parent, int line) {
+        uint64_t key = (static_cast<uint64_t>(parent) << 32) | static_cast<uint32_t>(line);
+        std::unordered_map<uint64_t, int>::iterator it = children.find(key);
+        if (it != children.end())
+            return it->second;
+        StackNode node = {line, parent, 0};
+        stackNodes.push_back(node);
+        int index = static_cast<int>(stackNodes.size() - 1);
+        children[key] = index;
+        return index;
+    }
+
+    void enter(ASTNode* node) {
+        LineStats& stats = statsFor(node->lineNumber);
+        stats.count++;
+        stats.active++;
+        statements++;
+        if (node->type == N_WHILE)
+            stats.loopEntries++;
+        int parent = frames.empty() ? 0 : frames.back().node;
+        Frame frame = {stackNodeFor(parent, node->lineNumber), node->lineNumber, Clock::now(), 0};
+        frames.push_back(frame);
+    }
+
+    void exit() {
+        Frame frame = frames.back();
+        frames.pop_back();
+        uint64_t elapsed = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - frame.start).count());
+        uint64_t self = elapsed > frame.childNs ? elapsed - frame.childNs : 0;
+        stackNodes[frame.node].selfNs += self;
+        LineStats& stats = lines[frame.line];
+        stats.selfNs += self;
+        // A statement nested in another on the same line is already inside its time
+        if (--stats.active == 0)
+            stats.inclusiveNs += elapsed;
+        if (!frames.empty())
+            frames.back().childNs += elapsed;
+    }
+
+    std::string stackPath(int node) const {
+        std::string path;
+        for (; node != 0; node = stackNodes[node].parent)
+            path = ";line " + std::to_string(stackNodes[node].line) + path;
+        return "program" + path;
+    }
+
+    static std::string milliseconds(uint64_t ns) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(ns) / 1e6);
+        return buffer;
+    }
+
+public:
+    Profiler() : running(false), totalNs(0), statements(0) {
+        StackNode root = {0, 0, 0};
+        stackNodes.push_back(root);
+    }
+
+    void loopIteration(WhileNode* node) {
+        lines[node->lineNumber].loopIterations++;
+    }
+
+    void start() {
+        started = Clock::now();
+        running = true;
+    }
+
+    // Whether the program got as far as running; errors before that leave nothing to report
+    bool wasStarted() const {
+        return running;
+    }
+
+    void stop() {
+        totalNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+    }
+
+    const std::vector<LineStats>& lineStats() const {
+        return lines;
+    }
+
+    // Hot-spot table: lines sorted by inclusive time, then by count
+    void writeReport(std::ostream& os, size_t limit = 20) const {
+        std::vector<int> order;
+        for (size_t line = 0; line < lines.size(); line++)
+            if (lines[line].count > 0)
+                order.push_back(static_cast<int>(line));
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            if (lines[a].inclusiveNs != lines[b].inclusiveNs)
+                return lines[a].inclusiveNs > lines[b].inclusiveNs;
+            return lines[a].count > lines[b].count;
+        });
+        os << "Profile: " << milliseconds(totalNs) << " ms, " << statements << " statements executed\n";
+        char row[160];
+        std::snprintf(row, sizeof(row), "%8s %14s %12s %8s %12s %16s\n", "line", "count", "incl ms", "incl %", "self ms", "loop iterations");
+        os << row;
+        for (size_t i = 0; i < order.size() && i < limit; i++) {
+            const LineStats& stats = lines[order[i]];
+            double percent = totalNs ? 100.0 * static_cast<double>(stats.inclusiveNs) / static_cast<double>(totalNs) : 0.0;
+            std::string loops = stats.loopEntries ? std::to_string(stats.loopIterations) + " in " + std::to_string(stats.loopEntries) : "-";
+            std::snprintf(row, sizeof(row), "%8d %14llu %12s %7.1f%% %12s %16s\n", order[i],
+                          static_cast<unsigned long long>(stats.count), milliseconds(stats.inclusiveNs).c_str(), percent,
+                          milliseconds(stats.selfNs).c_str(), loops.c_str());
+            os << row;
+        }
+        if (order.size() > limit)
+            os << "(" << order.size() - limit << " more lines)\n";
+    }
+
+    void writeJson(std::ostream& os) const {
+        os << "{\"total_ns\":" << totalNs << ",\"statements\":" << statements << ",\"lines\":[";
+        bool first = true;
+        for (size_t line = 0; line < lines.size(); line++) {
+            const LineStats& stats = lines[line];
+            if (stats.count == 0)
+                continue;
+            os << (first ? "" : ",") << "\n{\"line\":" << line << ",\"count\":" << stats.count
+               << ",\"inclusive_ns\":" << stats.inclusiveNs << ",\"self_ns\":" << stats.selfNs
+               << ",\"loop_entries\":" << stats.loopEntries << ",\"loop_iterations\":" << stats.loopIterations << "}";
+            first = false;
+        }
+        os << "\n]}\n";
+    }
+
+    // One "frame;frame;frame weight" line per distinct statement stack, weighted by self time in ns
+    void writeCollapsed(std::ostream& os) const {
+        for (size_t node = 1; node < stackNodes.size(); node++)
+            if (stackNodes[node].selfNs > 0)
+                os << stackPath(static_cast<int>(node)) << " " << stackNodes[node].selfNs << "\n";
+    }
+};
+
+#endif // PROFILER_H
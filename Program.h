@@ -0,0 +1,202 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "FastLexer.h"
+#include "Parser.h"
+#include "Optimizer.h"
+#include "TypeChecker.h"
+#include "Resolver.h"
+#include "DefiniteAssignment.h"
+#include "ClosureCompiler.h"
+#include "OutputSink.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstring>
+#include <cstddef>
+
+// Embedding API: compile a script once into a Program, then run it any number of
+// times, from any number of threads, each run in its own Execution.
+//
+//     Program program(source, ProgramOptions().input("n"));
+//     int n = program.slot("n");
+//     ...
+//     std::string text;
+//     OutputSink out(&text, 256);
+//     Execution execution(program, out);   // no allocation for frames up to INLINE_SLOTS
+//     execution.set(n, 42);
+//     execution.run();                     // throws std::runtime_error like the CLI engines
+//
+// A Program is immutable once constructed: it holds the closure-compiled code and the
+// name table, and every method is const, so concurrent Executions may share it freely.
+// It must outlive its Executions.
+
+struct ProgramOptions {
+    bool optimize;
+    bool blockScope;
+    std::vector<std::string> inputs; // variables the host binds before each run
+
+    ProgramOptions() : optimize(true), blockScope(false) {}
+
+    ProgramOptions& input(const std::string& name) {
+        inputs.push_back(name);
+        return *this;
+    }
+};
+
+class Program {
+private:
+    ClosureProgram code;
+    std::unordered_map<std::string, int> globals; // name -> slot, for set() and get()
+
+    Program(const Program&);
+    Program& operator=(const Program&);
+
+    // Deletes the tree once the closures no longer need it, including on errors
+    struct TreeOwner {
+        ASTNode* root;
+        ~TreeOwner() {
+            delete root;
+        }
+    };
+
+    void compile(const char* source, size_t size, const ProgramOptions& options) {
+        FastLexer lexer(source, size);
+        Parser parser(lexer.generateTokens());
+        parser.setDepthLimit(RECURSIVE_DEPTH_LIMIT);
+        TreeOwner tree = {parser.parse()};
+        if (options.optimize)
+            tree.root = Optimizer(options.blockScope).optimize(tree.root);
+        TypeChecker types;
+        types.check(tree.root);
+        if (types.usesArrays())
+            throw std::runtime_error("Arrays are only supported by the tree engine at line " + std::to_string(types.arrayLine()));
+
+        Resolver resolver(options.blockScope);
+        resolver.declareInputs(options.inputs);
+        SymbolTable symbols = resolver.resolve(tree.root);
+        DefiniteAssignment().analyze(tree.root, symbols);
+        ClosureCompiler().compile(tree.root, symbols, code);
+
+        // Without block scoping every variable is global; with it only the inputs
+        // are, since the program's own top-level variables end with its outer block
+        if (!options.blockScope) {
+            for (size_t id = 0; id < symbols.names.size(); id++)
+                globals[symbols.names[id]] = static_cast<int>(id);
+        } else {
+            for (size_t i = 0; i < options.inputs.size(); i++)
+                globals.insert(std::make_pair(options.inputs[i], static_cast<int>(globals.size())));
+        }
+    }
+
+public:
+    // Compiles source; lexer and parser errors are thrown as std::runtime_error
+    Program(const char* source, size_t size, const ProgramOptions& options = ProgramOptions()) {
+        compile(source, size, options);
+    }
+
+    explicit Program(const std::string& source, const ProgramOptions& options = ProgramOptions()) {
+        compile(source.data(), source.size(), options);
+    }
+
+    // Slot of a global variable, or -1 if the program has none by that name
+    int slot(const std::string& name) const {
+        std::unordered_map<std::string, int>::const_iterator it = globals.find(name);
+        return it == globals.end() ? -1 : it->second;
+    }
+
+    int frameSize() const {
+        return code.frameSlots();
+    }
+
+    const ClosureProgram& closures() const {
+        return code;
+    }
+};
+
+// One run of a Program: variable storage plus the sink the program prints to.
+// Frames of up to INLINE_SLOTS variables live inside the object, so constructing an
+// Execution on the stack does not allocate. Variables keep their values between
+// run() calls until reset().
+class Execution {
+public:
+    static const int INLINE_SLOTS = 64;
+
+private:
+    const Program& program;
+    OutputSink& out;
+    int inlineSlots[INLINE_SLOTS];
+    char inlineDefined[INLINE_SLOTS];
+    std::vector<int> heapSlots;
+    std::vector<char> heapDefined;
+    int* slots;
+    char* defined;
+
+    Execution(const Execution&);
+    Execution& operator=(const Execution&);
+
+    int checkedSlot(const std::string& name) const {
+        int index = program.slot(name);
+        if (index < 0)
+            throw std::runtime_error("Unknown variable '" + name + "'");
+        return index;
+    }
+
+public:
+    Execution(const Program& program, OutputSink& out) : program(program), out(out) {
+        int size = program.frameSize();
+        if (size <= INLINE_SLOTS) {
+            slots = inlineSlots;
+            defined = inlineDefined;
+        } else {
+            heapSlots.resize(size);
+            heapDefined.resize(size);
+            slots = heapSlots.data();
+            defined = heapDefined.data();
+        }
+        reset();
+    }
+
+    // Forgets every variable, including bound inputs
+    void reset() {
+        size_t size = static_cast<size_t>(program.frameSize());
+        std::memset(slots, 0, size * sizeof(int));
+        std::memset(defined, 0, size);
+    }
+
+    // Binds a variable by slot (see Program::slot) or by name
+    void set(int slot, int value) {
+        slots[slot] = value;
+        defined[slot] = 1;
+    }
+
+    void set(const std::string& name, int value) {
+        set(checkedSlot(name), value);
+    }
+
+    // Reads a global after a run; false if it was never assigned
+    bool get(int slot, int& value) const {
+        if (!defined[slot])
+            return false;
+        value = slots[slot];
+        return true;
+    }
+
+    bool get(const std::string& name, int& value) const {
+        return get(checkedSlot(name), value);
+    }
+
+    // Runs the program and flushes the sink, also when the program fails
+    void run() {
+        try {
+            program.closures().run(slots, defined, out);
+        } catch (...) {
+            out.flush();
+            throw;
+        }
+        out.flush();
+    }
+};
+
+#endif // PROGRAM_H
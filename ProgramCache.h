@@ -0,0 +1,556 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include "FlatAST.h"
+#include "SourceFile.h"
+#include <vector>
+#include <string>
+#include <ostream>
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PROGRAMCACHE_POSIX 1
+#endif
+
+// On-disk cache of parsed (and optionally optimized) programs, so repeated runs of the
+// same script skip the lexer, the parser and the optimizer.
+//
+// An entry is a FlatAST image. All fields are little-endian and laid out exactly like
+// the in-memory arrays, so on a little-endian host the file is memory-mapped and used
+// in place with no per-node decoding; big-endian hosts decode it into vectors.
+//
+//   offset  size  field
+//        0     8  magic "MCPROG\0\0"
+//        8     4  format version (PROGRAM_CACHE_FORMAT)
+//       12     4  byte-order mark 0x01020304
+//       16     8  cache key (hash of source, compiler version and flags)
+//       24     8  source size in bytes
+//       32     4  flags (CACHE_OPTIMIZED, CACHE_BLOCK_SCOPE)
+//       36     4  node count
+//       40     4  block list length
+//       44     4  name count
+//       48     4  name characters length
+//       52     4  root node index
+//       56     4  compiler version hash
+//       60     4  checksum of the rest of the image, header included
+//       64        nodes (20 bytes each: type, op, 2 bytes padding, line, a, b, c),
+//                 block lists, name offsets (name count + 1), name characters
+//
+// The engines walk an entry without checking its indices, so load() accepts one only
+// if the checksum matches and every child, name and list index is in range; anything
+// else is a miss and the entry is removed. --cache-stats and --cache-prune apply the
+// same checks.
+//
+// Entries live in one directory, named by the hex cache key. The key covers the
+// compiler version, so entries from an older build are never hit; --cache-prune
+// removes them. Hits and misses are counted in a "stats" file in the same directory.
+
+const uint32_t PROGRAM_CACHE_FORMAT = 2;
+const size_t PROGRAM_CACHE_HEADER = 64;
+
+// Anything that changes the trees the compiler produces must change this; by default
+// every build gets its own cache entries.
+#ifndef MINI_COMPILER_VERSION
+#define MINI_COMPILER_VERSION __DATE__ " " __TIME__
+#endif
+
+enum CacheFlag {
+    CACHE_OPTIMIZED = 1,
+    CACHE_BLOCK_SCOPE = 2
+};
+
+static_assert(sizeof(FlatNode) == 20 && offsetof(FlatNode, lineNumber) == 4 && offsetof(FlatNode, a) == 8,
+              "FlatNode layout must match the cache image");
+
+struct CacheKey {
+    uint64_t id;
+    uint64_t sourceSize;
+    uint32_t flags;
+
+    std::string fileName() const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.mcp", static_cast<unsigned long long>(id));
+        return name;
+    }
+};
+
+// A program loaded from the cache. Owns the mapping (or the decoded arrays) behind view().
+class CachedProgram {
+private:
+    SourceFile file;
+    std::vector<FlatNode> nodes;
+    std::vector<NodeIndex> lists;
+    std::vector<uint32_t> nameOffsets;
+    FlatView flat;
+
+    CachedProgram(const CachedProgram&);
+    CachedProgram& operator=(const CachedProgram&);
+
+    friend class ProgramCache;
+
+public:
+    CachedProgram() {
+        std::memset(&flat, 0, sizeof(flat));
+    }
+
+    const FlatView& view() const {
+        return flat;
+    }
+};
+
+class ProgramCache {
+private:
+    std::string directory;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    ProgramCache(const ProgramCache&);
+    ProgramCache& operator=(const ProgramCache&);
+
+    static uint64_t hash(uint64_t seed, const void* data, size_t size) {
+        // 64-bit FNV-1a
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            seed ^= bytes[i];
+            seed *= 1099511628211ull;
+        }
+        return seed;
+    }
+
+    // 64-bit FNV-1a over little-endian 8-byte words, then the remaining bytes
+    static uint64_t hashWords(uint64_t seed, const char* data, size_t size) {
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            seed ^= get64(data + i);
+            seed *= 1099511628211ull;
+        }
+        return hash(seed, data + i, size - i);
+    }
+
+    static uint32_t versionHash() {
+        static const char version[] = MINI_COMPILER_VERSION;
+        uint32_t format = PROGRAM_CACHE_FORMAT;
+        uint64_t h = hash(14695981039346656037ull, version, sizeof(version) - 1);
+        h = hash(h, &format, sizeof(format));
+        return static_cast<uint32_t>(h ^ (h >> 32));
+    }
+
+    static bool hostLittleEndian() {
+        uint16_t probe = 1;
+        unsigned char first;
+        std::memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+
+    static void put32(std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; i++)
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+
+    static void put64(std::string& out, uint64_t value) {
+        put32(out, static_cast<uint32_t>(value));
+        put32(out, static_cast<uint32_t>(value >> 32));
+    }
+
+    static uint32_t get32(const char* data) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+        return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+               (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+    }
+
+    static uint64_t get64(const char* data) {
+        return static_cast<uint64_t>(get32(data)) | (static_cast<uint64_t>(get32(data + 4)) << 32);
+    }
+
+    std::string pathFor(const std::string& name) const {
+        return directory + "/" + name;
+    }
+
+    // Creates the cache directory and its missing parents
+    bool makeDirectory() const {
+#ifdef PROGRAMCACHE_POSIX
+        for (size_t slash = directory.find('/', 1); ; slash = directory.find('/', slash + 1)) {
+            std::string prefix = directory.substr(0, slash);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+                return false;
+            if (slash == std::string::npos)
+                return true;
+        }
+#else
+        return false;
+#endif
+    }
+
+    // Reads the header; false if data is not a complete image of the current format
+    static bool readHeader(const char* data, size_t size, uint32_t counts[5], uint64_t& key, uint32_t& version) {
+        if (size < PROGRAM_CACHE_HEADER || std::memcmp(data, "MCPROG\0\0", 8) != 0 ||
+            get32(data + 8) != PROGRAM_CACHE_FORMAT || get32(data + 12) != 0x01020304u)
+            return false;
+        key = get64(data + 16);
+        for (int i = 0; i < 5; i++)
+            counts[i] = get32(data + 36 + 4 * i);
+        version = get32(data + 56);
+        uint64_t expected = PROGRAM_CACHE_HEADER + 20ull * counts[0] + 4ull * counts[1] + 4ull * (counts[2] + 1ull) + counts[3];
+        return size == expected && counts[4] < counts[0];
+    }
+
+    // Whether every index in the image is in range, so the engines can walk it as is.
+    // The builder appends children before their parent, so a child must come before
+    // its parent, which also rules out cycles.
+    static bool wellFormed(const FlatView& view, uint32_t nodeCount, uint32_t listLength) {
+        if (view.nameOffsets[0] != 0)
+            return false;
+        for (uint32_t i = 0; i < view.nameCount; i++) {
+            if (view.nameOffsets[i] > view.nameOffsets[i + 1])
+                return false;
+        }
+        for (uint32_t i = 0; i < nodeCount; i++) {
+            const FlatNode& node = view.nodes[i];
+            bool valid;
+            switch (node.type) {
+                case N_NUMBER:
+                    valid = true;
+                    break;
+                case N_VARIABLE:
+                    valid = node.a < view.nameCount;
+                    break;
+                case N_BIN_OP:
+                case N_INDEX:
+                case N_WHILE:
+                    valid = node.op <= O_NOT && node.a < i && node.b < i;
+                    break;
+                case N_UNARY_OP:
+                case N_PRINT:
+                    valid = node.op <= O_NOT && node.a < i;
+                    break;
+                case N_ASSIGN:
+                    valid = node.a < view.nameCount && node.b < i;
+                    break;
+                case N_IF:
+                    valid = node.a < i && node.b < i && (node.c == NO_NODE || node.c < i);
+                    break;
+                case N_INDEX_ASSIGN:
+                    valid = node.a < i && view.nodes[node.a].type == N_VARIABLE && node.b < i && node.c < i;
+                    break;
+                case N_CALL:
+                    valid = node.op <= B_MAX && node.a < i;
+                    break;
+                case N_BLOCK:
+                case N_ARRAY_LITERAL:
+                    valid = static_cast<uint64_t>(node.a) + node.b <= listLength;
+                    for (uint32_t k = 0; valid && k < node.b; k++)
+                        valid = view.lists[node.a + k] < i;
+                    break;
+                default:
+                    valid = false;
+                    break;
+            }
+            if (!valid)
+                return false;
+        }
+        return true;
+    }
+
+    // Checks the image program.file holds and sets up program.view() over it. False if
+    // it is not a complete image of the current format and compiler version, its
+    // checksum does not match, or an index in it is out of range. Fills in the key,
+    // source size and flags it was stored under.
+    static bool readImage(CachedProgram& program, CacheKey& stored) {
+        const char* data = program.file.data();
+        size_t size = program.file.size();
+        uint32_t counts[5];
+        uint32_t version;
+        if (!readHeader(data, size, counts, stored.id, version) || version != versionHash() ||
+            get32(data + 60) != checksum(data, size))
+            return false;
+        stored.sourceSize = get64(data + 24);
+        stored.flags = get32(data + 32);
+        const char* nodeData = data + PROGRAM_CACHE_HEADER;
+        const char* listData = nodeData + 20 * static_cast<size_t>(counts[0]);
+        const char* offsetData = listData + 4 * static_cast<size_t>(counts[1]);
+        const char* nameData = offsetData + 4 * (static_cast<size_t>(counts[2]) + 1);
+        if (get32(offsetData + 4 * static_cast<size_t>(counts[2])) != counts[3])
+            return false;
+        FlatView& view = program.flat;
+        if (hostLittleEndian() && reinterpret_cast<uintptr_t>(data) % alignof(FlatNode) == 0) {
+            // The image is the arrays
+            view.nodes = reinterpret_cast<const FlatNode*>(nodeData);
+            view.lists = reinterpret_cast<const NodeIndex*>(listData);
+            view.nameOffsets = reinterpret_cast<const uint32_t*>(offsetData);
+        } else {
+            program.nodes.resize(counts[0]);
+            for (uint32_t i = 0; i < counts[0]; i++) {
+                const char* record = nodeData + 20 * static_cast<size_t>(i);
+                FlatNode node = {static_cast<uint8_t>(record[0]), static_cast<uint8_t>(record[1]),
+                                 static_cast<int32_t>(get32(record + 4)), get32(record + 8), get32(record + 12), get32(record + 16)};
+                program.nodes[i] = node;
+            }
+            program.lists.resize(counts[1]);
+            for (uint32_t i = 0; i < counts[1]; i++)
+                program.lists[i] = get32(listData + 4 * static_cast<size_t>(i));
+            program.nameOffsets.resize(counts[2] + 1);
+            for (uint32_t i = 0; i <= counts[2]; i++)
+                program.nameOffsets[i] = get32(offsetData + 4 * static_cast<size_t>(i));
+            view.nodes = program.nodes.data();
+            view.lists = program.lists.data();
+            view.nameOffsets = program.nameOffsets.data();
+        }
+        view.nameChars = nameData;
+        view.nameCount = counts[2];
+        view.root = counts[4];
+        return wellFormed(view, counts[0], counts[1]);
+    }
+
+public:
+    explicit ProgramCache(const std::string& directory) : directory(directory), hits(0), misses(0) {}
+
+    // $XDG_CACHE_HOME/mini_compiler, else ~/.cache/mini_compiler
+    static std::string defaultDirectory() {
+        const char* xdg = std::getenv("XDG_CACHE_HOME");
+        if (xdg && *xdg)
+            return std::string(xdg) + "/mini_compiler";
+        const char* home = std::getenv("HOME");
+        if (home && *home)
+            return std::string(home) + "/.cache/mini_compiler";
+        return ".mini_compiler_cache";
+    }
+
+    const std::string& path() const {
+        return directory;
+    }
+
+    CacheKey key(const char* data, size_t size, uint32_t flags) const {
+        static const char version[] = MINI_COMPILER_VERSION;
+        uint32_t format = PROGRAM_CACHE_FORMAT;
+        uint64_t h = hash(14695981039346656037ull, data, size);
+        h = hash(h, version, sizeof(version) - 1);
+        h = hash(h, &format, sizeof(format));
+        h = hash(h, &flags, sizeof(flags));
+        CacheKey key = {h, static_cast<uint64_t>(size), flags};
+        return key;
+    }
+
+    // Checksum of a complete image: everything but the four bytes at offset 60, where
+    // it is stored
+    static uint32_t checksum(const char* data, size_t size) {
+        char header[PROGRAM_CACHE_HEADER];
+        std::memcpy(header, data, PROGRAM_CACHE_HEADER);
+        std::memset(header + 60, 0, 4);
+        uint64_t h = hashWords(14695981039346656037ull, header, PROGRAM_CACHE_HEADER);
+        h = hashWords(h, data + PROGRAM_CACHE_HEADER, size - PROGRAM_CACHE_HEADER);
+        return static_cast<uint32_t>(h ^ (h >> 32));
+    }
+
+    // Maps the entry for key into program; counts a hit or a miss. A damaged entry is a
+    // miss and is removed, so the caller's re-parse stores a good one.
+    bool load(const CacheKey& key, CachedProgram& program) {
+        std::string path = pathFor(key.fileName());
+        if (!program.file.open(path.c_str())) {
+            misses++;
+            return false;
+        }
+        CacheKey stored;
+        if (!readImage(program, stored) || stored.id != key.id || stored.sourceSize != key.sourceSize ||
+            stored.flags != key.flags) {
+            program.file.close();
+            std::remove(path.c_str());
+            misses++;
+            return false;
+        }
+#ifdef PROGRAMCACHE_POSIX
+        // Recently used entries survive --cache-prune
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+#endif
+        hits++;
+        return true;
+    }
+
+    // Writes the entry for key; a concurrent reader sees either no entry or a complete one
+    bool store(const CacheKey& key, const FlatAST& ast) {
+#ifdef PROGRAMCACHE_POSIX
+        std::string image;
+        image.reserve(PROGRAM_CACHE_HEADER + ast.nodes.size() * 20 + ast.lists.size() * 4 +
+                      ast.nameOffsets.size() * 4 + ast.nameChars.size());
+        image.append("MCPROG\0\0", 8);
+        put32(image, PROGRAM_CACHE_FORMAT);
+        put32(image, 0x01020304u);
+        put64(image, key.id);
+        put64(image, key.sourceSize);
+        put32(image, key.flags);
+        put32(image, static_cast<uint32_t>(ast.nodes.size()));
+        put32(image, static_cast<uint32_t>(ast.lists.size()));
+        put32(image, static_cast<uint32_t>(ast.nameCount()));
+        put32(image, static_cast<uint32_t>(ast.nameChars.size()));
+        put32(image, ast.root);
+        put32(image, versionHash());
+        put32(image, 0); // checksum, filled in below
+        for (const FlatNode& node : ast.nodes) {
+            image.push_back(static_cast<char>(node.type));
+            image.push_back(static_cast<char>(node.op));
+            image.append(2, '\0');
+            put32(image, static_cast<uint32_t>(node.lineNumber));
+            put32(image, node.a);
+            put32(image, node.b);
+            put32(image, node.c);
+        }
+        for (NodeIndex index : ast.lists)
+            put32(image, index);
+        for (uint32_t offset : ast.nameOffsets)
+            put32(image, offset);
+        image += ast.nameChars;
+        uint32_t sum = checksum(image.data(), image.size());
+        for (int i = 0; i < 4; i++)
+            image[60 + i] = static_cast<char>((sum >> (8 * i)) & 0xFF);
+
+        if (!makeDirectory())
+            return false;
+        std::string path = pathFor(key.fileName());
+        std::string temporary = path + ".tmp." + std::to_string(getpid()) + "." +
+                                std::to_string(reinterpret_cast<uintptr_t>(&ast));
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        const char* data = image.data();
+        size_t remaining = image.size();
+        while (remaining > 0) {
+            ssize_t written = ::write(fd, data, remaining);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                break;
+            data += written;
+            remaining -= static_cast<size_t>(written);
+        }
+        bool ok = ::close(fd) == 0 && remaining == 0 && std::rename(temporary.c_str(), path.c_str()) == 0;
+        if (!ok)
+            std::remove(temporary.c_str());
+        return ok;
+#else
+        (void)key;
+        (void)ast;
+        return false;
+#endif
+    }
+
+    // Adds this process's hits and misses to the directory's running totals
+    void saveStats() {
+#ifdef PROGRAMCACHE_POSIX
+        if (hits == 0 && misses == 0)
+            return;
+        if (!makeDirectory())
+            return;
+        int fd = ::open(pathFor("stats").c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            return;
+        if (flock(fd, LOCK_EX) == 0) {
+            char buffer[128] = {0};
+            ssize_t length = pread(fd, buffer, sizeof(buffer) - 1, 0);
+            unsigned long long totalHits = 0, totalMisses = 0;
+            if (length > 0)
+                std::sscanf(buffer, "hits %llu misses %llu", &totalHits, &totalMisses);
+            totalHits += hits;
+            totalMisses += misses;
+            int written = std::snprintf(buffer, sizeof(buffer), "hits %llu misses %llu\n", totalHits, totalMisses);
+            if (ftruncate(fd, 0) == 0 && pwrite(fd, buffer, static_cast<size_t>(written), 0) == written)
+                hits = misses = 0;
+            flock(fd, LOCK_UN);
+        }
+        ::close(fd);
+#endif
+    }
+
+    // Entry count, size and the running hit rate
+    void writeStats(std::ostream& os) const {
+        unsigned long long totalHits = 0, totalMisses = 0, entries = 0, stale = 0, bytes = 0;
+#ifdef PROGRAMCACHE_POSIX
+        FILE* stats = std::fopen(pathFor("stats").c_str(), "r");
+        if (stats) {
+            if (std::fscanf(stats, "hits %llu misses %llu", &totalHits, &totalMisses) != 2)
+                totalHits = totalMisses = 0;
+            std::fclose(stats);
+        }
+        DIR* dir = opendir(directory.c_str());
+        if (dir) {
+            while (dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name.size() != 20 || name.compare(16, 4, ".mcp") != 0)
+                    continue;
+                struct stat info;
+                if (stat(pathFor(name).c_str(), &info) != 0)
+                    continue;
+                entries++;
+                bytes += static_cast<unsigned long long>(info.st_size);
+                if (!isCurrent(name))
+                    stale++;
+            }
+            closedir(dir);
+        }
+#endif
+        unsigned long long lookups = totalHits + totalMisses;
+        char rate[32];
+        std::snprintf(rate, sizeof(rate), "%.1f%%", lookups ? 100.0 * static_cast<double>(totalHits) / static_cast<double>(lookups) : 0.0);
+        os << "Cache: " << directory << "\n"
+           << "  entries: " << entries << " (" << bytes << " bytes), " << stale << " stale or damaged\n"
+           << "  lookups: " << lookups << ", hits: " << totalHits << ", misses: " << totalMisses << ", hit rate: " << rate << "\n";
+    }
+
+    // Whether the named entry is an intact image written by this compiler version
+    bool isCurrent(const std::string& name) const {
+        CachedProgram program;
+        CacheKey stored;
+        return program.file.open(pathFor(name).c_str()) && readImage(program, stored);
+    }
+
+    // Removes entries from other compiler versions, damaged entries, abandoned temporary
+    // files, and entries not used for maxAgeDays. Returns the number of files removed.
+    size_t prune(int maxAgeDays, std::ostream& report) const {
+        size_t removed = 0, kept = 0;
+        unsigned long long freed = 0;
+#ifdef PROGRAMCACHE_POSIX
+        time_t cutoff = std::time(nullptr) - static_cast<time_t>(maxAgeDays) * 24 * 60 * 60;
+        DIR* dir = opendir(directory.c_str());
+        if (dir) {
+            std::vector<std::string> names;
+            while (dirent* entry = readdir(dir))
+                names.push_back(entry->d_name);
+            closedir(dir);
+            for (const std::string& name : names) {
+                bool entry = name.size() == 20 && name.compare(16, 4, ".mcp") == 0;
+                bool temporary = name.find(".mcp.tmp.") != std::string::npos;
+                struct stat info;
+                if ((!entry && !temporary) || stat(pathFor(name).c_str(), &info) != 0)
+                    continue;
+                bool expired = info.st_mtime < cutoff;
+                // A temporary file is being written by a running process unless it is old
+                if (temporary ? info.st_mtime < std::time(nullptr) - 60 * 60 : expired || !isCurrent(name)) {
+                    if (std::remove(pathFor(name).c_str()) == 0) {
+                        removed++;
+                        freed += static_cast<unsigned long long>(info.st_size);
+                        continue;
+                    }
+                }
+                if (entry)
+                    kept++;
+            }
+        }
+#else
+        (void)maxAgeDays;
+#endif
+        report << "Pruned " << removed << " files (" << freed << " bytes) from " << directory << ", " << kept << " entries kept\n";
+        return removed;
+    }
+};
+
+#endif // PROGRAMCACHE_H
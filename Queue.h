@@ -40,41 +40,115 @@ public:
 #define QUEUE_H
 
 #include <stdexcept> // For std::out_of_range
+#include <new>
+#include <utility>
+#include <cstddef>
 
+// Queue backed by a growable ring buffer: elements sit in one contiguous block, enqueue
+// and dequeue are amortized O(1) and never allocate per element.
 template <typename T>
 class Queue {
 private:
-    // Node structure for linked list
-    struct Node {
-        T data;
-        Node* next;
-        Node(const T& value) : data(value), next(nullptr) {}
-    };
-
-    Node* frontNode; // Pointer to the front node
-    Node* rearNode;  // Pointer to the rear node
+    T* buffer;       // raw storage for 'capacity' elements, only [head, head + size) are constructed
+    size_t capacity; // always zero or a power of two
+    size_t head;     // index of the front element
     size_t size;     // Number of elements in the queue
 
+    size_t slot(size_t i) const {
+        return (head + i) & (capacity - 1);
+    }
+
+    static T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void grow(size_t minCapacity) {
+        size_t newCapacity = capacity ? capacity : 16;
+        while (newCapacity < minCapacity)
+            newCapacity *= 2;
+        if (newCapacity == capacity)
+            return;
+        relocate(newCapacity);
+    }
+
+    // Moves the elements to a new buffer of newCapacity, starting at index 0
+    void relocate(size_t newCapacity) {
+        T* newBuffer = allocate(newCapacity);
+        for (size_t i = 0; i < size; i++) {
+            T& element = buffer[slot(i)];
+            new (newBuffer + i) T(std::move(element));
+            element.~T();
+        }
+        ::operator delete(buffer);
+        buffer = newBuffer;
+        capacity = newCapacity;
+        head = 0;
+    }
+
+    void destroyAll() {
+        for (size_t i = 0; i < size; i++)
+            buffer[slot(i)].~T();
+        ::operator delete(buffer);
+        buffer = nullptr;
+        capacity = head = size = 0;
+    }
+
 public:
-    Queue() : frontNode(nullptr), rearNode(nullptr), size(0) {}
+    Queue() : buffer(nullptr), capacity(0), head(0), size(0) {}
+
+    Queue(const Queue& other) : buffer(nullptr), capacity(0), head(0), size(0) {
+        reserve(other.size);
+        for (size_t i = 0; i < other.size; i++)
+            enqueue(other.buffer[other.slot(i)]);
+    }
+
+    Queue(Queue&& other) : buffer(other.buffer), capacity(other.capacity), head(other.head), size(other.size) {
+        other.buffer = nullptr;
+        other.capacity = other.head = other.size = 0;
+    }
+
+    Queue& operator=(Queue other) {
+        std::swap(buffer, other.buffer);
+        std::swap(capacity, other.capacity);
+        std::swap(head, other.head);
+        std::swap(size, other.size);
+        return *this;
+    }
 
     ~Queue() {
-        while (frontNode != nullptr) {
-            Node* temp = frontNode;
-            frontNode = frontNode->next;
-            delete temp;
-        }
+        destroyAll();
+    }
+
+    void reserve(size_t n) {
+        if (n > capacity)
+            grow(n);
+    }
+
+    // Appends n default-initialized elements in one contiguous block and returns its
+    // first element, so a known number of elements can be filled in place, also from
+    // several threads at once
+    T* extend(size_t n) {
+        grow(size + n);
+        if (head + size + n > capacity)
+            relocate(capacity); // unwrap so the block does not straddle the end
+        T* block = buffer + head + size;
+        for (size_t i = 0; i < n; i++)
+            new (block + i) T;
+        size += n;
+        return block;
     }
 
     void enqueue(const T& value) {
-        Node* newNode = new Node(value);
-        if (rearNode == nullptr) {
-            // If the queue is empty
-            frontNode = rearNode = newNode;
-        } else {
-            rearNode->next = newNode;
-            rearNode = newNode;
-        }
+        if (size == capacity)
+            grow(size + 1);
+        new (buffer + slot(size)) T(value);
+        ++size;
+    }
+
+    void enqueue(T&& value) {
+        if (size == capacity)
+            grow(size + 1);
+        new (buffer + slot(size)) T(std::move(value));
         ++size;
     }
 
@@ -82,27 +156,23 @@ public:
         if (isEmpty()) {
             throw std::out_of_range("Queue is empty");
         }
-        T value = frontNode->data;
-        Node* temp = frontNode;
-        frontNode = frontNode->next;
-        delete temp;
-        if (frontNode == nullptr) {
-            // If the queue is now empty
-            rearNode = nullptr;
-        }
+        T& element = buffer[head];
+        T value(std::move(element));
+        element.~T();
+        head = slot(1);
         --size;
         return value;
     }
 
-    T front() const {
+    const T& front() const {
         if (isEmpty()) {
             throw std::out_of_range("Queue is empty");
         }
-        return frontNode->data;
+        return buffer[head];
     }
 
     bool isEmpty() const {
-        return frontNode == nullptr;
+        return size == 0;
     }
 
     size_t getSize() const {
@@ -0,0 +1,234 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include "Parser.h"
+#include "Stack.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <stdexcept>
+
+// Result of resolution: every distinct identifier by id, the number of
+// frame slots an engine has to allocate and the number of while loops
+struct SymbolTable {
+    std::vector<std::string> names; // indexed by nameId
+    int frameSize;
+    int loopCount;                  // WhileNode::loopIndex runs from 0 to loopCount - 1
+
+    SymbolTable() : frameSize(0), loopCount(0) {}
+};
+
+// Resolver runs after Parser::parse(). It interns identifiers and assigns every
+// VariableNode / AssignNode a dense frame slot, so engines can keep variables in a
+// flat int array instead of hashing names at runtime.
+//
+// Without block scoping every identifier owns one slot for the whole program (the
+// language's original semantics). With block scoping an assignment to a name that is
+// not visible declares it in the innermost enclosing block; the block's slots form a
+// contiguous range [firstSlot, firstSlot + slotCount) that is reclaimed on exit and
+// reused by sibling blocks. A read resolves to the innermost visible declaration at
+// that point of the source; reads with no visible declaration get a slot that is
+// never written, so they fail with "Undefined variable" when executed.
+class Resolver {
+private:
+    bool blockScoping;
+    SymbolTable symbols;
+    std::unordered_map<std::string, int> nameIds;
+
+    // Block scoping state
+    std::vector<std::vector<int> > bindings; // per nameId: stack of visible slots
+    std::vector<std::vector<int> > scopes;   // per open block: nameIds declared in it
+    int nextSlot;
+    std::vector<VariableNode*> unresolved;
+
+    int intern(const std::string& name) {
+        std::unordered_map<std::string, int>::iterator it = nameIds.find(name);
+        if (it != nameIds.end())
+            return it->second;
+        int id = static_cast<int>(symbols.names.size());
+        nameIds[name] = id;
+        symbols.names.push_back(name);
+        bindings.push_back(std::vector<int>());
+        return id;
+    }
+
+    int lookup(int nameId) const {
+        const std::vector<int>& visible = bindings[nameId];
+        return visible.empty() ? -1 : visible.back();
+    }
+
+    int declare(int nameId) {
+        int slot = nextSlot++;
+        if (nextSlot > symbols.frameSize)
+            symbols.frameSize = nextSlot;
+        bindings[nameId].push_back(slot);
+        scopes.back().push_back(nameId);
+        return slot;
+    }
+
+    // Block scoping: opens the block's scope before its statements ...
+    void openBlock(BlockNode* node) {
+        node->firstSlot = nextSlot;
+        scopes.push_back(std::vector<int>());
+    }
+
+    // ... and reclaims its slots after them
+    void closeBlock(BlockNode* node) {
+        for (int nameId : scopes.back())
+            bindings[nameId].pop_back();
+        scopes.pop_back();
+        node->slotCount = nextSlot - node->firstSlot;
+        nextSlot = node->firstSlot;
+    }
+
+    void resolveVariable(VariableNode* var) {
+        var->nameId = intern(var->name);
+        if (!blockScoping) {
+            var->slot = var->nameId;
+        } else {
+            var->slot = lookup(var->nameId);
+            if (var->slot < 0)
+                unresolved.push_back(var);
+        }
+    }
+
+    // The right-hand side is resolved before the name comes into scope
+    void resolveAssignment(AssignNode* assign) {
+        assign->nameId = intern(assign->name);
+        if (!blockScoping) {
+            assign->slot = assign->nameId;
+        } else {
+            assign->slot = lookup(assign->nameId);
+            if (assign->slot < 0)
+                assign->slot = declare(assign->nameId);
+        }
+    }
+
+    // A node to visit, or (after its children) to finish
+    struct Step {
+        ASTNode* node;
+        bool after;
+    };
+
+    static void visit(Stack<Step>& steps, ASTNode* node, bool after = false) {
+        Step step = {node, after};
+        steps.push(step);
+    }
+
+    // Walks the tree in source order with an explicit stack, so any depth resolves.
+    // Children are pushed last-first so they come off the stack first-first.
+    void resolveTree(ASTNode* root) {
+        Stack<Step> steps;
+        visit(steps, root);
+        while (!steps.isEmpty()) {
+            Step step = steps.pop();
+            ASTNode* node = step.node;
+            if (step.after) {
+                if (node->type == N_ASSIGN)
+                    resolveAssignment(static_cast<AssignNode*>(node));
+                else
+                    closeBlock(static_cast<BlockNode*>(node));
+                continue;
+            }
+            switch (node->type) {
+                case N_NUMBER:
+                    break;
+                case N_VARIABLE:
+                    resolveVariable(static_cast<VariableNode*>(node));
+                    break;
+                case N_BIN_OP:
+                    visit(steps, static_cast<BinOpNode*>(node)->right);
+                    visit(steps, static_cast<BinOpNode*>(node)->left);
+                    break;
+                case N_UNARY_OP:
+                    visit(steps, static_cast<UnaryOpNode*>(node)->operand);
+                    break;
+                case N_ASSIGN:
+                    visit(steps, node, true);
+                    visit(steps, static_cast<AssignNode*>(node)->value);
+                    break;
+                case N_PRINT:
+                    visit(steps, static_cast<PrintNode*>(node)->expression);
+                    break;
+                case N_IF: {
+                    IfNode* ifNode = static_cast<IfNode*>(node);
+                    if (ifNode->falseBlock)
+                        visit(steps, ifNode->falseBlock);
+                    visit(steps, ifNode->trueBlock);
+                    visit(steps, ifNode->condition);
+                    break;
+                }
+                case N_WHILE: {
+                    WhileNode* whileNode = static_cast<WhileNode*>(node);
+                    whileNode->loopIndex = symbols.loopCount++;
+                    visit(steps, whileNode->block);
+                    visit(steps, whileNode->condition);
+                    break;
+                }
+                case N_BLOCK: {
+                    BlockNode* block = static_cast<BlockNode*>(node);
+                    if (blockScoping) {
+                        openBlock(block);
+                        visit(steps, node, true);
+                    }
+                    for (size_t i = block->statements.size(); i > 0; i--)
+                        visit(steps, block->statements[i - 1]);
+                    break;
+                }
+                case N_INDEX:
+                    visit(steps, static_cast<IndexNode*>(node)->index);
+                    visit(steps, static_cast<IndexNode*>(node)->array);
+                    break;
+                case N_INDEX_ASSIGN: {
+                    // The target array is read, like any other variable
+                    IndexAssignNode* store = static_cast<IndexAssignNode*>(node);
+                    visit(steps, store->value);
+                    visit(steps, store->index);
+                    visit(steps, store->target);
+                    break;
+                }
+                case N_CALL:
+                    visit(steps, static_cast<CallNode*>(node)->argument);
+                    break;
+                case N_ARRAY_LITERAL: {
+                    std::vector<ASTNode*>& elements = static_cast<ArrayLiteralNode*>(node)->elements;
+                    for (size_t i = elements.size(); i > 0; i--)
+                        visit(steps, elements[i - 1]);
+                    break;
+                }
+                default:
+                    throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+            }
+        }
+    }
+
+public:
+    Resolver(bool blockScoping = false) : blockScoping(blockScoping), nextSlot(0) {}
+
+    // Declares variables the host binds before the program runs (see Program.h). Call
+    // before resolve(); inputs get the first slots, in order, and are visible in every block.
+    void declareInputs(const std::vector<std::string>& inputs) {
+        if (blockScoping && scopes.empty())
+            scopes.push_back(std::vector<int>()); // outermost scope, never closed
+        for (const std::string& name : inputs) {
+            int nameId = intern(name);
+            if (blockScoping && lookup(nameId) < 0)
+                declare(nameId);
+        }
+    }
+
+    SymbolTable resolve(ASTNode* root) {
+        resolveTree(root);
+        if (!blockScoping) {
+            symbols.frameSize = static_cast<int>(symbols.names.size());
+        } else if (!unresolved.empty()) {
+            // One extra slot that is never assigned backs every out-of-scope read
+            int undefinedSlot = symbols.frameSize++;
+            for (VariableNode* var : unresolved)
+                var->slot = undefinedSlot;
+        }
+        return symbols;
+    }
+};
+
+#endif // RESOLVER_H
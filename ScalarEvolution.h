@@ -0,0 +1,424 @@
+#ifndef SCALAR_EVOLUTION_H
+#define SCALAR_EVOLUTION_H
+
+#include "Parser.h"
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+
+// Closed forms for counting loops (scalar evolution).
+//
+// ScalarEvolution recognizes while loops whose body only assigns polynomials (+, -, *
+// and unary minus over int variables and numbers) to int variables: induction variables
+// like i = i + 1, accumulators like s = s + i * i, and any other update that is a
+// polynomial in the values at the start of the iteration. Such a body cannot print or
+// fail. One iteration then maps the monomials of the loop's variables (1, i, s, i*i, ...)
+// linearly onto each other, so n iterations are the n-th power of a small matrix, taken
+// by repeated squaring. All of it is arithmetic modulo 2^32, which is exactly the
+// engines' wrapping int arithmetic, so the results are the ones the loop would compute.
+//
+// The iteration count comes from the condition: a comparison (or a bare value, or !value)
+// whose two sides each change by a loop-invariant amount per iteration.
+// ClosedFormLoop::run() works it out from the values at loop entry. It declines, and the
+// interpreter runs the loop as usual, when a side would wrap around before the loop ends,
+// the loop would never end, a variable the loop reads is undefined, or the loop is too
+// short for the closed form to pay off.
+
+// Loops with fewer iterations are interpreted; they are cheaper than the matrix power
+const int CLOSED_FORM_MIN_ITERATIONS = 16;
+
+typedef std::vector<int> Monomial;               // sorted variable indices; empty for the constant 1
+typedef std::map<Monomial, uint32_t> Polynomial; // coefficients modulo 2^32, none of them zero
+
+// The closed form of one loop. Variables are numbered by the analysis; slots maps them
+// to frame slots.
+class ClosedFormLoop {
+private:
+    std::vector<int> slots;
+    std::vector<char> readAtEntry; // read by the condition, or by the body before it assigns them
+    std::vector<char> assigned;
+    std::vector<Monomial> basis;
+    std::vector<int> variableBasis; // basis index of each variable
+    std::vector<uint32_t> matrix;   // row i: basis[i] after one iteration, as a combination of the basis
+    Polynomial left;                // condition: left <relation> right
+    Polynomial right;
+    Polynomial leftStep;            // per-iteration change of each side (loop-invariant)
+    Polynomial rightStep;
+    OpKind relation;
+
+    friend class ScalarEvolution;
+
+    ClosedFormLoop() : relation(O_NE) {}
+    ClosedFormLoop(const ClosedFormLoop&);
+    ClosedFormLoop& operator=(const ClosedFormLoop&);
+
+    static uint32_t evaluate(const Polynomial& polynomial, const std::vector<uint32_t>& values) {
+        uint32_t total = 0;
+        for (const auto& term : polynomial) {
+            uint32_t product = term.second;
+            for (int variable : term.first)
+                product *= values[static_cast<size_t>(variable)];
+            total += product;
+        }
+        return total;
+    }
+
+    // Iterations until "d <relation> 0" fails for d = start + k * step, or -1 if it never
+    // does without d leaving the int range
+    static int64_t iterations(OpKind relation, int64_t start, int64_t step) {
+        if (relation == O_GT || relation == O_GE) {
+            start = -start;
+            step = -step;
+            relation = relation == O_GT ? O_LT : O_LE;
+        }
+        switch (relation) {
+            case O_LT:
+                if (start >= 0)
+                    return 0;
+                return step > 0 ? (-start + step - 1) / step : -1;
+            case O_LE:
+                if (start > 0)
+                    return 0;
+                return step > 0 ? -start / step + 1 : -1;
+            case O_EQ:
+                if (start != 0)
+                    return 0;
+                return step != 0 ? 1 : -1;
+            case O_NE:
+                if (start == 0)
+                    return 0;
+                if (step == 0 || (-start) % step != 0 || (-start) / step < 0)
+                    return -1;
+                return -start / step;
+            default:
+                return -1;
+        }
+    }
+
+    // Does start + k * step stay an int for every k in [0, count]? It is monotonic, so
+    // the ends decide.
+    static bool staysInRange(int64_t start, int64_t step, int64_t count) {
+        if (step == 0)
+            return true;
+        int64_t magnitude = step < 0 ? -step : step;
+        if (count > (int64_t(1) << 32) / magnitude)
+            return false;
+        int64_t end = start + count * step;
+        return end >= INT_MIN && end <= INT_MAX;
+    }
+
+    // out = a * b for k x k matrices
+    void multiply(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b, std::vector<uint32_t>& out) const {
+        size_t k = basis.size();
+        for (size_t i = 0; i < k; i++) {
+            for (size_t j = 0; j < k; j++) {
+                uint32_t total = 0;
+                for (size_t m = 0; m < k; m++)
+                    total += a[i * k + m] * b[m * k + j];
+                out[i * k + j] = total;
+            }
+        }
+    }
+
+public:
+    // Runs the whole loop on the frame and returns its iteration count, or -1 (with
+    // nothing changed) if the closed form does not apply to these entry values or the
+    // loop would run more than maxIterations times
+    int64_t run(int* variables, char* defined, uint64_t maxIterations = UINT64_MAX) const {
+        std::vector<uint32_t> values(slots.size());
+        for (size_t v = 0; v < slots.size(); v++) {
+            if (readAtEntry[v] && !defined[slots[v]])
+                return -1;
+            values[v] = static_cast<uint32_t>(variables[slots[v]]);
+        }
+
+        // Each side is start + k * step as a mathematical integer while it stays in range
+        int64_t leftStart = static_cast<int32_t>(evaluate(left, values));
+        int64_t rightStart = static_cast<int32_t>(evaluate(right, values));
+        int64_t leftDelta = static_cast<int32_t>(evaluate(leftStep, values));
+        int64_t rightDelta = static_cast<int32_t>(evaluate(rightStep, values));
+        int64_t count = iterations(relation, leftStart - rightStart, leftDelta - rightDelta);
+        if (count < CLOSED_FORM_MIN_ITERATIONS || static_cast<uint64_t>(count) > maxIterations ||
+            !staysInRange(leftStart, leftDelta, count) || !staysInRange(rightStart, rightDelta, count))
+            return -1;
+
+        // state = matrix^count * state, by repeated squaring
+        size_t k = basis.size();
+        std::vector<uint32_t> state(k);
+        for (size_t i = 0; i < k; i++) {
+            uint32_t product = 1;
+            for (int variable : basis[i])
+                product *= values[static_cast<size_t>(variable)];
+            state[i] = product;
+        }
+        std::vector<uint32_t> power(matrix);
+        std::vector<uint32_t> scratch(k * k);
+        std::vector<uint32_t> next(k);
+        for (uint64_t remaining = static_cast<uint64_t>(count); remaining > 0; remaining >>= 1) {
+            if (remaining & 1) {
+                for (size_t i = 0; i < k; i++) {
+                    uint32_t total = 0;
+                    for (size_t j = 0; j < k; j++)
+                        total += power[i * k + j] * state[j];
+                    next[i] = total;
+                }
+                state.swap(next);
+            }
+            if (remaining > 1) {
+                multiply(power, power, scratch);
+                power.swap(scratch);
+            }
+        }
+
+        for (size_t v = 0; v < slots.size(); v++) {
+            if (assigned[v]) {
+                variables[slots[v]] = static_cast<int>(state[static_cast<size_t>(variableBasis[v])]);
+                defined[slots[v]] = 1;
+            }
+        }
+        return count;
+    }
+
+    size_t basisSize() const {
+        return basis.size();
+    }
+};
+
+// Builds the closed form of a loop after name resolution, if it has one
+class ScalarEvolution {
+private:
+    static const size_t MAX_VARIABLES = 8;
+    static const size_t MAX_DEGREE = 4;
+    static const size_t MAX_BASIS = 16;
+
+    std::vector<int> slots;
+    std::vector<int> variableOf;      // by slot: variable index, or -1
+    std::vector<Polynomial> current;  // value of each variable at this point of the body
+    std::vector<char> readAtEntry;
+    std::vector<char> assigned;
+
+    ScalarEvolution(const ScalarEvolution&);
+    ScalarEvolution& operator=(const ScalarEvolution&);
+
+    static void addTerm(Polynomial& polynomial, const Monomial& monomial, uint32_t coefficient) {
+        if (coefficient == 0)
+            return;
+        uint32_t& sum = polynomial[monomial];
+        sum += coefficient;
+        if (sum == 0)
+            polynomial.erase(monomial);
+    }
+
+    static Polynomial constant(uint32_t value) {
+        Polynomial polynomial;
+        addTerm(polynomial, Monomial(), value);
+        return polynomial;
+    }
+
+    // left + sign * right, with sign 1 or -1 (as 2^32 - 1)
+    static Polynomial add(const Polynomial& left, const Polynomial& right, uint32_t sign) {
+        Polynomial sum(left);
+        for (const auto& term : right)
+            addTerm(sum, term.first, term.second * sign);
+        return sum;
+    }
+
+    // False if the product has a term above MAX_DEGREE
+    static bool multiply(const Polynomial& left, const Polynomial& right, Polynomial& product) {
+        product.clear();
+        for (const auto& a : left) {
+            for (const auto& b : right) {
+                if (a.first.size() + b.first.size() > MAX_DEGREE)
+                    return false;
+                Monomial monomial(a.first);
+                monomial.insert(monomial.end(), b.first.begin(), b.first.end());
+                std::sort(monomial.begin(), monomial.end());
+                addTerm(product, monomial, a.second * b.second);
+            }
+        }
+        return true;
+    }
+
+    // The variable index of a frame slot, numbering it on first sight
+    size_t variable(int frameSlot) {
+        size_t slot = static_cast<size_t>(frameSlot);
+        if (slot >= variableOf.size())
+            variableOf.resize(slot + 1, -1);
+        if (variableOf[slot] < 0) {
+            variableOf[slot] = static_cast<int>(slots.size());
+            slots.push_back(frameSlot);
+            Polynomial initial;
+            addTerm(initial, Monomial(1, variableOf[slot]), 1);
+            current.push_back(initial);
+            readAtEntry.push_back(0);
+            assigned.push_back(0);
+        }
+        return static_cast<size_t>(variableOf[slot]);
+    }
+
+    // The expression as a polynomial in the values at the start of the iteration; false
+    // for anything that is not a polynomial or could fail
+    bool polynomial(ASTNode* node, Polynomial& result) {
+        if (node->isArray)
+            return false;
+        switch (node->type) {
+            case N_NUMBER:
+                result = constant(static_cast<uint32_t>(static_cast<NumberNode*>(node)->value));
+                return true;
+            case N_VARIABLE: {
+                size_t v = variable(static_cast<VariableNode*>(node)->slot);
+                if (!assigned[v])
+                    readAtEntry[v] = 1;
+                result = current[v];
+                return slots.size() <= MAX_VARIABLES;
+            }
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                if ((unaryOp->op != O_ADD && unaryOp->op != O_SUB) || !polynomial(unaryOp->operand, result))
+                    return false;
+                if (unaryOp->op == O_SUB)
+                    result = add(Polynomial(), result, UINT32_MAX);
+                return true;
+            }
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                Polynomial left;
+                Polynomial right;
+                if (!polynomial(binOp->left, left) || !polynomial(binOp->right, right))
+                    return false;
+                switch (binOp->op) {
+                    case O_ADD: result = add(left, right, 1); return true;
+                    case O_SUB: result = add(left, right, UINT32_MAX); return true;
+                    case O_MUL: return multiply(left, right, result);
+                    default: return false;
+                }
+            }
+            default:
+                return false;
+        }
+    }
+
+    // The polynomial with every variable replaced by its value after one iteration
+    static bool substitute(const Polynomial& polynomial, const std::vector<Polynomial>& next, Polynomial& result) {
+        result.clear();
+        for (const auto& term : polynomial) {
+            Polynomial product = constant(term.second);
+            for (int variable : term.first) {
+                Polynomial factor;
+                if (!multiply(product, next[static_cast<size_t>(variable)], factor))
+                    return false;
+                product.swap(factor);
+            }
+            result = add(result, product, 1);
+        }
+        return true;
+    }
+
+    // The per-iteration change of a condition side, which must not depend on anything
+    // the loop assigns
+    bool step(const Polynomial& side, const std::vector<Polynomial>& next, Polynomial& result) const {
+        Polynomial after;
+        if (!substitute(side, next, after))
+            return false;
+        result = add(after, side, UINT32_MAX);
+        for (const auto& term : result) {
+            for (int variable : term.first) {
+                if (assigned[static_cast<size_t>(variable)])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    ScalarEvolution() {}
+
+    // The closed form of the loop, or nullptr if it has none. The caller owns the result.
+    ClosedFormLoop* analyze(WhileNode* node) {
+        slots.clear();
+        variableOf.clear();
+        current.clear();
+        readAtEntry.clear();
+        assigned.clear();
+        if (node->block->type != N_BLOCK)
+            return nullptr;
+        BlockNode* body = static_cast<BlockNode*>(node->block);
+        if (body->slotCount > 0)
+            return nullptr; // its variables are cleared after every iteration
+
+        // The condition reads the state at the start of an iteration
+        ClosedFormLoop* loop = new ClosedFormLoop();
+        ASTNode* condition = node->condition;
+        bool ok = true;
+        OpKind conditionOp = condition->type == N_BIN_OP ? static_cast<BinOpNode*>(condition)->op : O_NONE;
+        if (conditionOp >= O_EQ && conditionOp <= O_GE) {
+            BinOpNode* comparison = static_cast<BinOpNode*>(condition);
+            loop->relation = comparison->op;
+            ok = polynomial(comparison->left, loop->left) && polynomial(comparison->right, loop->right);
+        } else if (condition->type == N_UNARY_OP && static_cast<UnaryOpNode*>(condition)->op == O_NOT) {
+            loop->relation = O_EQ;
+            ok = polynomial(static_cast<UnaryOpNode*>(condition)->operand, loop->left);
+        } else {
+            loop->relation = O_NE;
+            ok = polynomial(condition, loop->left);
+        }
+
+        // One iteration of the body, statement by statement
+        for (size_t i = 0; ok && i < body->statements.size(); i++) {
+            ASTNode* stmt = body->statements[i];
+            Polynomial value;
+            if (stmt->type != N_ASSIGN || stmt->isArray || !polynomial(static_cast<AssignNode*>(stmt)->value, value)) {
+                ok = false;
+                break;
+            }
+            size_t v = variable(static_cast<AssignNode*>(stmt)->slot);
+            ok = slots.size() <= MAX_VARIABLES;
+            current[v].swap(value);
+            assigned[v] = 1;
+        }
+        if (ok)
+            ok = step(loop->left, current, loop->leftStep) && step(loop->right, current, loop->rightStep);
+
+        // Close the basis under one iteration: the image of each monomial may bring in new ones
+        std::map<Monomial, int> index;
+        for (size_t v = 0; ok && v < slots.size(); v++) {
+            index[Monomial(1, static_cast<int>(v))] = static_cast<int>(loop->basis.size());
+            loop->variableBasis.push_back(static_cast<int>(loop->basis.size()));
+            loop->basis.push_back(Monomial(1, static_cast<int>(v)));
+        }
+        std::vector<Polynomial> images;
+        for (size_t i = 0; ok && i < loop->basis.size(); i++) {
+            Polynomial monomial;
+            addTerm(monomial, loop->basis[i], 1);
+            Polynomial image;
+            ok = substitute(monomial, current, image);
+            for (auto term = image.begin(); ok && term != image.end(); ++term) {
+                if (index.count(term->first))
+                    continue;
+                index[term->first] = static_cast<int>(loop->basis.size());
+                loop->basis.push_back(term->first);
+                ok = loop->basis.size() <= MAX_BASIS;
+            }
+            images.push_back(image);
+        }
+        if (!ok) {
+            delete loop;
+            return nullptr;
+        }
+
+        size_t k = loop->basis.size();
+        loop->matrix.assign(k * k, 0);
+        for (size_t i = 0; i < k; i++) {
+            for (const auto& term : images[i])
+                loop->matrix[i * k + static_cast<size_t>(index[term.first])] = term.second;
+        }
+        loop->slots = slots;
+        loop->readAtEntry = readAtEntry;
+        loop->assigned = assigned;
+        return loop;
+    }
+};
+
+#endif // SCALAR_EVOLUTION_H
@@ -0,0 +1,93 @@
+#ifndef SOURCEFILE_H
+#define SOURCEFILE_H
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstddef>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SOURCEFILE_MMAP 1
+#endif
+
+// Read-only view of a source file. Regular files are memory-mapped so the lexer reads
+// the page cache directly and tokens can point into it without a copy; anything that
+// cannot be mapped (pipes, empty files, non-POSIX systems) is read into a string.
+class SourceFile {
+private:
+    const char* mapped;
+    size_t mappedSize;
+    std::string fallback;
+
+    SourceFile(const SourceFile&);
+    SourceFile& operator=(const SourceFile&);
+
+    bool readFallback(const char* path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        fallback = buffer.str();
+        return true;
+    }
+
+public:
+    SourceFile() : mapped(nullptr), mappedSize(0) {}
+
+    ~SourceFile() {
+        close();
+    }
+
+    bool open(const char* path) {
+        close();
+#ifdef SOURCEFILE_MMAP
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                ::close(fd);
+#ifdef MADV_SEQUENTIAL
+                madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+#endif
+                mapped = static_cast<const char*>(data);
+                mappedSize = static_cast<size_t>(info.st_size);
+                return true;
+            }
+        }
+        ::close(fd);
+#endif
+        return readFallback(path);
+    }
+
+    void close() {
+#ifdef SOURCEFILE_MMAP
+        if (mapped)
+            munmap(const_cast<char*>(mapped), mappedSize);
+#endif
+        mapped = nullptr;
+        mappedSize = 0;
+        fallback.clear();
+    }
+
+    const char* data() const {
+        return mapped ? mapped : fallback.data();
+    }
+
+    size_t size() const {
+        return mapped ? mappedSize : fallback.size();
+    }
+
+    bool isMapped() const {
+        return mapped != nullptr;
+    }
+};
+
+#endif // SOURCEFILE_H
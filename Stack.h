@@ -3,42 +3,63 @@
 #ifndef STACK_H
 #define STACK_H
 
-#include "LinkedList.h"
+#include <vector>
 #include <stdexcept>
+#include <utility>
+#include <cstddef>
 
-// Stack class
+// Stack class, backed by contiguous storage: the top is the last element, so push and
+// pop are amortized O(1) without a heap node per element
 template <typename T>
 class Stack {
 private:
-    LinkedList<T> list;
+    std::vector<T> items;
 
 public:
     Stack() {}
 
     // Push an element onto the stack
-    void push(T value) {
-        list.insert(0, value); // Insert at the beginning for O(1) time
+    void push(const T& value) {
+        items.push_back(value);
+    }
+
+    void push(T&& value) {
+        items.push_back(std::move(value));
     }
 
     // Pop an element from the stack
     T pop() {
         if (isEmpty())
             throw std::out_of_range("Stack Underflow");
-        T value = list.get(0);
-        list.remove(0);
+        T value(std::move(items.back()));
+        items.pop_back();
         return value;
     }
 
     // Peek the top element
-    T top() {
+    T& top() {
+        if (isEmpty())
+            throw std::out_of_range("Stack is empty");
+        return items.back();
+    }
+
+    const T& top() const {
         if (isEmpty())
             throw std::out_of_range("Stack is empty");
-        return list.get(0);
+        return items.back();
     }
 
     // Check if the stack is empty
-    bool isEmpty() {
-        return list.getSize() == 0;
+    bool isEmpty() const {
+        return items.empty();
+    }
+
+    size_t getSize() const {
+        return items.size();
+    }
+
+    void reserve(size_t n) {
+        items.reserve(n);
     }
 };
 
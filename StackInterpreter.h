@@ -0,0 +1,233 @@
+#ifndef STACK_INTERPRETER_H
+#define STACK_INTERPRETER_H
+
+#include "Parser.h"
+#include "Resolver.h"
+#include "OutputSink.h"
+#include "ExecutionBudget.h"
+#include "Stack.h"
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+// Tree-walking interpreter that keeps its pending nodes and intermediate values on
+// heap-allocated stacks instead of the C++ call stack, so a program nested any number
+// of levels deep runs in bounded native stack. The pipeline runs trees deeper than
+// RECURSIVE_DEPTH_LIMIT on it (see Pipeline.h); everything shallower stays on
+// Interpreter, which is faster and adds arrays, the JIT and closed-form loops.
+//
+// Output, errors and the execution budget behave as in Interpreter. An if replaces its
+// own frame with the branch it takes, so a long else-if chain needs one frame.
+class StackInterpreter {
+private:
+    // A node being evaluated and how far it has got: the number of operands already
+    // evaluated, or for a block the next statement
+    struct Frame {
+        ASTNode* node;
+        size_t state;
+    };
+
+    ASTNode* root;
+    OutputSink& out;
+    std::vector<int> variables; //values indexed by the frame slots assigned by Resolver
+    std::vector<char> defined;  //defined[slot] is set once the slot has been assigned
+    ExecutionBudget* budget;    //nullptr when the run has no limits
+    Stack<Frame> frames;
+    Stack<int> values;          //results of evaluated expressions, operands in order
+
+    StackInterpreter(const StackInterpreter&);
+    StackInterpreter& operator=(const StackInterpreter&);
+
+    void enter(ASTNode* node) {
+        Frame frame = {node, 0};
+        frames.push(frame);
+    }
+
+    // Pushes the value of a number or variable right away and enters anything else;
+    // true if it entered a frame, which then has to run first
+    bool operand(ASTNode* node) {
+        if (node->type == N_NUMBER) {
+            values.push(static_cast<NumberNode*>(node)->value);
+            return false;
+        }
+        if (node->type == N_VARIABLE) {
+            values.push(variable(static_cast<VariableNode*>(node)));
+            return false;
+        }
+        enter(node);
+        return true;
+    }
+
+    int variable(VariableNode* node) const {
+        if (node->checked && !defined[node->slot])
+            throw std::runtime_error("Undefined variable '" + node->name + "' at line " + std::to_string(node->lineNumber));
+        return variables[node->slot];
+    }
+
+    static int binaryOp(BinOpNode* node, int left, int right) {
+        switch (node->op) {
+            case O_ADD: return left + right;
+            case O_SUB: return left - right;
+            case O_MUL: return left * right;
+            case O_DIV:
+                if (right == 0)
+                    throw std::runtime_error("Division by zero at line " + std::to_string(node->lineNumber));
+                return left / right;
+            case O_MOD:
+                if (right == 0)
+                    throw std::runtime_error("Modulo by zero at line " + std::to_string(node->lineNumber));
+                return left % right;
+            case O_EQ: return left == right;
+            case O_NE: return left != right;
+            case O_LT: return left < right;
+            case O_LE: return left <= right;
+            case O_GT: return left > right;
+            case O_GE: return left >= right;
+            default:
+                throw std::runtime_error(std::string("Unknown operator '") + opKindToString(node->op) + "' at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+    static int unaryOp(UnaryOpNode* node, int operand) {
+        switch (node->op) {
+            case O_ADD: return operand;
+            case O_SUB: return -operand;
+            case O_NOT: return !operand;
+            default:
+                throw std::runtime_error(std::string("Unknown operator '") + opKindToString(node->op) + "' at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+    // Counts an iteration that is about to start against the budget
+    void startIteration(WhileNode* node) {
+        if (budget && --budget->countdown == 0 && !budget->refill(node->lineNumber))
+            throw budget->error();
+    }
+
+    // Advances the frame on top of the stack by one step
+    void step() {
+        Frame& frame = frames.top();
+        ASTNode* node = frame.node;
+        switch (node->type) {
+            case N_NUMBER:
+            case N_VARIABLE:
+                frames.pop();
+                operand(node);
+                break;
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                if (frame.state == 0) {
+                    frame.state = 1;
+                    if (operand(binOp->left))
+                        break;
+                }
+                if (frame.state == 1) {
+                    frame.state = 2;
+                    if (operand(binOp->right))
+                        break;
+                }
+                int right = values.pop();
+                int left = values.pop();
+                frames.pop();
+                values.push(binaryOp(binOp, left, right));
+                break;
+            }
+            case N_UNARY_OP: {
+                UnaryOpNode* unaryOp = static_cast<UnaryOpNode*>(node);
+                if (frame.state == 0) {
+                    frame.state = 1;
+                    if (operand(unaryOp->operand))
+                        break;
+                }
+                int value = values.pop();
+                frames.pop();
+                values.push(StackInterpreter::unaryOp(unaryOp, value));
+                break;
+            }
+            case N_ASSIGN: {
+                AssignNode* assign = static_cast<AssignNode*>(node);
+                if (frame.state == 0) {
+                    frame.state = 1;
+                    if (operand(assign->value))
+                        break;
+                }
+                frames.pop();
+                variables[assign->slot] = values.pop();
+                defined[assign->slot] = 1;
+                break;
+            }
+            case N_PRINT: {
+                PrintNode* print = static_cast<PrintNode*>(node);
+                if (frame.state == 0) {
+                    frame.state = 1;
+                    if (operand(print->expression))
+                        break;
+                }
+                frames.pop();
+                int value = values.pop();
+                if (budget)
+                    budget->checkOutput(OutputSink::intLength(value), node);
+                out.printInt(value);
+                break;
+            }
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                if (frame.state == 0) {
+                    frame.state = 1;
+                    if (operand(ifNode->condition))
+                        break;
+                }
+                frames.pop();
+                if (values.pop())
+                    enter(ifNode->trueBlock);
+                else if (ifNode->falseBlock)
+                    enter(ifNode->falseBlock);
+                break;
+            }
+            case N_WHILE: {
+                WhileNode* whileNode = static_cast<WhileNode*>(node);
+                if (frame.state == 0) {
+                    frame.state = 1;
+                    if (operand(whileNode->condition))
+                        break;
+                }
+                if (values.pop()) {
+                    frame.state = 0;
+                    startIteration(whileNode);
+                    enter(whileNode->block);
+                } else {
+                    frames.pop();
+                }
+                break;
+            }
+            case N_BLOCK: {
+                BlockNode* block = static_cast<BlockNode*>(node);
+                if (frame.state < block->statements.size()) {
+                    enter(block->statements[frame.state++]);
+                } else {
+                    frames.pop();
+                    // Variables declared in this block go out of scope (only non-empty with block scoping)
+                    for (int slot = block->firstSlot; slot < block->firstSlot + block->slotCount; slot++)
+                        defined[slot] = 0;
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown node type at line " + std::to_string(node->lineNumber));
+        }
+    }
+
+public:
+    // Runs int programs; the type checker keeps deep programs with arrays away from it.
+    // A budget, when given, is charged for every loop iteration and print.
+    StackInterpreter(ASTNode* root, const SymbolTable& symbols, OutputSink& out, ExecutionBudget* budget = nullptr)
+        : root(root), out(out), variables(symbols.frameSize, 0), defined(symbols.frameSize, 0), budget(budget) {}
+
+    void interpret() {
+        enter(root);
+        while (!frames.isEmpty())
+            step();
+    }
+};
+
+#endif // STACK_INTERPRETER_H
@@ -0,0 +1,143 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+// Fixed-size work-stealing thread pool. Every worker owns a task deque: it takes its
+// own work from the back and, when that runs dry, steals from the front of the other
+// workers' deques, so long and short tasks even out without a single shared queue.
+// Tasks must not throw; catch errors inside the task and record them.
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    // Guards the counters below; workers sleep on wake, wait() sleeps on idle
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    size_t queued;   // submitted, not yet taken by a worker
+    size_t pending;  // submitted, not yet finished
+    size_t nextWorker;
+    bool stopping;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    bool takeOwn(size_t self, Task& task) {
+        Worker& worker = *workers[self];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty())
+            return false;
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t self, Task& task) {
+        for (size_t i = 1; i < workers.size(); i++) {
+            Worker& victim = *workers[(self + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t self) {
+        for (;;) {
+            Task task;
+            if (takeOwn(self, task) || steal(self, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(stateMutex);
+                    queued--;
+                }
+                task();
+                std::lock_guard<std::mutex> lock(stateMutex);
+                if (--pending == 0)
+                    idle.notify_all();
+                continue;
+            }
+            // Another worker may have taken the task we were woken for; sleep until more arrive
+            std::unique_lock<std::mutex> lock(stateMutex);
+            wake.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0)
+                return;
+        }
+    }
+
+public:
+    // Starts threadCount workers; 0 means one per hardware thread
+    explicit ThreadPool(size_t threadCount = 0) : queued(0), pending(0), nextWorker(0), stopping(false) {
+        if (threadCount == 0)
+            threadCount = defaultThreadCount();
+        for (size_t i = 0; i < threadCount; i++)
+            workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        for (size_t i = 0; i < threadCount; i++)
+            threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+
+    // Finishes all submitted tasks, then joins the workers
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+
+    static size_t defaultThreadCount() {
+        unsigned int cores = std::thread::hardware_concurrency();
+        return cores > 0 ? cores : 1;
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    // Hands the task to the workers round-robin; idle workers steal it if its owner is busy
+    void submit(Task task) {
+        // Count the task before it becomes visible so a worker never sees the counters go negative
+        Worker* worker;
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            queued++;
+            pending++;
+            worker = workers[nextWorker].get();
+            nextWorker = (nextWorker + 1) % workers.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every submitted task has finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        idle.wait(lock, [this] { return pending == 0; });
+    }
+};
+
+#endif // THREADPOOL_H
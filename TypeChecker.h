@@ -0,0 +1,265 @@
+#ifndef TYPECHECKER_H
+#define TYPECHECKER_H
+
+#include "Parser.h"
+#include "Stack.h"
+#include <string>
+#include <unordered_set>
+#include <stdexcept>
+
+// Static types for arrays. A value is an int or an array of ints, and a variable name
+// holds the same kind everywhere in the program (with block scoping too): it is an
+// array if any assignment to it has an array value. Array values come from literals,
+// array(n), array variables, and arithmetic or comparisons with an array operand, which
+// work elementwise.
+//
+// TypeChecker sets ASTNode::isArray on every array-valued expression, and on the
+// assignments and prints of one, and reports misuse before the program runs: indexing
+// an int, an array used as an index, element, condition or array() size, an array
+// function given an int, and an int assigned to an array variable.
+//
+// A program without array syntax has no array values, so it is only scanned once and
+// no names are looked up.
+class TypeChecker {
+private:
+    std::unordered_set<std::string> arrayNames;
+    int firstArrayLine;   // first array syntax in the program, or -1
+    bool changed;
+
+    TypeChecker(const TypeChecker&);
+    TypeChecker& operator=(const TypeChecker&);
+
+    static std::string at(ASTNode* node) {
+        return " at line " + std::to_string(node->lineNumber);
+    }
+
+    // Sets firstArrayLine at the first index, call or array literal. Until then it
+    // clears the flags a previous check may have left on a reused tree (see Watch.h).
+    // Walks with an explicit stack, so trees of any depth are scanned.
+    void findArrays(ASTNode* root) {
+        Stack<ASTNode*> nodes;
+        nodes.push(root);
+        while (!nodes.isEmpty() && firstArrayLine < 0) {
+            ASTNode* node = nodes.pop();
+            if (!node)
+                continue;
+            node->isArray = false;
+            switch (node->type) {
+                case N_INDEX:
+                case N_INDEX_ASSIGN:
+                case N_CALL:
+                case N_ARRAY_LITERAL:
+                    firstArrayLine = node->lineNumber;
+                    break;
+                case N_BIN_OP:
+                    nodes.push(static_cast<BinOpNode*>(node)->right);
+                    nodes.push(static_cast<BinOpNode*>(node)->left);
+                    break;
+                case N_UNARY_OP:
+                    nodes.push(static_cast<UnaryOpNode*>(node)->operand);
+                    break;
+                case N_ASSIGN:
+                    nodes.push(static_cast<AssignNode*>(node)->value);
+                    break;
+                case N_PRINT:
+                    nodes.push(static_cast<PrintNode*>(node)->expression);
+                    break;
+                case N_IF:
+                    nodes.push(static_cast<IfNode*>(node)->falseBlock);
+                    nodes.push(static_cast<IfNode*>(node)->trueBlock);
+                    nodes.push(static_cast<IfNode*>(node)->condition);
+                    break;
+                case N_WHILE:
+                    nodes.push(static_cast<WhileNode*>(node)->block);
+                    nodes.push(static_cast<WhileNode*>(node)->condition);
+                    break;
+                case N_BLOCK: {
+                    std::vector<ASTNode*>& statements = static_cast<BlockNode*>(node)->statements;
+                    for (size_t i = statements.size(); i > 0; i--)
+                        nodes.push(statements[i - 1]);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    // Is the expression array-valued, given the array names found so far?
+    bool arrayValued(ASTNode* node) const {
+        switch (node->type) {
+            case N_VARIABLE:
+                return arrayNames.count(static_cast<VariableNode*>(node)->name) > 0;
+            case N_BIN_OP:
+                return arrayValued(static_cast<BinOpNode*>(node)->left) || arrayValued(static_cast<BinOpNode*>(node)->right);
+            case N_UNARY_OP:
+                return arrayValued(static_cast<UnaryOpNode*>(node)->operand);
+            case N_CALL:
+                return static_cast<CallNode*>(node)->function == B_ARRAY;
+            case N_ARRAY_LITERAL:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // One round of inference: names assigned an array value become arrays
+    void inferStatement(ASTNode* node) {
+        switch (node->type) {
+            case N_ASSIGN: {
+                AssignNode* assign = static_cast<AssignNode*>(node);
+                if (!arrayNames.count(assign->name) && arrayValued(assign->value)) {
+                    arrayNames.insert(assign->name);
+                    changed = true;
+                }
+                break;
+            }
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                inferStatement(ifNode->trueBlock);
+                if (ifNode->falseBlock)
+                    inferStatement(ifNode->falseBlock);
+                break;
+            }
+            case N_WHILE:
+                inferStatement(static_cast<WhileNode*>(node)->block);
+                break;
+            case N_BLOCK:
+                for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                    inferStatement(stmt);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Checks an expression and records whether it is array-valued
+    bool expression(ASTNode* node) {
+        bool isArray = false;
+        switch (node->type) {
+            case N_NUMBER:
+                break;
+            case N_VARIABLE:
+                isArray = arrayNames.count(static_cast<VariableNode*>(node)->name) > 0;
+                break;
+            case N_BIN_OP: {
+                BinOpNode* binOp = static_cast<BinOpNode*>(node);
+                bool left = expression(binOp->left);
+                bool right = expression(binOp->right);
+                isArray = left || right;
+                break;
+            }
+            case N_UNARY_OP:
+                isArray = expression(static_cast<UnaryOpNode*>(node)->operand);
+                break;
+            case N_INDEX: {
+                IndexNode* index = static_cast<IndexNode*>(node);
+                if (!expression(index->array))
+                    throw std::runtime_error("Only arrays can be indexed" + at(node));
+                requireInt(index->index, "Array index");
+                break;
+            }
+            case N_CALL: {
+                CallNode* call = static_cast<CallNode*>(node);
+                if (call->function == B_ARRAY) {
+                    requireInt(call->argument, "Array size");
+                    isArray = true;
+                } else if (!expression(call->argument)) {
+                    throw std::runtime_error(std::string(builtinName(call->function)) + "() expects an array" + at(node));
+                }
+                break;
+            }
+            case N_ARRAY_LITERAL:
+                for (ASTNode* element : static_cast<ArrayLiteralNode*>(node)->elements)
+                    requireInt(element, "Array element");
+                isArray = true;
+                break;
+            default:
+                throw std::runtime_error("Unknown node type" + at(node));
+        }
+        node->isArray = isArray;
+        return isArray;
+    }
+
+    void requireInt(ASTNode* node, const char* what) {
+        if (expression(node))
+            throw std::runtime_error(std::string(what) + " must be an int, not an array" + at(node));
+    }
+
+    void statement(ASTNode* node) {
+        switch (node->type) {
+            case N_ASSIGN: {
+                AssignNode* assign = static_cast<AssignNode*>(node);
+                assign->isArray = expression(assign->value);
+                if (!assign->isArray && arrayNames.count(assign->name))
+                    throw std::runtime_error("Cannot assign an int to array variable '" + assign->name + "'" + at(node));
+                break;
+            }
+            case N_INDEX_ASSIGN: {
+                IndexAssignNode* store = static_cast<IndexAssignNode*>(node);
+                if (!expression(store->target))
+                    throw std::runtime_error("Only arrays can be indexed" + at(node));
+                requireInt(store->index, "Array index");
+                requireInt(store->value, "Array element");
+                break;
+            }
+            case N_PRINT:
+                node->isArray = expression(static_cast<PrintNode*>(node)->expression);
+                break;
+            case N_IF: {
+                IfNode* ifNode = static_cast<IfNode*>(node);
+                requireInt(ifNode->condition, "Condition");
+                statement(ifNode->trueBlock);
+                if (ifNode->falseBlock)
+                    statement(ifNode->falseBlock);
+                break;
+            }
+            case N_WHILE:
+                requireInt(static_cast<WhileNode*>(node)->condition, "Condition");
+                statement(static_cast<WhileNode*>(node)->block);
+                break;
+            case N_BLOCK:
+                for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                    statement(stmt);
+                break;
+            default:
+                throw std::runtime_error("Unknown node type" + at(node));
+        }
+    }
+
+public:
+    TypeChecker() : firstArrayLine(-1), changed(false) {}
+
+    // Annotates the tree in place; type errors are thrown as std::runtime_error. Only
+    // the scan for array syntax handles trees deeper than RECURSIVE_DEPTH_LIMIT, so a
+    // deep tree (see Pipeline.h) that uses arrays is rejected.
+    void check(ASTNode* root, bool deep = false) {
+        arrayNames.clear();
+        firstArrayLine = -1;
+        findArrays(root);
+        if (firstArrayLine < 0)
+            return;
+        if (deep)
+            throw std::runtime_error("Arrays are not supported in programs nested more than " +
+                                     std::to_string(RECURSIVE_DEPTH_LIMIT) + " levels deep at line " +
+                                     std::to_string(firstArrayLine));
+        // An assignment can make a name an array only once, so this settles after at
+        // most one round per array name
+        do {
+            changed = false;
+            inferStatement(root);
+        } while (changed);
+        statement(root);
+    }
+
+    bool usesArrays() const {
+        return firstArrayLine >= 0;
+    }
+
+    // Line of the first array syntax, for engines that reject arrays
+    int arrayLine() const {
+        return firstArrayLine;
+    }
+};
+
+#endif // TYPECHECKER_H
@@ -0,0 +1,100 @@
+#ifndef VM_H
+#define VM_H
+
+#include "Compiler.h"
+#include "OutputSink.h"
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+// Stack-based virtual machine that executes a Chunk produced by Compiler.
+// Produces the same output and the same runtime errors as Interpreter.
+class VM {
+private:
+    const Chunk& chunk;
+    OutputSink& out;
+    std::vector<int> stack;      // contiguous operand stack, sized once from Chunk::maxStackDepth
+    std::vector<int> variables;  // indexed by frame slot
+    std::vector<char> defined;   // defined[slot] is set by a store, cleared when its block exits
+
+    std::string lineSuffix(size_t pc) const {
+        return " at line " + std::to_string(chunk.debug[pc].lineNumber);
+    }
+
+public:
+    VM(const Chunk& chunk, OutputSink& out)
+        : chunk(chunk), out(out), stack(chunk.maxStackDepth + 1), variables(chunk.frameSize, 0), defined(chunk.frameSize, 0) {}
+
+    void run() {
+        const Instruction* code = chunk.code.data();
+        int* sp = stack.data(); // points one past the top of the stack
+        size_t pc = 0;
+        for (;;) {
+            const Instruction& ins = code[pc];
+            switch (ins.op) {
+                case OP_CONST:
+                    *sp++ = ins.operand;
+                    break;
+                case OP_LOAD:
+                    if (!defined[ins.operand])
+                        throw std::runtime_error("Undefined variable '" + chunk.names[chunk.debug[pc].nameId] + "'" + lineSuffix(pc));
+                    // fall through
+                case OP_LOAD_FAST:
+                    *sp++ = variables[ins.operand];
+                    break;
+                case OP_STORE:
+                    variables[ins.operand] = *--sp;
+                    defined[ins.operand] = 1;
+                    break;
+                case OP_CLEAR: {
+                    const SlotRange& range = chunk.scopes[ins.operand];
+                    for (int slot = range.first; slot < range.first + range.count; slot++)
+                        defined[slot] = 0;
+                    break;
+                }
+                case OP_ADD: sp--; sp[-1] = sp[-1] + sp[0]; break;
+                case OP_SUB: sp--; sp[-1] = sp[-1] - sp[0]; break;
+                case OP_MUL: sp--; sp[-1] = sp[-1] * sp[0]; break;
+                case OP_DIV:
+                    sp--;
+                    if (sp[0] == 0)
+                        throw std::runtime_error("Division by zero" + lineSuffix(pc));
+                    sp[-1] = sp[-1] / sp[0];
+                    break;
+                case OP_MOD:
+                    sp--;
+                    if (sp[0] == 0)
+                        throw std::runtime_error("Modulo by zero" + lineSuffix(pc));
+                    sp[-1] = sp[-1] % sp[0];
+                    break;
+                case OP_EQ: sp--; sp[-1] = sp[-1] == sp[0]; break;
+                case OP_NE: sp--; sp[-1] = sp[-1] != sp[0]; break;
+                case OP_LT: sp--; sp[-1] = sp[-1] < sp[0]; break;
+                case OP_LE: sp--; sp[-1] = sp[-1] <= sp[0]; break;
+                case OP_GT: sp--; sp[-1] = sp[-1] > sp[0]; break;
+                case OP_GE: sp--; sp[-1] = sp[-1] >= sp[0]; break;
+                case OP_NEG: sp[-1] = -sp[-1]; break;
+                case OP_NOT: sp[-1] = !sp[-1]; break;
+                case OP_PRINT:
+                    out.printInt(*--sp);
+                    break;
+                case OP_JUMP:
+                    pc = ins.operand;
+                    continue;
+                case OP_JUMP_IF_FALSE:
+                    if (*--sp == 0) {
+                        pc = ins.operand;
+                        continue;
+                    }
+                    break;
+                case OP_HALT:
+                    return;
+                default:
+                    throw std::runtime_error("Unknown opcode" + lineSuffix(pc));
+            }
+            pc++;
+        }
+    }
+};
+
+#endif // VM_H
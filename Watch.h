@@ -0,0 +1,342 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "Pipeline.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <ostream>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cerrno>
+#include <cstddef>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#define WATCH_INOTIFY 1
+#endif
+
+// A program kept as its top-level statements, each with the byte range it was parsed
+// from, so an edited source can be re-parsed piecewise.
+//
+// update() compares the new source with the previous one: everything before the first
+// and after the last differing byte is unchanged. Statements that lie entirely inside
+// the unchanged prefix or suffix are reused as they are; only the text between them is
+// re-lexed (starting at the right line) and re-parsed. Statements after the edit have
+// their byte offsets and line numbers shifted by what the edit added or removed.
+//
+// Re-parsing the edited range on its own gives the same statements as re-parsing the
+// whole file whenever it succeeds, because the range starts right after a complete
+// statement and ends right before one. When it fails (say an edit left a `while`
+// header whose body is the next, unchanged statement) the whole file is re-parsed.
+class IncrementalParser {
+public:
+    struct Update {
+        size_t reused;       // statements kept from the previous version
+        size_t rebuilt;      // statements lexed and parsed again
+        size_t relexedBytes;
+        bool fullReparse;
+    };
+
+private:
+    struct Statement {
+        size_t begin;   // first byte of the statement
+        size_t end;     // one past its last byte
+        int lastLine;   // line of its last token
+        ASTNode* tree;
+    };
+
+    std::string text;
+    std::vector<Statement> statements;
+
+    IncrementalParser(const IncrementalParser&);
+    IncrementalParser& operator=(const IncrementalParser&);
+
+    static int countLines(const std::string& s, size_t from, size_t to) {
+        int lines = 0;
+        for (size_t i = from; i < to; i++)
+            if (s[i] == '\n')
+                lines++;
+        return lines;
+    }
+
+    static void shiftLines(ASTNode* node, int delta) {
+        if (!node)
+            return;
+        node->lineNumber += delta;
+        switch (node->type) {
+            case N_BIN_OP:
+                shiftLines(static_cast<BinOpNode*>(node)->left, delta);
+                shiftLines(static_cast<BinOpNode*>(node)->right, delta);
+                break;
+            case N_UNARY_OP:
+                shiftLines(static_cast<UnaryOpNode*>(node)->operand, delta);
+                break;
+            case N_ASSIGN:
+                shiftLines(static_cast<AssignNode*>(node)->value, delta);
+                break;
+            case N_PRINT:
+                shiftLines(static_cast<PrintNode*>(node)->expression, delta);
+                break;
+            case N_IF:
+                shiftLines(static_cast<IfNode*>(node)->condition, delta);
+                shiftLines(static_cast<IfNode*>(node)->trueBlock, delta);
+                shiftLines(static_cast<IfNode*>(node)->falseBlock, delta);
+                break;
+            case N_WHILE:
+                shiftLines(static_cast<WhileNode*>(node)->condition, delta);
+                shiftLines(static_cast<WhileNode*>(node)->block, delta);
+                break;
+            case N_BLOCK:
+                for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                    shiftLines(stmt, delta);
+                break;
+            case N_INDEX:
+                shiftLines(static_cast<IndexNode*>(node)->array, delta);
+                shiftLines(static_cast<IndexNode*>(node)->index, delta);
+                break;
+            case N_INDEX_ASSIGN:
+                shiftLines(static_cast<IndexAssignNode*>(node)->target, delta);
+                shiftLines(static_cast<IndexAssignNode*>(node)->index, delta);
+                shiftLines(static_cast<IndexAssignNode*>(node)->value, delta);
+                break;
+            case N_CALL:
+                shiftLines(static_cast<CallNode*>(node)->argument, delta);
+                break;
+            case N_ARRAY_LITERAL:
+                for (ASTNode* element : static_cast<ArrayLiteralNode*>(node)->elements)
+                    shiftLines(element, delta);
+                break;
+            default:
+                break;
+        }
+    }
+
+    static void release(std::vector<Statement>& list, size_t from, size_t to) {
+        for (size_t i = from; i < to; i++)
+            delete list[i].tree;
+    }
+
+    // Lexes and parses source[from, to) as a run of whole statements, appending them to
+    // out. On a syntax error nothing is appended and the error is rethrown.
+    static void parseRange(const std::string& source, size_t from, size_t to, int firstLine, std::vector<Statement>& out) {
+        FastLexer lexer(source.data() + from, to - from, firstLine);
+        Parser parser(lexer.generateTokens());
+        parser.setDepthLimit(RECURSIVE_DEPTH_LIMIT); // each run copies and flattens the tree recursively
+        size_t mark = out.size();
+        try {
+            while (!parser.atEnd()) {
+                Statement stmt;
+                stmt.begin = static_cast<size_t>(parser.current().text - source.data());
+                stmt.tree = parser.nextStatement();
+                const Token& last = parser.previous();
+                stmt.end = static_cast<size_t>(last.text + last.length - source.data());
+                stmt.lastLine = last.lineNumber;
+                out.push_back(stmt);
+            }
+        } catch (...) {
+            release(out, mark, out.size());
+            out.resize(mark);
+            throw;
+        }
+    }
+
+public:
+    IncrementalParser() {}
+
+    ~IncrementalParser() {
+        release(statements, 0, statements.size());
+    }
+
+    const std::string& source() const {
+        return text;
+    }
+
+    size_t statementCount() const {
+        return statements.size();
+    }
+
+    // Brings the program up to date with next. Syntax errors are thrown and leave the
+    // previous version in place, so the next update is still diffed against it.
+    Update update(const std::string& next) {
+        Update result = {0, 0, 0, false};
+        size_t oldSize = text.size();
+        size_t newSize = next.size();
+        size_t shorter = oldSize < newSize ? oldSize : newSize;
+        size_t prefix = 0;
+        while (prefix < shorter && text[prefix] == next[prefix])
+            prefix++;
+        size_t suffix = 0;
+        while (suffix < shorter - prefix && text[oldSize - 1 - suffix] == next[newSize - 1 - suffix])
+            suffix++;
+        if (prefix == oldSize && prefix == newSize) {
+            result.reused = statements.size();
+            return result;
+        }
+        size_t oldEnd = oldSize - suffix; // old text [prefix, oldEnd) became next [prefix, newSize - suffix)
+
+        // Statements ending before the edit and starting after it are untouched
+        size_t first = 0;
+        while (first < statements.size() && statements[first].end < prefix)
+            first++;
+        size_t after = first;
+        while (after < statements.size() && statements[after].begin <= oldEnd)
+            after++;
+
+        long long byteDelta = static_cast<long long>(newSize) - static_cast<long long>(oldSize);
+        size_t from = first > 0 ? statements[first - 1].end : 0;
+        size_t to = after < statements.size() ? static_cast<size_t>(static_cast<long long>(statements[after].begin) + byteDelta) : newSize;
+        int firstLine = first > 0 ? statements[first - 1].lastLine : 1;
+
+        std::vector<Statement> rebuilt;
+        try {
+            parseRange(next, from, to, firstLine, rebuilt);
+        } catch (const std::exception&) {
+            // The edit changed how its neighbours parse; start over from the whole file
+            std::vector<Statement> all;
+            parseRange(next, 0, newSize, 1, all);
+            release(statements, 0, statements.size());
+            statements.swap(all);
+            text = next;
+            result.rebuilt = statements.size();
+            result.relexedBytes = newSize;
+            result.fullReparse = true;
+            return result;
+        }
+
+        int lineDelta = countLines(next, prefix, newSize - suffix) - countLines(text, prefix, oldEnd);
+        for (size_t i = after; i < statements.size(); i++) {
+            Statement& stmt = statements[i];
+            stmt.begin = static_cast<size_t>(static_cast<long long>(stmt.begin) + byteDelta);
+            stmt.end = static_cast<size_t>(static_cast<long long>(stmt.end) + byteDelta);
+            if (lineDelta != 0) {
+                stmt.lastLine += lineDelta;
+                shiftLines(stmt.tree, lineDelta);
+            }
+        }
+        release(statements, first, after);
+        result.reused = statements.size() - (after - first);
+        result.rebuilt = rebuilt.size();
+        result.relexedBytes = to - from;
+        statements.erase(statements.begin() + first, statements.begin() + after);
+        statements.insert(statements.begin() + first, rebuilt.begin(), rebuilt.end());
+        text = next;
+        return result;
+    }
+
+    // Runs the current version. The statement trees are shared with later versions, so
+    // the optimizer, which rewrites in place, works on a copy.
+    void run(const PipelineOptions& options, OutputSink& out) {
+        BlockNode root(statements.empty() ? 1 : statements[0].tree->lineNumber);
+        struct Borrowed {
+            BlockNode& block;
+            ~Borrowed() {
+                block.statements.clear();
+            }
+        } borrowed = {root};
+        for (const Statement& stmt : statements)
+            root.statements.push_back(stmt.tree);
+
+        if (options.engine == "flat") {
+            FlatAST ast;
+            flattenTree(&root, ast);
+            FlatInterpreter interpreter(ast, out);
+            interpreter.interpret();
+        } else if (options.optimize) {
+            TreeBuilder builder;
+            ASTHolder copy(replayTree(static_cast<ASTNode*>(&root), builder));
+            Optimizer optimizer(options.blockScope, options.optReport);
+            copy.reset(optimizer.optimize(copy.get()));
+            runTree(copy.get(), options, out);
+        } else {
+            runTree(&root, options, out);
+        }
+    }
+};
+
+// Runs path, then re-runs it every time it is saved, until the process is interrupted.
+// Each run is preceded by a line on log saying how much of the program was reused.
+inline int watchFile(const char* path, const PipelineOptions& options, OutputSink& out, std::ostream& log) {
+#ifdef WATCH_INOTIFY
+    std::string file = path;
+    size_t slash = file.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : file.substr(0, slash);
+    std::string name = slash == std::string::npos ? file : file.substr(slash + 1);
+
+    // Watch the directory, not the file: editors often save by renaming a new file over it
+    int notify = inotify_init1(IN_CLOEXEC);
+    if (notify < 0 || inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        log << "Could not watch " << directory << std::endl;
+        return 1;
+    }
+
+    IncrementalParser program;
+    bool loaded = false;
+    for (;;) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            log << "Could not open file: " << path << std::endl;
+        } else {
+            std::stringstream buffer;
+            buffer << input.rdbuf();
+            std::string source = buffer.str();
+            if (!loaded || source != program.source()) {
+                std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+                try {
+                    IncrementalParser::Update update = program.update(source);
+                    loaded = true;
+                    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+                    char timing[32];
+                    std::snprintf(timing, sizeof(timing), "%.3f", ms);
+                    log << "[watch] " << path << ": " << update.reused << " statements reused, " << update.rebuilt
+                        << " rebuilt, " << update.relexedBytes << " of " << source.size() << " bytes re-lexed"
+                        << (update.fullReparse ? " (full re-parse)" : "") << " in " << timing << " ms" << std::endl;
+                    try {
+                        program.run(options, out);
+                    } catch (const std::exception& e) {
+                        out.flush();
+                        log << "Error: " << e.what() << std::endl;
+                    }
+                    out.flush();
+                } catch (const std::exception& e) {
+                    log << "Error: " << e.what() << std::endl;
+                }
+            }
+        }
+
+        // Wait for the file to be written, then let a burst of events settle
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        bool changed = false;
+        while (!changed) {
+            ssize_t length = read(notify, events, sizeof(events));
+            if (length <= 0) {
+                if (length < 0 && errno == EINTR)
+                    continue;
+                close(notify);
+                return 1;
+            }
+            for (char* p = events; p < events + length;) {
+                struct inotify_event* event = reinterpret_cast<struct inotify_event*>(p);
+                if (event->len > 0 && name == event->name)
+                    changed = true;
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        struct pollfd pending = {notify, POLLIN, 0};
+        while (poll(&pending, 1, 50) > 0 && read(notify, events, sizeof(events)) > 0) {
+        }
+    }
+#else
+    (void)path;
+    (void)options;
+    (void)out;
+    log << "--watch needs inotify (Linux)" << std::endl;
+    return 1;
+#endif
+}
+
+#endif // WATCH_H
@@ -0,0 +1,220 @@
+// Array kernel benchmark: checks that the scalar, SSE2 and AVX2 kernels of ArrayKernels.h
+// agree on random arrays (every operator and operand shape, the reductions, lengths that
+// leave a tail, and values near INT_MIN / INT_MAX so arithmetic wraps around), then
+// reports the throughput of each level on large arrays.
+//
+// It finishes with the same computation written both ways in the language: once with
+// whole-array operations and once as an element-by-element while loop, run on the tree
+// engine, whose outputs must match.
+//
+// Build and run from the repository root:
+//   g++ -std=c++11 -O2 -pthread -o array_bench benchmarks/array_bench.cpp
+//   ./array_bench [--length=<elements>] [--repeat=<n>] [--cases=<n>]
+
+#include "../Pipeline.h"
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace arraykernels;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+unsigned int seed = 7;
+
+unsigned int next() {
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 8;
+}
+
+// Mostly small values, with the extremes mixed in
+int randomValue() {
+    switch (next() % 8) {
+        case 0: return INT_MAX - static_cast<int>(next() % 4);
+        case 1: return INT_MIN + static_cast<int>(next() % 4);
+        case 2: return 0;
+        default: return static_cast<int>(next() % 2001) - 1000;
+    }
+}
+
+std::vector<int> randomArray(size_t length) {
+    std::vector<int> values(length);
+    for (size_t i = 0; i < length; i++)
+        values[i] = randomValue();
+    return values;
+}
+
+// Every level against the scalar kernels
+bool checkKernels(const std::vector<Kernels>& levels, int cases) {
+    const Kernels& reference = levels[0];
+    int scalar = 7;
+    for (int c = 0; c < cases; c++) {
+        size_t length = next() % 70;
+        std::vector<int> left = randomArray(length);
+        std::vector<int> right = randomArray(length);
+        for (size_t i = 0; i < length; i++) {
+            // Division needs nonzero divisors for the kernels to run to the end, and no
+            // -1 divisor, since INT_MIN / -1 traps in every engine
+            if (right[i] == 0 && next() % 4 != 0)
+                right[i] = 3;
+            else if (right[i] == -1)
+                right[i] = -3;
+        }
+        for (const Kernels& kernels : levels) {
+            for (int op = O_ADD; op <= O_GE; op++) {
+                for (int shape = ARRAY_ARRAY; shape <= SCALAR_ARRAY; shape++) {
+                    // A scalar operand is the first value of its random array, or a fixed one if that is empty
+                    const int* a = shape == SCALAR_ARRAY && length == 0 ? &scalar : left.data();
+                    const int* b = shape == ARRAY_SCALAR && length == 0 ? &scalar : right.data();
+                    std::vector<int> expected(length);
+                    std::vector<int> actual(length);
+                    bool expectedOk = reference.binary[op][shape](a, b, expected.data(), length);
+                    bool actualOk = kernels.binary[op][shape](a, b, actual.data(), length);
+                    if (expectedOk != actualOk || (expectedOk && expected != actual)) {
+                        std::printf("MISMATCH: %s %s, shape %d, length %zu\n", kernelLevelName(kernels.level),
+                                    opKindToString(static_cast<OpKind>(op)), shape, length);
+                        return false;
+                    }
+                }
+            }
+            if (kernels.sum(left.data(), length) != reference.sum(left.data(), length) ||
+                (length > 0 && (kernels.min(left.data(), length) != reference.min(left.data(), length) ||
+                                kernels.max(left.data(), length) != reference.max(left.data(), length)))) {
+                std::printf("MISMATCH: %s reduction, length %zu\n", kernelLevelName(kernels.level), length);
+                return false;
+            }
+        }
+    }
+    std::printf("kernels: %d random cases match the scalar kernels at every level\n", cases);
+    return true;
+}
+
+// Best time of one kernel call over 'repeat' runs
+template <class Run>
+double best(int repeat, Run run) {
+    double result = 1e300;
+    for (int r = 0; r < repeat; r++) {
+        Clock::time_point start = Clock::now();
+        run();
+        result = std::min(result, seconds(start));
+    }
+    return result;
+}
+
+volatile int checksum = 0; // keeps reductions from being optimized away
+
+void measure(const std::vector<Kernels>& levels, size_t length, int repeat) {
+    std::vector<int> left = randomArray(length);
+    std::vector<int> right = randomArray(length);
+    std::vector<int> out(length);
+    int scalar = 5;
+    double mb = static_cast<double>(length * sizeof(int)) / (1 << 20);
+    std::printf("\n%zu elements (%.1f MiB per array), MiB/s of input:\n", length, mb);
+    std::printf("%-8s %10s %10s %10s %10s %10s\n", "level", "a + b", "a * b", "a < 5", "sum", "max");
+    for (const Kernels& kernels : levels) {
+        double add = best(repeat, [&] { kernels.binary[O_ADD][ARRAY_ARRAY](left.data(), right.data(), out.data(), length); });
+        double mul = best(repeat, [&] { kernels.binary[O_MUL][ARRAY_ARRAY](left.data(), right.data(), out.data(), length); });
+        double lt = best(repeat, [&] { kernels.binary[O_LT][ARRAY_SCALAR](left.data(), &scalar, out.data(), length); });
+        double sum = best(repeat, [&] { checksum += kernels.sum(left.data(), length); });
+        double max = best(repeat, [&] { checksum += kernels.max(left.data(), length); });
+        std::printf("%-8s %10.1f %10.1f %10.1f %10.1f %10.1f\n", kernelLevelName(kernels.level),
+                    2 * mb / add, 2 * mb / mul, mb / lt, mb / sum, mb / max);
+    }
+}
+
+// Runs a program on the tree engine and returns its output
+std::string run(const std::string& source, double& elapsed) {
+    std::string output;
+    OutputSink out(&output);
+    PipelineOptions options;
+    Clock::time_point start = Clock::now();
+    runPipeline(source.data(), source.size(), options, out);
+    out.flush();
+    elapsed = seconds(start);
+    return output;
+}
+
+bool comparePrograms(size_t length) {
+    std::string n = std::to_string(length);
+    std::string setup =
+        "a = array(" + n + ");\n"
+        "b = array(" + n + ");\n"
+        "i = 0;\n"
+        "while (i < " + n + ") { a[i] = i % 1000; b[i] = i % 7 - 3; i = i + 1; }\n";
+    std::string whole = setup +
+        "c = a * b + a;\n"
+        "print(sum(c));\n"
+        "print(max(c < 10));\n";
+    std::string elements = setup +
+        "c = array(" + n + ");\n"
+        "s = 0;\n"
+        "m = 0;\n"
+        "i = 0;\n"
+        "while (i < " + n + ") {\n"
+        "    c[i] = a[i] * b[i] + a[i];\n"
+        "    s = s + c[i];\n"
+        "    if (c[i] < 10) { m = 1; }\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "print(s);\n"
+        "print(m);\n";
+    double wholeTime = 0;
+    double elementTime = 0;
+    std::string expected = run(elements, elementTime);
+    std::string actual = run(whole, wholeTime);
+    std::printf("\nprogram on %zu elements: element loop %.2f ms, whole-array %.2f ms (including the same setup loop)\n",
+                length, elementTime * 1000, wholeTime * 1000);
+    if (expected != actual) {
+        std::printf("MISMATCH between the programs:\n%s---\n%s", expected.c_str(), actual.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t length = 1 << 22;
+    int repeat = 5;
+    int cases = 2000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 9, "--length=") == 0)
+            length = static_cast<size_t>(std::atol(arg.c_str() + 9));
+        else if (arg.compare(0, 9, "--repeat=") == 0)
+            repeat = std::atoi(arg.c_str() + 9);
+        else if (arg.compare(0, 8, "--cases=") == 0)
+            cases = std::atoi(arg.c_str() + 8);
+        else
+            length = 0;
+    }
+    if (length == 0 || repeat < 1 || cases < 0) {
+        std::fprintf(stderr, "Usage: array_bench [--length=<elements>] [--repeat=<n>] [--cases=<n>]\n");
+        return 2;
+    }
+
+    // Levels the CPU lacks are not measured
+    std::vector<Kernels> levels;
+    for (int level = KERNEL_SCALAR; level <= detectKernelLevel(); level++)
+        levels.push_back(Kernels(static_cast<KernelLevel>(level)));
+    std::printf("kernel levels on this CPU: ");
+    for (const Kernels& kernels : levels)
+        std::printf("%s ", kernelLevelName(kernels.level));
+    std::printf("(the engines use %s)\n", kernelLevelName(defaultKernels().level));
+
+    if (!checkKernels(levels, cases))
+        return 1;
+    measure(levels, length, repeat);
+    if (!comparePrograms(length < 1000000 ? length : 1000000))
+        return 1;
+    return 0;
+}
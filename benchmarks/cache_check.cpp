@@ -0,0 +1,259 @@
+// Test for damaged --cache entries: stores each program in a scratch cache, damages the
+// entry in place and checks that the next run re-parses it cleanly (same output as an
+// uncached run) and leaves an intact entry behind.
+//
+// Build and run from the repository root:
+//   g++ -std=c++11 -O2 -pthread -o cache_check benchmarks/cache_check.cpp
+//   ./cache_check [--samples=<dir>]
+//
+// Two kinds of damage are tried on every program, on the tree engine with and without
+// the optimizer and on the flat engine:
+//
+// - Every byte of the entry flipped in turn, file size unchanged. The checksum has to
+//   catch these.
+// - Every child index, name id, list range, list entry and name offset set out of
+//   range, with the checksum recomputed so only the bounds checks stand in the way.
+//   Fields a node type does not use are changed as well; they must not matter.
+//
+// The first failure is written to cache_check_failure.txt.
+
+#include "../Pipeline.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+
+namespace {
+
+// Uses every node type, so every kind of index is in the entry
+const char COVERAGE_PROGRAM[] =
+    "a = [3, -1, 4];\n"
+    "b = array(3);\n"
+    "i = 0;\n"
+    "while (i < len(a)) {\n"
+    "    b[i] = a[i] * 2 + i;\n"
+    "    i = i + 1;\n"
+    "}\n"
+    "if (!(sum(b) == 0)) {\n"
+    "    print(b);\n"
+    "} else {\n"
+    "    print(-max(a));\n"
+    "}\n"
+    "print(min(b) % 5);\n";
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::ostringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+void writeFile(const std::string& path, const std::string& data) {
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    file << data;
+}
+
+uint32_t get32(const std::string& image, size_t offset) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(image.data() + offset);
+    return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+           (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+void put32(std::string& image, size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; i++)
+        image[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+class Checker {
+private:
+    std::string directory;
+    ProgramCache cache;
+    int runs;
+
+    // Output and error of one run, cached or not
+    std::string run(const std::string& source, const PipelineOptions& options) {
+        std::string output;
+        OutputSink out(&output);
+        try {
+            runPipeline(source.data(), source.size(), options, out);
+        } catch (const std::exception& e) {
+            out.flush();
+            output += std::string("Error: ") + e.what() + "\n";
+        }
+        out.flush();
+        runs++;
+        return output;
+    }
+
+    bool fail(const std::string& source, const std::string& what) {
+        std::fprintf(stderr, "%s\n", what.c_str());
+        writeFile("cache_check_failure.txt", "# " + what + "\n" + source);
+        return false;
+    }
+
+    // Writes the damaged image over the entry, runs the program from the cache and
+    // checks the run and the entry it leaves
+    bool damaged(const std::string& source, const PipelineOptions& options, const std::string& expected,
+                 const std::string& path, const std::string& image, const std::string& what) {
+        writeFile(path, image);
+        if (run(source, options) != expected)
+            return fail(source, "wrong output after " + what);
+        CachedProgram program;
+        uint32_t flags = options.engine == "flat" || !options.optimize ? 0 : CACHE_OPTIMIZED;
+        if (!cache.load(cache.key(source.data(), source.size(), flags), program))
+            return fail(source, "no intact entry after " + what);
+        return true;
+    }
+
+public:
+    explicit Checker(const std::string& directory) : directory(directory), cache(directory), runs(0) {}
+
+    int runCount() const {
+        return runs;
+    }
+
+    bool check(const std::string& source, const PipelineOptions& base) {
+        std::string expected = run(source, base);
+        PipelineOptions options = base;
+        options.cache = &cache;
+        uint32_t flags = options.engine == "flat" || !options.optimize ? 0 : CACHE_OPTIMIZED;
+        std::string path = directory + "/" + cache.key(source.data(), source.size(), flags).fileName();
+        std::remove(path.c_str());
+        if (run(source, options) != expected || run(source, options) != expected)
+            return fail(source, "wrong output from an intact entry");
+        std::string image = readFile(path);
+        if (image.size() < PROGRAM_CACHE_HEADER)
+            return fail(source, "no entry stored");
+
+        for (size_t i = 0; i < image.size(); i++) {
+            std::string copy = image;
+            copy[i] = static_cast<char>(copy[i] ^ 0x01);
+            if (!damaged(source, options, expected, path, copy, "flipping byte " + std::to_string(i)))
+                return false;
+        }
+
+        // Field offsets to set out of range; each is paired with a value past every table
+        uint32_t nodeCount = get32(image, 36);
+        uint32_t listLength = get32(image, 40);
+        uint32_t nameCount = get32(image, 44);
+        std::vector<size_t> fields;
+        std::vector<uint32_t> values;
+        size_t nodes = PROGRAM_CACHE_HEADER;
+        for (uint32_t n = 0; n < nodeCount; n++) {
+            size_t record = nodes + 20 * static_cast<size_t>(n);
+            unsigned char type = static_cast<unsigned char>(image[record]);
+            for (int field = 0; field < 3; field++) {
+                // A number's value is data; any value is a valid program
+                if (field == 0 && type == N_NUMBER)
+                    continue;
+                fields.push_back(record + 8 + 4 * field);
+                values.push_back(nodeCount);
+                fields.push_back(record + 8 + 4 * field);
+                values.push_back(0xFFFFFFF0u);
+                // Itself, a cycle; for a name id that may be another valid name
+                if (field > 0 || (type != N_VARIABLE && type != N_ASSIGN)) {
+                    fields.push_back(record + 8 + 4 * field);
+                    values.push_back(n);
+                }
+            }
+        }
+        size_t lists = nodes + 20 * static_cast<size_t>(nodeCount);
+        for (uint32_t k = 0; k < listLength; k++) {
+            fields.push_back(lists + 4 * static_cast<size_t>(k));
+            values.push_back(nodeCount);
+        }
+        size_t offsets = lists + 4 * static_cast<size_t>(listLength);
+        for (uint32_t k = 0; k + 1 < nameCount; k++) {
+            fields.push_back(offsets + 4 * static_cast<size_t>(k) + 4);
+            values.push_back(get32(image, offsets + 4 * static_cast<size_t>(k) + 8) + 1); // past the next offset
+        }
+        fields.push_back(52); // root
+        values.push_back(nodeCount);
+        for (size_t f = 0; f < fields.size(); f++) {
+            std::string copy = image;
+            put32(copy, fields[f], values[f]);
+            put32(copy, 60, ProgramCache::checksum(copy.data(), copy.size()));
+            if (!damaged(source, options, expected, path, copy,
+                         "setting the word at " + std::to_string(fields[f]) + " to " + std::to_string(values[f])))
+                return false;
+        }
+        return true;
+    }
+};
+
+// A scratch directory under TMPDIR
+std::string temporaryDirectory() {
+    const char* directory = std::getenv("TMPDIR");
+    std::string path = std::string(directory && *directory ? directory : "/tmp") + "/cache_check_XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    if (!mkdtemp(name.data()))
+        throw std::runtime_error("Could not create a temporary directory in " + path);
+    return std::string(name.data());
+}
+
+void removeDirectory(const std::string& path) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+        return;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..")
+            std::remove((path + "/" + name).c_str());
+    }
+    closedir(dir);
+    rmdir(path.c_str());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string samples = "sample_programs";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 10, "--samples=") == 0) {
+            samples = arg.substr(10);
+        } else {
+            std::fprintf(stderr, "Usage: ./cache_check [--samples=<dir>]\n");
+            return 1;
+        }
+    }
+    std::vector<std::string> sources(1, COVERAGE_PROGRAM);
+    std::vector<std::string> names;
+    if (DIR* dir = opendir(samples.c_str())) {
+        while (dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] != '.')
+                names.push_back(samples + "/" + entry->d_name);
+        }
+        closedir(dir);
+    }
+    std::sort(names.begin(), names.end());
+    for (const std::string& name : names)
+        sources.push_back(readFile(name));
+
+    std::string directory = temporaryDirectory();
+    Checker checker(directory);
+    bool ok = true;
+    for (size_t s = 0; ok && s < sources.size(); s++) {
+        for (int variant = 0; ok && variant < 3; variant++) {
+            PipelineOptions options;
+            options.lexThreads = 1;
+            options.engine = variant == 2 ? "flat" : "tree";
+            options.optimize = variant == 0;
+            // The flat engine has no arrays
+            if (variant == 2 && s == 0)
+                continue;
+            ok = checker.check(sources[s], options);
+        }
+    }
+    removeDirectory(directory);
+    if (!ok)
+        return 1;
+    std::printf("%zu programs, %d runs: every damaged entry was re-parsed\n", sources.size(), checker.runCount());
+    return 0;
+}
@@ -0,0 +1,259 @@
+// Micro-benchmark: contiguous Queue / Stack and tail-pointer LinkedList against the
+// original node-per-element implementations (kept below in namespace legacy).
+//
+// Build and run from the repository root:
+//   g++ -std=c++11 -O2 -o container_bench benchmarks/container_bench.cpp
+//   ./container_bench [operations]
+
+#include "../Queue.h"
+#include "../Stack.h"
+#include "../LinkedList.h"
+#include "../Lexer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace legacy {
+
+// Original Queue.h: one heap node per element, copies on enqueue / dequeue / front
+template <typename T>
+class Queue {
+private:
+    struct Node {
+        T data;
+        Node* next;
+        Node(const T& value) : data(value), next(nullptr) {}
+    };
+    Node* frontNode;
+    Node* rearNode;
+    size_t size;
+
+    Queue(const Queue&);
+
+public:
+    Queue() : frontNode(nullptr), rearNode(nullptr), size(0) {}
+    ~Queue() {
+        while (frontNode != nullptr) {
+            Node* temp = frontNode;
+            frontNode = frontNode->next;
+            delete temp;
+        }
+    }
+    void enqueue(const T& value) {
+        Node* newNode = new Node(value);
+        if (rearNode == nullptr) {
+            frontNode = rearNode = newNode;
+        } else {
+            rearNode->next = newNode;
+            rearNode = newNode;
+        }
+        ++size;
+    }
+    T dequeue() {
+        T value = frontNode->data;
+        Node* temp = frontNode;
+        frontNode = frontNode->next;
+        delete temp;
+        if (frontNode == nullptr)
+            rearNode = nullptr;
+        --size;
+        return value;
+    }
+    bool isEmpty() const { return frontNode == nullptr; }
+};
+
+// Original LinkedList.h: head pointer only, O(n) append / get / set
+template <typename T>
+class LinkedList {
+private:
+    struct Node {
+        T data;
+        Node* next;
+        Node(T value) : data(value), next(nullptr) {}
+    };
+    Node* head;
+    int size;
+
+    LinkedList(const LinkedList&);
+
+public:
+    LinkedList() : head(nullptr), size(0) {}
+    ~LinkedList() {
+        while (head) {
+            Node* next = head->next;
+            delete head;
+            head = next;
+        }
+    }
+    void append(T value) {
+        Node* newNode = new Node(value);
+        if (!head) {
+            head = newNode;
+        } else {
+            Node* temp = head;
+            while (temp->next)
+                temp = temp->next;
+            temp->next = newNode;
+        }
+        size++;
+    }
+    void insert(int index, T value) {
+        Node* newNode = new Node(value);
+        if (index == 0) {
+            newNode->next = head;
+            head = newNode;
+        } else {
+            Node* temp = head;
+            for (int i = 0; i < index - 1; i++)
+                temp = temp->next;
+            newNode->next = temp->next;
+            temp->next = newNode;
+        }
+        size++;
+    }
+    void remove(int index) {
+        Node* temp = head;
+        if (index == 0) {
+            head = head->next;
+            delete temp;
+        } else {
+            for (int i = 0; i < index - 1; i++)
+                temp = temp->next;
+            Node* nodeToDelete = temp->next;
+            temp->next = nodeToDelete->next;
+            delete nodeToDelete;
+        }
+        size--;
+    }
+    T get(int index) {
+        Node* temp = head;
+        for (int i = 0; i < index; i++)
+            temp = temp->next;
+        return temp->data;
+    }
+    int getSize() { return size; }
+};
+
+// Original Stack.h: push/pop at index 0 of the linked list
+template <typename T>
+class Stack {
+private:
+    LinkedList<T> list;
+
+public:
+    void push(T value) { list.insert(0, value); }
+    T pop() {
+        T value = list.get(0);
+        list.remove(0);
+        return value;
+    }
+    bool isEmpty() { return list.getSize() == 0; }
+};
+
+} // namespace legacy
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* name, long long ops, double legacySeconds, double newSeconds) {
+    std::printf("%-34s %12lld %10.1f %10.1f %8.1fx\n", name, ops, ops / legacySeconds / 1e6, ops / newSeconds / 1e6,
+                legacySeconds / newSeconds);
+}
+
+static Token sampleToken(int i) {
+    static const char text[] = "identifier";
+    Token token = Token();
+    token.text = text;
+    token.length = 10;
+    token.lineNumber = i;
+    token.type = T_IDENTIFIER;
+    return token;
+}
+
+// Fills then drains the queue, the way Lexer and Parser use it
+template <typename Q>
+static double benchQueue(int n, long long& checksum) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Q queue;
+    for (int i = 0; i < n; i++)
+        queue.enqueue(sampleToken(i));
+    while (!queue.isEmpty())
+        checksum += queue.dequeue().lineNumber;
+    return secondsSince(start);
+}
+
+// Keeps a small window of elements in flight
+template <typename Q>
+static double benchQueueInterleaved(int n, long long& checksum) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Q queue;
+    for (int i = 0; i < 64; i++)
+        queue.enqueue(i);
+    for (int i = 0; i < n; i++) {
+        queue.enqueue(i);
+        checksum += queue.dequeue();
+    }
+    return secondsSince(start);
+}
+
+template <typename S>
+static double benchStack(int n, long long& checksum) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    S stack;
+    for (int i = 0; i < n; i++)
+        stack.push(i);
+    while (!stack.isEmpty())
+        checksum += stack.pop();
+    return secondsSince(start);
+}
+
+template <typename L>
+static double benchListAppend(int n, long long& checksum) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    L list;
+    for (int i = 0; i < n; i++)
+        list.append(i);
+    checksum += list.getSize();
+    return secondsSince(start);
+}
+
+static double legacyListScan(int n, long long& checksum) {
+    legacy::LinkedList<int> list;
+    for (int i = 0; i < n; i++)
+        list.insert(0, i);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+        checksum += list.get(i);
+    return secondsSince(start);
+}
+
+static double listScan(int n, long long& checksum) {
+    LinkedList<int> list;
+    for (int i = 0; i < n; i++)
+        list.append(i);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int value : list)
+        checksum += value;
+    return secondsSince(start);
+}
+
+int main(int argc, char* argv[]) {
+    int n = argc > 1 ? std::atoi(argv[1]) : 5000000;
+    int quadratic = n / 200; // legacy append/get are O(n) each, keep those runs short
+    long long checksum = 0;
+
+    std::printf("%-34s %12s %10s %10s %9s\n", "benchmark", "ops", "old Mop/s", "new Mop/s", "speedup");
+    report("Queue<Token> fill + drain", 2LL * n, benchQueue<legacy::Queue<Token> >(n, checksum),
+           benchQueue<Queue<Token> >(n, checksum));
+    report("Queue<int> interleaved", 2LL * n, benchQueueInterleaved<legacy::Queue<int> >(n, checksum),
+           benchQueueInterleaved<Queue<int> >(n, checksum));
+    report("Stack<int> push + pop", 2LL * n, benchStack<legacy::Stack<int> >(n, checksum),
+           benchStack<Stack<int> >(n, checksum));
+    report("LinkedList<int> append", quadratic, benchListAppend<legacy::LinkedList<int> >(quadratic, checksum),
+           benchListAppend<LinkedList<int> >(quadratic, checksum));
+    report("LinkedList<int> sequential read", quadratic, legacyListScan(quadratic, checksum), listScan(quadratic, checksum));
+    std::printf("(checksum %lld)\n", checksum);
+    return 0;
+}
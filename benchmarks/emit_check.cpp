@@ -0,0 +1,395 @@
+// Differential test for --emit: compiles programs to native executables through
+// NativeEmitter.h (assembly and C) and compares each executable's stdout, stderr and
+// exit status with the tree interpreter's on the same program.
+//
+// Build and run from the repository root (needs as and ld, or cc, on the PATH):
+//   g++ -std=c++11 -O2 -pthread -o emit_check benchmarks/emit_check.cpp
+//   ./emit_check [--programs=<n>] [--seed=<n>] [--target=asm|c|both] [--samples=<dir>]
+//
+// Every file in the samples directory (default sample_programs) is checked, followed by
+// random programs: nested loops with reserved counters so they terminate, else-if
+// chains, unary operators, wrapping arithmetic, and divisions, modulos and reads that
+// may fail with "Division by zero", "Modulo by zero" or "Undefined variable". Each
+// program runs with and without the optimizer, and with block scoping. The interpreter
+// runs in a child process like the executables, so a crash (e.g. SIGFPE on
+// INT_MIN / -1, which neither side guards) is compared too. The first mismatching
+// program is written to emit_check_failure.txt.
+
+#include "../NativeEmitter.h"
+#include "../OutputSink.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace {
+
+struct Options {
+    int programs;
+    unsigned int seed;
+    bool asmTarget;
+    bool cTarget;
+    std::string samples;
+
+    Options() : programs(200), seed(1), asmTarget(true), cTarget(true), samples("sample_programs") {}
+};
+
+// What a run printed and how it ended
+struct Outcome {
+    std::string out;
+    std::string err;
+    int status; // raw wait status
+
+    bool operator==(const Outcome& other) const {
+        return out == other.out && err == other.err && status == other.status;
+    }
+};
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 11, "--programs=") == 0) {
+            options.programs = std::atoi(argv[i] + 11);
+            if (options.programs < 0)
+                return false;
+        } else if (arg.compare(0, 7, "--seed=") == 0) {
+            options.seed = static_cast<unsigned int>(std::strtoul(argv[i] + 7, nullptr, 10));
+        } else if (arg == "--target=asm" || arg == "--target=c" || arg == "--target=both") {
+            options.asmTarget = arg != "--target=c";
+            options.cTarget = arg != "--target=asm";
+        } else if (arg.compare(0, 10, "--samples=") == 0) {
+            options.samples = arg.substr(10);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::ostringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+// A scratch file name under TMPDIR; the file itself is created and kept empty
+std::string temporaryPath(const char* tag) {
+    const char* directory = std::getenv("TMPDIR");
+    std::string path = std::string(directory && *directory ? directory : "/tmp") + "/emit_check_" + tag + "_XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(name.data());
+    if (fd < 0)
+        throw std::runtime_error("Could not create a temporary file in " + path);
+    close(fd);
+    return std::string(name.data());
+}
+
+// Forks; the child sends stdout and stderr to the two paths and runs body (which
+// must not return), the parent waits and collects the outcome
+template <typename Body>
+Outcome runChild(const std::string& outPath, const std::string& errPath, Body body) {
+    std::fflush(stdout);
+    std::fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0)
+        throw std::runtime_error("fork failed");
+    if (pid == 0) {
+        int outFd = open(outPath.c_str(), O_WRONLY | O_TRUNC);
+        int errFd = open(errPath.c_str(), O_WRONLY | O_TRUNC);
+        if (outFd < 0 || errFd < 0 || dup2(outFd, STDOUT_FILENO) < 0 || dup2(errFd, STDERR_FILENO) < 0)
+            _exit(127);
+        close(outFd);
+        close(errFd);
+        body();
+        _exit(127);
+    }
+    Outcome outcome;
+    outcome.status = 0;
+    while (waitpid(pid, &outcome.status, 0) < 0) {
+        if (errno != EINTR)
+            throw std::runtime_error("waitpid failed");
+    }
+    outcome.out = readFile(outPath);
+    outcome.err = readFile(errPath);
+    return outcome;
+}
+
+std::string describe(const Outcome& outcome) {
+    std::ostringstream text;
+    if (WIFEXITED(outcome.status))
+        text << "exit " << WEXITSTATUS(outcome.status);
+    else if (WIFSIGNALED(outcome.status))
+        text << "signal " << WTERMSIG(outcome.status);
+    else
+        text << "status " << outcome.status;
+    text << ", " << outcome.out.size() << " bytes of output, stderr \"" << outcome.err << "\"";
+    return text.str();
+}
+
+class Checker {
+private:
+    std::string outPath;
+    std::string errPath;
+    std::string binaryPath;
+    int compared;
+
+    // The tree engine, reporting errors like main.cpp
+    Outcome interpret(const std::string& source, const PipelineOptions& options) {
+        return runChild(outPath, errPath, [&]() {
+            OutputSink out(STDOUT_FILENO, OutputSink::FULLY_BUFFERED);
+            int status = 0;
+            try {
+                runPipeline(source.data(), source.size(), options, out);
+            } catch (const std::exception& e) {
+                out.flush();
+                std::fprintf(stderr, "Error: %s\n", e.what());
+                status = 1;
+            }
+            out.flush();
+            std::fflush(stderr);
+            _exit(status);
+        });
+    }
+
+    // Compiles and runs the program; a compile-time error is reported like the driver does
+    Outcome compileAndRun(const std::string& source, const PipelineOptions& options, EmitTarget target) {
+        std::string code;
+        try {
+            code = emitNative(source.data(), source.size(), options, target);
+        } catch (const std::exception& e) {
+            Outcome outcome;
+            outcome.err = std::string("Error: ") + e.what() + "\n";
+            outcome.status = 1 << 8; // exit status 1
+            return outcome;
+        }
+        std::remove(binaryPath.c_str());
+        buildNative(code, target, binaryPath);
+        std::string binary = binaryPath;
+        return runChild(outPath, errPath, [&binary]() {
+            char* argv[] = {const_cast<char*>(binary.c_str()), nullptr};
+            execv(binary.c_str(), argv);
+        });
+    }
+
+public:
+    Checker()
+        : outPath(temporaryPath("out")), errPath(temporaryPath("err")), binaryPath(temporaryPath("bin")), compared(0) {}
+
+    ~Checker() {
+        std::remove(outPath.c_str());
+        std::remove(errPath.c_str());
+        std::remove(binaryPath.c_str());
+    }
+
+    // Compares every selected target under the three option sets; false on the first mismatch
+    bool check(const std::string& name, const std::string& source, const Options& selected) {
+        for (int variant = 0; variant < 3; variant++) {
+            PipelineOptions options;
+            options.optimize = variant != 1;
+            options.blockScope = variant == 2;
+            options.lexThreads = 1;
+            Outcome expected = interpret(source, options);
+            for (int t = 0; t < 2; t++) {
+                EmitTarget target = t == 0 ? EMIT_ASM : EMIT_C;
+                if (!(target == EMIT_ASM ? selected.asmTarget : selected.cTarget))
+                    continue;
+                Outcome actual = compileAndRun(source, options, target);
+                compared++;
+                if (actual == expected)
+                    continue;
+                std::printf("MISMATCH %s (%s, %s%s):\n  interpreter: %s\n  executable:  %s\n", name.c_str(),
+                            target == EMIT_ASM ? "asm" : "c", options.optimize ? "optimized" : "--no-optimize",
+                            options.blockScope ? ", --block-scope" : "", describe(expected).c_str(),
+                            describe(actual).c_str());
+                std::ofstream("emit_check_failure.txt", std::ios::binary) << source;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int comparisons() const {
+        return compared;
+    }
+};
+
+// Random program generator. Loop counters c0, c1, ... are only assigned by their own
+// loop, so every loop ends; u is never assigned, so reading it fails unless the read
+// is never reached.
+class ProgramGenerator {
+private:
+    unsigned int& seed;
+    std::ostringstream text;
+
+    int next(int bound) {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<int>((seed >> 16) % static_cast<unsigned int>(bound));
+    }
+
+    void newLine(int indent) {
+        text << "\n" << std::string(static_cast<size_t>(indent) * 2, ' ');
+    }
+
+    std::string number() {
+        static const char* const special[] = {"0", "1", "2", "7", "10", "100", "65536", "2147483647", "46341"};
+        if (next(4) == 0)
+            return special[next(sizeof(special) / sizeof(special[0]))];
+        return std::to_string(next(50));
+    }
+
+    std::string variable(int loops) {
+        static const char* const names[] = {"a", "b", "c", "d", "e"};
+        int pick = next(128);
+        if (pick < 96)
+            return names[pick % 5];
+        if (pick < 127)
+            return loops > 0 ? "c" + std::to_string(next(loops)) : names[pick % 5];
+        return next(4) != 0 ? "f" : "u";
+    }
+
+    std::string expression(int depth, int loops) {
+        int pick = next(depth > 3 ? 3 : 14);
+        if (pick == 0)
+            return number();
+        if (pick <= 2)
+            return variable(loops);
+        if (pick == 3)
+            return "-" + expression(depth + 1, loops);
+        if (pick == 4)
+            return "!" + expression(depth + 1, loops);
+        if (pick == 5)
+            return "+" + expression(depth + 1, loops);
+        static const char* const ops[] = {"+", "-", "*", "+", "-", "*", "/", "%", "==", "!=", "<", "<=", ">", ">="};
+        std::string op = ops[next(sizeof(ops) / sizeof(ops[0]))];
+        std::string right;
+        if ((op == "/" || op == "%") && next(3) != 0)
+            right = std::to_string(1 + next(9)); // most divisions should not fail
+        else
+            right = expression(depth + 1, loops);
+        return "(" + expression(depth + 1, loops) + " " + op + " " + right + ")";
+    }
+
+    std::string target() {
+        static const char* const names[] = {"a", "b", "c", "d", "e", "f"};
+        return names[next(6)];
+    }
+
+    void block(int indent, int loops, int statements) {
+        text << "{";
+        for (int i = 0; i < statements; i++) {
+            newLine(indent + 1);
+            statement(indent + 1, loops);
+        }
+        newLine(indent);
+        text << "}";
+    }
+
+    void statement(int indent, int loops) {
+        int pick = next(indent > 3 ? 6 : 10);
+        if (pick < 3) {
+            text << target() << " = " << expression(0, loops) << ";";
+        } else if (pick < 6) {
+            text << "print(" << expression(0, loops) << ");";
+        } else if (pick < 8) {
+            text << "if (" << expression(1, loops) << ") ";
+            block(indent, loops, 1 + next(3));
+            for (int arms = next(3); arms > 0; arms--) {
+                text << " else if (" << expression(1, loops) << ") ";
+                block(indent, loops, 1 + next(2));
+            }
+            if (next(2) == 0) {
+                text << " else ";
+                block(indent, loops, 1 + next(2));
+            }
+        } else {
+            std::string counter = "c" + std::to_string(loops);
+            text << counter << " = 0;";
+            newLine(indent);
+            text << "while (" << counter << " < " << 1 + next(12) << ") {";
+            for (int i = 1 + next(3); i > 0; i--) {
+                newLine(indent + 1);
+                statement(indent + 1, loops + 1);
+            }
+            newLine(indent + 1);
+            text << counter << " = " << counter << " + 1;";
+            newLine(indent);
+            text << "}";
+        }
+    }
+
+public:
+    explicit ProgramGenerator(unsigned int& seed) : seed(seed) {}
+
+    std::string generate() {
+        // Most programs define a to e first, so they get past the first statements; f is
+        // only ever assigned later, inside blocks too
+        static const char* const names[] = {"a", "b", "c", "d", "e"};
+        for (int i = 0; i < 5; i++) {
+            if (next(40) != 0) {
+                text << names[i] << " = " << number() << ";";
+                newLine(0);
+            }
+        }
+        for (int i = 4 + next(10); i > 0; i--) {
+            statement(0, 0);
+            newLine(0);
+        }
+        return text.str();
+    }
+};
+
+std::vector<std::string> listSamples(const std::string& directory) {
+    std::vector<std::string> paths;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        return paths;
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            paths.push_back(directory + "/" + entry->d_name);
+    }
+    closedir(dir);
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: emit_check [--programs=<n>] [--seed=<n>] [--target=asm|c|both] [--samples=<dir>]\n");
+        return 2;
+    }
+    try {
+        Checker checker;
+        std::vector<std::string> samples = listSamples(options.samples);
+        for (const std::string& path : samples) {
+            if (!checker.check(path, readFile(path), options))
+                return 1;
+        }
+        unsigned int seed = options.seed;
+        for (int i = 0; i < options.programs; i++) {
+            std::string name = "random program " + std::to_string(i) + " (--seed=" + std::to_string(options.seed) + ")";
+            if (!checker.check(name, ProgramGenerator(seed).generate(), options))
+                return 1;
+        }
+        std::printf("emit_check: %zu samples and %d random programs, %d comparisons, no differences\n", samples.size(),
+                    options.programs, checker.comparisons());
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "emit_check: %s\n", e.what());
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Parallel lexing benchmark: generates a large script and lexes it with FastLexer on one
+// thread and with ParallelLexer on 1, 2, 4, ... up to every core, reporting throughput
+// and speedup over the serial lexer. Every parallel result is checked token by token
+// against the serial one. The speedup has only been measured on a single core, where
+// extra threads add overhead; its scaling across cores is unmeasured.
+//
+// It also checks the cases where chunks must agree on more than tokens: small random
+// inputs with an unknown character or a NUL byte somewhere are lexed with tiny chunks,
+// and the error message (or the tokens up to the NUL) must match the serial lexer.
+//
+// Build and run from the repository root:
+//   g++ -std=c++11 -O2 -pthread -o lexer_bench benchmarks/lexer_bench.cpp
+//   ./lexer_bench [--mb=<source size>] [--threads=<max>] [--repeat=<n>] [--cases=<n>]
+
+#include "../ParallelLexer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Straight-line code with loops and indentation, about 'bytes' long
+std::string generate(size_t bytes) {
+    std::string source;
+    source.reserve(bytes + 256);
+    for (size_t i = 0; source.size() < bytes; i++) {
+        std::string v = "value" + std::to_string(i % 97);
+        source += "i" + std::to_string(i % 13) + " = 0;\n";
+        source += "while (i" + std::to_string(i % 13) + " < 3) {\n";
+        source += "    " + v + " = " + v + " * 31 + " + std::to_string(i % 100000) + " % 7;\n";
+        source += "    if (" + v + " >= 1000000) {\n";
+        source += "        " + v + " = " + v + " - 1000000;\n";
+        source += "    }\n";
+        source += "    i" + std::to_string(i % 13) + " = i" + std::to_string(i % 13) + " + 1;\n";
+        source += "}\n";
+    }
+    return source;
+}
+
+// The token stream as text, or the error message
+std::string describe(Queue<Token> (*lex)(const std::string&, size_t), const std::string& source, size_t threads) {
+    std::ostringstream text;
+    try {
+        Queue<Token> tokens = lex(source, threads);
+        while (!tokens.isEmpty()) {
+            Token token = tokens.dequeue();
+            text << static_cast<int>(token.type) << " " << static_cast<int>(token.op) << " @" << (token.text - source.data())
+                 << "+" << token.length << " line " << token.lineNumber << " = " << token.number << "\n";
+        }
+    } catch (const std::exception& e) {
+        text << "error: " << e.what() << "\n";
+    }
+    return text.str();
+}
+
+Queue<Token> lexSerial(const std::string& source, size_t) {
+    return FastLexer(source.data(), source.size()).generateTokens();
+}
+
+// Chunks of at least 16 bytes, so a short input is split many times
+Queue<Token> lexTinyChunks(const std::string& source, size_t threads) {
+    return ParallelLexer(source.data(), source.size(), threads, 16).generateTokens();
+}
+
+bool sameTokens(Queue<Token>& expected, Queue<Token>& actual) {
+    if (expected.getSize() != actual.getSize())
+        return false;
+    while (!expected.isEmpty()) {
+        Token a = expected.dequeue();
+        Token b = actual.dequeue();
+        if (a.text != b.text || a.length != b.length || a.lineNumber != b.lineNumber || a.type != b.type ||
+            a.op != b.op || a.number != b.number || a.overflow != b.overflow)
+            return false;
+    }
+    return true;
+}
+
+// Random lines with an unknown character and/or a NUL byte dropped in at random
+bool checkStops(int cases) {
+    static const char* lines[] = {"x = 1;\n", "while (x < 10) {\n", "    y = y + x * 2;\n", "}\n", "\n", "   \t\n",
+                                  "print(y);\n", "if (y != 3) { z = 4; } else { z = 5; }\n", "count = 2147483648;\n"};
+    unsigned int seed = 7;
+    for (int c = 0; c < cases; c++) {
+        std::string source;
+        seed = seed * 1103515245u + 12345u;
+        size_t count = 1 + (seed >> 16) % 200;
+        for (size_t i = 0; i < count; i++) {
+            seed = seed * 1103515245u + 12345u;
+            source += lines[(seed >> 16) % (sizeof(lines) / sizeof(lines[0]))];
+        }
+        for (int k = 0; k < 2; k++) {
+            seed = seed * 1103515245u + 12345u;
+            if ((seed >> 16) % 3 == 0)
+                continue;
+            seed = seed * 1103515245u + 12345u;
+            source[(seed >> 8) % source.size()] = (seed >> 4) % 2 ? '@' : '\0';
+        }
+        std::string expected = describe(&lexSerial, source, 1);
+        for (size_t threads = 2; threads <= 4; threads++) {
+            if (describe(&lexTinyChunks, source, threads) != expected) {
+                std::printf("MISMATCH on case %d with %zu threads:\n%s\n", c, threads, expected.c_str());
+                return false;
+            }
+        }
+    }
+    std::printf("errors and NUL bytes: %d random inputs match the serial lexer\n", cases);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = 64;
+    size_t maxThreads = ThreadPool::defaultThreadCount();
+    int repeat = 3;
+    int cases = 3000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 5, "--mb=") == 0)
+            megabytes = static_cast<size_t>(std::atol(arg.c_str() + 5));
+        else if (arg.compare(0, 10, "--threads=") == 0)
+            maxThreads = static_cast<size_t>(std::atol(arg.c_str() + 10));
+        else if (arg.compare(0, 9, "--repeat=") == 0)
+            repeat = std::atoi(arg.c_str() + 9);
+        else if (arg.compare(0, 8, "--cases=") == 0)
+            cases = std::atoi(arg.c_str() + 8);
+        else
+            megabytes = 0;
+    }
+    if (megabytes == 0 || maxThreads == 0 || repeat < 1 || cases < 0) {
+        std::fprintf(stderr, "Usage: lexer_bench [--mb=<source size>] [--threads=<max>] [--repeat=<n>] [--cases=<n>]\n");
+        return 2;
+    }
+
+    if (!checkStops(cases))
+        return 1;
+
+    std::string source = generate(megabytes << 20);
+    Queue<Token> reference;
+    double serial = 1e300;
+    for (int r = 0; r < repeat; r++) {
+        Clock::time_point start = Clock::now();
+        Queue<Token> tokens = FastLexer(source.data(), source.size()).generateTokens();
+        serial = std::min(serial, seconds(start));
+        reference = std::move(tokens);
+    }
+    double mb = static_cast<double>(source.size()) / (1 << 20);
+    std::printf("source %.1f MiB, %zu tokens, %zu cores\n", mb, reference.getSize(), ThreadPool::defaultThreadCount());
+    std::printf("%-8s %10s %10s %9s\n", "threads", "best ms", "MiB/s", "speedup");
+    std::printf("%-8s %10.2f %10.1f %9s\n", "serial", serial * 1000, mb / serial, "1.00x");
+
+    std::vector<size_t> counts;
+    for (size_t t = 1; t < maxThreads; t *= 2)
+        counts.push_back(t);
+    counts.push_back(maxThreads);
+    for (size_t threads : counts) {
+        double best = 1e300;
+        bool same = true;
+        for (int r = 0; r < repeat; r++) {
+            Clock::time_point start = Clock::now();
+            Queue<Token> tokens = ParallelLexer(source.data(), source.size(), threads).generateTokens();
+            best = std::min(best, seconds(start));
+            if (r == 0) {
+                Queue<Token> expected = reference;
+                same = sameTokens(expected, tokens);
+            }
+        }
+        std::printf("%-8zu %10.2f %10.1f %8.2fx%s\n", threads, best * 1000, mb / best, serial / best,
+                    same ? "" : "  MISMATCH");
+        if (!same)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+// Test for --max-output: runs programs under output limits and checks the bytes that
+// actually reach the output, not just the error. A limited run must write a prefix of
+// the unlimited run's output, made of whole lines, no longer than the limit, and stop
+// only when the next line would not fit.
+//
+// Build and run from the repository root:
+//   g++ -std=c++11 -O2 -pthread -o limits_check benchmarks/limits_check.cpp
+//   ./limits_check [--programs=<n>] [--seed=<n>]
+//
+// The fixed cases are a million-element array printed under a 100-byte limit and a
+// loop of 10-byte prints under a 1000-byte one. Random programs mix scalar prints of
+// every width, array prints and loops, and get random limits. Every program runs with
+// the JIT, without it, and on the explicit-stack interpreter (--max-depth). The first
+// failing program is written to limits_check_failure.txt.
+
+#include "../Pipeline.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+struct Options {
+    int programs;
+    unsigned int seed;
+
+    Options() : programs(300), seed(1) {}
+};
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 11, "--programs=") == 0) {
+            options.programs = std::atoi(argv[i] + 11);
+            if (options.programs < 0)
+                return false;
+        } else if (arg.compare(0, 7, "--seed=") == 0) {
+            options.seed = static_cast<unsigned int>(std::strtoul(argv[i] + 7, nullptr, 10));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// What a run wrote and the error it stopped with, if any
+struct Run {
+    std::string out;
+    std::string error;
+};
+
+// Runs like main.cpp: the sink is flushed before the error is reported, so out is
+// everything the program got to stdout
+Run run(const std::string& source, int variant, unsigned long long maxOutput) {
+    PipelineOptions options;
+    options.lexThreads = 1;
+    options.jit = variant != 1;
+    options.maxDepth = variant == 2 ? 1000000 : 0;
+    options.limits.maxOutputBytes = maxOutput;
+    Run result;
+    OutputSink out(&result.out, 256);
+    try {
+        runPipeline(source.data(), source.size(), options, out);
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    out.flush();
+    return result;
+}
+
+const char* variantName(int variant) {
+    return variant == 0 ? "jit" : variant == 1 ? "no-jit" : "max-depth";
+}
+
+// Empty if the limited run is right, otherwise what is wrong with it
+std::string compare(const Run& full, const Run& limited, unsigned long long maxOutput) {
+    std::ostringstream problem;
+    if (limited.out.size() > maxOutput) {
+        problem << "wrote " << limited.out.size() << " bytes";
+    } else if (full.out.compare(0, limited.out.size(), limited.out) != 0) {
+        problem << "output is not a prefix of the unlimited output";
+    } else if (!limited.out.empty() && limited.out[limited.out.size() - 1] != '\n') {
+        problem << "output ends inside a line";
+    } else if (limited.error.empty() != (full.out.size() <= maxOutput)) {
+        problem << (limited.error.empty() ? "no error for " : "error for ") << full.out.size() << " bytes of output";
+    } else if (!limited.error.empty()) {
+        size_t next = full.out.find('\n', limited.out.size());
+        if (limited.error.find("output bytes") == std::string::npos)
+            problem << "unexpected error";
+        else if (next != std::string::npos && next + 1 <= maxOutput)
+            problem << "stopped at " << limited.out.size() << " bytes, the next line fits";
+    }
+    if (problem.tellp() > 0)
+        problem << " (limit " << maxOutput << ", error \"" << limited.error << "\")";
+    return problem.str();
+}
+
+// Checks one program under one limit on every variant; false on the first failure
+bool check(const std::string& source, unsigned long long maxOutput) {
+    Run full = run(source, 1, 0);
+    if (!full.error.empty()) {
+        std::fprintf(stderr, "unlimited run failed: %s\n", full.error.c_str());
+        return false;
+    }
+    for (int variant = 0; variant < 3; variant++) {
+        std::string problem = compare(full, run(source, variant, maxOutput), maxOutput);
+        if (!problem.empty()) {
+            std::fprintf(stderr, "%s: %s\n", variantName(variant), problem.c_str());
+            std::ofstream failure("limits_check_failure.txt");
+            failure << "# --max-output=" << maxOutput << " (" << variantName(variant) << ")\n" << source;
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned int nextRandom(unsigned int& state) {
+    state = state * 1103515245u + 12345u;
+    return state >> 8;
+}
+
+// A program of prints and loops; values cover every print width, negatives included
+std::string randomProgram(unsigned int& state) {
+    static const char* const values[] = {"0", "7", "-3", "42", "1000", "-65536", "123456789", "-2147483647 - 1", "2147483647"};
+    std::ostringstream source;
+    source << "a = [1, -22, 333];\nb = array(" << nextRandom(state) % 40 << ");\n";
+    int statements = 1 + static_cast<int>(nextRandom(state) % 6);
+    for (int s = 0; s < statements; s++) {
+        switch (nextRandom(state) % 4) {
+            case 0:
+                source << "print(" << values[nextRandom(state) % 9] << ");\n";
+                break;
+            case 1:
+                source << "print(" << (nextRandom(state) % 2 ? "a" : "b + " + std::to_string(nextRandom(state) % 1000)) << ");\n";
+                break;
+            default: {
+                // A counting loop printing a value that changes width as it goes
+                int trips = static_cast<int>(nextRandom(state) % 300);
+                int scale = static_cast<int>(nextRandom(state) % 100000) - 50000;
+                source << "i" << s << " = 0;\nwhile (i" << s << " < " << trips << ") {\n"
+                       << "    print(i" << s << " * " << scale << ");\n";
+                if (nextRandom(state) % 3 == 0)
+                    source << "    print(a * i" << s << ");\n";
+                source << "    i" << s << " = i" << s << " + 1;\n}\n";
+                break;
+            }
+        }
+    }
+    return source.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: ./limits_check [--programs=<n>] [--seed=<n>]\n");
+        return 1;
+    }
+    int checked = 0;
+    if (!check("a = array(1000000);\nprint(a);\n", 100) ||
+        !check("i = 0;\nwhile (i < 1000) {\n    print(123456789);\n    i = i + 1;\n}\n", 1000))
+        return 1;
+    checked += 2;
+    unsigned int state = options.seed;
+    for (int p = 0; p < options.programs; p++) {
+        std::string source = randomProgram(state);
+        unsigned long long fullSize = run(source, 1, 0).out.size();
+        // Mostly limits inside the output, some exactly at its end or past it
+        unsigned long long maxOutput = 1 + nextRandom(state) % (fullSize + 20);
+        if (!check(source, maxOutput))
+            return 1;
+        checked++;
+    }
+    std::printf("%d programs, %d runs each: output within the limit\n", checked, 3);
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Embedding benchmark: compile one script into a Program, then measure how many
+// Executions per second run it, on one thread and on every core, the way a request
+// handler would (fresh context per request, inputs bound, output captured).
+//
+// Build and run from the repository root:
+//   g++ -std=c++11 -O2 -pthread -o program_bench benchmarks/program_bench.cpp
+//   ./program_bench [executions per thread]
+
+#include "../Program.h"
+#include "../OutputSink.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A small request-sized script: a few inputs, a short loop, one line of output
+static const char SCRIPT[] =
+    "total = 0;\n"
+    "i = 0;\n"
+    "while (i < count) {\n"
+    "    total = total + price * (i + 1);\n"
+    "    i = i + 1;\n"
+    "}\n"
+    "if (total > limit) {\n"
+    "    total = limit;\n"
+    "}\n"
+    "print(total);\n";
+
+struct Counter {
+    size_t bytes;
+};
+
+static void countBytes(void* context, const char*, size_t length) {
+    static_cast<Counter*>(context)->bytes += length;
+}
+
+// Runs n executions, each with its own context; returns the sum of the results as a checksum
+static long long worker(const Program& program, int n, int seed) {
+    int count = program.slot("count");
+    int price = program.slot("price");
+    int limit = program.slot("limit");
+    int total = program.slot("total");
+    Counter counter = {0};
+    OutputSink out(&countBytes, &counter, OutputSink::FULLY_BUFFERED, 256);
+    long long checksum = 0;
+    for (int i = 0; i < n; i++) {
+        Execution execution(program, out);
+        execution.set(count, 8 + (i + seed) % 8);
+        execution.set(price, 3 + i % 5);
+        execution.set(limit, 250);
+        execution.run();
+        int value = 0;
+        execution.get(total, value);
+        checksum += value;
+    }
+    return checksum + static_cast<long long>(counter.bytes);
+}
+
+static double seconds(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+int main(int argc, char* argv[]) {
+    int n = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Program program(SCRIPT, ProgramOptions().input("count").input("price").input("limit"));
+    std::printf("compile: %.3f ms, %d slots\n", seconds(start) * 1e3, program.frameSize());
+
+    start = std::chrono::steady_clock::now();
+    long long checksum = worker(program, n, 0);
+    double single = seconds(start);
+    std::printf("1 thread:  %d executions in %.3f s, %.0f executions/s\n", n, single, n / single);
+
+    unsigned int threads = std::thread::hardware_concurrency();
+    if (threads > 1) {
+        std::vector<long long> sums(threads, 0);
+        std::vector<std::thread> pool;
+        start = std::chrono::steady_clock::now();
+        for (unsigned int t = 0; t < threads; t++)
+            pool.push_back(std::thread([&program, &sums, n, t] { sums[t] = worker(program, n, static_cast<int>(t)); }));
+        for (size_t t = 0; t < pool.size(); t++)
+            pool[t].join();
+        double shared = seconds(start);
+        for (size_t t = 0; t < sums.size(); t++)
+            checksum += sums[t];
+        std::printf("%u threads: %lld executions in %.3f s, %.0f executions/s\n", threads,
+                    static_cast<long long>(n) * threads, shared, static_cast<double>(n) * threads / shared);
+    }
+    std::printf("(checksum %lld)\n", checksum);
+    return 0;
+}
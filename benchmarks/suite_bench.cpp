@@ -0,0 +1,683 @@
+// Benchmark suite: generates synthetic programs of configurable size and shape, times
+// every phase of the pipeline separately and compares the results with a stored JSON
+// baseline. Exits with status 1 when a phase is slower than the baseline by more than
+// the threshold.
+//
+// Baselines are stored relative to a reference workload (plain C++: arithmetic,
+// unpredictable branches and dependent loads over an L2-sized table) that is timed
+// right before every phase, so a baseline recorded on one machine still applies on a
+// faster or slower one, or on the same machine under a different load. The default
+// threshold of 25% is above the run-to-run spread seen on a shared single-core host.
+//
+// Build and run from the repository root:
+//   g++ -std=c++11 -O2 -o suite_bench benchmarks/suite_bench.cpp
+//   ./suite_bench [--scale=<x>] [--repeat=<n>] [--shape=<name>] [--baseline=<file>]
+//                 [--save-baseline=<file>] [--threshold=<fraction>] [--dump=<shape>]
+//   ./suite_bench --verify-lexer[=<random inputs>]
+//
+// Shapes:
+//   straight  long straight-line code over 64 variables
+//   nested    deeply nested arithmetic expressions
+//   loop      a tight while loop with arithmetic and a branch
+//   print     a print-heavy loop
+//
+// Phases and their throughput units:
+//   lex        Lexer::generateTokens        tokens/s
+//   fastlex    FastLexer::generateTokens    tokens/s
+//   parse      Parser::parse                nodes/s
+//   interpret  Interpreter (JIT off)        statements/s or loop iterations/s
+//   jit        Interpreter (JIT on)         same unit as interpret
+//   vm         Compiler + VM                same unit as interpret
+//   closure    ClosureCompiler + program    same unit as interpret
+//
+// Every shape runs in a child process so its peak RSS is reported on its own. Phases
+// that take less than MIN_COMPARE_MS are reported but neither saved nor compared, since
+// their timings are mostly noise (e.g. lexing the few lines of the loop shape).
+//
+// --verify-lexer is the differential test for FastLexer: it lexes every shape and a
+// set of random inputs (odd whitespace, NUL and non-ASCII bytes, overflowing numbers,
+// near-keywords) with Lexer and with FastLexer at each vector width, and reports the
+// first input where the token streams or the error messages differ.
+
+#include "../Lexer.h"
+#include "../FastLexer.h"
+#include "../Parser.h"
+#include "../Resolver.h"
+#include "../DefiniteAssignment.h"
+#include "../Interpreter.h"
+#include "../Compiler.h"
+#include "../VM.h"
+#include "../ClosureCompiler.h"
+#include "../OutputSink.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace {
+
+const double MIN_COMPARE_MS = 5.0;
+
+// Marks a baseline file as relative to the reference workload
+const char RELATIVE_KEY[] = "relative";
+
+// The reference workload, reported by measure() like a phase
+const char REFERENCE_PHASE[] = "reference";
+
+struct Options {
+    double scale;
+    int repeat;
+    double threshold;
+    std::string shape;
+    std::string baseline;
+    std::string saveBaseline;
+    std::string dump;
+    int verifyLexer; // random inputs for --verify-lexer, or -1
+    Options() : scale(1.0), repeat(3), threshold(0.25), verifyLexer(-1) {}
+};
+
+struct Program {
+    std::string source;
+    long long workUnits;  // statements executed, or loop iterations
+    const char* workName; // "statements" or "iterations"
+};
+
+// Program generator
+
+Program straightLine(long long statements) {
+    std::string source;
+    source.reserve(static_cast<size_t>(statements) * 32);
+    for (int v = 0; v < 64; v++)
+        source += "v" + std::to_string(v) + " = " + std::to_string(v) + ";\n";
+    for (long long i = 0; i < statements; i++) {
+        source += "v" + std::to_string(i % 64) + " = v" + std::to_string((i + 63) % 64) + " + " +
+                  std::to_string(i % 100) + " * 3 - v" + std::to_string((i + 7) % 64) + " % 7;\n";
+    }
+    source += "print(v0);\n";
+    Program program = {source, statements + 65, "statements"};
+    return program;
+}
+
+Program nestedExpressions(long long statements, int depth) {
+    static const char* ops[] = {" + ", " * ", " - ", " % "};
+    std::string source = "x = 1;\n";
+    for (long long i = 0; i < statements; i++) {
+        std::string expr = "x";
+        for (int d = 0; d < depth; d++)
+            expr = "(" + expr + ops[d % 4] + std::to_string(d % 9 + 2) + ")";
+        source += "x = " + expr + ";\n";
+    }
+    source += "print(x);\n";
+    Program program = {source, statements + 2, "statements"};
+    return program;
+}
+
+Program tightLoop(long long iterations) {
+    std::string source =
+        "i = 0;\n"
+        "s = 0;\n"
+        "while (i < " + std::to_string(iterations) + ") {\n"
+        "    s = s + i % 7 * 3;\n"
+        "    if (s > 100000) {\n"
+        "        s = s - 100000;\n"
+        "    }\n"
+        "    i = i + 1;\n"
+        "}\n"
+        "print(s);\n";
+    Program program = {source, iterations, "iterations"};
+    return program;
+}
+
+Program printLoop(long long iterations) {
+    std::string source =
+        "i = 0;\n"
+        "while (i < " + std::to_string(iterations) + ") {\n"
+        "    print(i * 3 - 7);\n"
+        "    i = i + 1;\n"
+        "}\n";
+    Program program = {source, iterations, "iterations"};
+    return program;
+}
+
+bool generate(const std::string& shape, double scale, Program& program) {
+    long long n;
+    if (shape == "straight") {
+        n = static_cast<long long>(200000 * scale);
+        program = straightLine(n < 1 ? 1 : n);
+    } else if (shape == "nested") {
+        n = static_cast<long long>(20000 * scale);
+        program = nestedExpressions(n < 1 ? 1 : n, 40);
+    } else if (shape == "loop") {
+        n = static_cast<long long>(5000000 * scale);
+        program = tightLoop(n < 1 ? 1 : n);
+    } else if (shape == "print") {
+        n = static_cast<long long>(1000000 * scale);
+        program = printLoop(n < 1 ? 1 : n);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Measurement
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+size_t countNodes(ASTNode* node) {
+    switch (node->type) {
+        case N_BIN_OP:
+            return 1 + countNodes(static_cast<BinOpNode*>(node)->left) + countNodes(static_cast<BinOpNode*>(node)->right);
+        case N_UNARY_OP:
+            return 1 + countNodes(static_cast<UnaryOpNode*>(node)->operand);
+        case N_ASSIGN:
+            return 1 + countNodes(static_cast<AssignNode*>(node)->value);
+        case N_PRINT:
+            return 1 + countNodes(static_cast<PrintNode*>(node)->expression);
+        case N_IF: {
+            IfNode* ifNode = static_cast<IfNode*>(node);
+            return 1 + countNodes(ifNode->condition) + countNodes(ifNode->trueBlock) +
+                   (ifNode->falseBlock ? countNodes(ifNode->falseBlock) : 0);
+        }
+        case N_WHILE:
+            return 1 + countNodes(static_cast<WhileNode*>(node)->condition) + countNodes(static_cast<WhileNode*>(node)->block);
+        case N_BLOCK: {
+            size_t count = 1;
+            for (ASTNode* stmt : static_cast<BlockNode*>(node)->statements)
+                count += countNodes(stmt);
+            return count;
+        }
+        default:
+            return 1;
+    }
+}
+
+struct PhaseResult {
+    std::string phase;
+    double seconds;  // best of the repetitions
+    double units;    // work done per run
+    double relative; // throughput divided by the reference workload's
+    std::string unitName;
+};
+
+long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // kilobytes on Linux
+}
+
+// Timed phases per shape
+const int PHASE_COUNT = 7;
+
+// Steps of the reference workload per run, about 25 ms; one run precedes every phase
+const int REFERENCE_STEPS = 1000000;
+
+// Keeps the reference workload's result alive
+volatile uint32_t referenceSink;
+
+// A 256 KiB table of pseudo-random words for the reference workload
+std::vector<uint32_t> referenceTable() {
+    std::vector<uint32_t> table(1 << 16);
+    uint32_t x = 1;
+    for (uint32_t& value : table) {
+        x = x * 1664525u + 1013904223u;
+        value = x;
+    }
+    return table;
+}
+
+// Times one run of the reference workload: arithmetic, an unpredictable branch and a
+// dependent load per step
+double referenceSeconds(const std::vector<uint32_t>& table) {
+    uint32_t mask = static_cast<uint32_t>(table.size() - 1);
+    Clock::time_point start = Clock::now();
+    uint32_t index = 0, sum = 0;
+    for (int i = 0; i < REFERENCE_STEPS; i++) {
+        uint32_t value = table[index];
+        if (value & 0x100)
+            sum += value >> 3;
+        else
+            sum ^= value * 7;
+        index = (value ^ sum) & mask;
+    }
+    double elapsed = seconds(start);
+    referenceSink = sum;
+    return elapsed;
+}
+
+// Keeps the best time of each phase and of the reference workload, which is run
+// before every phase so both see the same state of the machine
+class PhaseTimes {
+private:
+    const std::vector<uint32_t>& table;
+    double best[PHASE_COUNT];
+    double bestReference;
+
+public:
+    explicit PhaseTimes(const std::vector<uint32_t>& table) : table(table), bestReference(1e300) {
+        for (int p = 0; p < PHASE_COUNT; p++)
+            best[p] = 1e300;
+    }
+
+    // Times the reference workload and starts the clock for the next phase
+    Clock::time_point start() {
+        bestReference = std::min(bestReference, referenceSeconds(table));
+        return Clock::now();
+    }
+
+    void stop(int phase, Clock::time_point started) {
+        best[phase] = std::min(best[phase], seconds(started));
+    }
+
+    double phaseSeconds(int phase) const {
+        return best[phase];
+    }
+
+    // Phase throughput divided by reference throughput, for 'units' of work per run
+    double relative(int phase, double units) const {
+        return units / REFERENCE_STEPS * (bestReference / best[phase]);
+    }
+
+    double referenceBest() const {
+        return bestReference;
+    }
+};
+
+// Runs every phase of one shape 'repeat' times and keeps the best time of each
+std::vector<PhaseResult> measure(const Program& program, int repeat) {
+    std::vector<uint32_t> table = referenceTable();
+    PhaseTimes times(table);
+    size_t tokens = 0;
+    size_t nodes = 0;
+    int devNull = open("/dev/null", O_WRONLY);
+    for (int r = 0; r < repeat; r++) {
+        Clock::time_point start = times.start();
+        Lexer lexer(program.source);
+        Queue<Token> lexed = lexer.generateTokens();
+        times.stop(0, start);
+        tokens = lexed.getSize();
+
+        start = times.start();
+        FastLexer fastLexer(program.source);
+        lexed = fastLexer.generateTokens();
+        times.stop(1, start);
+
+        start = times.start();
+        Parser parser(std::move(lexed));
+        ASTNode* root = parser.parse();
+        times.stop(2, start);
+        nodes = countNodes(root);
+
+        Resolver resolver;
+        SymbolTable symbols = resolver.resolve(root);
+        DefiniteAssignment().analyze(root, symbols);
+        for (int engine = 0; engine < 4; engine++) {
+            OutputSink out(devNull);
+            start = times.start();
+            if (engine == 0 || engine == 1) {
+                Interpreter interpreter(root, symbols, out, engine == 1, nullptr, false);
+                interpreter.interpret();
+            } else if (engine == 2) {
+                Compiler compiler;
+                Chunk chunk = compiler.compile(root, symbols);
+                VM vm(chunk, out);
+                vm.run();
+            } else {
+                ClosureProgram compiled;
+                ClosureCompiler().compile(root, symbols, compiled);
+                compiled.run(out);
+            }
+            out.flush();
+            times.stop(3 + engine, start);
+        }
+        delete root;
+    }
+    close(devNull);
+
+    static const char* names[PHASE_COUNT] = {"lex", "fastlex", "parse", "interpret", "jit", "vm", "closure"};
+    std::vector<PhaseResult> results;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        PhaseResult result;
+        result.phase = names[p];
+        result.seconds = times.phaseSeconds(p);
+        result.units = p <= 1 ? static_cast<double>(tokens) : p == 2 ? static_cast<double>(nodes) : static_cast<double>(program.workUnits);
+        result.relative = times.relative(p, result.units);
+        result.unitName = p <= 1 ? "tokens" : p == 2 ? "nodes" : program.workName;
+        results.push_back(result);
+    }
+    PhaseResult reference;
+    reference.phase = REFERENCE_PHASE;
+    reference.seconds = times.referenceBest();
+    reference.units = REFERENCE_STEPS;
+    reference.relative = 1;
+    reference.unitName = "steps";
+    results.push_back(reference);
+    return results;
+}
+
+// Lexer differential test
+
+// The whole token stream as text, or the error message; the two lexers agree exactly
+// when these strings are equal
+template <typename L>
+std::string describeTokens(L& lexer, const char* base) {
+    std::ostringstream text;
+    try {
+        Queue<Token> tokens = lexer.generateTokens();
+        while (!tokens.isEmpty()) {
+            Token token = tokens.dequeue();
+            text << static_cast<int>(token.type) << " " << static_cast<int>(token.op) << " @" << (token.text - base) << "+"
+                 << token.length << " line " << token.lineNumber << " = " << token.number << (token.overflow ? " overflow" : "")
+                 << "\n";
+        }
+    } catch (const std::exception& e) {
+        text << "error: " << e.what() << "\n";
+    }
+    return text.str();
+}
+
+// Returns false and prints the input if any FastLexer width disagrees with Lexer
+bool sameTokens(const std::string& source, const char* label) {
+    Lexer reference(source.data(), source.size());
+    std::string expected = describeTokens(reference, source.data());
+    static const fastlex::ScanLevel levels[] = {fastlex::SCAN_SCALAR, fastlex::SCAN_SSE2, fastlex::SCAN_AVX2};
+    for (fastlex::ScanLevel level : levels) {
+        fastlex::Scanners scanners(level);
+        FastLexer lexer(source.data(), source.size(), scanners);
+        std::string actual = describeTokens(lexer, source.data());
+        if (actual != expected) {
+            std::printf("MISMATCH (%s, %s) on %zu-byte input:\n", label, fastlex::scanLevelName(scanners.level), source.size());
+            std::string shown = source.substr(0, 400);
+            for (char& c : shown)
+                if (static_cast<unsigned char>(c) < 0x20 && c != '\n')
+                    c = '?';
+            std::printf("%s\n", shown.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Random text mixing the pieces most likely to trip a scanner at vector boundaries
+std::string randomSource(unsigned int& seed) {
+    static const char* pieces[] = {
+        " ", "  ", "                ", "\n", "\r\n", "\t", "\v", "\f", "x", "_", "a_1", "if", "iff", "else", "elsee",
+        "while", "whil", "print", "printx", "If", "PRINT", "0", "7", "00", "2147483647", "2147483648", "99999999999999999999",
+        "=", "==", "!", "!=", "<", "<=", ">", ">=", "+", "-", "*", "/", "%", ";", "(", ")", "{", "}",
+        "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789", "1234567890123456789012345678901234567890",
+        "@", "#", "\x80", "\xff", "`", "[", "]", ",", "{", ""};
+    const size_t count = sizeof(pieces) / sizeof(pieces[0]);
+    seed = seed * 1103515245u + 12345u;
+    size_t parts = (seed >> 16) % 64;
+    std::string source;
+    for (size_t i = 0; i < parts; i++) {
+        seed = seed * 1103515245u + 12345u;
+        size_t pick = (seed >> 16) % count;
+        if (pick == count - 1)
+            source += '\0'; // the empty C string above stands for a NUL byte
+        else
+            source += pieces[pick];
+    }
+    return source;
+}
+
+int verifyLexer(double scale, int randomInputs) {
+    static const char* shapes[] = {"straight", "nested", "loop", "print"};
+    std::printf("FastLexer scanners on this CPU: %s\n", fastlex::scanLevelName(fastlex::defaultScanners().level));
+    for (const char* shape : shapes) {
+        Program program;
+        generate(shape, scale, program);
+        if (!sameTokens(program.source, shape))
+            return 1;
+    }
+    unsigned int seed = 12345;
+    for (int i = 0; i < randomInputs; i++) {
+        std::string source = randomSource(seed);
+        if (!sameTokens(source, "random"))
+            return 1;
+        // Every tail of a longer input shifts the vector boundaries by one byte
+        if (i % 64 == 0) {
+            for (size_t skip = 1; skip < source.size() && skip < 40; skip++)
+                if (!sameTokens(source.substr(skip), "random tail"))
+                    return 1;
+        }
+    }
+    std::printf("FastLexer matches Lexer on %zu shapes and %d random inputs\n", sizeof(shapes) / sizeof(shapes[0]), randomInputs);
+    return 0;
+}
+
+// Runs a shape in a child process; the child reports one "phase seconds units unit"
+// line per phase and a final "rss <kb>" line through a pipe
+bool runIsolated(const Program& program, int repeat, std::vector<PhaseResult>& results, long& rssKb) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0) {
+        close(fds[0]);
+        std::ostringstream report;
+        try {
+            std::vector<PhaseResult> measured = measure(program, repeat);
+            for (const PhaseResult& result : measured)
+                report << result.phase << " " << result.seconds << " " << result.units << " " << result.relative << " "
+                       << result.unitName << "\n";
+            report << "rss " << peakRssKb() << "\n";
+        } catch (const std::exception& e) {
+            report << "error " << e.what() << "\n";
+        }
+        std::string text = report.str();
+        ssize_t written = write(fds[1], text.data(), text.size());
+        _exit(written == static_cast<ssize_t>(text.size()) ? 0 : 1);
+    }
+    close(fds[1]);
+    std::string text;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(fds[0], buffer, sizeof(buffer))) > 0)
+        text.append(buffer, static_cast<size_t>(got));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    std::istringstream lines(text);
+    std::string key;
+    while (lines >> key) {
+        if (key == "rss") {
+            lines >> rssKb;
+        } else if (key == "error") {
+            std::string message;
+            std::getline(lines, message);
+            std::fprintf(stderr, "benchmark failed:%s\n", message.c_str());
+            return false;
+        } else {
+            PhaseResult result;
+            result.phase = key;
+            lines >> result.seconds >> result.units >> result.relative >> result.unitName;
+            results.push_back(result);
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && !results.empty();
+}
+
+// Baselines are flat JSON objects: {"shape.phase": throughput, ...}
+
+std::map<std::string, double> readBaseline(const std::string& path, bool& ok) {
+    std::map<std::string, double> values;
+    std::ifstream file(path);
+    ok = static_cast<bool>(file);
+    std::stringstream content;
+    content << file.rdbuf();
+    std::string text = content.str();
+    size_t pos = 0;
+    while ((pos = text.find('"', pos)) != std::string::npos) {
+        size_t end = text.find('"', pos + 1);
+        if (end == std::string::npos)
+            break;
+        std::string key = text.substr(pos + 1, end - pos - 1);
+        size_t colon = text.find(':', end);
+        if (colon == std::string::npos)
+            break;
+        values[key] = std::strtod(text.c_str() + colon + 1, nullptr);
+        pos = colon + 1;
+    }
+    return values;
+}
+
+bool writeBaseline(const std::string& path, const std::map<std::string, double>& values) {
+    std::ofstream file(path);
+    file << "{\n";
+    size_t i = 0;
+    for (std::map<std::string, double>::const_iterator it = values.begin(); it != values.end(); ++it, ++i) {
+        char number[64];
+        std::snprintf(number, sizeof(number), "%.6g", it->second);
+        file << "  \"" << it->first << "\": " << number << (i + 1 < values.size() ? "," : "") << "\n";
+    }
+    file << "}\n";
+    return static_cast<bool>(file);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--scale=") == 0)
+            options.scale = std::atof(arg.c_str() + 8);
+        else if (arg.compare(0, 9, "--repeat=") == 0)
+            options.repeat = std::atoi(arg.c_str() + 9);
+        else if (arg.compare(0, 12, "--threshold=") == 0)
+            options.threshold = std::atof(arg.c_str() + 12);
+        else if (arg.compare(0, 8, "--shape=") == 0)
+            options.shape = arg.substr(8);
+        else if (arg.compare(0, 11, "--baseline=") == 0)
+            options.baseline = arg.substr(11);
+        else if (arg.compare(0, 16, "--save-baseline=") == 0)
+            options.saveBaseline = arg.substr(16);
+        else if (arg.compare(0, 7, "--dump=") == 0)
+            options.dump = arg.substr(7);
+        else if (arg == "--verify-lexer")
+            options.verifyLexer = 100000;
+        else if (arg.compare(0, 15, "--verify-lexer=") == 0)
+            options.verifyLexer = std::atoi(arg.c_str() + 15);
+        else
+            return false;
+    }
+    return options.scale > 0 && options.repeat > 0 && options.threshold >= 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "Usage: suite_bench [--scale=<x>] [--repeat=<n>] [--shape=straight|nested|loop|print]\n"
+                             "                   [--baseline=<file>] [--save-baseline=<file>] [--threshold=<fraction>]\n"
+                             "                   [--dump=<shape>]\n"
+                             "       suite_bench --verify-lexer[=<random inputs>]\n");
+        return 2;
+    }
+
+    // --dump prints a generated program instead of benchmarking it
+    if (!options.dump.empty()) {
+        Program program;
+        if (!generate(options.dump, options.scale, program)) {
+            std::fprintf(stderr, "Unknown shape: %s\n", options.dump.c_str());
+            return 2;
+        }
+        std::fwrite(program.source.data(), 1, program.source.size(), stdout);
+        return 0;
+    }
+
+    if (options.verifyLexer >= 0)
+        return verifyLexer(options.scale, options.verifyLexer);
+
+    std::map<std::string, double> baseline;
+    if (!options.baseline.empty()) {
+        bool ok;
+        baseline = readBaseline(options.baseline, ok);
+        if (!ok) {
+            std::fprintf(stderr, "Could not read baseline: %s\n", options.baseline.c_str());
+            return 2;
+        }
+        if (!baseline.count(RELATIVE_KEY)) {
+            std::fprintf(stderr, "%s holds absolute throughputs; record it again with --save-baseline\n",
+                         options.baseline.c_str());
+            return 2;
+        }
+    }
+
+    static const char* shapes[] = {"straight", "nested", "loop", "print"};
+    std::map<std::string, double> measured;
+    int regressions = 0;
+    std::printf("%-9s %-10s %10s %16s %-11s %14s %9s\n", "shape", "phase", "best ms", "throughput", "", "baseline", "change");
+    for (const char* shape : shapes) {
+        if (!options.shape.empty() && options.shape != shape)
+            continue;
+        Program program;
+        generate(shape, options.scale, program);
+        std::vector<PhaseResult> results;
+        long rssKb = 0;
+        if (!runIsolated(program, options.repeat, results, rssKb)) {
+            std::fprintf(stderr, "%s: benchmark run failed\n", shape);
+            return 2;
+        }
+        for (const PhaseResult& result : results) {
+            if (result.phase == REFERENCE_PHASE) {
+                std::printf("%-9s %-10s %10.2f %16.4g %-11s\n", shape, result.phase.c_str(), result.seconds * 1000,
+                            result.units / result.seconds, (result.unitName + "/s").c_str());
+                continue;
+            }
+            std::string key = std::string(shape) + "." + result.phase;
+            double throughput = result.seconds > 0 ? result.units / result.seconds : 0;
+            bool comparable = result.seconds * 1000 >= MIN_COMPARE_MS;
+            if (comparable)
+                measured[key] = result.relative;
+            std::string compared = "-";
+            std::string change = comparable ? "" : "too short";
+            std::map<std::string, double>::const_iterator base = baseline.find(key);
+            if (comparable && base != baseline.end() && base->second > 0) {
+                // The baseline throughput scaled to this run's reference rate
+                double expected = throughput / result.relative * base->second;
+                char text[32];
+                std::snprintf(text, sizeof(text), "%.4g", expected);
+                compared = text;
+                double delta = result.relative / base->second - 1.0;
+                std::snprintf(text, sizeof(text), "%+.1f%%", delta * 100);
+                change = text;
+                if (delta < -options.threshold) {
+                    change += " REGRESSION";
+                    regressions++;
+                }
+            }
+            std::printf("%-9s %-10s %10.2f %16.4g %-11s %14s %9s\n", shape, result.phase.c_str(), result.seconds * 1000,
+                        throughput, (result.unitName + "/s").c_str(), compared.c_str(), change.c_str());
+        }
+        std::printf("%-9s peak RSS %ld KiB, source %zu bytes\n", shape, rssKb, program.source.size());
+    }
+
+    if (!options.saveBaseline.empty()) {
+        measured[RELATIVE_KEY] = 1;
+        if (!writeBaseline(options.saveBaseline, measured)) {
+            std::fprintf(stderr, "Could not write baseline: %s\n", options.saveBaseline.c_str());
+            return 2;
+        }
+        std::printf("Baseline written to %s\n", options.saveBaseline.c_str());
+    }
+    if (regressions > 0) {
+        std::printf("%d phase(s) regressed by more than %.0f%%\n", regressions, options.threshold * 100);
+        return 1;
+    }
+    return 0;
+}
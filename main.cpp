@@ -1,49 +1,375 @@
-#include "Lexer.h"
-#include "Parser.h"
-#include "Interpreter.h"
-#include <fstream>
-#include <sstream>
+#include "Pipeline.h"
+#include "Batch.h"
+#include "Watch.h"
+#include "Profiler.h"
+#include "SourceFile.h"
+#include "OutputSink.h"
+#include "NativeEmitter.h"
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <vector>
+#include <cstdlib>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: ./mini_compiler <source_file>" << std::endl;
+    // Command line: [--engine=tree|vm|closure|flat] [--block-scope] [--no-optimize] [--verbose-opt] [--dump-ast] [--warn-undefined]
+    //               [--ast-stats] [--no-jit] [--no-closed-form] [--lex-threads=N] [--profile] [--profile-json=<file>]
+    //               [--profile-collapsed=<file>] [--unbuffered] [--output=<file>] [--cache] [--cache-dir=<dir>]
+    //               [--max-iterations=N] [--max-time=<ms>] [--max-output=<bytes>] [--max-variables=N]
+    //               [--max-array-elements=N] [--max-depth=N]
+    //               <source_file>
+    //               [--batch] [--manifest=<file>] [--jobs=N] <source_file>...
+    //               [--cache-dir=<dir>] [--cache-stats] [--cache-prune[=<days>]]
+    //               --watch [engine options] <source_file>
+    //               --emit=asm|c [--build=<file>] [--block-scope] [--no-optimize] [--output=<file>] <source_file>
+    PipelineOptions options;
+    bool verboseOpt = false;
+    bool dumpAst = false;
+    bool astStats = false;
+    bool warnUndefined = false;
+    bool profile = false;
+    const char* profileJson = nullptr;
+    const char* profileCollapsed = nullptr;
+    bool unbuffered = false;
+    const char* outputPath = nullptr;
+    bool batch = false;
+    bool watch = false;
+    const char* manifestPath = nullptr;
+    size_t jobs = 0;
+    bool useCache = false;
+    std::string cacheDir;
+    bool cacheStats = false;
+    int pruneDays = -1;
+    const char* emit = nullptr;
+    const char* buildPath = nullptr;
+    bool badArgument = false;
+    std::vector<std::string> sourcePaths;
+    // A positive count after a flag's '=', for the execution and depth limits
+    auto parseLimit = [](const char* text, unsigned long long& value) {
+        char* end;
+        value = std::strtoull(text, &end, 10);
+        return *text >= '0' && *text <= '9' && *end == '\0' && value > 0;
+    };
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 9, "--engine=") == 0) {
+            options.engine = arg.substr(9);
+        } else if (arg == "--block-scope") {
+            options.blockScope = true;
+        } else if (arg == "--no-optimize") {
+            options.optimize = false;
+        } else if (arg == "--verbose-opt") {
+            verboseOpt = true;
+        } else if (arg == "--dump-ast") {
+            dumpAst = true;
+        } else if (arg == "--ast-stats") {
+            astStats = true;
+        } else if (arg == "--warn-undefined") {
+            warnUndefined = true;
+        } else if (arg == "--no-jit") {
+            options.jit = false;
+        } else if (arg == "--no-closed-form") {
+            options.closedForms = false;
+        } else if (arg.compare(0, 14, "--lex-threads=") == 0) {
+            char* end;
+            long value = std::strtol(argv[i] + 14, &end, 10);
+            if (*end != '\0' || value < 1) {
+                badArgument = true;
+                break;
+            }
+            options.lexThreads = static_cast<size_t>(value);
+        } else if (arg.compare(0, 17, "--max-iterations=") == 0) {
+            unsigned long long value;
+            if (!parseLimit(argv[i] + 17, value)) {
+                badArgument = true;
+                break;
+            }
+            options.limits.maxIterations = value;
+        } else if (arg.compare(0, 11, "--max-time=") == 0) {
+            unsigned long long value;
+            if (!parseLimit(argv[i] + 11, value)) {
+                badArgument = true;
+                break;
+            }
+            options.limits.maxMilliseconds = value;
+        } else if (arg.compare(0, 13, "--max-output=") == 0) {
+            unsigned long long value;
+            if (!parseLimit(argv[i] + 13, value)) {
+                badArgument = true;
+                break;
+            }
+            options.limits.maxOutputBytes = value;
+        } else if (arg.compare(0, 16, "--max-variables=") == 0) {
+            unsigned long long value;
+            if (!parseLimit(argv[i] + 16, value) || value > 1000000000) {
+                badArgument = true;
+                break;
+            }
+            options.limits.maxVariables = static_cast<int>(value);
+        } else if (arg.compare(0, 21, "--max-array-elements=") == 0) {
+            unsigned long long value;
+            if (!parseLimit(argv[i] + 21, value)) {
+                badArgument = true;
+                break;
+            }
+            options.limits.maxArrayElements = value;
+        } else if (arg.compare(0, 12, "--max-depth=") == 0) {
+            unsigned long long value;
+            if (!parseLimit(argv[i] + 12, value) || value > 1000000000) {
+                badArgument = true;
+                break;
+            }
+            options.maxDepth = static_cast<int>(value);
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg.compare(0, 15, "--profile-json=") == 0) {
+            profile = true;
+            profileJson = argv[i] + 15;
+        } else if (arg.compare(0, 20, "--profile-collapsed=") == 0) {
+            profile = true;
+            profileCollapsed = argv[i] + 20;
+        } else if (arg == "--unbuffered") {
+            unbuffered = true;
+        } else if (arg.compare(0, 9, "--output=") == 0) {
+            outputPath = argv[i] + 9;
+        } else if (arg.compare(0, 7, "--emit=") == 0) {
+            emit = argv[i] + 7;
+        } else if (arg.compare(0, 8, "--build=") == 0) {
+            buildPath = argv[i] + 8;
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if (arg.compare(0, 11, "--manifest=") == 0) {
+            batch = true;
+            manifestPath = argv[i] + 11;
+        } else if (arg.compare(0, 7, "--jobs=") == 0) {
+            char* end;
+            long value = std::strtol(argv[i] + 7, &end, 10);
+            if (*end != '\0' || value < 1) {
+                badArgument = true;
+                break;
+            }
+            jobs = static_cast<size_t>(value);
+        } else if (arg == "--cache") {
+            useCache = true;
+        } else if (arg.compare(0, 12, "--cache-dir=") == 0) {
+            useCache = true;
+            cacheDir = arg.substr(12);
+        } else if (arg == "--cache-stats") {
+            cacheStats = true;
+        } else if (arg == "--cache-prune") {
+            pruneDays = 30;
+        } else if (arg.compare(0, 14, "--cache-prune=") == 0) {
+            char* end;
+            long value = std::strtol(argv[i] + 14, &end, 10);
+            if (*end != '\0' || value < 0) {
+                badArgument = true;
+                break;
+            }
+            pruneDays = static_cast<int>(value);
+        } else if (arg.compare(0, 2, "--") != 0) {
+            sourcePaths.push_back(arg);
+        } else {
+            badArgument = true;
+            break;
+        }
+    }
+    const std::string& engine = options.engine;
+    bool cacheTool = cacheStats || pruneDays >= 0;
+    bool runsScripts = batch || !sourcePaths.empty();
+    if (badArgument || (batch ? sourcePaths.empty() && !manifestPath : sourcePaths.size() > 1 || (!cacheTool && sourcePaths.empty())) ||
+        (engine != "tree" && engine != "vm" && engine != "closure" && engine != "flat") ||
+        (emit && std::string(emit) != "asm" && std::string(emit) != "c") || (buildPath && !*buildPath)) {
+        std::cerr << "Usage: ./mini_compiler [--engine=tree|vm|closure|flat] [--block-scope] [--no-optimize] [--verbose-opt] [--dump-ast]"
+                     " [--warn-undefined] [--ast-stats] [--no-jit] [--no-closed-form] [--lex-threads=N] [--profile] [--profile-json=<file>]"
+                     " [--profile-collapsed=<file>] [--unbuffered] [--output=<file>] [--cache] [--cache-dir=<dir>]"
+                     " [--max-iterations=N] [--max-time=<ms>] [--max-output=<bytes>] [--max-variables=N]"
+                     " [--max-array-elements=N] [--max-depth=N]"
+                     " <source_file>\n"
+                     "       ./mini_compiler --batch [--manifest=<file>] [--jobs=N] [engine options] [--output=<file>]"
+                     " <source_file>...\n"
+                     "       ./mini_compiler [--cache-dir=<dir>] [--cache-stats] [--cache-prune[=<days>]]\n"
+                     "       ./mini_compiler --watch [engine options] [--verbose-opt] <source_file>\n"
+                     "       ./mini_compiler --emit=asm|c [--build=<file>] [--block-scope] [--no-optimize] [--output=<file>]"
+                     " <source_file>" << std::endl;
+        return 1;
+    }
+    if (profile && engine != "tree") {
+        std::cerr << "--profile is only supported by the tree engine" << std::endl;
+        return 1;
+    }
+    if (astStats && engine != "flat") {
+        std::cerr << "--ast-stats is only supported by the flat engine" << std::endl;
+        return 1;
+    }
+    if (options.limits.any() && engine != "tree") {
+        std::cerr << "Execution limits (--max-*) are only supported by the tree engine" << std::endl;
+        return 1;
+    }
+    if (engine == "flat" && (options.blockScope || dumpAst || verboseOpt)) {
+        std::cerr << (options.blockScope ? "--block-scope" : dumpAst ? "--dump-ast" : "--verbose-opt")
+                  << " is not supported by the flat engine" << std::endl;
+        return 1;
+    }
+    // Diagnostics go to stderr unordered, so they would interleave across concurrent scripts
+    if (batch && (profile || dumpAst || verboseOpt || astStats || warnUndefined)) {
+        std::cerr << (profile ? "--profile" : dumpAst ? "--dump-ast" : verboseOpt ? "--verbose-opt" : astStats ? "--ast-stats" :
+                      "--warn-undefined")
+                  << " is not supported in batch mode" << std::endl;
         return 1;
     }
 
-    // Read code from the file
-    std::ifstream file(argv[1]);
-    if (!file) {
-        std::cerr << "Could not open file: " << argv[1] << std::endl;
+    // Watch mode keeps its own parsed statements and re-runs on every save
+    if (watch && (batch || profile || dumpAst || astStats || useCache || sourcePaths.empty())) {
+        std::cerr << (batch ? "--batch" : profile ? "--profile" : dumpAst ? "--dump-ast" : astStats ? "--ast-stats" :
+                      useCache ? "--cache" : "a source file")
+                  << (sourcePaths.empty() ? " is required by --watch" : " is not supported with --watch") << std::endl;
         return 1;
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string code = buffer.str();
-    file.close();
 
-    try {
-        // Lexical Analysis
-        Lexer lexer(code);
-        Queue<Token> tokens = lexer.generateTokens();
+    // Ahead-of-time compilation reads one file and runs nothing; --build alone means --emit=asm
+    bool compiles = emit || buildPath;
+    if (compiles && (batch || watch || profile || dumpAst || astStats || useCache || cacheTool || options.limits.any() ||
+                     engine != "tree")) {
+        std::string unsupported = batch ? "--batch is" : watch ? "--watch is" : profile ? "--profile is" :
+                                  dumpAst ? "--dump-ast is" : astStats ? "--ast-stats is" :
+                                  useCache || cacheTool ? "The cache is" :
+                                  options.limits.any() ? "Execution limits (--max-*) are" : "--engine=" + engine + " is";
+        std::cerr << unsupported << " not supported with " << (emit ? "--emit" : "--build") << std::endl;
+        return 1;
+    }
+    if (compiles) {
+        SourceFile source;
+        if (!source.open(sourcePaths[0].c_str())) {
+            std::cerr << "Could not open file: " << sourcePaths[0] << std::endl;
+            return 1;
+        }
+        if (warnUndefined)
+            options.warnUndefined = &std::cerr;
+        if (verboseOpt)
+            options.optReport = &std::cerr;
+        EmitTarget target = emit && std::string(emit) == "c" ? EMIT_C : EMIT_ASM;
+        try {
+            std::string code = emitNative(source.data(), source.size(), options, target);
+            if (buildPath) {
+                buildNative(code, target, buildPath);
+            } else if (outputPath) {
+                std::ofstream file(outputPath, std::ios::binary);
+                file << code;
+                if (!file) {
+                    std::cerr << "Could not write output file: " << outputPath << std::endl;
+                    return 1;
+                }
+            } else {
+                std::cout << code;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // Parsed programs are cached on disk; the maintenance flags work without a script
+    ProgramCache cache(cacheDir.empty() ? ProgramCache::defaultDirectory() : cacheDir);
+    if (useCache)
+        options.cache = &cache;
+    std::ostream& cacheReport = runsScripts ? std::cerr : std::cout;
+    if (pruneDays >= 0)
+        cache.prune(pruneDays, cacheReport);
+    if (cacheStats)
+        cache.writeStats(cacheReport);
+    if (!runsScripts)
+        return 0;
+
+    // Program output goes through a buffered sink; --unbuffered flushes every line
+    int outputFd = STDOUT_FILENO;
+    if (outputPath) {
+        outputFd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (outputFd < 0) {
+            std::cerr << "Could not open output file: " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    OutputSink out(outputFd, unbuffered ? OutputSink::LINE_BUFFERED : OutputSink::FULLY_BUFFERED);
 
-        // Parsing
-        Parser parser(tokens);
-        ASTNode* root = parser.parse();
+    if (warnUndefined)
+        options.warnUndefined = &std::cerr;
 
-        // Interpretation
-        Interpreter interpreter(root);
-        interpreter.interpret();
+    if (watch) {
+        if (verboseOpt)
+            options.optReport = &std::cerr;
+        return watchFile(sourcePaths[0].c_str(), options, out, std::cerr);
+    }
 
-        // Clean up
-        delete root;
+    if (batch) {
+        // Many scripts on a thread pool; results are written in command-line order
+        if (manifestPath && !BatchRunner::readManifest(manifestPath, sourcePaths)) {
+            std::cerr << "Could not open manifest: " << manifestPath << std::endl;
+            return 1;
+        }
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        BatchRunner runner(options);
+        size_t failures = runner.run(sourcePaths, jobs, out, std::cerr);
+        out.flush();
+        cache.saveStats();
+        long long ms = static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count());
+        std::cerr << "Batch: " << sourcePaths.size() << " scripts, " << failures << " failed, " << ms << " ms" << std::endl;
+        return failures > 0 ? 1 : 0;
+    }
 
+    // Map the source file; tokens point straight into it
+    SourceFile source;
+    if (!source.open(sourcePaths[0].c_str())) {
+        std::cerr << "Could not open file: " << sourcePaths[0] << std::endl;
+        return 1;
+    }
+
+    // Per-line profile, reported on exit whether or not the program failed
+    Profiler profiler;
+    if (profile)
+        options.profiler = &profiler;
+    if (dumpAst)
+        options.dumpAst = &std::cerr;
+    if (verboseOpt)
+        options.optReport = &std::cerr;
+    if (astStats)
+        options.astStats = &std::cerr;
+    int status = 0;
+
+    try {
+        runPipeline(source.data(), source.size(), options, out);
     } catch (const std::exception& e) {
+        // Emit everything printed so far before the error message
+        out.flush();
         // Print the error message to stderr
         std::cerr << "Error: " << e.what() << std::endl;
         // Optionally, you can return a non-zero exit code to indicate an error
-        return 1;
+        status = 1;
+    }
+    cache.saveStats();
+
+    if (profiler.wasStarted()) {
+        profiler.stop();
+        out.flush();
+        profiler.writeReport(std::cerr);
+        if (profileJson) {
+            std::ofstream file(profileJson);
+            profiler.writeJson(file);
+            if (!file)
+                std::cerr << "Could not write profile: " << profileJson << std::endl;
+        }
+        if (profileCollapsed) {
+            std::ofstream file(profileCollapsed);
+            profiler.writeCollapsed(file);
+            if (!file)
+                std::cerr << "Could not write profile: " << profileCollapsed << std::endl;
+        }
     }
-    return 0;
+    return status;
 }